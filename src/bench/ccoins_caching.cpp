@@ -4,6 +4,7 @@
 
 #include "bench.h"
 #include "coins.h"
+#include "crypto/common.h"
 #include "policy/policy.h"
 #include "wallet/crypter.h"
 
@@ -84,4 +85,94 @@ static void CCoinsCaching(benchmark::State& state)
     }
 }
 
+// Number of coins in the cache for the AccessCoin/SpendCoin benchmarks, and
+// the number of operations per iteration.
+static const size_t NUM_CACHED_COINS = 200000;
+static const size_t NUM_OPS_PER_ITERATION = 1000;
+
+// Add n distinct P2PKH coins to the cache, returning their outpoints.
+static std::vector<COutPoint> AddDummyCoins(CCoinsViewCache& coins, size_t n)
+{
+    std::vector<COutPoint> outpoints;
+    outpoints.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        uint256 txid;
+        WriteLE64(txid.begin(), i);
+        CTxOut out(1 * CENT, CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, i & 0xff) << OP_EQUALVERIFY << OP_CHECKSIG);
+        outpoints.emplace_back(txid, i % 4);
+        coins.AddCoin(outpoints.back(), Coin(std::move(out), 1, false), false);
+    }
+    return outpoints;
+}
+
+// Lookups of coins that are present in a large cache.
+static void CCoinsCacheAccessCoin(benchmark::State& state)
+{
+    CCoinsView coinsDummy;
+    CCoinsViewCache coins(&coinsDummy);
+    const std::vector<COutPoint> outpoints = AddDummyCoins(coins, NUM_CACHED_COINS);
+
+    size_t pos = 0;
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < NUM_OPS_PER_ITERATION; ++i) {
+            const Coin& coin = coins.AccessCoin(outpoints[pos]);
+            assert(!coin.IsSpent());
+            pos = (pos + 7919) % outpoints.size();
+        }
+    }
+}
+
+// Spending coins from a large cache through a child cache, as ConnectBlock
+// does. Each spend pulls the coin into the child cache, allocating a node.
+static void CCoinsCacheSpendCoin(benchmark::State& state)
+{
+    CCoinsView coinsDummy;
+    CCoinsViewCache base(&coinsDummy);
+    const std::vector<COutPoint> outpoints = AddDummyCoins(base, NUM_CACHED_COINS);
+
+    size_t pos = 0;
+    while (state.KeepRunning()) {
+        CCoinsViewCache view(&base);
+        for (size_t i = 0; i < NUM_OPS_PER_ITERATION; ++i) {
+            bool spent = view.SpendCoin(outpoints[pos]);
+            assert(spent);
+            pos = (pos + 7919) % outpoints.size();
+        }
+    }
+}
+
+// Filling an empty cache with coins whose scripts follow the mix of the UTXO
+// set: mostly P2PKH, then P2SH, P2WPKH and scripts the cache keeps on the
+// heap. Also checks how many bytes of -dbcache each coin takes.
+static void CCoinsCacheFill(benchmark::State& state)
+{
+    std::vector<CScript> scripts;
+    for (int i = 0; i < 10; ++i) {
+        std::vector<unsigned char> hash(20, i);
+        if (i < 6) {
+            scripts.push_back(CScript() << OP_DUP << OP_HASH160 << hash << OP_EQUALVERIFY << OP_CHECKSIG);
+        } else if (i < 8) {
+            scripts.push_back(CScript() << OP_HASH160 << hash << OP_EQUAL);
+        } else if (i < 9) {
+            scripts.push_back(CScript() << OP_0 << hash);
+        } else {
+            scripts.push_back(CScript() << std::vector<unsigned char>(33, i) << OP_CHECKSIG);
+        }
+    }
+
+    while (state.KeepRunning()) {
+        CCoinsView coinsDummy;
+        CCoinsViewCache coins(&coinsDummy);
+        for (size_t i = 0; i < NUM_CACHED_COINS; ++i) {
+            uint256 txid;
+            WriteLE64(txid.begin(), i);
+            coins.AddCoin(COutPoint(txid, i % 4), Coin(CTxOut(1 * CENT, scripts[i % scripts.size()]), 1, false), false);
+        }
+        assert(coins.DynamicMemoryUsage() / NUM_CACHED_COINS < 112);
+    }
+}
+
 BENCHMARK(CCoinsCaching);
+BENCHMARK(CCoinsCacheAccessCoin);
+BENCHMARK(CCoinsCacheSpendCoin);
+BENCHMARK(CCoinsCacheFill);
@@ -8,6 +8,9 @@
 #include "validation.h"
 #include "streams.h"
 #include "consensus/validation.h"
+#include "util.h"
+
+#include <boost/thread/thread.hpp>
 
 namespace block_bench {
 #include "bench/data/block413567.raw.h"
@@ -52,5 +55,45 @@ static void DeserializeAndCheckBlockTest(benchmark::State& state)
     }
 }
 
+// The same with the transactions checked on a number of threads, as done with
+// -par.
+static void DeserializeAndCheckBlockTestThreads(benchmark::State& state, int nThreads)
+{
+    CDataStream stream((const char*)block_bench::block413567,
+            (const char*)&block_bench::block413567[sizeof(block_bench::block413567)],
+            SER_NETWORK, PROTOCOL_VERSION);
+    char a = '\0';
+    stream.write(&a, 1); // Prevent compaction
+
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+
+    // The calling thread takes part in the checks.
+    nScriptCheckThreads = nThreads;
+    boost::thread_group tg;
+    for (int i = 0; i < nThreads - 1; i++) {
+        tg.create_thread(&ThreadBlockCheck);
+    }
+
+    while (state.KeepRunning()) {
+        CBlock block;
+        stream >> block;
+        assert(stream.Rewind(sizeof(block_bench::block413567)));
+
+        CValidationState validationState;
+        assert(CheckBlock(block, validationState, chainParams->GetConsensus()));
+    }
+
+    tg.interrupt_all();
+    tg.join_all();
+    nScriptCheckThreads = 0;
+}
+
+static void DeserializeAndCheckBlockTest2Threads(benchmark::State& state) { DeserializeAndCheckBlockTestThreads(state, 2); }
+static void DeserializeAndCheckBlockTest4Threads(benchmark::State& state) { DeserializeAndCheckBlockTestThreads(state, 4); }
+static void DeserializeAndCheckBlockTest8Threads(benchmark::State& state) { DeserializeAndCheckBlockTestThreads(state, 8); }
+
 BENCHMARK(DeserializeBlockTest);
 BENCHMARK(DeserializeAndCheckBlockTest);
+BENCHMARK(DeserializeAndCheckBlockTest2Threads);
+BENCHMARK(DeserializeAndCheckBlockTest4Threads);
+BENCHMARK(DeserializeAndCheckBlockTest8Threads);
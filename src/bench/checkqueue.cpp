@@ -7,6 +7,7 @@
 #include "validation.h"
 #include "checkqueue.h"
 #include "prevector.h"
+#include "crypto/sha256.h"
 #include <vector>
 #include <boost/thread/thread.hpp>
 #include "random.h"
@@ -99,5 +100,67 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
     tg.interrupt_all();
     tg.join_all();
 }
+
+// This Benchmark tests how the CheckQueue scales with the number of threads,
+// with checks that each hash a few hundred bytes, and a block's worth of
+// them added in batches of varying size.
+static void CCheckQueueScaling(benchmark::State& state, int nThreads)
+{
+    struct HashJob {
+        unsigned char data[256];
+        HashJob() {}
+        explicit HashJob(FastRandomContext& insecure_rand)
+        {
+            for (unsigned char& c : data)
+                c = insecure_rand.randbits(8);
+        }
+        bool operator()()
+        {
+            unsigned char hash[CSHA256::OUTPUT_SIZE];
+            CSHA256().Write(data, sizeof(data)).Finalize(hash);
+            return hash[0] != 0 || hash[1] != 0 || hash[2] != 0 || hash[3] != 0;
+        }
+        void swap(HashJob& x) { std::swap(data, x.data); }
+    };
+    CCheckQueue<HashJob> queue {QUEUE_BATCH_SIZE};
+    boost::thread_group tg;
+    // The master thread takes part in the checks.
+    for (auto x = 0; x < nThreads - 1; ++x) {
+       tg.create_thread([&]{queue.Thread();});
+    }
+    FastRandomContext insecure_rand(true);
+    std::vector<std::vector<HashJob>> vBatches(BATCHES);
+    for (auto& vChecks : vBatches) {
+        vChecks.reserve(BATCH_SIZE * 2);
+        for (size_t x = 0, nSize = 1 + insecure_rand.randrange(BATCH_SIZE * 2); x < nSize; ++x)
+            vChecks.emplace_back(insecure_rand);
+    }
+    while (state.KeepRunning()) {
+        CCheckQueueControl<HashJob> control(&queue);
+        std::vector<std::vector<HashJob>> vAdd(vBatches);
+        for (auto& vChecks : vAdd) {
+            control.Add(vChecks);
+        }
+        control.Wait();
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+static void CCheckQueueScaling1Thread(benchmark::State& state) { CCheckQueueScaling(state, 1); }
+static void CCheckQueueScaling2Threads(benchmark::State& state) { CCheckQueueScaling(state, 2); }
+static void CCheckQueueScaling4Threads(benchmark::State& state) { CCheckQueueScaling(state, 4); }
+static void CCheckQueueScaling8Threads(benchmark::State& state) { CCheckQueueScaling(state, 8); }
+static void CCheckQueueScaling16Threads(benchmark::State& state) { CCheckQueueScaling(state, 16); }
+static void CCheckQueueScaling32Threads(benchmark::State& state) { CCheckQueueScaling(state, 32); }
+static void CCheckQueueScaling64Threads(benchmark::State& state) { CCheckQueueScaling(state, 64); }
+
 BENCHMARK(CCheckQueueSpeed);
 BENCHMARK(CCheckQueueSpeedPrevectorJob);
+BENCHMARK(CCheckQueueScaling1Thread);
+BENCHMARK(CCheckQueueScaling2Threads);
+BENCHMARK(CCheckQueueScaling4Threads);
+BENCHMARK(CCheckQueueScaling8Threads);
+BENCHMARK(CCheckQueueScaling16Threads);
+BENCHMARK(CCheckQueueScaling32Threads);
+BENCHMARK(CCheckQueueScaling64Threads);
@@ -10,6 +10,7 @@
 #include "random.h"
 #include "uint256.h"
 #include "utiltime.h"
+#include "crypto/adhash.h"
 #include "crypto/ripemd160.h"
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
@@ -70,6 +71,18 @@ static void SipHash_32b(benchmark::State& state)
     }
 }
 
+static void AdHash4096_Insert(benchmark::State& state)
+{
+    AdHash4096 hash;
+    unsigned char in[64] = {0};
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 1000; i++) {
+            in[0] = i;
+            hash.Insert(in, sizeof(in));
+        }
+    }
+}
+
 static void FastRandom_32bit(benchmark::State& state)
 {
     FastRandomContext rng(true);
@@ -99,5 +112,6 @@ BENCHMARK(SHA512);
 
 BENCHMARK(SHA256_32b);
 BENCHMARK(SipHash_32b);
+BENCHMARK(AdHash4096_Insert);
 BENCHMARK(FastRandom_32bit);
 BENCHMARK(FastRandom_1bit);
@@ -0,0 +1,62 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "consensus/merkle.h"
+#include "hash.h"
+#include "streams.h"
+#include "uint256.h"
+#include "version.h"
+
+namespace block_bench {
+#include "bench/data/block413567.raw.h"
+} // namespace block_bench
+
+static std::vector<uint256> GetBlockLeaves()
+{
+    CDataStream stream((const char*)block_bench::block413567,
+            (const char*)&block_bench::block413567[sizeof(block_bench::block413567)],
+            SER_NETWORK, PROTOCOL_VERSION);
+    CBlock block;
+    stream >> block;
+
+    std::vector<uint256> leaves(block.vtx.size());
+    for (size_t s = 0; s < block.vtx.size(); s++) {
+        leaves[s] = block.vtx[s]->GetHash();
+    }
+    return leaves;
+}
+
+// Merkle root of block 413567's transactions, using SHA256D64 on each level.
+static void MerkleRoot(benchmark::State& state)
+{
+    const std::vector<uint256> leaves = GetBlockLeaves();
+    while (state.KeepRunning()) {
+        bool mutated = false;
+        uint256 root = ComputeMerkleRoot(leaves, &mutated);
+        assert(!mutated && !root.IsNull());
+    }
+}
+
+// The same computation, hashing one pair of nodes at a time through CHash256,
+// for comparison.
+static void MerkleRootPairwise(benchmark::State& state)
+{
+    const std::vector<uint256> leaves = GetBlockLeaves();
+    while (state.KeepRunning()) {
+        std::vector<uint256> level = leaves;
+        while (level.size() > 1) {
+            if (level.size() & 1) level.push_back(level.back());
+            for (size_t pos = 0; pos < level.size(); pos += 2) {
+                CHash256().Write(level[pos].begin(), 32).Write(level[pos + 1].begin(), 32).Finalize(level[pos / 2].begin());
+            }
+            level.resize(level.size() / 2);
+        }
+        assert(!level[0].IsNull());
+    }
+}
+
+BENCHMARK(MerkleRoot);
+BENCHMARK(MerkleRootPairwise);
@@ -0,0 +1,96 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "blockimport.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "consensus/consensus.h"
+#include "consensus/validation.h"
+#include "fs.h"
+#include "primitives/block.h"
+#include "streams.h"
+#include "validation.h"
+
+namespace block_bench {
+#include "bench/data/block413567.raw.h"
+} // namespace block_bench
+
+static const int REINDEX_BLOCKS = 20;
+
+// Write a block file holding the test block a number of times, framed like
+// the blocks in blk?????.dat.
+static fs::path WriteBlockFile(const CChainParams& chainParams)
+{
+    fs::path path = fs::temp_directory_path() / fs::unique_path();
+    CAutoFile file(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+    assert(!file.IsNull());
+    for (int i = 0; i < REINDEX_BLOCKS; i++) {
+        file << FLATDATA(chainParams.MessageStart()) << (unsigned int)sizeof(block_bench::block413567);
+        file.write((const char*)block_bench::block413567, sizeof(block_bench::block413567));
+    }
+    return path;
+}
+
+// The part of -reindex that runs before blocks are accepted: locating,
+// deserializing and checking each block in a block file, on a single thread.
+static void ReindexBlockFileSerial(benchmark::State& state)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    const fs::path path = WriteBlockFile(*chainParams);
+
+    while (state.KeepRunning()) {
+        CBufferedFile blkdat(fsbridge::fopen(path, "rb"), 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
+        int nBlocks = 0;
+        while (true) {
+            unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
+            unsigned int nSize;
+            try {
+                blkdat.FindByte(chainParams->MessageStart()[0]);
+                blkdat >> FLATDATA(buf) >> nSize;
+            } catch (const std::exception&) {
+                break;
+            }
+            CBlock block;
+            blkdat >> block;
+            CValidationState validationState;
+            assert(CheckBlock(block, validationState, chainParams->GetConsensus()));
+            nBlocks++;
+        }
+        assert(nBlocks == REINDEX_BLOCKS);
+    }
+    fs::remove(path);
+}
+
+// The same through CBlockFileImporter, with a number of worker threads.
+static void ReindexBlockFile(benchmark::State& state, int nWorkers)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    const fs::path path = WriteBlockFile(*chainParams);
+
+    while (state.KeepRunning()) {
+        CBlockFileImporter importer(fsbridge::fopen(path, "rb"), *chainParams, nWorkers);
+        std::shared_ptr<CBlock> pblock;
+        uint64_t nPos;
+        int nBlocks = 0;
+        while (importer.Next(pblock, nPos)) {
+            assert(pblock->fChecked);
+            nBlocks++;
+        }
+        assert(nBlocks == REINDEX_BLOCKS);
+    }
+    fs::remove(path);
+}
+
+static void ReindexBlockFile1Worker(benchmark::State& state) { ReindexBlockFile(state, 1); }
+static void ReindexBlockFile2Workers(benchmark::State& state) { ReindexBlockFile(state, 2); }
+static void ReindexBlockFile4Workers(benchmark::State& state) { ReindexBlockFile(state, 4); }
+static void ReindexBlockFile8Workers(benchmark::State& state) { ReindexBlockFile(state, 8); }
+
+BENCHMARK(ReindexBlockFileSerial);
+BENCHMARK(ReindexBlockFile1Worker);
+BENCHMARK(ReindexBlockFile2Workers);
+BENCHMARK(ReindexBlockFile4Workers);
+BENCHMARK(ReindexBlockFile8Workers);
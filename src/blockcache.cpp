@@ -0,0 +1,133 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcache.h"
+
+#include "core_memusage.h"
+#include "memusage.h"
+#include "primitives/block.h"
+
+#include <string.h>
+#include <vector>
+
+CBlockCache::CBlockCache(size_t nMaxUsageIn) : nMaxUsage(nMaxUsageIn), nUsage(0)
+{
+    memset(nHits, 0, sizeof(nHits));
+    memset(nMisses, 0, sizeof(nMisses));
+}
+
+CBlockCache::Entry* CBlockCache::Lookup(const uint256& hash)
+{
+    auto it = index.find(hash);
+    if (it == index.end()) return nullptr;
+    if (it->second != entries.begin()) {
+        entries.splice(entries.begin(), entries, it->second);
+    }
+    return &*it->second;
+}
+
+CBlockCache::Entry& CBlockCache::Insert(const uint256& hash)
+{
+    Entry* entry = Lookup(hash);
+    if (entry) return *entry;
+    entries.emplace_front();
+    entries.front().hash = hash;
+    // The list node and the index node.
+    entries.front().nUsage = memusage::MallocUsage(sizeof(Entry) + 2 * sizeof(void*)) +
+        memusage::MallocUsage(sizeof(std::pair<const uint256, std::list<Entry>::iterator>) + sizeof(void*));
+    nUsage += entries.front().nUsage;
+    index.emplace(hash, entries.begin());
+    return entries.front();
+}
+
+void CBlockCache::Shrink()
+{
+    while (nUsage > nMaxUsage && !entries.empty()) {
+        nUsage -= entries.back().nUsage;
+        index.erase(entries.back().hash);
+        entries.pop_back();
+    }
+}
+
+std::shared_ptr<const CBlock> CBlockCache::GetBlock(const uint256& hash, bool fCount)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    Entry* entry = Lookup(hash);
+    if (entry && entry->block) {
+        if (fCount) ++nHits[BLOCK];
+        return entry->block;
+    }
+    if (fCount) ++nMisses[BLOCK];
+    return nullptr;
+}
+
+bool CBlockCache::GetRawBlock(const uint256& hash, bool fWitness, CRawBlock& out, bool fCount)
+{
+    const Form form = fWitness ? WITNESS : NO_WITNESS;
+    std::lock_guard<std::mutex> lock(cs);
+    Entry* entry = Lookup(hash);
+    if (entry && !entry->raw[fWitness].empty()) {
+        if (fCount) ++nHits[form];
+        out = entry->raw[fWitness];
+        return true;
+    }
+    if (fCount) ++nMisses[form];
+    return false;
+}
+
+void CBlockCache::AddBlock(const uint256& hash, std::shared_ptr<const CBlock> block)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    if (nMaxUsage == 0) return;
+    Entry& entry = Insert(hash);
+    if (entry.block) return;
+    const size_t nBlockUsage = RecursiveDynamicUsage(block);
+    entry.block = std::move(block);
+    entry.nUsage += nBlockUsage;
+    nUsage += nBlockUsage;
+    Shrink();
+}
+
+void CBlockCache::AddRawBlock(const uint256& hash, bool fWitness, const CRawBlock& raw)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    if (nMaxUsage == 0) return;
+    Entry& entry = Insert(hash);
+    if (!entry.raw[fWitness].empty()) return;
+    // The bytes may be in a mapping of a whole block file, which a reference
+    // would keep alive (and its disk space allocated, if the file is pruned).
+    auto buffer = std::make_shared<std::vector<unsigned char>>(raw.begin(), raw.end());
+    const size_t nRawUsage = memusage::DynamicUsage(buffer) + memusage::DynamicUsage(*buffer);
+    entry.raw[fWitness] = CRawBlock(buffer, buffer->data(), buffer->size());
+    entry.nUsage += nRawUsage;
+    nUsage += nRawUsage;
+    Shrink();
+}
+
+void CBlockCache::SetMaxUsage(size_t nMaxUsageIn)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    nMaxUsage = nMaxUsageIn;
+    Shrink();
+}
+
+void CBlockCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(cs);
+    index.clear();
+    entries.clear();
+    nUsage = 0;
+}
+
+CBlockCache::Stats CBlockCache::GetStats()
+{
+    std::lock_guard<std::mutex> lock(cs);
+    Stats stats;
+    stats.nEntries = entries.size();
+    stats.nUsage = nUsage;
+    stats.nMaxUsage = nMaxUsage;
+    memcpy(stats.nHits, nHits, sizeof(nHits));
+    memcpy(stats.nMisses, nMisses, sizeof(nMisses));
+    return stats;
+}
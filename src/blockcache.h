@@ -0,0 +1,102 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKCACHE_H
+#define BITCOIN_BLOCKCACHE_H
+
+#include "blockreader.h"
+#include "uint256.h"
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <unordered_map>
+
+class CBlock;
+
+/**
+ * A bounded cache of recently served blocks, keyed by block hash.
+ *
+ * Each entry can hold the deserialized block as well as its serialization
+ * with and without witness data, so that a block requested in the same form
+ * again needs neither a disk read nor serialization. The forms are added
+ * independently as readers come across them. Serialized forms are copied into
+ * buffers owned by the cache, rather than referencing the block file mappings
+ * they are read from, so an entry neither keeps a whole file mapped nor
+ * depends on the file still existing after it is pruned. The memory usage of
+ * all forms is accounted, and least recently used entries are evicted to stay
+ * within the limit.
+ */
+class CBlockCache
+{
+public:
+    enum Form {
+        BLOCK,      //!< Deserialized CBlock
+        WITNESS,    //!< Serialized with witness data
+        NO_WITNESS, //!< Serialized without witness data
+        FORM_COUNT
+    };
+
+    struct Stats
+    {
+        size_t nEntries;
+        size_t nUsage;
+        size_t nMaxUsage;
+        uint64_t nHits[FORM_COUNT];
+        uint64_t nMisses[FORM_COUNT];
+    };
+
+private:
+    struct Entry
+    {
+        uint256 hash;
+        std::shared_ptr<const CBlock> block;
+        CRawBlock raw[2];
+        size_t nUsage;
+    };
+
+    struct CheapHasher
+    {
+        size_t operator()(const uint256& hash) const { return hash.GetCheapHash(); }
+    };
+
+    std::mutex cs;
+    size_t nMaxUsage;
+    size_t nUsage;
+    //! Most recently used first.
+    std::list<Entry> entries;
+    std::unordered_map<uint256, std::list<Entry>::iterator, CheapHasher> index;
+    uint64_t nHits[FORM_COUNT];
+    uint64_t nMisses[FORM_COUNT];
+
+    /** Find an entry and mark it as most recently used. */
+    Entry* Lookup(const uint256& hash);
+    /** Find or create an entry, and mark it as most recently used. */
+    Entry& Insert(const uint256& hash);
+    void Shrink();
+
+public:
+    explicit CBlockCache(size_t nMaxUsageIn);
+
+    /**
+     * Look up the deserialized form of a block. Returns nullptr if it is not
+     * cached. Lookups of another form to build the requested one from pass
+     * fCount = false, so that each request counts once in the statistics.
+     */
+    std::shared_ptr<const CBlock> GetBlock(const uint256& hash, bool fCount = true);
+    /** Look up a serialized form of a block. */
+    bool GetRawBlock(const uint256& hash, bool fWitness, CRawBlock& out, bool fCount = true);
+
+    void AddBlock(const uint256& hash, std::shared_ptr<const CBlock> block);
+    /** Add a serialized form of a block. The cache keeps a copy of its bytes. */
+    void AddRawBlock(const uint256& hash, bool fWitness, const CRawBlock& raw);
+
+    /** Change the memory limit, evicting entries if needed. 0 disables the cache. */
+    void SetMaxUsage(size_t nMaxUsageIn);
+    void Clear();
+    Stats GetStats();
+};
+
+#endif // BITCOIN_BLOCKCACHE_H
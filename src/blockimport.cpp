@@ -0,0 +1,191 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockimport.h"
+
+#include "chainparams.h"
+#include "clientversion.h"
+#include "consensus/consensus.h"
+#include "consensus/validation.h"
+#include "primitives/block.h"
+#include "protocol.h"
+#include "util.h"
+#include "validation.h"
+
+#include <string.h>
+
+CBlockFileImporter::CBlockFileImporter(FILE* fileIn, const CChainParams& chainparamsIn, int nWorkers) :
+    chainparams(chainparamsIn),
+    blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION),
+    nBytesInFlight(0), nGeneration(0), fRestart(false), nRestartPos(0), fEndOfFile(false), fShutdown(false)
+{
+    threadReader = std::thread(&CBlockFileImporter::ThreadRead, this);
+    for (int i = 0; i < std::max(nWorkers, 1); i++) {
+        threadWorkers.emplace_back(&CBlockFileImporter::ThreadWork, this);
+    }
+}
+
+CBlockFileImporter::~CBlockFileImporter()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fShutdown = true;
+    }
+    cvReader.notify_all();
+    cvWorkers.notify_all();
+    threadReader.join();
+    for (std::thread& thread : threadWorkers) thread.join();
+}
+
+std::shared_ptr<CBlockFileImporter::Frame> CBlockFileImporter::ReadFrame(uint64_t& nRewind)
+{
+    while (!blkdat.eof() && !fShutdown) {
+        blkdat.SetPos(nRewind);
+        nRewind++; // start one byte further next time, in case of failure
+        blkdat.SetLimit(); // remove former limit
+        std::shared_ptr<Frame> frame = std::make_shared<Frame>();
+        unsigned int nSize = 0;
+        try {
+            // locate a header
+            unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
+            blkdat.FindByte(chainparams.MessageStart()[0]);
+            frame->nStartPos = blkdat.GetPos();
+            nRewind = blkdat.GetPos()+1;
+            blkdat >> FLATDATA(buf);
+            if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
+                continue;
+            // read size
+            blkdat >> nSize;
+            if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+                continue;
+        } catch (const std::exception&) {
+            // no valid block header found; don't complain
+            return nullptr;
+        }
+        try {
+            // read block
+            frame->nPos = blkdat.GetPos();
+            frame->nSize = nSize;
+            frame->data.resize(nSize);
+            blkdat.read((char*)frame->data.data(), nSize);
+            nRewind = blkdat.GetPos();
+            return frame;
+        } catch (const std::exception& e) {
+            LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+        }
+    }
+    return nullptr;
+}
+
+void CBlockFileImporter::ThreadRead()
+{
+    RenameThread("bitcoin-loadblk-read");
+    uint64_t nRewind = blkdat.GetPos();
+    uint64_t nReadGeneration = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            cvReader.wait(lock, [this] {
+                return fShutdown || fRestart || (!fEndOfFile && nBytesInFlight < MAX_IMPORT_BYTES_IN_FLIGHT && results.size() < MAX_IMPORT_BLOCKS_IN_FLIGHT);
+            });
+            if (fShutdown) return;
+            if (fRestart) {
+                fRestart = false;
+                fEndOfFile = false;
+                nReadGeneration = nGeneration;
+                nRewind = nRestartPos;
+                if (!blkdat.SetPos(nRewind) && !blkdat.Seek(nRewind)) {
+                    fEndOfFile = true;
+                    cvResults.notify_all();
+                    continue;
+                }
+            }
+        }
+
+        std::shared_ptr<Frame> frame = ReadFrame(nRewind);
+
+        std::lock_guard<std::mutex> lock(cs);
+        if (nReadGeneration != nGeneration) continue;
+        if (!frame) {
+            fEndOfFile = true;
+            cvResults.notify_all();
+            continue;
+        }
+        nBytesInFlight += frame->nSize;
+        results.push_back(frame);
+        work.push_back(frame);
+        cvWorkers.notify_one();
+    }
+}
+
+void CBlockFileImporter::ThreadWork()
+{
+    RenameThread("bitcoin-loadblk-check");
+    while (true) {
+        std::shared_ptr<Frame> frame;
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            cvWorkers.wait(lock, [this] { return fShutdown || !work.empty(); });
+            if (fShutdown) return;
+            frame = work.front();
+            work.pop_front();
+        }
+
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        bool fFailed = false;
+        try {
+            CMemoryReader reader(SER_DISK, CLIENT_VERSION, frame->data.data(), frame->data.data() + frame->data.size());
+            reader >> *pblock;
+        } catch (const std::exception& e) {
+            LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+            fFailed = true;
+        }
+        if (!fFailed) {
+            // Only the block remembering it passed matters here, a failure
+            // is reported when the block is accepted.
+            CValidationState state;
+            CheckBlock(*pblock, state, chainparams.GetConsensus());
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            std::vector<unsigned char>().swap(frame->data);
+            if (!fFailed) frame->block = std::move(pblock);
+            frame->fFailed = fFailed;
+            frame->fDone = true;
+        }
+        cvResults.notify_all();
+    }
+}
+
+bool CBlockFileImporter::Next(std::shared_ptr<CBlock>& block, uint64_t& nPos)
+{
+    std::unique_lock<std::mutex> lock(cs);
+    while (true) {
+        cvResults.wait(lock, [this] {
+            return results.empty() ? fEndOfFile && !fRestart : results.front()->fDone;
+        });
+        if (results.empty()) return false;
+
+        std::shared_ptr<Frame> frame = results.front();
+        results.pop_front();
+        nBytesInFlight -= frame->nSize;
+        cvReader.notify_one();
+        if (frame->fFailed) {
+            // Scan again from just after the network magic of this block, and
+            // drop the blocks found after it.
+            results.clear();
+            work.clear();
+            nBytesInFlight = 0;
+            fRestart = true;
+            nRestartPos = frame->nStartPos + 1;
+            nGeneration++;
+            fEndOfFile = false;
+            continue;
+        }
+        block = frame->block;
+        nPos = frame->nPos;
+        return true;
+    }
+}
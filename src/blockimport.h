@@ -0,0 +1,99 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKIMPORT_H
+#define BITCOIN_BLOCKIMPORT_H
+
+#include "streams.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+class CBlock;
+class CChainParams;
+
+/** Maximum number of bytes of blocks read ahead of the block being imported */
+static const size_t MAX_IMPORT_BYTES_IN_FLIGHT = 32 << 20;
+/** Maximum number of blocks read ahead of the block being imported */
+static const size_t MAX_IMPORT_BLOCKS_IN_FLIGHT = 1024;
+
+/**
+ * Reads the blocks from a file of blocks preceded by the network magic and
+ * their size, like blk?????.dat or a -loadblock file.
+ *
+ * One thread locates the blocks in the file and reads their bytes, and a
+ * number of worker threads deserialize them and run the context-free
+ * CheckBlock on them. The blocks are handed out in file order by Next. A
+ * block that passed CheckBlock remembers so, and AcceptBlock won't check it
+ * again. Blocks that fail CheckBlock are handed out all the same, for
+ * AcceptBlock to reject.
+ *
+ * The file is scanned like a single thread deserializing each block would:
+ * when a block cannot be deserialized, scanning resumes right after the
+ * network magic in front of it, and the blocks read ahead are dropped.
+ */
+class CBlockFileImporter
+{
+private:
+    struct Frame
+    {
+        uint64_t nStartPos; //!< Position of the network magic
+        uint64_t nPos;      //!< Position of the block
+        size_t nSize;
+        std::vector<unsigned char> data;
+        std::shared_ptr<CBlock> block;
+        bool fDone;
+        bool fFailed;
+
+        Frame() : nStartPos(0), nPos(0), nSize(0), fDone(false), fFailed(false) {}
+    };
+
+    const CChainParams& chainparams;
+    //! Only used by the reader thread.
+    CBufferedFile blkdat;
+
+    std::mutex cs;
+    std::condition_variable cvReader;
+    std::condition_variable cvWorkers;
+    std::condition_variable cvResults;
+    //! Frames in file order, waiting to be handed out.
+    std::deque<std::shared_ptr<Frame>> results;
+    //! Frames waiting for a worker.
+    std::deque<std::shared_ptr<Frame>> work;
+    size_t nBytesInFlight;
+    //! Incremented whenever scanning restarts, to drop frames read before.
+    uint64_t nGeneration;
+    bool fRestart;
+    uint64_t nRestartPos;
+    bool fEndOfFile;
+    std::atomic<bool> fShutdown;
+
+    std::thread threadReader;
+    std::vector<std::thread> threadWorkers;
+
+    /** Find and read the next block in the file. Returns nullptr at the end of the file. */
+    std::shared_ptr<Frame> ReadFrame(uint64_t& nRewind);
+    void ThreadRead();
+    void ThreadWork();
+
+public:
+    /** Takes over fileIn, which must be positioned at its start, and closes it when done. */
+    CBlockFileImporter(FILE* fileIn, const CChainParams& chainparams, int nWorkers);
+    ~CBlockFileImporter();
+
+    CBlockFileImporter(const CBlockFileImporter&) = delete;
+    CBlockFileImporter& operator=(const CBlockFileImporter&) = delete;
+
+    /** Wait for the next block in the file, and its position. Returns false at the end of the file. */
+    bool Next(std::shared_ptr<CBlock>& block, uint64_t& nPos);
+};
+
+#endif // BITCOIN_BLOCKIMPORT_H
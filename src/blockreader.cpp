@@ -0,0 +1,78 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockreader.h"
+
+#include <vector>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+struct CBlockFileMapper::Mapping
+{
+    const unsigned char* data;
+    size_t size;
+
+    Mapping(const unsigned char* dataIn, size_t sizeIn) : data(dataIn), size(sizeIn) {}
+    Mapping(const Mapping&) = delete;
+    Mapping& operator=(const Mapping&) = delete;
+    ~Mapping()
+    {
+#ifndef WIN32
+        munmap((void*)data, size);
+#endif
+    }
+};
+
+bool CBlockFileMapper::Read(const fs::path& path, uint64_t nPos, size_t nSize, CRawBlock& out)
+{
+#ifdef WIN32
+    FILE* file = fsbridge::fopen(path, "rb");
+    if (!file) return false;
+    auto buffer = std::make_shared<std::vector<unsigned char>>(nSize);
+    bool ret = fseek(file, nPos, SEEK_SET) == 0 && fread(buffer->data(), 1, nSize, file) == nSize;
+    fclose(file);
+    if (ret) out = CRawBlock(buffer, buffer->data(), nSize);
+    return ret;
+#else
+    std::lock_guard<std::mutex> lock(cs);
+    auto it = mappings.begin();
+    while (it != mappings.end() && it->first != path) ++it;
+    if (it == mappings.end() || nPos + nSize > it->second->size) {
+        int fd = open(path.string().c_str(), O_RDONLY);
+        if (fd == -1) return false;
+        struct stat st;
+        void* data = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && nPos + nSize <= (uint64_t)st.st_size) {
+            data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (data == MAP_FAILED) return false;
+        if (it != mappings.end()) mappings.erase(it);
+        mappings.emplace_front(path, std::make_shared<const Mapping>((const unsigned char*)data, st.st_size));
+        if (mappings.size() > nMaxFiles) mappings.pop_back();
+    } else if (it != mappings.begin()) {
+        mappings.splice(mappings.begin(), mappings, it);
+    }
+    const std::shared_ptr<const Mapping>& mapping = mappings.front().second;
+    out = CRawBlock(mapping, mapping->data + nPos, nSize);
+    return true;
+#endif
+}
+
+void CBlockFileMapper::Invalidate(const fs::path& path)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    mappings.remove_if([&path](const std::pair<fs::path, std::shared_ptr<const Mapping>>& entry) { return entry.first == path; });
+}
+
+size_t CBlockFileMapper::Size()
+{
+    std::lock_guard<std::mutex> lock(cs);
+    return mappings.size();
+}
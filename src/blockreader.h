@@ -0,0 +1,81 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKREADER_H
+#define BITCOIN_BLOCKREADER_H
+
+#include "fs.h"
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+
+/**
+ * A range of bytes read from a block file, typically a serialized block.
+ *
+ * The bytes stay valid for as long as the object (or a copy of it) exists,
+ * even if the file is unmapped or deleted in the meantime. Serializing it
+ * writes the bytes as they are.
+ */
+class CRawBlock
+{
+private:
+    std::shared_ptr<const void> owner;
+    const unsigned char* pbegin;
+    size_t nSize;
+
+public:
+    CRawBlock() : pbegin(nullptr), nSize(0) {}
+    CRawBlock(std::shared_ptr<const void> ownerIn, const unsigned char* pbeginIn, size_t nSizeIn)
+        : owner(std::move(ownerIn)), pbegin(pbeginIn), nSize(nSizeIn) {}
+
+    const unsigned char* begin() const { return pbegin; }
+    const unsigned char* end() const { return pbegin + nSize; }
+    size_t size() const { return nSize; }
+    bool empty() const { return nSize == 0; }
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        s.write((const char*)pbegin, nSize);
+    }
+};
+
+/**
+ * Read-only memory mappings of block files, so that blocks can be read
+ * without a syscall and a copy per read.
+ *
+ * Each file is mapped once, as a whole, and the mapping is reused by later
+ * reads. It is replaced when a read goes past its end because the file has
+ * grown. At most nMaxFiles mappings are kept, dropping the least recently
+ * used one; files that shrink or are deleted must be invalidated. On Windows
+ * the bytes are read into a buffer instead.
+ */
+class CBlockFileMapper
+{
+private:
+    struct Mapping;
+
+    const size_t nMaxFiles;
+    std::mutex cs;
+    //! Most recently used first.
+    std::list<std::pair<fs::path, std::shared_ptr<const Mapping>>> mappings;
+
+public:
+    explicit CBlockFileMapper(size_t nMaxFilesIn) : nMaxFiles(nMaxFilesIn) {}
+
+    /** Read nSize bytes at nPos of a file. Fails if the file is shorter. */
+    bool Read(const fs::path& path, uint64_t nPos, size_t nSize, CRawBlock& out);
+
+    /** Forget the mapping of a file, if any. Readers holding on to its bytes are not affected. */
+    void Invalidate(const fs::path& path);
+
+    /** Number of files currently mapped. */
+    size_t Size();
+};
+
+#endif // BITCOIN_BLOCKREADER_H
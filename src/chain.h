@@ -12,6 +12,8 @@
 #include "tinyformat.h"
 #include "uint256.h"
 
+#include <algorithm>
+#include <utility>
 #include <vector>
 
 /**
@@ -431,6 +433,48 @@ public:
     }
 };
 
+/**
+ * Allocates block index entries in large contiguous chunks instead of one by
+ * one. Entries keep their address until Clear(), which destroys all of them.
+ */
+class CBlockIndexArena
+{
+private:
+    static const size_t CHUNK_SIZE = 4096;
+    std::vector<std::vector<CBlockIndex>> vChunks;
+
+public:
+    CBlockIndexArena() {}
+    CBlockIndexArena(const CBlockIndexArena&) = delete;
+    CBlockIndexArena& operator=(const CBlockIndexArena&) = delete;
+
+    /** Make sure the next nCount entries are allocated next to each other. */
+    void Reserve(size_t nCount)
+    {
+        if (!vChunks.empty() && vChunks.back().capacity() - vChunks.back().size() >= nCount)
+            return;
+        vChunks.emplace_back();
+        vChunks.back().reserve(std::max(nCount, CHUNK_SIZE));
+    }
+
+    template<typename... Args>
+    CBlockIndex* New(Args&&... args)
+    {
+        Reserve(1);
+        vChunks.back().emplace_back(std::forward<Args>(args)...);
+        return &vChunks.back().back();
+    }
+
+    size_t Size() const
+    {
+        size_t nSize = 0;
+        for (const std::vector<CBlockIndex>& chunk : vChunks) nSize += chunk.size();
+        return nSize;
+    }
+
+    void Clear() { vChunks.clear(); }
+};
+
 /** An in-memory indexed chain of blocks. */
 class CChain {
 private:
@@ -8,6 +8,10 @@
 #include "sync.h"
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
@@ -16,21 +20,44 @@
 template <typename T>
 class CCheckQueueControl;
 
-/** 
+/**
  * Queue for verifications that have to be performed.
-  * The verifications are represented by a type T, which must provide an
-  * operator(), returning a bool.
-  *
-  * One thread (the master) is assumed to push batches of verifications
-  * onto the queue, where they are processed by N-1 worker threads. When
-  * the master is done adding work, it temporarily joins the worker pool
-  * as an N'th worker, until all jobs are done.
-  */
+ * The verifications are represented by a type T, which must provide an
+ * operator(), returning a bool.
+ *
+ * One thread (the master) is assumed to push batches of verifications
+ * onto the queue, where they are processed by N-1 worker threads. When
+ * the master is done adding work, it temporarily joins the worker pool
+ * as an N'th worker, until all jobs are done.
+ *
+ * Every thread has a deque of verifications of its own (threads beyond
+ * the number of deques share one), which the master fills in turn. A
+ * thread takes batches from the back of its own deque, and when that is
+ * empty, steals from the front of the others. The batch size follows the
+ * measured cost of a verification, so that cheap verifications are taken
+ * in large batches and expensive ones in small batches that spread evenly
+ * over the threads. Adding verifications only locks the deque they are
+ * added to, and the shared mutex only when a worker thread is asleep.
+ */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    //! Number of deques verifications are spread over
+    static const unsigned int NUM_DEQUES = 64;
+    //! Time a batch of verifications is aimed to take, in nanoseconds
+    static const int64_t BATCH_TARGET_NANOS = 100000;
+
+    struct Deque
+    {
+        boost::mutex mutex;
+        std::deque<T> checks;
+        //! checks.size(), readable without the lock
+        std::atomic<size_t> nSize{0};
+    };
+    std::unique_ptr<Deque[]> deques;
+
+    //! Mutex for sleeping and waking up
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -39,91 +66,136 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
-
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! The number of worker threads that are asleep, or about to be.
+    std::atomic<int> nSleeping;
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! The number of worker threads.
+    std::atomic<int> nWorkers;
 
-    //! The temporary evaluation result.
-    bool fAllOk;
+    //! The number of verifications in the deques.
+    std::atomic<size_t> nQueued;
 
     /**
      * Number of verifications that haven't completed yet.
-     * This includes elements that are no longer queued, but still in the
-     * worker's own batches.
+     * This includes elements that are no longer queued, but still in a
+     * thread's own batch.
      */
-    unsigned int nTodo;
+    std::atomic<size_t> nTodo;
 
-    //! Whether we're shutting down.
-    bool fQuit;
+    //! The temporary evaluation result.
+    std::atomic<bool> fAllOk;
 
     //! The maximum number of elements to be processed in one batch
-    unsigned int nBatchSize;
+    const unsigned int nBatchSizeMax;
 
-    /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster = false)
+    //! The current number of elements to be processed in one batch
+    std::atomic<unsigned int> nBatchSize;
+
+    //! Moving average of the time a verification takes, in nanoseconds
+    std::atomic<int64_t> nCheckNanos;
+
+    //! The deque the master adds to next
+    unsigned int nNextDeque;
+
+    /** Move a batch of verifications into vChecks, from the deque of nDeque or else from another one. */
+    bool TakeBatch(unsigned int nDeque, std::vector<T>& vChecks)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
-        std::vector<T> vChecks;
-        vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
-        do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
+        if (nQueued.load() == 0)
+            return false;
+        const unsigned int nBatch = nBatchSize.load(std::memory_order_relaxed);
+        for (unsigned int i = 0; i < NUM_DEQUES; i++) {
+            Deque& deque = deques[(nDeque + i) % NUM_DEQUES];
+            if (deque.nSize.load(std::memory_order_relaxed) == 0)
+                continue;
+            boost::unique_lock<boost::mutex> lock(deque.mutex);
+            if (deque.checks.empty())
+                continue;
+            // Take at most half of what is left, so the others find some
+            // work near the end as well.
+            const size_t nNow = std::max<size_t>(1, std::min<size_t>(nBatch, deque.checks.size() / 2));
+            vChecks.resize(nNow);
+            for (size_t j = 0; j < nNow; j++) {
+                // Swap jobs out of the deque instead of copying them.
+                if (i == 0) {
+                    vChecks[j].swap(deque.checks.back());
+                    deque.checks.pop_back();
                 } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
+                    vChecks[j].swap(deque.checks.front());
+                    deque.checks.pop_front();
                 }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
-                }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
             }
-            // execute work
+            deque.nSize.store(deque.checks.size(), std::memory_order_relaxed);
+            nQueued -= nNow;
+            return true;
+        }
+        return false;
+    }
+
+    /** Run a batch of verifications, and destroy them before marking them done. */
+    void RunBatch(std::vector<T>& vChecks)
+    {
+        const size_t nNow = vChecks.size();
+        bool fOk = fAllOk.load(std::memory_order_relaxed);
+        if (fOk) {
+            const auto start = std::chrono::steady_clock::now();
             for (T& check : vChecks)
                 if (fOk)
                     fOk = check();
-            vChecks.clear();
-        } while (true);
+            const int64_t nNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            // Update the cost estimate and the batch size derived from it.
+            // Races between threads only lose a sample.
+            const int64_t nAverage = (nCheckNanos.load(std::memory_order_relaxed) * 7 + nNanos / (int64_t)nNow) / 8;
+            nCheckNanos.store(nAverage, std::memory_order_relaxed);
+            nBatchSize.store(std::max<int64_t>(1, std::min<int64_t>(nBatchSizeMax, BATCH_TARGET_NANOS / std::max<int64_t>(nAverage, 1))), std::memory_order_relaxed);
+            if (!fOk)
+                fAllOk = false;
+        }
+        vChecks.clear();
+        if (nTodo.fetch_sub(nNow) == nNow) {
+            // We processed the last element; inform the master it can exit and return the result
+            boost::unique_lock<boost::mutex> lock(mutex);
+            condMaster.notify_one();
+        }
+    }
+
+    /** Internal function that does bulk of the verification work. */
+    bool Loop(unsigned int nDeque, bool fMaster)
+    {
+        std::vector<T> vChecks;
+        vChecks.reserve(nBatchSizeMax);
+        while (true) {
+            if (TakeBatch(nDeque, vChecks)) {
+                RunBatch(vChecks);
+                continue;
+            }
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (fMaster) {
+                // No work is added while the master waits, so only the
+                // verifications other threads are running remain.
+                while (nTodo.load() != 0 && nQueued.load() == 0)
+                    condMaster.wait(lock);
+                if (nTodo.load() == 0) {
+                    bool fRet = fAllOk;
+                    // reset the status for new work later
+                    fAllOk = true;
+                    // return the current status
+                    return fRet;
+                }
+            } else {
+                // Announce the intent to sleep before looking for work one
+                // last time, so that Add either sees it or its work is seen.
+                nSleeping++;
+                while (nQueued.load() == 0) {
+                    try {
+                        condWorker.wait(lock);
+                    } catch (...) {
+                        nSleeping--;
+                        throw;
+                    }
+                }
+                nSleeping--;
+            }
+        }
     }
 
 public:
@@ -131,39 +203,68 @@ public:
     boost::mutex ControlMutex;
 
     //! Create a new check queue
-    explicit CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    explicit CCheckQueue(unsigned int nBatchSizeIn) :
+        deques(new Deque[NUM_DEQUES]), nSleeping(0), nWorkers(0), nQueued(0), nTodo(0), fAllOk(true),
+        nBatchSizeMax(std::max(nBatchSizeIn, 1U)), nBatchSize(nBatchSizeMax), nCheckNanos(0), nNextDeque(0) {}
 
     //! Worker thread
     void Thread()
     {
-        Loop();
+        // The master uses deque 0.
+        const unsigned int nDeque = 1 + (nWorkers++) % (NUM_DEQUES - 1);
+        try {
+            Loop(nDeque, false);
+        } catch (...) {
+            nWorkers--;
+            throw;
+        }
+        nWorkers--;
     }
 
     //! Wait until execution finishes, and return whether all evaluations were successful.
     bool Wait()
     {
-        return Loop(true);
+        return Loop(0, true);
     }
 
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        for (T& check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        if (vChecks.empty())
+            return;
         nTodo += vChecks.size();
-        if (vChecks.size() == 1)
-            condWorker.notify_one();
-        else if (vChecks.size() > 1)
-            condWorker.notify_all();
+        // Spread the checks over the deques of the running threads, in
+        // batches.
+        const unsigned int nDeques = std::min<unsigned int>(NUM_DEQUES, 1 + nWorkers.load(std::memory_order_relaxed));
+        const size_t nBatch = nBatchSize.load(std::memory_order_relaxed);
+        for (size_t nDone = 0; nDone < vChecks.size(); ) {
+            const size_t nNow = std::min(nBatch, vChecks.size() - nDone);
+            Deque& deque = deques[nNextDeque++ % nDeques];
+            {
+                boost::unique_lock<boost::mutex> lock(deque.mutex);
+                for (size_t i = nDone; i < nDone + nNow; i++) {
+                    deque.checks.emplace_back();
+                    vChecks[i].swap(deque.checks.back());
+                }
+                deque.nSize.store(deque.checks.size(), std::memory_order_relaxed);
+                // Count them before they can be taken, which also happens
+                // under this lock, so that nQueued never goes below zero.
+                nQueued += nNow;
+            }
+            nDone += nNow;
+        }
+        if (nSleeping.load() > 0) {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (vChecks.size() == 1)
+                condWorker.notify_one();
+            else
+                condWorker.notify_all();
+        }
     }
 
     ~CCheckQueue()
     {
     }
-
 };
 
 /** 
@@ -177,6 +278,17 @@ private:
     CCheckQueue<T> * const pqueue;
     bool fDone;
 
+    static CCheckQueue<T>* TryEnter(CCheckQueue<T> * const pqueueIn)
+    {
+        if (pqueueIn == nullptr)
+            return nullptr;
+        EnterCritical("pqueue->ControlMutex", __FILE__, __LINE__, (void*)(&pqueueIn->ControlMutex), true);
+        if (pqueueIn->ControlMutex.try_lock())
+            return pqueueIn;
+        LeaveCritical();
+        return nullptr;
+    }
+
 public:
     CCheckQueueControl() = delete;
     CCheckQueueControl(const CCheckQueueControl&) = delete;
@@ -189,6 +301,15 @@ public:
         }
     }
 
+    //! Take control of the queue only if no other controller has it, and act as if there was no queue otherwise
+    CCheckQueueControl(CCheckQueue<T> * const pqueueIn, boost::try_to_lock_t) : pqueue(TryEnter(pqueueIn)), fDone(false) {}
+
+    //! Whether checks are run by the queue; if not, Add drops them
+    bool HasQueue() const
+    {
+        return pqueue != nullptr;
+    }
+
     bool Wait()
     {
         if (pqueue == nullptr)
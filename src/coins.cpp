@@ -10,10 +10,176 @@
 
 #include <assert.h>
 
+#include <algorithm>
+#include <iterator>
+#include <limits>
+
+uint32_t CompactCoin::GetRawSize() const
+{
+    uint32_t size;
+    memcpy(&size, data, sizeof(size));
+    return size;
+}
+
+unsigned char* CompactCoin::GetRawScript() const
+{
+    unsigned char* script;
+    memcpy(&script, data + sizeof(uint32_t), sizeof(script));
+    return script;
+}
+
+Coin* CompactCoin::GetExpanded() const
+{
+    Coin* coin;
+    memcpy(&coin, data, sizeof(coin));
+    return coin;
+}
+
+void CompactCoin::SetExpanded(Coin* coin)
+{
+    static_assert(sizeof(Coin*) <= DATA_SIZE, "no room for a coin pointer");
+    nValue = 0;
+    nScriptType = EXPANDED;
+    memcpy(data, &coin, sizeof(coin));
+}
+
+void CompactCoin::FreeHeap()
+{
+    if (nScriptType == RAW) {
+        delete[] GetRawScript();
+        nScriptType = SPENT;
+    } else if (nScriptType == EXPANDED) {
+        delete GetExpanded();
+        nScriptType = SPENT;
+    }
+}
+
+CompactCoin& CompactCoin::operator=(const Coin& coin)
+{
+    static_assert(sizeof(uint32_t) + sizeof(unsigned char*) <= DATA_SIZE, "no room for a script pointer");
+    FreeHeap();
+    const CScript& script = coin.out.scriptPubKey;
+    fCoinBase = coin.fCoinBase;
+    nHeight = coin.nHeight;
+    // Amounts that pass CheckTransaction fit in 56 bits with plenty to spare,
+    // but nothing stops a caller from caching any other.
+    if (!IsCompactAmount(coin.out.nValue)) {
+        SetExpanded(new Coin(coin));
+        return *this;
+    }
+    nValue = coin.out.nValue;
+    if (coin.IsSpent()) {
+        nScriptType = SPENT;
+    } else if (script.size() == 25 && script[0] == OP_DUP && script[1] == OP_HASH160 && script[2] == 20 &&
+               script[23] == OP_EQUALVERIFY && script[24] == OP_CHECKSIG) {
+        nScriptType = KEY_ID;
+        memcpy(data, &script[3], 20);
+    } else if (script.size() == 23 && script[0] == OP_HASH160 && script[1] == 20 && script[22] == OP_EQUAL) {
+        nScriptType = SCRIPT_ID;
+        memcpy(data, &script[2], 20);
+    } else if (script.size() == 22 && script[0] == OP_0 && script[1] == 20) {
+        nScriptType = WITNESS_KEYHASH;
+        memcpy(data, &script[2], 20);
+    } else {
+        nScriptType = RAW;
+        uint32_t size = script.size();
+        unsigned char* copy = new unsigned char[size];
+        if (size) memcpy(copy, script.data(), size);
+        memcpy(data, &size, sizeof(size));
+        memcpy(data + sizeof(size), &copy, sizeof(copy));
+    }
+    return *this;
+}
+
+CompactCoin& CompactCoin::operator=(Coin&& coin)
+{
+    // Only a Coin that is not compacted can be kept as it is.
+    if (IsCompactAmount(coin.out.nValue)) return *this = static_cast<const Coin&>(coin);
+    FreeHeap();
+    fCoinBase = coin.fCoinBase;
+    nHeight = coin.nHeight;
+    SetExpanded(new Coin(std::move(coin)));
+    return *this;
+}
+
+CompactCoin& CompactCoin::operator=(const CompactCoin& other)
+{
+    if (this == &other) return *this;
+    if (other.nScriptType == EXPANDED) return *this = *other.GetExpanded();
+    FreeHeap();
+    nValue = other.nValue;
+    fCoinBase = other.fCoinBase;
+    nHeight = other.nHeight;
+    memcpy(data, other.data, DATA_SIZE);
+    if (other.nScriptType == RAW) {
+        uint32_t size = other.GetRawSize();
+        unsigned char* copy = new unsigned char[size];
+        if (size) memcpy(copy, other.GetRawScript(), size);
+        memcpy(data + sizeof(size), &copy, sizeof(copy));
+    }
+    nScriptType = other.nScriptType;
+    return *this;
+}
+
+CompactCoin& CompactCoin::operator=(CompactCoin&& other) noexcept
+{
+    if (this == &other) return *this;
+    FreeHeap();
+    nValue = other.nValue;
+    nScriptType = other.nScriptType;
+    fCoinBase = other.fCoinBase;
+    nHeight = other.nHeight;
+    memcpy(data, other.data, DATA_SIZE);
+    // The heap copy, if any, now belongs to us.
+    other.nScriptType = SPENT;
+    other.nValue = -1;
+    return *this;
+}
+
+Coin CompactCoin::Expand() const
+{
+    if (nScriptType == EXPANDED) return *GetExpanded();
+    Coin coin;
+    coin.out.nValue = nValue;
+    coin.fCoinBase = fCoinBase;
+    coin.nHeight = nHeight;
+    CScript& script = coin.out.scriptPubKey;
+    switch (nScriptType) {
+    case KEY_ID:
+        script.resize(25);
+        script[0] = OP_DUP;
+        script[1] = OP_HASH160;
+        script[2] = 20;
+        memcpy(&script[3], data, 20);
+        script[23] = OP_EQUALVERIFY;
+        script[24] = OP_CHECKSIG;
+        break;
+    case SCRIPT_ID:
+        script.resize(23);
+        script[0] = OP_HASH160;
+        script[1] = 20;
+        memcpy(&script[2], data, 20);
+        script[22] = OP_EQUAL;
+        break;
+    case WITNESS_KEYHASH:
+        script.resize(22);
+        script[0] = OP_0;
+        script[1] = 20;
+        memcpy(&script[2], data, 20);
+        break;
+    case RAW: {
+        const unsigned char* raw = GetRawScript();
+        script.assign(raw, raw + GetRawSize());
+        break;
+    }
+    }
+    return coin;
+}
+
 bool CCoinsView::GetCoin(const COutPoint &outpoint, Coin &coin) const { return false; }
 uint256 CCoinsView::GetBestBlock() const { return uint256(); }
 std::vector<uint256> CCoinsView::GetHeadBlocks() const { return std::vector<uint256>(); }
-bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) { return false; }
+bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase) { return false; }
 CCoinsViewCursor *CCoinsView::Cursor() const { return nullptr; }
 
 bool CCoinsView::HaveCoin(const COutPoint &outpoint) const
@@ -28,13 +194,16 @@ bool CCoinsViewBacked::HaveCoin(const COutPoint &outpoint) const { return base->
 uint256 CCoinsViewBacked::GetBestBlock() const { return base->GetBestBlock(); }
 std::vector<uint256> CCoinsViewBacked::GetHeadBlocks() const { return base->GetHeadBlocks(); }
 void CCoinsViewBacked::SetBackend(CCoinsView &viewIn) { base = &viewIn; }
-bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) { return base->BatchWrite(mapCoins, hashBlock); }
+bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase) { return base->BatchWrite(mapCoins, hashBlock, erase); }
 CCoinsViewCursor *CCoinsViewBacked::Cursor() const { return base->Cursor(); }
 size_t CCoinsViewBacked::EstimateSize() const { return base->EstimateSize(); }
 
 SaltedOutpointHasher::SaltedOutpointHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 
-CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), cachedCoinsUsage(0) {}
+CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn),
+    cacheCoinsMemoryResource(new CCoinsMapMemoryResource()),
+    cacheCoins(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), CCoinsMapAllocator(cacheCoinsMemoryResource.get())),
+    cachedCoinsUsage(0), cacheEpoch(0) {}
 
 size_t CCoinsViewCache::DynamicMemoryUsage() const {
     return memusage::DynamicUsage(cacheCoins) + cachedCoinsUsage;
@@ -42,12 +211,15 @@ size_t CCoinsViewCache::DynamicMemoryUsage() const {
 
 CCoinsMap::iterator CCoinsViewCache::FetchCoin(const COutPoint &outpoint) const {
     CCoinsMap::iterator it = cacheCoins.find(outpoint);
-    if (it != cacheCoins.end())
+    if (it != cacheCoins.end()) {
+        it->second.last_used = cacheEpoch;
         return it;
+    }
     Coin tmp;
     if (!base->GetCoin(outpoint, tmp))
         return cacheCoins.end();
     CCoinsMap::iterator ret = cacheCoins.emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::forward_as_tuple(std::move(tmp))).first;
+    ret->second.last_used = cacheEpoch;
     if (ret->second.coin.IsSpent()) {
         // The parent only has an empty entry for this outpoint; we can consider our
         // version as fresh.
@@ -60,7 +232,7 @@ CCoinsMap::iterator CCoinsViewCache::FetchCoin(const COutPoint &outpoint) const
 bool CCoinsViewCache::GetCoin(const COutPoint &outpoint, Coin &coin) const {
     CCoinsMap::const_iterator it = FetchCoin(outpoint);
     if (it != cacheCoins.end()) {
-        coin = it->second.coin;
+        coin = it->second.coin.Expand();
         return !coin.IsSpent();
     }
     return false;
@@ -84,9 +256,21 @@ void CCoinsViewCache::AddCoin(const COutPoint &outpoint, Coin&& coin, bool possi
     }
     it->second.coin = std::move(coin);
     it->second.flags |= CCoinsCacheEntry::DIRTY | (fresh ? CCoinsCacheEntry::FRESH : 0);
+    it->second.last_used = cacheEpoch;
     cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
 }
 
+void CCoinsViewCache::EmplaceCoinFromBase(const COutPoint &outpoint, Coin&& coin) {
+    assert(!coin.IsSpent());
+    CCoinsMap::iterator it;
+    bool inserted;
+    std::tie(it, inserted) = cacheCoins.emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::forward_as_tuple(std::move(coin)));
+    if (inserted) {
+        it->second.last_used = cacheEpoch;
+        cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
+    }
+}
+
 void AddCoins(CCoinsViewCache& cache, const CTransaction &tx, int nHeight, bool check) {
     bool fCoinbase = tx.IsCoinBase();
     const uint256& txid = tx.GetHash();
@@ -103,7 +287,7 @@ bool CCoinsViewCache::SpendCoin(const COutPoint &outpoint, Coin* moveout) {
     if (it == cacheCoins.end()) return false;
     cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
     if (moveout) {
-        *moveout = std::move(it->second.coin);
+        *moveout = it->second.coin.Expand();
     }
     if (it->second.flags & CCoinsCacheEntry::FRESH) {
         cacheCoins.erase(it);
@@ -114,14 +298,12 @@ bool CCoinsViewCache::SpendCoin(const COutPoint &outpoint, Coin* moveout) {
     return true;
 }
 
-static const Coin coinEmpty;
-
-const Coin& CCoinsViewCache::AccessCoin(const COutPoint &outpoint) const {
+Coin CCoinsViewCache::AccessCoin(const COutPoint &outpoint) const {
     CCoinsMap::const_iterator it = FetchCoin(outpoint);
     if (it == cacheCoins.end()) {
-        return coinEmpty;
+        return Coin();
     } else {
-        return it->second.coin;
+        return it->second.coin.Expand();
     }
 }
 
@@ -145,8 +327,9 @@ void CCoinsViewCache::SetBestBlock(const uint256 &hashBlockIn) {
     hashBlock = hashBlockIn;
 }
 
-bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn) {
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn, bool erase) {
+    cacheEpoch++;
+    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it = erase ? mapCoins.erase(it) : std::next(it)) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) { // Ignore non-dirty entries (optimization).
             CCoinsMap::iterator itUs = cacheCoins.find(it->first);
             if (itUs == cacheCoins.end()) {
@@ -156,9 +339,14 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
                     // Otherwise we will need to create it in the parent
                     // and move the data up and mark it as dirty
                     CCoinsCacheEntry& entry = cacheCoins[it->first];
-                    entry.coin = std::move(it->second.coin);
+                    if (erase) {
+                        entry.coin = std::move(it->second.coin);
+                    } else {
+                        entry.coin = it->second.coin;
+                    }
                     cachedCoinsUsage += entry.coin.DynamicMemoryUsage();
                     entry.flags = CCoinsCacheEntry::DIRTY;
+                    entry.last_used = cacheEpoch;
                     // We can mark it FRESH in the parent if it was FRESH in the child
                     // Otherwise it might have just been flushed from the parent's cache
                     // and already exist in the grandparent
@@ -183,9 +371,14 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
                 } else {
                     // A normal modification.
                     cachedCoinsUsage -= itUs->second.coin.DynamicMemoryUsage();
-                    itUs->second.coin = std::move(it->second.coin);
+                    if (erase) {
+                        itUs->second.coin = std::move(it->second.coin);
+                    } else {
+                        itUs->second.coin = it->second.coin;
+                    }
                     cachedCoinsUsage += itUs->second.coin.DynamicMemoryUsage();
                     itUs->second.flags |= CCoinsCacheEntry::DIRTY;
+                    itUs->second.last_used = cacheEpoch;
                     // NOTE: It is possible the child has a FRESH flag here in
                     // the event the entry we found in the parent is pruned. But
                     // we must not copy that FRESH flag to the parent as that
@@ -194,8 +387,6 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
                 }
             }
         }
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
     }
     hashBlock = hashBlockIn;
     return true;
@@ -204,10 +395,84 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
 bool CCoinsViewCache::Flush() {
     bool fOk = base->BatchWrite(cacheCoins, hashBlock);
     cacheCoins.clear();
+    ReallocateCache();
     cachedCoinsUsage = 0;
     return fOk;
 }
 
+bool CCoinsViewCache::Sync() {
+    bool fOk = base->BatchWrite(cacheCoins, hashBlock, false);
+    // Instead of clearing the cache as Flush() does, drop the spent entries
+    // (the parent now has them as spent, or not at all) and mark the rest as
+    // matching the parent.
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end();) {
+        if (it->second.coin.IsSpent()) {
+            cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+            it = cacheCoins.erase(it);
+        } else {
+            it->second.flags = 0;
+            ++it;
+        }
+    }
+    return fOk;
+}
+
+size_t CCoinsViewCache::EvictClean(size_t target_usage) {
+    const size_t usage = DynamicMemoryUsage();
+    if (usage <= target_usage || cacheCoins.empty()) return 0;
+
+    // Find the range of epochs of the unmodified entries.
+    uint32_t min_epoch = std::numeric_limits<uint32_t>::max();
+    uint32_t max_epoch = 0;
+    for (const auto& entry : cacheCoins) {
+        if (entry.second.flags) continue;
+        min_epoch = std::min(min_epoch, entry.second.last_used);
+        max_epoch = std::max(max_epoch, entry.second.last_used);
+    }
+    if (min_epoch > max_epoch) return 0;
+
+    // Tally the memory held by unmodified entries per age bucket, and find the
+    // youngest bucket that needs to go to get below target_usage.
+    static const size_t NUM_BUCKETS = 256;
+    const uint64_t range = (uint64_t)max_epoch - min_epoch + 1;
+    auto bucket = [&](uint32_t epoch) { return (size_t)(((uint64_t)(epoch - min_epoch) * NUM_BUCKETS) / range); };
+    const size_t node_usage = memusage::DynamicUsage(cacheCoins) / cacheCoins.size();
+    std::vector<size_t> bucket_usage(NUM_BUCKETS, 0);
+    for (const auto& entry : cacheCoins) {
+        if (entry.second.flags) continue;
+        bucket_usage[bucket(entry.second.last_used)] += node_usage + entry.second.coin.DynamicMemoryUsage();
+    }
+    const size_t excess = usage - target_usage;
+    size_t cutoff = 0;
+    size_t freed = bucket_usage[0];
+    while (freed < excess && cutoff + 1 < NUM_BUCKETS) {
+        freed += bucket_usage[++cutoff];
+    }
+
+    size_t removed = 0;
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end();) {
+        if (!it->second.flags && bucket(it->second.last_used) <= cutoff) {
+            cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+            it = cacheCoins.erase(it);
+            removed++;
+        } else {
+            ++it;
+        }
+    }
+    return removed;
+}
+
+void CCoinsViewCache::ReallocateCache()
+{
+    assert(cacheCoins.empty());
+    // Moving in a map that uses the new resource takes over its allocator, and
+    // releases the buckets of the old map to the old resource, which can then
+    // be destroyed.
+    std::unique_ptr<CCoinsMapMemoryResource> resource(new CCoinsMapMemoryResource());
+    cacheCoins = CCoinsMap(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), CCoinsMapAllocator(resource.get()));
+    cacheCoinsMemoryResource.swap(resource);
+}
+
 void CCoinsViewCache::Uncache(const COutPoint& hash)
 {
     CCoinsMap::iterator it = cacheCoins.find(hash);
@@ -248,13 +513,13 @@ bool CCoinsViewCache::HaveInputs(const CTransaction& tx) const
 static const size_t MIN_TRANSACTION_OUTPUT_WEIGHT = WITNESS_SCALE_FACTOR * ::GetSerializeSize(CTxOut(), SER_NETWORK, PROTOCOL_VERSION);
 static const size_t MAX_OUTPUTS_PER_BLOCK = MAX_BLOCK_WEIGHT / MIN_TRANSACTION_OUTPUT_WEIGHT;
 
-const Coin& AccessByTxid(const CCoinsViewCache& view, const uint256& txid)
+Coin AccessByTxid(const CCoinsViewCache& view, const uint256& txid)
 {
     COutPoint iter(txid, 0);
     while (iter.n < MAX_OUTPUTS_PER_BLOCK) {
-        const Coin& alternate = view.AccessCoin(iter);
+        Coin alternate = view.AccessCoin(iter);
         if (!alternate.IsSpent()) return alternate;
         ++iter.n;
     }
-    return coinEmpty;
+    return Coin();
 }
@@ -12,9 +12,11 @@
 #include "hash.h"
 #include "memusage.h"
 #include "serialize.h"
+#include "support/allocators/pool.h"
 #include "uint256.h"
 
 #include <assert.h>
+#include <memory>
 #include <stdint.h>
 
 #include <unordered_map>
@@ -81,11 +83,93 @@ public:
     }
 };
 
+/**
+ * A Coin as it is kept in a CCoinsViewCache entry, in fewer bytes.
+ *
+ * The scriptPubKeys of P2PKH, P2SH and P2WPKH outputs, which make up most of
+ * the UTXO set, are reduced to their 20-byte hash (as CScriptCompressor does
+ * for the first two) and stored inline. Other scripts are copied to the heap.
+ * The amount shares a word with the script type; the rare amount that does not
+ * fit is kept in a whole Coin instead. The Coin is rebuilt when it is
+ * accessed, so that cached entries stay compact; the serialization is the
+ * same as the Coin's.
+ */
+class CompactCoin
+{
+private:
+    enum ScriptType {
+        SPENT = 0,          //!< No output
+        KEY_ID = 1,         //!< OP_DUP OP_HASH160 <20 bytes> OP_EQUALVERIFY OP_CHECKSIG
+        SCRIPT_ID = 2,      //!< OP_HASH160 <20 bytes> OP_EQUAL
+        WITNESS_KEYHASH = 3, //!< OP_0 <20 bytes>
+        RAW = 4,            //!< Any other script, on the heap
+        EXPANDED = 5,       //!< The whole Coin, on the heap, for amounts that do not fit
+    };
+    static const size_t DATA_SIZE = 20;
+
+    //! 56 bits hold any amount in MoneyRange, and -1 for spent coins.
+    int64_t nValue : 56;
+    uint64_t nScriptType : 8;
+    uint32_t fCoinBase : 1;
+    uint32_t nHeight : 31;
+    //! The hash for the hash-based script types. For RAW scripts, the size
+    //! followed by the pointer to the script, and for EXPANDED the pointer to
+    //! the Coin.
+    unsigned char data[DATA_SIZE];
+
+    static bool IsCompactAmount(CAmount nValue) { return nValue >> 55 == 0 || nValue >> 55 == -1; }
+    uint32_t GetRawSize() const;
+    unsigned char* GetRawScript() const;
+    Coin* GetExpanded() const;
+    void SetExpanded(Coin* coin);
+    void FreeHeap();
+
+public:
+    CompactCoin() : nValue(-1), nScriptType(SPENT), fCoinBase(false), nHeight(0) {}
+    explicit CompactCoin(const Coin& coin) : CompactCoin() { *this = coin; }
+    explicit CompactCoin(Coin&& coin) : CompactCoin() { *this = std::move(coin); }
+    CompactCoin(const CompactCoin& other) : CompactCoin() { *this = other; }
+    CompactCoin(CompactCoin&& other) noexcept : CompactCoin() { *this = std::move(other); }
+    ~CompactCoin() { FreeHeap(); }
+
+    CompactCoin& operator=(const Coin& coin);
+    CompactCoin& operator=(Coin&& coin);
+    CompactCoin& operator=(const CompactCoin& other);
+    CompactCoin& operator=(CompactCoin&& other) noexcept;
+
+    //! The Coin this represents.
+    Coin Expand() const;
+
+    void Clear()
+    {
+        FreeHeap();
+        nValue = -1;
+        nScriptType = SPENT;
+        fCoinBase = false;
+        nHeight = 0;
+    }
+
+    bool IsSpent() const {
+        return nScriptType == SPENT || (nScriptType == EXPANDED && GetExpanded()->IsSpent());
+    }
+
+    size_t DynamicMemoryUsage() const {
+        if (nScriptType == RAW) return memusage::MallocUsage(GetRawSize());
+        if (nScriptType == EXPANDED) return memusage::MallocUsage(sizeof(Coin)) + GetExpanded()->DynamicMemoryUsage();
+        return 0;
+    }
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        ::Serialize(s, Expand());
+    }
+};
+
 class SaltedOutpointHasher
 {
 private:
     /** Salt */
-    const uint64_t k0, k1;
+    uint64_t k0, k1;
 
 public:
     SaltedOutpointHasher();
@@ -94,16 +178,20 @@ public:
      * This *must* return size_t. With Boost 1.46 on 32-bit systems the
      * unordered_map will behave unpredictably if the custom hasher returns a
      * uint64_t, resulting in failures when syncing the chain (#4634).
+     *
+     * Being noexcept keeps libstdc++ from storing the hash in every node of
+     * the coins cache, at the cost of rehashing the keys when it grows.
      */
-    size_t operator()(const COutPoint& id) const {
+    size_t operator()(const COutPoint& id) const noexcept {
         return SipHashUint256Extra(k0, k1, id.hash, id.n);
     }
 };
 
 struct CCoinsCacheEntry
 {
-    Coin coin; // The actual cached data.
+    CompactCoin coin; // The actual cached data.
     unsigned char flags;
+    uint32_t last_used; // The owning cache's epoch at the last access, for evicting the least recently used entries.
 
     enum Flags {
         DIRTY = (1 << 0), // This cache entry is potentially different from the version in the parent view.
@@ -115,11 +203,22 @@ struct CCoinsCacheEntry
          */
     };
 
-    CCoinsCacheEntry() : flags(0) {}
-    explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0) {}
+    CCoinsCacheEntry() : flags(0), last_used(0) {}
+    explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0), last_used(0) {}
 };
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+/**
+ * CCoinsMap nodes are allocated from a pool, which avoids the per-node
+ * malloc overhead and keeps the nodes densely packed. The largest pooled
+ * block leaves room for the node's bookkeeping (next pointer and cached hash
+ * in libstdc++) on top of the value itself.
+ */
+typedef PoolAllocator<std::pair<const COutPoint, CCoinsCacheEntry>,
+                      sizeof(std::pair<const COutPoint, CCoinsCacheEntry>) + sizeof(void*) * 4,
+                      alignof(void*)> CCoinsMapAllocator;
+typedef CCoinsMapAllocator::ResourceType CCoinsMapMemoryResource;
+
+typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher, std::equal_to<COutPoint>, CCoinsMapAllocator> CCoinsMap;
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -164,8 +263,9 @@ public:
     virtual std::vector<uint256> GetHeadBlocks() const;
 
     //! Do a bulk modification (multiple Coin changes + BestBlock change).
-    //! The passed mapCoins can be modified.
-    virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    //! If erase is true, the passed mapCoins can be modified, and its entries
+    //! are removed. Otherwise it is left unchanged.
+    virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase = true);
 
     //! Get a cursor to iterate over the whole state
     virtual CCoinsViewCursor *Cursor() const;
@@ -191,7 +291,7 @@ public:
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
     void SetBackend(CCoinsView &viewIn);
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase = true) override;
     CCoinsViewCursor *Cursor() const override;
     size_t EstimateSize() const override;
 };
@@ -206,11 +306,17 @@ protected:
      * declared as "const".  
      */
     mutable uint256 hashBlock;
+    /* Backing memory for the nodes of cacheCoins; must outlive it. */
+    std::unique_ptr<CCoinsMapMemoryResource> cacheCoinsMemoryResource;
     mutable CCoinsMap cacheCoins;
 
     /* Cached dynamic memory usage for the inner Coin objects. */
     mutable size_t cachedCoinsUsage;
 
+    /* Advanced on every BatchWrite into this cache (i.e. once per connected
+     * block for the chainstate cache), and stamped on entries when used. */
+    uint32_t cacheEpoch;
+
 public:
     CCoinsViewCache(CCoinsView *baseIn);
 
@@ -224,7 +330,7 @@ public:
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
     void SetBestBlock(const uint256 &hashBlock);
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase = true) override;
     CCoinsViewCursor* Cursor() const override {
         throw std::logic_error("CCoinsViewCache cursor iteration not supported.");
     }
@@ -237,16 +343,13 @@ public:
     bool HaveCoinInCache(const COutPoint &outpoint) const;
 
     /**
-     * Return a reference to Coin in the cache, or a pruned one if not found. This is
-     * more efficient than GetCoin.
+     * Return a copy of the Coin in the cache, or a pruned one if not found.
+     * Unlike GetCoin, spent coins in the cache are returned as well.
      *
-     * Generally, do not hold the reference returned for more than a short scope.
-     * While the current implementation allows for modifications to the contents
-     * of the cache while holding the reference, this behavior should not be relied
-     * on! To be safe, best to not hold the returned reference through any other
-     * calls to this cache.
+     * The cache keeps coins in a compact form, so the Coin is rebuilt from
+     * the entry, which stays compact.
      */
-    const Coin& AccessCoin(const COutPoint &output) const;
+    Coin AccessCoin(const COutPoint &output) const;
 
     /**
      * Add a coin. Set potential_overwrite to true if a non-pruned version may
@@ -254,6 +357,14 @@ public:
      */
     void AddCoin(const COutPoint& outpoint, Coin&& coin, bool potential_overwrite);
 
+    /**
+     * Add an unspent coin that was read from the base view ahead of time,
+     * unless the outpoint is already cached. The entry is not dirty, just like
+     * one loaded on demand. The caller must make sure the base view has not
+     * been written to since the coin was read.
+     */
+    void EmplaceCoinFromBase(const COutPoint& outpoint, Coin&& coin);
+
     /**
      * Spend a coin. Pass moveto in order to get the deleted data.
      * If no unspent output exists for the passed outpoint, this call
@@ -268,6 +379,20 @@ public:
      */
     bool Flush();
 
+    /**
+     * Like Flush(), but only writes the modified entries, and keeps all
+     * unspent ones cached (no longer marked as modified).
+     * If false is returned, the state of this cache (and its backing view) will be undefined.
+     */
+    bool Sync();
+
+    /**
+     * Remove unmodified entries, least recently used first, until the memory
+     * usage is at most target_usage or no unmodified entries remain.
+     * Returns the number of entries removed.
+     */
+    size_t EvictClean(size_t target_usage);
+
     /**
      * Removes the UTXO with the given outpoint from the cache, if it is
      * not modified.
@@ -295,6 +420,12 @@ public:
 
 private:
     CCoinsMap::iterator FetchCoin(const COutPoint &outpoint) const;
+
+    /**
+     * Replace the (empty) cacheCoins and its memory resource with fresh ones,
+     * releasing the memory held by the old pool.
+     */
+    void ReallocateCache();
 };
 
 //! Utility function to add all of a transaction's outputs to a cache.
@@ -309,6 +440,6 @@ void AddCoins(CCoinsViewCache& cache, const CTransaction& tx, int nHeight, bool
 // This function can be quite expensive because in the event of a transaction
 // which is not found in the cache, it can cause up to MAX_OUTPUTS_PER_BLOCK
 // lookups to database, so it should be used with care.
-const Coin& AccessByTxid(const CCoinsViewCache& cache, const uint256& txid);
+Coin AccessByTxid(const CCoinsViewCache& cache, const uint256& txid);
 
 #endif // BITCOIN_COINS_H
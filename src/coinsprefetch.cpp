@@ -0,0 +1,131 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinsprefetch.h"
+
+#include "primitives/block.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+std::vector<COutPoint> CCoinsPrefetcher::GetBlockPrevouts(const CBlock& block)
+{
+    std::vector<uint256> txids;
+    txids.reserve(block.vtx.size());
+    for (const auto& tx : block.vtx) {
+        txids.push_back(tx->GetHash());
+    }
+    std::sort(txids.begin(), txids.end());
+
+    std::vector<COutPoint> prevouts;
+    for (const auto& tx : block.vtx) {
+        if (tx->IsCoinBase()) continue;
+        for (const CTxIn& txin : tx->vin) {
+            if (!std::binary_search(txids.begin(), txids.end(), txin.prevout.hash)) {
+                prevouts.push_back(txin.prevout);
+            }
+        }
+    }
+    return prevouts;
+}
+
+void CCoinsPrefetcher::Enqueue(const CBlock& block, CCoinsView* base, const CCoinsViewCache& cache)
+{
+    std::vector<Batch> batches;
+    for (const COutPoint& prevout : GetBlockPrevouts(block)) {
+        if (cache.HaveCoinInCache(prevout)) continue;
+        if (batches.empty() || batches.back().outpoints.size() == BATCH_SIZE) {
+            batches.emplace_back();
+            batches.back().base = base;
+            batches.back().outpoints.reserve(BATCH_SIZE);
+        }
+        batches.back().outpoints.push_back(prevout);
+    }
+    if (batches.empty()) return;
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    for (Batch& batch : batches) {
+        queue.push_back(std::move(batch));
+    }
+    condWorker.notify_all();
+}
+
+void CCoinsPrefetcher::Thread()
+{
+    while (true) {
+        Batch batch;
+        uint64_t generation;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (queue.empty()) {
+                condWorker.wait(lock); // interruption point
+            }
+            batch = std::move(queue.front());
+            queue.pop_front();
+            generation = nGeneration;
+        }
+
+        std::vector<std::pair<COutPoint, Coin>> coins;
+        coins.reserve(batch.outpoints.size());
+        for (const COutPoint& outpoint : batch.outpoints) {
+            Coin coin;
+            try {
+                if (batch.base->GetCoin(outpoint, coin)) {
+                    coins.emplace_back(outpoint, std::move(coin));
+                }
+            } catch (const std::runtime_error&) {
+                // Leave reporting read errors to the synchronous lookup.
+            }
+        }
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (generation != nGeneration) {
+            stats.nDiscarded += coins.size();
+            continue;
+        }
+        stats.nPrefetched += coins.size();
+        staged.insert(staged.end(), std::make_move_iterator(coins.begin()), std::make_move_iterator(coins.end()));
+    }
+}
+
+void CCoinsPrefetcher::Drain(CCoinsViewCache& cache)
+{
+    std::vector<std::pair<COutPoint, Coin>> coins;
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        coins.swap(staged);
+    }
+    for (auto& entry : coins) {
+        cache.EmplaceCoinFromBase(entry.first, std::move(entry.second));
+    }
+}
+
+void CCoinsPrefetcher::Invalidate()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    nGeneration++;
+    stats.nDiscarded += staged.size();
+    staged.clear();
+}
+
+void CCoinsPrefetcher::CountHits(const CBlock& block, const CCoinsViewCache& cache)
+{
+    uint64_t hits = 0, misses = 0;
+    for (const COutPoint& prevout : GetBlockPrevouts(block)) {
+        if (cache.HaveCoinInCache(prevout)) {
+            hits++;
+        } else {
+            misses++;
+        }
+    }
+    boost::unique_lock<boost::mutex> lock(mutex);
+    stats.nHits += hits;
+    stats.nMisses += misses;
+}
+
+CCoinsPrefetchStats CCoinsPrefetcher::GetStats()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return stats;
+}
@@ -0,0 +1,110 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COINSPREFETCH_H
+#define BITCOIN_COINSPREFETCH_H
+
+#include "coins.h"
+#include "primitives/transaction.h"
+
+#include <deque>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+class CBlock;
+
+/** Counters reported by CCoinsPrefetcher::GetStats(). */
+struct CCoinsPrefetchStats
+{
+    //! Coins read from the database by the prefetch threads.
+    uint64_t nPrefetched;
+    //! Prefetched coins that were thrown away because the database changed.
+    uint64_t nDiscarded;
+    //! Inputs of connected blocks that were in the cache when connecting started.
+    uint64_t nHits;
+    //! Inputs of connected blocks that still had to be read from the database.
+    uint64_t nMisses;
+
+    CCoinsPrefetchStats() : nPrefetched(0), nDiscarded(0), nHits(0), nMisses(0) {}
+};
+
+/**
+ * Reads the inputs of blocks that are about to be connected on background
+ * threads, so that ConnectBlock finds them in the chainstate cache instead of
+ * waiting on a synchronous database read for each of them.
+ *
+ * The worker threads read coins from the base view without holding the lock
+ * that protects the cache, into a staging area. Drain() moves them into the
+ * cache, and must be called with that lock held. A coin read from the base
+ * view is only current as long as the base view isn't written to, so
+ * Invalidate() must be called after every write to it (i.e. after flushing
+ * the cache), which discards everything read up to that point.
+ */
+class CCoinsPrefetcher
+{
+private:
+    //! Number of outpoints handed to a worker at once.
+    static const size_t BATCH_SIZE = 64;
+
+    struct Batch {
+        CCoinsView* base;
+        std::vector<COutPoint> outpoints;
+    };
+
+    //! Mutex to protect the inner state
+    boost::mutex mutex;
+
+    //! Worker threads block on this when out of work
+    boost::condition_variable condWorker;
+
+    //! Outpoints waiting to be read.
+    std::deque<Batch> queue;
+
+    //! Coins that were read, but not yet moved into the cache.
+    std::vector<std::pair<COutPoint, Coin>> staged;
+
+    //! Incremented by Invalidate(). Reads started before that are discarded.
+    uint64_t nGeneration;
+
+    CCoinsPrefetchStats stats;
+
+public:
+    CCoinsPrefetcher() : nGeneration(0) {}
+
+    /** Worker thread loop. Returns when the thread is interrupted. */
+    void Thread();
+
+    /**
+     * Queue the inputs of block for reading from base, skipping those that are
+     * spent within the block itself or already present in cache. The caller
+     * must hold the lock protecting cache, and base must outlive the workers.
+     */
+    void Enqueue(const CBlock& block, CCoinsView* base, const CCoinsViewCache& cache);
+
+    /**
+     * Move the coins that have been read so far into cache. The caller must
+     * hold the lock protecting cache.
+     */
+    void Drain(CCoinsViewCache& cache);
+
+    /**
+     * Discard everything read so far. Must be called, with the lock
+     * protecting the cache held, after the base view has been written to.
+     */
+    void Invalidate();
+
+    /** Count how many of block's inputs are present in cache, for the hit/miss statistics. */
+    void CountHits(const CBlock& block, const CCoinsViewCache& cache);
+
+    CCoinsPrefetchStats GetStats();
+
+    /** The inputs of block that are not created by its own transactions. */
+    static std::vector<COutPoint> GetBlockPrevouts(const CBlock& block);
+};
+
+#endif // BITCOIN_COINSPREFETCH_H
@@ -0,0 +1,65 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinstats.h"
+
+#include "coins.h"
+#include "primitives/transaction.h"
+#include "streams.h"
+#include "version.h"
+
+#include <vector>
+
+namespace {
+
+//! The element of the set hash that represents a coin.
+void SerializeCoin(std::vector<unsigned char>& data, const COutPoint& outpoint, const Coin& coin)
+{
+    data.reserve(128);
+    CVectorWriter(SER_DISK, PROTOCOL_VERSION, data, 0) << outpoint << coin;
+}
+
+} // namespace
+
+int64_t CCoinsRollingStats::GetBogoSize(const Coin& coin)
+{
+    return 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
+           2 /* scriptPubKey len */ + coin.out.scriptPubKey.size() /* scriptPubKey */;
+}
+
+void CCoinsRollingStats::AddCoin(const COutPoint& outpoint, const Coin& coin)
+{
+    std::vector<unsigned char> data;
+    SerializeCoin(data, outpoint, coin);
+    hash.Insert(data.data(), data.size());
+    nTransactionOutputs++;
+    nBogoSize += GetBogoSize(coin);
+    nTotalAmount += coin.out.nValue;
+}
+
+void CCoinsRollingStats::RemoveCoin(const COutPoint& outpoint, const Coin& coin)
+{
+    std::vector<unsigned char> data;
+    SerializeCoin(data, outpoint, coin);
+    hash.Remove(data.data(), data.size());
+    nTransactionOutputs--;
+    nBogoSize -= GetBogoSize(coin);
+    nTotalAmount -= coin.out.nValue;
+}
+
+CCoinsRollingStats& CCoinsRollingStats::operator+=(const CCoinsRollingStats& other)
+{
+    hash += other.hash;
+    nTransactionOutputs += other.nTransactionOutputs;
+    nBogoSize += other.nBogoSize;
+    nTotalAmount += other.nTotalAmount;
+    return *this;
+}
+
+uint256 CCoinsRollingStats::GetHash() const
+{
+    uint256 ret;
+    hash.Finalize(ret.begin());
+    return ret;
+}
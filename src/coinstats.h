@@ -0,0 +1,64 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COINSTATS_H
+#define BITCOIN_COINSTATS_H
+
+#include "amount.h"
+#include "crypto/adhash.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <stdint.h>
+
+class COutPoint;
+class Coin;
+
+/**
+ * Statistics about a set of coins that can be updated one coin at a time:
+ * an order-independent hash of the coins, and the running totals reported by
+ * gettxoutsetinfo. Used both for the statistics of the whole UTXO set, and
+ * for the change a single block makes to them (in which case the totals can
+ * be negative).
+ */
+class CCoinsRollingStats
+{
+public:
+    AdHash4096 hash;
+    int64_t nTransactionOutputs;
+    int64_t nBogoSize;
+    CAmount nTotalAmount;
+
+    CCoinsRollingStats() : nTransactionOutputs(0), nBogoSize(0), nTotalAmount(0) {}
+
+    void AddCoin(const COutPoint& outpoint, const Coin& coin);
+    void RemoveCoin(const COutPoint& outpoint, const Coin& coin);
+
+    CCoinsRollingStats& operator+=(const CCoinsRollingStats& other);
+
+    bool operator==(const CCoinsRollingStats& other) const
+    {
+        return hash == other.hash && nTransactionOutputs == other.nTransactionOutputs &&
+               nBogoSize == other.nBogoSize && nTotalAmount == other.nTotalAmount;
+    }
+    bool operator!=(const CCoinsRollingStats& other) const { return !(*this == other); }
+
+    /** Digest of the hash of the set, as reported by gettxoutsetinfo. */
+    uint256 GetHash() const;
+
+    /** The size gettxoutsetinfo's bogosize metric attributes to a coin. */
+    static int64_t GetBogoSize(const Coin& coin);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(hash);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nBogoSize);
+        READWRITE(nTotalAmount);
+    }
+};
+
+#endif // BITCOIN_COINSTATS_H
@@ -0,0 +1,168 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinswriter.h"
+
+#include "memusage.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <functional>
+#include <stdexcept>
+
+CCoinsViewAsyncWriter::CCoinsViewAsyncWriter(CCoinsView* viewIn) : CCoinsViewBacked(viewIn), fWriting(false), fFailed(false), fStop(false)
+{
+    threadWrite = std::thread(&TraceThread<std::function<void()> >, "coinswriter", std::function<void()>(std::bind(&CCoinsViewAsyncWriter::ThreadWrite, this)));
+}
+
+CCoinsViewAsyncWriter::~CCoinsViewAsyncWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        fStop = true;
+    }
+    cond.notify_all();
+    threadWrite.join();
+}
+
+void CCoinsViewAsyncWriter::ThreadWrite()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        cond.wait(lock, [this] { return fStop || (pending && !fWriting && !fFailed); });
+        if (!pending || fFailed) return;
+
+        // The snapshot isn't modified while it is being written, so lookups
+        // can keep using it without synchronizing with the write.
+        fWriting = true;
+        Snapshot& snapshot = *pending;
+        lock.unlock();
+
+        int64_t nStart = GetTimeMicros();
+        bool fOk = false;
+        try {
+            fOk = base->BatchWrite(snapshot.coins, snapshot.hashBlock, false);
+        } catch (const std::runtime_error& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
+        }
+        int64_t nDuration = GetTimeMicros() - nStart;
+
+        lock.lock();
+        fWriting = false;
+        if (fOk) {
+            stats.nWrites++;
+            stats.nCoinsWritten += snapshot.coins.size();
+            stats.nLastWriteMicros = nDuration;
+            stats.nTotalWriteMicros += nDuration;
+            LogPrint(BCLog::COINDB, "Wrote %u coins in the background in %.2fs\n", snapshot.coins.size(), nDuration * 0.000001);
+            pending.reset();
+        } else {
+            // Keep the snapshot, so lookups still see its contents.
+            LogPrintf("%s: Failed to write to coin database\n", __func__);
+            fFailed = true;
+        }
+        cond.notify_all();
+    }
+}
+
+void CCoinsViewAsyncWriter::WaitForPending(std::unique_lock<std::mutex>& lock) const
+{
+    if (!pending || fFailed) return;
+    int64_t nStart = GetTimeMicros();
+    cond.wait(lock, [this] { return !pending || fFailed; });
+    stats.nTotalStallMicros += GetTimeMicros() - nStart;
+}
+
+bool CCoinsViewAsyncWriter::GetCoin(const COutPoint& outpoint, Coin& coin) const
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pending) {
+            CCoinsMap::const_iterator it = pending->coins.find(outpoint);
+            if (it != pending->coins.end()) {
+                coin = it->second.coin.Expand();
+                return !coin.IsSpent();
+            }
+        }
+    }
+    // Not part of the write in progress, so the base view has the latest version.
+    return base->GetCoin(outpoint, coin);
+}
+
+bool CCoinsViewAsyncWriter::HaveCoin(const COutPoint& outpoint) const
+{
+    Coin coin;
+    return GetCoin(outpoint, coin);
+}
+
+uint256 CCoinsViewAsyncWriter::GetBestBlock() const
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pending) return pending->hashBlock;
+    }
+    return base->GetBestBlock();
+}
+
+bool CCoinsViewAsyncWriter::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, bool erase)
+{
+    std::unique_ptr<Snapshot> snapshot(new Snapshot());
+    snapshot->hashBlock = hashBlock;
+    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it = erase ? mapCoins.erase(it) : std::next(it)) {
+        if (!(it->second.flags & CCoinsCacheEntry::DIRTY)) continue;
+        CCoinsCacheEntry& entry = snapshot->coins[it->first];
+        if (erase) {
+            entry.coin = std::move(it->second.coin);
+        } else {
+            entry.coin = it->second.coin;
+        }
+        entry.flags = CCoinsCacheEntry::DIRTY;
+        snapshot->usage += entry.coin.DynamicMemoryUsage();
+    }
+    snapshot->usage += memusage::DynamicUsage(snapshot->coins);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    WaitForPending(lock);
+    if (fFailed) return false;
+    pending = std::move(snapshot);
+    lock.unlock();
+    cond.notify_all();
+    return true;
+}
+
+CCoinsViewCursor* CCoinsViewAsyncWriter::Cursor() const
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        WaitForPending(lock);
+    }
+    return base->Cursor();
+}
+
+bool CCoinsViewAsyncWriter::Wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    WaitForPending(lock);
+    return !fFailed;
+}
+
+bool CCoinsViewAsyncWriter::Failed() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return fFailed;
+}
+
+size_t CCoinsViewAsyncWriter::DynamicMemoryUsage() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return pending ? pending->usage : 0;
+}
+
+CCoinsWriterStats CCoinsViewAsyncWriter::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    CCoinsWriterStats ret = stats;
+    ret.fPending = pending != nullptr;
+    return ret;
+}
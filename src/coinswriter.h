@@ -0,0 +1,104 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COINSWRITER_H
+#define BITCOIN_COINSWRITER_H
+
+#include "coins.h"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+
+/** Counters reported by CCoinsViewAsyncWriter::GetStats(). */
+struct CCoinsWriterStats
+{
+    //! Number of completed writes.
+    uint64_t nWrites;
+    //! Number of modified coins in the completed writes.
+    uint64_t nCoinsWritten;
+    //! Duration of the last completed write.
+    int64_t nLastWriteMicros;
+    //! Total duration of all completed writes.
+    int64_t nTotalWriteMicros;
+    //! Total time callers spent waiting for a write to finish.
+    int64_t nTotalStallMicros;
+    //! Whether a write is in progress.
+    bool fPending;
+
+    CCoinsWriterStats() : nWrites(0), nCoinsWritten(0), nLastWriteMicros(0), nTotalWriteMicros(0), nTotalStallMicros(0), fPending(false) {}
+};
+
+/**
+ * CCoinsView that writes to its base view on a background thread.
+ *
+ * BatchWrite() copies the modified entries it is given and returns right
+ * away; a dedicated thread then writes the copy to the base view. Until that
+ * write has completed, lookups are answered from the copy first, so the
+ * combined state seen through this view is always the latest one written to
+ * it. At most one write is in flight: a BatchWrite() while the previous one is
+ * still running waits for it to finish.
+ *
+ * The base view must support reads concurrent with a write, as CCoinsViewDB
+ * does. A failed background write is reported by Failed(), and by all later
+ * calls to BatchWrite() and Wait().
+ */
+class CCoinsViewAsyncWriter : public CCoinsViewBacked
+{
+private:
+    //! The modified entries of one BatchWrite() call.
+    struct Snapshot {
+        CCoinsMapMemoryResource resource;
+        CCoinsMap coins;
+        uint256 hashBlock;
+        size_t usage;
+
+        Snapshot() : coins(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), CCoinsMapAllocator(&resource)), usage(0) {}
+    };
+
+    mutable std::mutex mutex;
+    mutable std::condition_variable cond;
+
+    //! The write in progress, or waiting for the thread to pick it up.
+    std::unique_ptr<Snapshot> pending;
+    //! Whether the thread is writing pending to the base view.
+    bool fWriting;
+    bool fFailed;
+    bool fStop;
+
+    mutable CCoinsWriterStats stats;
+
+    std::thread threadWrite;
+    void ThreadWrite();
+
+    //! Wait until no write is in flight. Requires mutex to be held through lock.
+    void WaitForPending(std::unique_lock<std::mutex>& lock) const;
+
+public:
+    explicit CCoinsViewAsyncWriter(CCoinsView* viewIn);
+    //! Completes the write in progress, if any.
+    ~CCoinsViewAsyncWriter();
+
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const override;
+    bool HaveCoin(const COutPoint& outpoint) const override;
+    uint256 GetBestBlock() const override;
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, bool erase = true) override;
+    //! Iterates over the base view, after waiting for the write in progress.
+    CCoinsViewCursor* Cursor() const override;
+
+    /** Wait for the write in progress to complete. Returns false if a write failed. */
+    bool Wait();
+
+    /** Whether a background write failed. */
+    bool Failed() const;
+
+    /** Memory used by the copy of the entries that are being written. */
+    size_t DynamicMemoryUsage() const;
+
+    CCoinsWriterStats GetStats() const;
+};
+
+#endif // BITCOIN_COINSWRITER_H
@@ -0,0 +1,89 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/adhash.h"
+
+#include "crypto/chacha20.h"
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+
+#include <string.h>
+
+AdHash4096::AdHash4096()
+{
+    memset(limbs, 0, sizeof(limbs));
+}
+
+void AdHash4096::SetElement(const unsigned char* data, size_t len)
+{
+    unsigned char key[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(key);
+    unsigned char bytes[BYTE_SIZE];
+    ChaCha20(key, sizeof(key)).Output(bytes, BYTE_SIZE);
+    SetBytes(bytes);
+}
+
+AdHash4096& AdHash4096::Insert(const unsigned char* data, size_t len)
+{
+    AdHash4096 element;
+    element.SetElement(data, len);
+    return *this += element;
+}
+
+AdHash4096& AdHash4096::Remove(const unsigned char* data, size_t len)
+{
+    AdHash4096 element;
+    element.SetElement(data, len);
+    return *this -= element;
+}
+
+AdHash4096& AdHash4096::operator+=(const AdHash4096& other)
+{
+    uint64_t carry = 0;
+    for (int i = 0; i < LIMBS; ++i) {
+        uint64_t sum = limbs[i] + carry;
+        carry = sum < carry;
+        limbs[i] = sum + other.limbs[i];
+        carry += limbs[i] < sum;
+    }
+    return *this;
+}
+
+AdHash4096& AdHash4096::operator-=(const AdHash4096& other)
+{
+    uint64_t borrow = 0;
+    for (int i = 0; i < LIMBS; ++i) {
+        uint64_t sub = other.limbs[i] + borrow;
+        borrow = sub < borrow;
+        borrow += limbs[i] < sub;
+        limbs[i] -= sub;
+    }
+    return *this;
+}
+
+bool AdHash4096::operator==(const AdHash4096& other) const
+{
+    return memcmp(limbs, other.limbs, sizeof(limbs)) == 0;
+}
+
+void AdHash4096::Finalize(unsigned char hash[OUTPUT_SIZE]) const
+{
+    unsigned char bytes[BYTE_SIZE];
+    GetBytes(bytes);
+    CSHA256().Write(bytes, BYTE_SIZE).Finalize(hash);
+}
+
+void AdHash4096::GetBytes(unsigned char out[BYTE_SIZE]) const
+{
+    for (int i = 0; i < LIMBS; ++i) {
+        WriteLE64(out + 8 * i, limbs[i]);
+    }
+}
+
+void AdHash4096::SetBytes(const unsigned char in[BYTE_SIZE])
+{
+    for (int i = 0; i < LIMBS; ++i) {
+        limbs[i] = ReadLE64(in + 8 * i);
+    }
+}
@@ -0,0 +1,81 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_ADHASH_H
+#define BITCOIN_CRYPTO_ADHASH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * Incremental hash of a multiset of byte strings (AdHash, Bellare-Micciancio).
+ *
+ * Every element is hashed with SHA256, the result is expanded to 4096 bits
+ * with ChaCha20, and the set hash is the sum of the expanded elements modulo
+ * 2^4096. As addition is commutative the result does not depend on the order
+ * in which elements were inserted, and an element is removed again by
+ * subtracting it, so the hash of a large set can be kept up to date at the
+ * cost of one element hash per change. Hashes of disjoint sets combine by
+ * adding them.
+ *
+ * The modulus is large enough that finding a collision with the generalized
+ * birthday attack takes about 2^128 work.
+ */
+class AdHash4096
+{
+public:
+    static const size_t OUTPUT_SIZE = 32;
+    static const size_t BYTE_SIZE = 512;
+
+private:
+    static const int LIMBS = BYTE_SIZE / 8;
+    uint64_t limbs[LIMBS];
+
+    //! Set this to the expanded hash of a single element.
+    void SetElement(const unsigned char* data, size_t len);
+
+public:
+    /** The hash of the empty set. */
+    AdHash4096();
+
+    /** Add an element to the set. */
+    AdHash4096& Insert(const unsigned char* data, size_t len);
+
+    /** Remove an element from the set. Removing an element that isn't present is not detected. */
+    AdHash4096& Remove(const unsigned char* data, size_t len);
+
+    /** Combine with the hash of another set, giving the hash of the multiset union. */
+    AdHash4096& operator+=(const AdHash4096& other);
+
+    /** Undo a previous operator+=. */
+    AdHash4096& operator-=(const AdHash4096& other);
+
+    bool operator==(const AdHash4096& other) const;
+    bool operator!=(const AdHash4096& other) const { return !(*this == other); }
+
+    /** Write a 32-byte digest of the set. */
+    void Finalize(unsigned char hash[OUTPUT_SIZE]) const;
+
+    /** Raw state, for serialization. */
+    void GetBytes(unsigned char out[BYTE_SIZE]) const;
+    void SetBytes(const unsigned char in[BYTE_SIZE]);
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        unsigned char bytes[BYTE_SIZE];
+        GetBytes(bytes);
+        s.write((const char*)bytes, BYTE_SIZE);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s)
+    {
+        unsigned char bytes[BYTE_SIZE];
+        s.read((char*)bytes, BYTE_SIZE);
+        SetBytes(bytes);
+    }
+};
+
+#endif // BITCOIN_CRYPTO_ADHASH_H
@@ -19,6 +19,27 @@ void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
 #endif
 #endif
 
+#if defined(ENABLE_SHANI) && !defined(BUILD_BITCOIN_INTERNAL)
+namespace sha256_shani
+{
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
+}
+#endif
+
+#if defined(ENABLE_SSE41) && !defined(BUILD_BITCOIN_INTERNAL)
+namespace sha256d64_sse41
+{
+void Transform_4way(unsigned char* out, const unsigned char* in);
+}
+#endif
+
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+namespace sha256d64_avx2
+{
+void Transform_8way(unsigned char* out, const unsigned char* in);
+}
+#endif
+
 // Internal implementation code.
 namespace
 {
@@ -144,8 +165,43 @@ void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
 } // namespace sha256
 
 typedef void (*TransformType)(uint32_t*, const unsigned char*, size_t);
+typedef void (*TransformD64Type)(unsigned char*, const unsigned char*);
 
-bool SelfTest(TransformType tr) {
+/** Compute the double-SHA256 of a single 64-byte input, using a block transform. */
+template<TransformType tr>
+void TransformD64Wrapper(unsigned char* out, const unsigned char* in)
+{
+    // Padding block for a 64-byte (512-bit) message.
+    static const unsigned char padding1[64] = {
+        0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0
+    };
+    // Padding for a 32-byte (256-bit) message, following the message itself.
+    static const unsigned char padding2[32] = {
+        0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0
+    };
+    uint32_t s[8];
+    unsigned char buffer2[64];
+    sha256::Initialize(s);
+    tr(s, in, 1);
+    tr(s, padding1, 1);
+    for (int i = 0; i < 8; ++i) {
+        WriteBE32(buffer2 + 4 * i, s[i]);
+    }
+    memcpy(buffer2 + 32, padding2, 32);
+    sha256::Initialize(s);
+    tr(s, buffer2, 1);
+    for (int i = 0; i < 8; ++i) {
+        WriteBE32(out + 4 * i, s[i]);
+    }
+}
+
+TransformType Transform = sha256::Transform;
+TransformD64Type TransformD64 = TransformD64Wrapper<sha256::Transform>;
+TransformD64Type TransformD64_4way = nullptr;
+TransformD64Type TransformD64_8way = nullptr;
+
+bool SelfTest() {
     static const unsigned char in1[65] = {0, 0x80};
     static const unsigned char in2[129] = {
         0,
@@ -157,38 +213,163 @@ bool SelfTest(TransformType tr) {
     static const uint32_t init[8] = {0x6a09e667ul, 0xbb67ae85ul, 0x3c6ef372ul, 0xa54ff53aul, 0x510e527ful, 0x9b05688cul, 0x1f83d9abul, 0x5be0cd19ul};
     static const uint32_t out1[8] = {0xe3b0c442ul, 0x98fc1c14ul, 0x9afbf4c8ul, 0x996fb924ul, 0x27ae41e4ul, 0x649b934cul, 0xa495991bul, 0x7852b855ul};
     static const uint32_t out2[8] = {0xce4153b0ul, 0x147c2a86ul, 0x3ed4298eul, 0xe0676bc8ul, 0x79fc77a1ul, 0x2abe1f49ul, 0xb2b055dful, 0x1069523eul};
+    static const unsigned char in3[513] = {
+        0x5c, 0x86, 0xd0, 0xe4, 0x50, 0xe3, 0x8c, 0xa8, 0x85, 0xce, 0xfb, 0xd8, 0xc3, 0x16, 0x42, 0x0f,
+        0x9d, 0xea, 0x03, 0x8f, 0xca, 0x51, 0xfb, 0xf9, 0x11, 0xd4, 0xfa, 0x6f, 0xe2, 0x9b, 0x99, 0x1a,
+        0x7b, 0xf4, 0xe8, 0x44, 0x18, 0x24, 0xe1, 0xa5, 0xed, 0x51, 0xc3, 0xfb, 0x6f, 0x82, 0x33, 0x47,
+        0x9f, 0xf5, 0xa4, 0xac, 0xb3, 0xcc, 0xc0, 0x2a, 0xf9, 0xb8, 0x75, 0x86, 0x38, 0xab, 0x3f, 0x4b,
+        0xa6, 0xfe, 0xb1, 0x66, 0x18, 0xc7, 0x53, 0x4d, 0xbb, 0xea, 0xf7, 0x56, 0xa7, 0x61, 0x28, 0x3d,
+        0x61, 0x70, 0xac, 0xa5, 0x6a, 0x49, 0xde, 0x04, 0x47, 0xc4, 0xb4, 0x07, 0x6e, 0x0d, 0xfc, 0x25,
+        0x05, 0xc6, 0x47, 0xe7, 0xfb, 0xac, 0x89, 0x08, 0x5c, 0x1f, 0xd4, 0xe4, 0x92, 0xcb, 0x50, 0xad,
+        0xea, 0xfd, 0x33, 0x4f, 0x5e, 0x93, 0xea, 0xd0, 0x3a, 0xd9, 0xf0, 0x5a, 0x51, 0x3d, 0x14, 0xeb,
+        0x03, 0xeb, 0xee, 0x0f, 0xb6, 0x39, 0x1e, 0xfa, 0xb9, 0xa0, 0xe3, 0xe8, 0xe6, 0x05, 0xa0, 0x70,
+        0xec, 0xd7, 0xf9, 0x5b, 0x5a, 0x30, 0x75, 0x00, 0xff, 0xbe, 0x82, 0x1e, 0x1e, 0xd2, 0x5d, 0x8c,
+        0x6a, 0xa1, 0xc7, 0x25, 0xcc, 0xe4, 0xf8, 0x64, 0x3a, 0xbe, 0x4d, 0xf5, 0xa3, 0xa9, 0x02, 0xe5,
+        0x5a, 0xc9, 0x34, 0x81, 0x0e, 0xa5, 0xe7, 0x85, 0x2b, 0x4b, 0x96, 0xaa, 0x4d, 0x53, 0xc7, 0xab,
+        0x42, 0x75, 0xf0, 0x5e, 0x6d, 0x23, 0xbf, 0xa8, 0x52, 0x39, 0xdf, 0x0a, 0xf4, 0x78, 0x58, 0xc7,
+        0x3b, 0x48, 0xb0, 0x6c, 0x74, 0xd2, 0xdc, 0x9b, 0x38, 0xcd, 0x8f, 0x1c, 0xa6, 0x65, 0x7d, 0x9e,
+        0xe1, 0x25, 0x84, 0xb4, 0xf3, 0x87, 0x59, 0x92, 0xcd, 0x7b, 0xf8, 0xe7, 0x09, 0x0c, 0x37, 0x8d,
+        0x4c, 0xf2, 0xc7, 0x77, 0xff, 0xab, 0x80, 0xba, 0xea, 0x3f, 0x22, 0x52, 0xb2, 0x3a, 0x7c, 0x93,
+        0x47, 0xeb, 0x27, 0xbe, 0x68, 0xdd, 0xe4, 0xba, 0x79, 0xd9, 0x81, 0x6b, 0xe1, 0x8d, 0x64, 0x70,
+        0x27, 0x4c, 0x29, 0x07, 0x9b, 0x5f, 0x2b, 0x45, 0x60, 0xb8, 0xe4, 0xf0, 0x0a, 0xe4, 0x8d, 0x4a,
+        0x2a, 0x2c, 0x3d, 0x36, 0xcf, 0x38, 0x06, 0x8b, 0xbb, 0xda, 0x1a, 0xc9, 0xc1, 0x1c, 0xec, 0x0d,
+        0x93, 0x65, 0x22, 0xef, 0xe0, 0x86, 0xe2, 0xed, 0x91, 0xc1, 0x31, 0x03, 0x22, 0x04, 0x0f, 0x88,
+        0xfd, 0x64, 0x36, 0xec, 0xe3, 0x6c, 0xcd, 0x7a, 0xf5, 0xbc, 0x37, 0x82, 0xb8, 0xe0, 0xd6, 0x68,
+        0x56, 0x36, 0x51, 0xa1, 0x89, 0x2a, 0xe6, 0xa4, 0xb6, 0x0a, 0x65, 0xaf, 0xc7, 0x98, 0x42, 0xe9,
+        0x50, 0xb3, 0xc1, 0x0e, 0xbc, 0x4a, 0xed, 0x1d, 0x79, 0x91, 0x87, 0x47, 0x4e, 0xcf, 0x58, 0xc7,
+        0xf8, 0x94, 0x8c, 0x78, 0xd3, 0xee, 0xbd, 0x63, 0xa3, 0x6c, 0x4d, 0x5c, 0x89, 0xbf, 0x2b, 0x4e,
+        0x68, 0x28, 0x47, 0x9c, 0xbc, 0xd6, 0x07, 0x47, 0xa5, 0x5f, 0x29, 0x76, 0xe0, 0xbe, 0xc4, 0xd4,
+        0x57, 0xa8, 0xe8, 0x41, 0x2d, 0x13, 0x42, 0xbe, 0xf2, 0x76, 0x0d, 0xf6, 0xa1, 0x9e, 0x1e, 0x60,
+        0x9c, 0xb1, 0xdc, 0xfd, 0x06, 0x8f, 0xd3, 0x5c, 0xfa, 0xd0, 0x8a, 0xb2, 0x5c, 0xfb, 0x33, 0x54,
+        0xf5, 0x41, 0xaf, 0x93, 0x01, 0xdc, 0x0c, 0xf9, 0x74, 0xfc, 0x55, 0x34, 0xff, 0x77, 0x3d, 0x94,
+        0x0e, 0x4a, 0x65, 0x50, 0x0f, 0x53, 0x17, 0xf8, 0x7d, 0x5f, 0x5b, 0xfd, 0xaa, 0x89, 0x40, 0xe2,
+        0x7f, 0x22, 0xdc, 0x78, 0x1b, 0xd3, 0xed, 0x70, 0x4c, 0xcc, 0xc7, 0x8b, 0x2b, 0x9a, 0x0d, 0x54,
+        0x9f, 0xeb, 0x85, 0x22, 0x0a, 0xc3, 0x28, 0x64, 0x25, 0x48, 0x09, 0xe4, 0xc9, 0x1d, 0xe5, 0x61,
+        0x88, 0xce, 0x05, 0x94, 0x3e, 0x35, 0xa3, 0x80, 0x20, 0x60, 0x8b, 0x43, 0xb0, 0x7d, 0x6b, 0x37,
+        0xf2,
+    };
+    static const unsigned char out3[256] = {
+        0x53, 0x41, 0x6c, 0x1f, 0x43, 0x33, 0x0f, 0x14, 0xf6, 0x5b, 0x25, 0x41, 0xa9, 0x15, 0xf6, 0xe3,
+        0xbb, 0x76, 0xda, 0xdc, 0x68, 0x5f, 0xc4, 0x1e, 0x9b, 0x3f, 0x7b, 0x43, 0xa9, 0x22, 0xe9, 0xa6,
+        0xee, 0xa0, 0x9a, 0xee, 0x9f, 0xb4, 0x9d, 0xfb, 0x1a, 0x68, 0x7c, 0xcf, 0x99, 0xa5, 0x00, 0xad,
+        0x90, 0x4c, 0x3d, 0x87, 0xd6, 0xa5, 0x88, 0x25, 0xe5, 0x26, 0x1f, 0xa7, 0xef, 0x85, 0x37, 0x71,
+        0x14, 0xb6, 0xad, 0x15, 0x54, 0x44, 0xfd, 0x9e, 0xbf, 0x35, 0x49, 0x9d, 0x0d, 0x81, 0x69, 0xa8,
+        0xaf, 0x40, 0x3a, 0x50, 0xe6, 0xda, 0xb9, 0x9d, 0xa3, 0x10, 0xf8, 0x6c, 0xd8, 0xc8, 0xab, 0x8e,
+        0xaa, 0x57, 0x9c, 0xd8, 0x57, 0x73, 0x56, 0x07, 0xed, 0xa6, 0x3b, 0x31, 0xe5, 0x9b, 0x70, 0xcb,
+        0x0a, 0x5b, 0x39, 0x29, 0x0d, 0x16, 0xed, 0x75, 0xfc, 0x2b, 0x5c, 0x29, 0x7a, 0xd7, 0x01, 0x8e,
+        0xeb, 0xae, 0x7f, 0x9c, 0xca, 0x0b, 0x88, 0x4c, 0xbc, 0x73, 0x18, 0x3f, 0x76, 0xee, 0x69, 0x01,
+        0x13, 0xd7, 0xe6, 0x75, 0x25, 0x58, 0x33, 0x6b, 0xab, 0x2c, 0x6d, 0xab, 0x18, 0x49, 0x60, 0x7f,
+        0x70, 0x5f, 0x20, 0x03, 0xaf, 0x0c, 0x66, 0xf2, 0x41, 0xa2, 0xa6, 0x7f, 0xaf, 0x03, 0x30, 0xe7,
+        0xf8, 0x20, 0xbe, 0xca, 0x24, 0x6c, 0x38, 0xb7, 0xf7, 0x85, 0x40, 0x2d, 0xa2, 0x8a, 0xac, 0x3d,
+        0x36, 0x9b, 0xd2, 0xcc, 0x86, 0xe0, 0xf1, 0xdb, 0xcf, 0xf4, 0x94, 0x4b, 0xb4, 0xc2, 0x1d, 0x51,
+        0x56, 0x2e, 0xbe, 0xb6, 0x15, 0x6b, 0x2f, 0xd3, 0x8a, 0x31, 0xcf, 0xd1, 0xb2, 0x83, 0x35, 0x24,
+        0x67, 0x83, 0x91, 0x85, 0x38, 0xc2, 0x1b, 0x29, 0x2b, 0x7f, 0x3d, 0x2b, 0xec, 0x48, 0xfa, 0xab,
+        0x9d, 0xaf, 0x8e, 0xff, 0xb1, 0xdc, 0x2c, 0x7a, 0x66, 0x78, 0xe0, 0x38, 0xdb, 0xe3, 0xf8, 0xb9,
+    };
     uint32_t buf[8];
     memcpy(buf, init, sizeof(buf));
     // Process nothing, and check we remain in the initial state.
-    tr(buf, nullptr, 0);
+    Transform(buf, nullptr, 0);
     if (memcmp(buf, init, sizeof(buf))) return false;
     // Process the padded empty string (unaligned)
-    tr(buf, in1 + 1, 1);
+    Transform(buf, in1 + 1, 1);
     if (memcmp(buf, out1, sizeof(buf))) return false;
     // Process 64 spaces (unaligned)
     memcpy(buf, init, sizeof(buf));
-    tr(buf, in2 + 1, 2);
+    Transform(buf, in2 + 1, 2);
     if (memcmp(buf, out2, sizeof(buf))) return false;
+    // Double-SHA256 of a single 64-byte input (unaligned)
+    unsigned char out[256];
+    TransformD64(out, in3 + 1);
+    if (memcmp(out, out3, 32)) return false;
+    // 4-way and 8-way double-SHA256 of 64-byte inputs (unaligned)
+    if (TransformD64_4way) {
+        TransformD64_4way(out, in3 + 1);
+        if (memcmp(out, out3, 128)) return false;
+    }
+    if (TransformD64_8way) {
+        TransformD64_8way(out, in3 + 1);
+        if (memcmp(out, out3, 256)) return false;
+    }
     return true;
 }
 
-TransformType Transform = sha256::Transform;
+#if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__))
+/** Check whether the OS has enabled AVX registers. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
 
 } // namespace
 
 std::string SHA256AutoDetect()
 {
+    std::string ret = "standard";
 #if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__))
+    bool have_sse4 = false;
+    bool have_xsave = false;
+    bool have_avx = false;
+    bool have_avx2 = false;
+    bool have_shani = false;
+    bool enabled_avx = false;
+
+    // Silence unused warnings when some of the implementations are not built.
+    (void)have_avx2;
+    (void)have_shani;
+    (void)enabled_avx;
+
     uint32_t eax, ebx, ecx, edx;
-    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx >> 19) & 1) {
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        have_sse4 = (ecx >> 19) & 1;
+        have_xsave = (ecx >> 27) & 1;
+        have_avx = (ecx >> 28) & 1;
+    }
+    if (have_xsave && have_avx) {
+        enabled_avx = AVXEnabled();
+    }
+    if (__get_cpuid_max(0, nullptr) >= 7) {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        have_avx2 = (ebx >> 5) & 1;
+        have_shani = (ebx >> 29) & 1;
+    }
+
+#if defined(ENABLE_SHANI) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (have_shani && have_sse4) {
+        // The SHA extensions outperform the multi-lane SSE4.1 and AVX2 kernels
+        // for 64-byte double hashes too, so those are not used alongside them.
+        Transform = sha256_shani::Transform;
+        TransformD64 = TransformD64Wrapper<sha256_shani::Transform>;
+        ret = "shani(1way)";
+        have_sse4 = false;
+        have_avx2 = false;
+    }
+#endif
+
+    if (have_sse4) {
         Transform = sha256_sse4::Transform;
-        assert(SelfTest(Transform));
-        return "sse4";
+        TransformD64 = TransformD64Wrapper<sha256_sse4::Transform>;
+        ret = "sse4(1way)";
+#if defined(ENABLE_SSE41) && !defined(BUILD_BITCOIN_INTERNAL)
+        TransformD64_4way = sha256d64_sse41::Transform_4way;
+        ret += ",sse41(4way)";
+#endif
     }
+
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+    // AVX2 requires both CPU support and OS support for saving the YMM registers.
+    if (have_avx2 && have_avx && enabled_avx) {
+        TransformD64_8way = sha256d64_avx2::Transform_8way;
+        ret += ",avx2(8way)";
+    }
+#endif
 #endif
 
-    assert(SelfTest(Transform));
-    return "standard";
+    assert(SelfTest());
+    return ret;
 }
 
 ////// SHA-256
@@ -247,3 +428,29 @@ CSHA256& CSHA256::Reset()
     sha256::Initialize(s);
     return *this;
 }
+
+void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks)
+{
+    if (TransformD64_8way) {
+        while (blocks >= 8) {
+            TransformD64_8way(out, in);
+            out += 256;
+            in += 512;
+            blocks -= 8;
+        }
+    }
+    if (TransformD64_4way) {
+        while (blocks >= 4) {
+            TransformD64_4way(out, in);
+            out += 128;
+            in += 256;
+            blocks -= 4;
+        }
+    }
+    while (blocks) {
+        TransformD64(out, in);
+        out += 32;
+        in += 64;
+        --blocks;
+    }
+}
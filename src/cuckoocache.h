@@ -475,6 +475,22 @@ public:
             }
         return false;
     }
+
+    /** for_each calls f on every element in the table that is not marked
+     * for garbage collection, in table order.
+     *
+     * Elements that are inserted or erased concurrently may or may not be
+     * visited.
+     *
+     * @param f a function taking a const Element&
+     */
+    template <typename F>
+    void for_each(F f) const
+    {
+        for (uint32_t i = 0; i < size; ++i)
+            if (!collection_flags.bit_is_set(i))
+                f(table[i]);
+    }
 };
 } // namespace CuckooCache
 
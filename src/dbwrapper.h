@@ -13,6 +13,8 @@
 #include "utilstrencodings.h"
 #include "version.h"
 
+#include <memory>
+
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
@@ -221,16 +223,22 @@ public:
     CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
     ~CDBWrapper();
 
+    /**
+     * @param[in] snapshot    If not null, read the value as of this snapshot
+     *                        (see GetSnapshot()).
+     */
     template <typename K, typename V>
-    bool Read(const K& key, V& value) const
+    bool Read(const K& key, V& value, const leveldb::Snapshot* snapshot = nullptr) const
     {
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
         ssKey << key;
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
 
+        leveldb::ReadOptions options = readoptions;
+        options.snapshot = snapshot;
         std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        leveldb::Status status = pdb->Get(options, slKey, &strValue);
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -296,9 +304,27 @@ public:
         return WriteBatch(batch, true);
     }
 
-    CDBIterator *NewIterator()
+    /**
+     * @param[in] snapshot    If not null, iterate over the database as of this
+     *                        snapshot (see GetSnapshot()).
+     */
+    CDBIterator *NewIterator(const leveldb::Snapshot* snapshot = nullptr)
+    {
+        leveldb::ReadOptions options = iteroptions;
+        options.snapshot = snapshot;
+        return new CDBIterator(*this, pdb->NewIterator(options));
+    }
+
+    /**
+     * Take a snapshot of the current state of the database, so that several
+     * reads or iterators see the same state regardless of later writes. The
+     * snapshot is released when the last copy of the returned pointer is
+     * destroyed, which must happen before the database is closed.
+     */
+    std::shared_ptr<const leveldb::Snapshot> GetSnapshot() const
     {
-        return new CDBIterator(*this, pdb->NewIterator(iteroptions));
+        leveldb::DB* db = pdb;
+        return std::shared_ptr<const leveldb::Snapshot>(pdb->GetSnapshot(), [db](const leveldb::Snapshot* snapshot) { db->ReleaseSnapshot(snapshot); });
     }
 
     /**
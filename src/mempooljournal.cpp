@@ -0,0 +1,170 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "mempooljournal.h"
+
+#include "clientversion.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <boost/bind.hpp>
+
+CMempoolJournal::CMempoolJournal(CTxMemPool& poolIn, const fs::path& pathIn, uint64_t nSeqIn) :
+    pool(poolIn), path(pathIn), nSeq(nSeqIn), nSize(0), fCompacting(false)
+{
+    file = fsbridge::fopen(path, "ab");
+    if (file) {
+        fseek(file, 0, SEEK_END);
+        nSize = ftell(file);
+    } else {
+        LogPrintf("Failed to open mempool journal %s, mempool changes are not journaled\n", path.string());
+    }
+    pool.NotifyEntryAdded.connect(boost::bind(&CMempoolJournal::TransactionAdded, this, _1));
+    pool.NotifyEntryRemoved.connect(boost::bind(&CMempoolJournal::TransactionRemoved, this, _1, _2));
+}
+
+CMempoolJournal::~CMempoolJournal()
+{
+    pool.NotifyEntryAdded.disconnect(boost::bind(&CMempoolJournal::TransactionAdded, this, _1));
+    pool.NotifyEntryRemoved.disconnect(boost::bind(&CMempoolJournal::TransactionRemoved, this, _1, _2));
+    Flush();
+    if (file)
+        fclose(file);
+}
+
+void CMempoolJournal::TransactionAdded(CTransactionRef tx)
+{
+    Record record;
+    record.nType = ADDED;
+    record.tx = std::move(tx);
+    record.nTime = GetTime();
+    LOCK(cs);
+    Append(record);
+}
+
+void CMempoolJournal::TransactionRemoved(CTransactionRef tx, MemPoolRemovalReason reason)
+{
+    Record record;
+    record.nType = REMOVED;
+    record.txid = tx->GetHash();
+    record.nReason = (uint8_t)reason;
+    LOCK(cs);
+    Append(record);
+}
+
+void CMempoolJournal::Append(Record& record)
+{
+    AssertLockHeld(cs);
+    record.nSeq = ++nSeq;
+    if (fCompacting)
+        vCompacting.push_back(record);
+    if (!file)
+        return;
+
+    const size_t nBufferSize = vBuffer.size();
+    CVectorWriter(SER_DISK, CLIENT_VERSION, vBuffer, nBufferSize, record);
+    nSize += vBuffer.size() - nBufferSize;
+    if (vBuffer.size() >= MAX_BUFFER_SIZE)
+        WriteBuffer();
+}
+
+void CMempoolJournal::WriteBuffer()
+{
+    AssertLockHeld(cs);
+    if (!file || vBuffer.empty())
+        return;
+    if (fwrite(vBuffer.data(), 1, vBuffer.size(), file) != vBuffer.size() || fflush(file) != 0) {
+        LogPrintf("Failed to write to mempool journal %s, mempool changes are not journaled\n", path.string());
+        fclose(file);
+        file = nullptr;
+    }
+    vBuffer.clear();
+}
+
+void CMempoolJournal::Flush()
+{
+    LOCK(cs);
+    WriteBuffer();
+}
+
+uint64_t CMempoolJournal::BeginCompaction()
+{
+    AssertLockHeld(pool.cs);
+    LOCK(cs);
+    fCompacting = true;
+    vCompacting.clear();
+    return nSeq;
+}
+
+bool CMempoolJournal::EndCompaction(bool fDumped)
+{
+    LOCK(cs);
+    std::vector<Record> vRecords;
+    vRecords.swap(vCompacting);
+    fCompacting = false;
+    if (!fDumped)
+        return true;
+
+    fs::path pathNew = path;
+    pathNew += ".new";
+    try {
+        CAutoFile fileNew(fsbridge::fopen(pathNew, "wb"), SER_DISK, CLIENT_VERSION);
+        if (fileNew.IsNull())
+            return false;
+        for (const Record& record : vRecords) {
+            fileNew << record;
+        }
+        FileCommit(fileNew.Get());
+        fileNew.fclose();
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to compact mempool journal: %s\n", e.what());
+        return false;
+    }
+
+    // The buffered records are either in the dump, or in the new journal.
+    vBuffer.clear();
+    if (file)
+        fclose(file);
+    file = nullptr;
+    if (!RenameOver(pathNew, path)) {
+        LogPrintf("Failed to replace mempool journal %s, mempool changes are not journaled\n", path.string());
+        return false;
+    }
+    file = fsbridge::fopen(path, "ab");
+    if (!file) {
+        LogPrintf("Failed to open mempool journal %s, mempool changes are not journaled\n", path.string());
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    nSize = ftell(file);
+    return true;
+}
+
+uint64_t CMempoolJournal::GetSize()
+{
+    LOCK(cs);
+    return nSize;
+}
+
+bool CMempoolJournal::Read(const fs::path& path, std::vector<Record>& records)
+{
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        return false;
+    while (true) {
+        Record record;
+        try {
+            file >> record;
+        } catch (const std::exception&) {
+            // The end of the journal, or a record cut short by a crash.
+            break;
+        }
+        if (record.nType != ADDED && record.nType != REMOVED)
+            break;
+        records.push_back(std::move(record));
+    }
+    return true;
+}
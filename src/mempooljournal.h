@@ -0,0 +1,114 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_MEMPOOLJOURNAL_H
+#define BITCOIN_MEMPOOLJOURNAL_H
+
+#include "fs.h"
+#include "primitives/transaction.h"
+#include "serialize.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+class CTxMemPool;
+enum class MemPoolRemovalReason;
+
+/**
+ * Append-only journal of the transactions added to and removed from the
+ * mempool since it was last dumped to mempool.dat, so that they are not lost
+ * when the node does not shut down cleanly.
+ *
+ * Records are numbered, and mempool.dat holds the number of the last record
+ * it includes. When the mempool is dumped, the records written in the
+ * meantime are also kept in memory, and once mempool.dat is written the
+ * journal is replaced by these alone. Whichever mempool.dat is on disk, the
+ * journal holds every record after it.
+ *
+ * Records are buffered in memory, since they are appended with the mempool
+ * lock held, and written out together by Flush(), or once MAX_BUFFER_SIZE
+ * bytes are pending. A crash loses the records since the last write.
+ */
+class CMempoolJournal
+{
+public:
+    enum Type : uint8_t {
+        ADDED = 1,
+        REMOVED = 2,
+    };
+
+    struct Record
+    {
+        uint8_t nType = ADDED;
+        uint64_t nSeq = 0;
+        //! For ADDED, the transaction and when it was added
+        CTransactionRef tx;
+        int64_t nTime = 0;
+        //! For REMOVED, the txid and the MemPoolRemovalReason
+        uint256 txid;
+        uint8_t nReason = 0;
+
+        ADD_SERIALIZE_METHODS;
+
+        template <typename Stream, typename Operation>
+        inline void SerializationOp(Stream& s, Operation ser_action) {
+            READWRITE(nType);
+            READWRITE(nSeq);
+            if (nType == ADDED) {
+                READWRITE(tx);
+                READWRITE(nTime);
+            } else {
+                READWRITE(txid);
+                READWRITE(nReason);
+            }
+        }
+    };
+
+private:
+    //! Pending bytes at which Append writes the buffer out itself
+    static const size_t MAX_BUFFER_SIZE = 1 << 20;
+
+    CTxMemPool& pool;
+    const fs::path path;
+
+    CCriticalSection cs;
+    FILE* file;
+    uint64_t nSeq;
+    //! Bytes in the journal, including the buffered records
+    uint64_t nSize;
+    std::vector<unsigned char> vBuffer;
+    bool fCompacting;
+    std::vector<Record> vCompacting;
+
+    void TransactionAdded(CTransactionRef tx);
+    void TransactionRemoved(CTransactionRef tx, MemPoolRemovalReason reason);
+    void Append(Record& record);
+    void WriteBuffer();
+
+public:
+    /** Append to the journal at pathIn, numbering records after nSeqIn */
+    CMempoolJournal(CTxMemPool& poolIn, const fs::path& pathIn, uint64_t nSeqIn);
+    ~CMempoolJournal();
+
+    /**
+     * Start keeping new records in memory for the journal that will replace
+     * this one. Called with pool.cs held while the mempool is copied for a
+     * dump, and returns the number of the last record the dump includes.
+     */
+    uint64_t BeginCompaction();
+    /** Replace the journal with the records since BeginCompaction if the dump was written, and stop keeping them */
+    bool EndCompaction(bool fDumped);
+    /** Write the buffered records to disk */
+    void Flush();
+    /** Size of the journal, in bytes */
+    uint64_t GetSize();
+
+    /** Read the records of the journal at path, up to its end or to a record that was not fully written */
+    static bool Read(const fs::path& path, std::vector<Record>& records);
+};
+
+#endif // BITCOIN_MEMPOOLJOURNAL_H
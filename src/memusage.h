@@ -6,6 +6,7 @@
 #define BITCOIN_MEMUSAGE_H
 
 #include "indirectmap.h"
+#include "support/allocators/pool.h"
 
 #include <stdlib.h>
 
@@ -164,6 +165,26 @@ static inline size_t DynamicUsage(const std::unordered_map<X, Y, Z>& m)
     return MallocUsage(sizeof(unordered_node<std::pair<const X, Y> >)) * m.size() + MallocUsage(sizeof(void*) * m.bucket_count());
 }
 
+template<typename X, typename Y, typename Z, typename P, size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES>
+static inline size_t DynamicUsage(const std::unordered_map<X, Y, Z, P, PoolAllocator<std::pair<const X, Y>, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> >& m)
+{
+    const auto* resource = m.get_allocator().resource();
+    if (!resource) {
+        return MallocUsage(sizeof(unordered_node<std::pair<const X, Y> >)) * m.size() + MallocUsage(sizeof(void*) * m.bucket_count());
+    }
+    // Nodes live in the resource's chunks. Memory in them that was freed is
+    // not counted, as it is reused for the next nodes before the pool grows
+    // again. Chunks are multiples of 16 bytes, for which MallocUsage only adds
+    // a fixed per-allocation overhead.
+    size_t usage_chunks = resource->AllocatedBytes() - resource->UnusedBytes() + resource->NumAllocatedChunks() * (MallocUsage(16) - 16);
+    size_t usage_chunk_list = MallocUsage(sizeof(void*) * resource->NumAllocatedChunks());
+    // The bucket array is allocated through the pool as well, and is in the
+    // chunks already unless it is too large to be pooled.
+    const size_t bucket_bytes = sizeof(void*) * m.bucket_count();
+    size_t usage_buckets = bucket_bytes > MAX_BLOCK_SIZE_BYTES ? MallocUsage(bucket_bytes) : 0;
+    return usage_chunks + usage_chunk_list + usage_buckets;
+}
+
 }
 
 #endif // BITCOIN_MEMUSAGE_H
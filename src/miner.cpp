@@ -31,6 +31,8 @@
 #include <queue>
 #include <utility>
 
+#include <boost/bind.hpp>
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // BitcoinMiner
@@ -45,6 +47,8 @@
 uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockWeight = 0;
 
+std::unique_ptr<CBlockTemplateEngine> g_blocktemplates;
+
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev)
 {
     int64_t nOldTime = pblock->nTime;
@@ -97,13 +101,43 @@ void BlockAssembler::resetBlock()
     inBlock.clear();
 
     // Reserve space for coinbase tx
-    nBlockWeight = 4000;
+    nBlockWeight = COINBASE_RESERVED_WEIGHT;
     nBlockSigOpsCost = 400;
     fIncludeWitness = false;
 
     // These counters do not include coinbase tx
     nBlockTx = 0;
     nFees = 0;
+
+    fBlockFull = false;
+    minPackageFeeRate = CFeeRate(MAX_MONEY);
+}
+
+// Add the coinbase transaction paying nFees and the subsidy to
+// scriptPubKeyIn, and fill in the rest of the header.
+static void FinishBlock(CBlockTemplate& blocktemplate, const CScript& scriptPubKeyIn, const CBlockIndex* pindexPrev, CAmount nFees, const CChainParams& chainparams)
+{
+    CBlock* pblock = &blocktemplate.block;
+    const int nHeight = pindexPrev->nHeight + 1;
+
+    // Create coinbase transaction.
+    CMutableTransaction coinbaseTx;
+    coinbaseTx.vin.resize(1);
+    coinbaseTx.vin[0].prevout.SetNull();
+    coinbaseTx.vout.resize(1);
+    coinbaseTx.vout[0].scriptPubKey = scriptPubKeyIn;
+    coinbaseTx.vout[0].nValue = nFees + GetBlockSubsidy(nHeight, chainparams.GetConsensus());
+    coinbaseTx.vin[0].scriptSig = CScript() << nHeight << OP_0;
+    pblock->vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
+    blocktemplate.vchCoinbaseCommitment = GenerateCoinbaseCommitment(*pblock, pindexPrev, chainparams.GetConsensus());
+    blocktemplate.vTxFees[0] = -nFees;
+
+    // Fill in header
+    pblock->hashPrevBlock  = pindexPrev->GetBlockHash();
+    UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev);
+    pblock->nBits          = GetNextWorkRequired(pindexPrev, pblock, chainparams.GetConsensus());
+    pblock->nNonce         = 0;
+    blocktemplate.vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*pblock->vtx[0]);
 }
 
 std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx)
@@ -158,27 +192,10 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     nLastBlockTx = nBlockTx;
     nLastBlockWeight = nBlockWeight;
 
-    // Create coinbase transaction.
-    CMutableTransaction coinbaseTx;
-    coinbaseTx.vin.resize(1);
-    coinbaseTx.vin[0].prevout.SetNull();
-    coinbaseTx.vout.resize(1);
-    coinbaseTx.vout[0].scriptPubKey = scriptPubKeyIn;
-    coinbaseTx.vout[0].nValue = nFees + GetBlockSubsidy(nHeight, chainparams.GetConsensus());
-    coinbaseTx.vin[0].scriptSig = CScript() << nHeight << OP_0;
-    pblock->vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
-    pblocktemplate->vchCoinbaseCommitment = GenerateCoinbaseCommitment(*pblock, pindexPrev, chainparams.GetConsensus());
-    pblocktemplate->vTxFees[0] = -nFees;
+    FinishBlock(*pblocktemplate, scriptPubKeyIn, pindexPrev, nFees, chainparams);
 
     LogPrintf("CreateNewBlock(): block weight: %u txs: %u fees: %ld sigops %d\n", GetBlockWeight(*pblock), nBlockTx, nFees, nBlockSigOpsCost);
 
-    // Fill in header
-    pblock->hashPrevBlock  = pindexPrev->GetBlockHash();
-    UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev);
-    pblock->nBits          = GetNextWorkRequired(pindexPrev, pblock, chainparams.GetConsensus());
-    pblock->nNonce         = 0;
-    pblocktemplate->vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*pblock->vtx[0]);
-
     CValidationState state;
     if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
         throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
@@ -385,6 +402,7 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
         }
 
         if (!TestPackage(packageSize, packageSigOpsCost)) {
+            fBlockFull = true;
             if (fUsingModified) {
                 // Since we always look at the best entry in mapModifiedTx,
                 // we must erase failed entries so that we can consider the
@@ -434,12 +452,239 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
         }
 
         ++nPackagesSelected;
+        minPackageFeeRate = std::min(minPackageFeeRate, CFeeRate(packageFees, packageSize));
 
         // Update transactions that depend on each of these
         nDescendantsUpdated += UpdatePackagesForAdded(ancestors, mapModifiedTx);
     }
 }
 
+CBlockTemplateEngine::CBlockTemplateEngine(const CChainParams& params) : chainparams(params)
+{
+    Reset();
+    mempool.NotifyEntryAdded.connect(boost::bind(&CBlockTemplateEngine::TransactionAdded, this, _1));
+    mempool.NotifyEntryRemoved.connect(boost::bind(&CBlockTemplateEngine::TransactionRemoved, this, _1, _2));
+}
+
+CBlockTemplateEngine::~CBlockTemplateEngine()
+{
+    mempool.NotifyEntryAdded.disconnect(boost::bind(&CBlockTemplateEngine::TransactionAdded, this, _1));
+    mempool.NotifyEntryRemoved.disconnect(boost::bind(&CBlockTemplateEngine::TransactionRemoved, this, _1, _2));
+}
+
+void CBlockTemplateEngine::TransactionAdded(CTransactionRef tx)
+{
+    LOCK(cs);
+    if (!ptemplate)
+        return;
+    if (vQueued.size() >= MAX_TEMPLATE_QUEUED_CHANGES) {
+        Reset();
+        return;
+    }
+    vQueued.emplace_back(tx->GetHash(), true);
+}
+
+void CBlockTemplateEngine::TransactionRemoved(CTransactionRef tx, MemPoolRemovalReason reason)
+{
+    LOCK(cs);
+    if (!ptemplate)
+        return;
+    if (vQueued.size() >= MAX_TEMPLATE_QUEUED_CHANGES) {
+        Reset();
+        return;
+    }
+    vQueued.emplace_back(tx->GetHash(), false);
+}
+
+void CBlockTemplateEngine::Reset()
+{
+    vQueued.clear();
+    assembler.reset();
+    ptemplate.reset();
+    mapIndex.clear();
+    nRemoved = 0;
+    fSuboptimal = false;
+}
+
+void CBlockTemplateEngine::ApplyQueued()
+{
+    AssertLockHeld(mempool.cs);
+    for (const std::pair<uint256, bool>& change : vQueued) {
+        if (change.second) {
+            // It may have been removed again since.
+            CTxMemPool::txiter it = mempool.mapTx.find(change.first);
+            if (it != mempool.mapTx.end() && !mapIndex.count(change.first))
+                AddTransaction(it);
+        } else {
+            RemoveTransaction(change.first);
+        }
+    }
+    vQueued.clear();
+    if (nRemoved > ptemplate->block.vtx.size() / 2)
+        Compact();
+}
+
+void CBlockTemplateEngine::AddTransaction(CTxMemPool::txiter it)
+{
+    // Transactions with ancestors left out of the template are left to
+    // BlockAssembler, which considers them together.
+    for (CTxMemPool::txiter parent : mempool.GetMemPoolParents(it)) {
+        if (!mapIndex.count(parent->GetTx().GetHash())) {
+            CFeeRate packageFeeRate(it->GetModFeesWithAncestors(), it->GetSizeWithAncestors());
+            if (packageFeeRate >= assembler->blockMinFeeRate && (!assembler->fBlockFull || packageFeeRate > assembler->minPackageFeeRate))
+                fSuboptimal = true;
+            return;
+        }
+    }
+
+    if (it->GetModifiedFee() < assembler->blockMinFeeRate.GetFee(it->GetTxSize()))
+        return;
+    CFeeRate feeRate(it->GetModifiedFee(), it->GetTxSize());
+    if (!assembler->TestPackage(it->GetTxSize(), it->GetSigOpCost())) {
+        assembler->fBlockFull = true;
+        if (feeRate > assembler->minPackageFeeRate)
+            fSuboptimal = true;
+        return;
+    }
+    if (!assembler->TestPackageTransactions(CTxMemPool::setEntries{it}))
+        return;
+
+    mapIndex.emplace(it->GetTx().GetHash(), ptemplate->block.vtx.size());
+    ptemplate->block.vtx.push_back(it->GetSharedTx());
+    ptemplate->vTxFees.push_back(it->GetFee());
+    ptemplate->vTxSigOpsCost.push_back(it->GetSigOpCost());
+    assembler->nBlockWeight += it->GetTxWeight();
+    ++assembler->nBlockTx;
+    assembler->nBlockSigOpsCost += it->GetSigOpCost();
+    assembler->nFees += it->GetFee();
+    assembler->minPackageFeeRate = std::min(assembler->minPackageFeeRate, feeRate);
+    stats.nTxAdded++;
+}
+
+void CBlockTemplateEngine::RemoveTransaction(const uint256& hash)
+{
+    auto mi = mapIndex.find(hash);
+    if (mi == mapIndex.end())
+        return;
+    const size_t i = mi->second;
+    CTransactionRef& tx = ptemplate->block.vtx[i];
+    assembler->nBlockWeight -= GetTransactionWeight(*tx);
+    --assembler->nBlockTx;
+    assembler->nBlockSigOpsCost -= ptemplate->vTxSigOpsCost[i];
+    assembler->nFees -= ptemplate->vTxFees[i];
+    tx.reset();
+    mapIndex.erase(mi);
+    nRemoved++;
+    stats.nTxRemoved++;
+    // The space freed may fit a transaction that was left out.
+    if (assembler->fBlockFull)
+        fSuboptimal = true;
+}
+
+void CBlockTemplateEngine::Compact()
+{
+    CBlockTemplate& blocktemplate = *ptemplate;
+    size_t j = 1;
+    for (size_t i = 1; i < blocktemplate.block.vtx.size(); i++) {
+        if (!blocktemplate.block.vtx[i])
+            continue;
+        mapIndex[blocktemplate.block.vtx[i]->GetHash()] = j;
+        blocktemplate.block.vtx[j] = std::move(blocktemplate.block.vtx[i]);
+        blocktemplate.vTxFees[j] = blocktemplate.vTxFees[i];
+        blocktemplate.vTxSigOpsCost[j] = blocktemplate.vTxSigOpsCost[i];
+        j++;
+    }
+    blocktemplate.block.vtx.resize(j);
+    blocktemplate.vTxFees.resize(j);
+    blocktemplate.vTxSigOpsCost.resize(j);
+    nRemoved = 0;
+}
+
+std::unique_ptr<CBlockTemplate> CBlockTemplateEngine::GetTemplate(const CScript& scriptPubKeyIn, bool fMineWitnessTxIn)
+{
+    int64_t nTimeStart = GetTimeMicros();
+
+    LOCK2(cs_main, mempool.cs);
+    LOCK(cs);
+    CBlockIndex* pindexPrev = chainActive.Tip();
+    assert(pindexPrev != nullptr);
+    bool fAssemble = !ptemplate || pindexPrev->GetBlockHash() != hashPrevBlock || fMineWitnessTxIn != fMineWitnessTx;
+    if (!fAssemble) {
+        ApplyQueued();
+        fAssemble = fSuboptimal && GetTime() - nAssembledTime >= TEMPLATE_REASSEMBLE_INTERVAL;
+    }
+
+    if (fAssemble) {
+        Reset();
+        std::unique_ptr<BlockAssembler> assemblerNew(new BlockAssembler(chainparams));
+        std::unique_ptr<CBlockTemplate> pblocktemplate = assemblerNew->CreateNewBlock(scriptPubKeyIn, fMineWitnessTxIn);
+        // The selected entries may be removed from mapTx before they are
+        // next looked at; the template keeps its transactions instead.
+        assemblerNew->inBlock.clear();
+        assembler = std::move(assemblerNew);
+        ptemplate.reset(new CBlockTemplate(*pblocktemplate));
+        for (size_t i = 1; i < ptemplate->block.vtx.size(); i++) {
+            mapIndex.emplace(ptemplate->block.vtx[i]->GetHash(), i);
+        }
+        hashPrevBlock = pindexPrev->GetBlockHash();
+        fMineWitnessTx = fMineWitnessTxIn;
+        nAssembledTime = GetTime();
+        stats.nAssembled++;
+        stats.assembleMicros.Add(GetTimeMicros() - nTimeStart);
+        return pblocktemplate;
+    }
+
+    std::unique_ptr<CBlockTemplate> pblocktemplate(new CBlockTemplate());
+    CBlock* pblock = &pblocktemplate->block;
+    pblock->vtx.reserve(ptemplate->block.vtx.size() - nRemoved);
+    pblock->vtx.emplace_back();
+    pblocktemplate->vTxFees.push_back(-1);
+    pblocktemplate->vTxSigOpsCost.push_back(-1);
+    for (size_t i = 1; i < ptemplate->block.vtx.size(); i++) {
+        if (!ptemplate->block.vtx[i])
+            continue;
+        pblock->vtx.push_back(ptemplate->block.vtx[i]);
+        pblocktemplate->vTxFees.push_back(ptemplate->vTxFees[i]);
+        pblocktemplate->vTxSigOpsCost.push_back(ptemplate->vTxSigOpsCost[i]);
+    }
+
+    pblock->nVersion = ComputeBlockVersion(pindexPrev, chainparams.GetConsensus());
+    if (chainparams.MineBlocksOnDemand())
+        pblock->nVersion = gArgs.GetArg("-blockversion", pblock->nVersion);
+    pblock->nTime = GetAdjustedTime();
+    FinishBlock(*pblocktemplate, scriptPubKeyIn, pindexPrev, assembler->nFees, chainparams);
+
+    CValidationState state;
+    if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
+        LogPrintf("%s: updated template failed TestBlockValidity, assembling it again: %s\n", __func__, FormatStateMessage(state));
+        Reset();
+        return GetTemplate(scriptPubKeyIn, fMineWitnessTxIn);
+    }
+
+    nLastBlockTx = assembler->nBlockTx;
+    nLastBlockWeight = assembler->nBlockWeight;
+    stats.nUpdated++;
+    stats.updateMicros.Add(GetTimeMicros() - nTimeStart);
+    return pblocktemplate;
+}
+
+void CBlockTemplateEngine::MarkSuboptimal()
+{
+    LOCK(cs);
+    fSuboptimal = true;
+}
+
+CBlockTemplateEngine::Stats CBlockTemplateEngine::GetStats()
+{
+    LOCK(cs);
+    Stats result = stats;
+    if (assembler) {
+        result.nTx = assembler->nBlockTx;
+        result.nWeight = assembler->nBlockWeight - BlockAssembler::COINBASE_RESERVED_WEIGHT;
+    }
+    return result;
+}
+
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
 {
     // Update nExtraNonce
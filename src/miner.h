@@ -7,10 +7,15 @@
 #define BITCOIN_MINER_H
 
 #include "primitives/block.h"
+#include "sync.h"
 #include "txmempool.h"
+#include "validationstats.h"
 
 #include <stdint.h>
 #include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
 
@@ -21,6 +26,10 @@ class CScript;
 namespace Consensus { struct Params; };
 
 static const bool DEFAULT_PRINTPRIORITY = false;
+/** Minimum age in seconds of a block template before it is assembled again because better transactions may be left out */
+static const int64_t TEMPLATE_REASSEMBLE_INTERVAL = 5;
+/** Maximum number of mempool changes waiting to be applied to a block template before it is dropped instead */
+static const size_t MAX_TEMPLATE_QUEUED_CHANGES = 100000;
 
 struct CBlockTemplate
 {
@@ -71,7 +80,7 @@ struct modifiedentry_iter {
 // except operating on CTxMemPoolModifiedEntry.
 // TODO: refactor to avoid duplication of this logic.
 struct CompareModifiedEntry {
-    bool operator()(const CTxMemPoolModifiedEntry &a, const CTxMemPoolModifiedEntry &b)
+    bool operator()(const CTxMemPoolModifiedEntry &a, const CTxMemPoolModifiedEntry &b) const
     {
         double f1 = (double)a.nModFeesWithAncestors * b.nSizeWithAncestors;
         double f2 = (double)b.nModFeesWithAncestors * a.nSizeWithAncestors;
@@ -86,7 +95,7 @@ struct CompareModifiedEntry {
 // This is sufficient to sort an ancestor package in an order that is valid
 // to appear in a block.
 struct CompareTxIterByAncestorCount {
-    bool operator()(const CTxMemPool::txiter &a, const CTxMemPool::txiter &b)
+    bool operator()(const CTxMemPool::txiter &a, const CTxMemPool::txiter &b) const
     {
         if (a->GetCountWithAncestors() != b->GetCountWithAncestors())
             return a->GetCountWithAncestors() < b->GetCountWithAncestors();
@@ -148,13 +157,22 @@ private:
     uint64_t nBlockSigOpsCost;
     CAmount nFees;
     CTxMemPool::setEntries inBlock;
+    // Whether a package was left out because it did not fit
+    bool fBlockFull;
+    // The lowest ancestor feerate of the selected packages
+    CFeeRate minPackageFeeRate;
 
     // Chain context for the block
     int nHeight;
     int64_t nLockTimeCutoff;
     const CChainParams& chainparams;
 
+    friend class CBlockTemplateEngine;
+
 public:
+    // Weight reserved for the coinbase transaction, which nBlockWeight starts at
+    static constexpr uint64_t COINBASE_RESERVED_WEIGHT = 4000;
+
     struct Options {
         Options();
         size_t nBlockMaxWeight;
@@ -201,6 +219,84 @@ private:
     int UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set &mapModifiedTx);
 };
 
+/**
+ * Keeps a block template up to date with the mempool, so that a fresh one
+ * can be handed out without selecting its transactions from scratch.
+ *
+ * The template is assembled by BlockAssembler when there is none for the
+ * current tip. After that, a transaction added to the mempool is appended to
+ * it when all its in-mempool parents are in it and it fits, and a transaction
+ * removed from the mempool is removed from it. Changes after which
+ * BlockAssembler could select better transactions, like a transaction with a
+ * higher feerate than the selected ones not fitting, mark the template as
+ * suboptimal: it is then assembled again once it is older than
+ * TEMPLATE_REASSEMBLE_INTERVAL.
+ *
+ * Transactions are notified before they are in mapTx, so the changes are
+ * queued and applied when a template is requested.
+ */
+class CBlockTemplateEngine
+{
+public:
+    struct Stats
+    {
+        //! Templates assembled from scratch
+        uint64_t nAssembled = 0;
+        //! Templates handed out after updating the last one
+        uint64_t nUpdated = 0;
+        //! Transactions appended to and removed from the template
+        uint64_t nTxAdded = 0;
+        uint64_t nTxRemoved = 0;
+        //! Transactions in the template, and its weight, excluding the coinbase
+        uint64_t nTx = 0;
+        uint64_t nWeight = 0;
+        //! Time taken to hand out a template, in microseconds
+        CValidationStats::Histogram assembleMicros;
+        CValidationStats::Histogram updateMicros;
+    };
+
+private:
+    const CChainParams& chainparams;
+    CCriticalSection cs;
+
+    //! Mempool changes not applied yet: the txid, and whether it was added
+    std::vector<std::pair<uint256, bool>> vQueued;
+
+    //! The assembler of the template, which keeps its totals up to date
+    std::unique_ptr<BlockAssembler> assembler;
+    //! Removed transactions are left as null until the template is compacted
+    std::unique_ptr<CBlockTemplate> ptemplate;
+    std::unordered_map<uint256, size_t, SaltedTxidHasher> mapIndex;
+    size_t nRemoved;
+    uint256 hashPrevBlock;
+    bool fMineWitnessTx;
+    bool fSuboptimal;
+    int64_t nAssembledTime;
+    Stats stats;
+
+    void TransactionAdded(CTransactionRef tx);
+    void TransactionRemoved(CTransactionRef tx, MemPoolRemovalReason reason);
+
+    void Reset();
+    void ApplyQueued();
+    void AddTransaction(CTxMemPool::txiter it);
+    void RemoveTransaction(const uint256& hash);
+    void Compact();
+
+public:
+    explicit CBlockTemplateEngine(const CChainParams& params);
+    ~CBlockTemplateEngine();
+
+    /** Get a block template with coinbase to scriptPubKeyIn, updating or assembling it as needed */
+    std::unique_ptr<CBlockTemplate> GetTemplate(const CScript& scriptPubKeyIn, bool fMineWitnessTxIn=true);
+    /** Mark the template as suboptimal, for changes the mempool does not notify, like fee deltas */
+    void MarkSuboptimal();
+    Stats GetStats();
+};
+
+/** The block template engine used by getblocktemplate, if any */
+extern std::unique_ptr<CBlockTemplateEngine> g_blocktemplates;
+
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
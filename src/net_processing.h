@@ -21,6 +21,15 @@ static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN = 100;
  *  Timeout = base + per_header * (expected number of headers) */
 static constexpr int64_t HEADERS_DOWNLOAD_TIMEOUT_BASE = 15 * 60 * 1000000; // 15 minutes
 static constexpr int64_t HEADERS_DOWNLOAD_TIMEOUT_PER_HEADER = 1000; // 1ms/header
+/** Maximum number of transaction prevalidation threads */
+static const int MAX_TX_PREVALIDATION_THREADS = 16;
+/** -txprevalidationthreads default */
+static const int DEFAULT_TX_PREVALIDATION_THREADS = 4;
+/** Maximum number of transactions of a peer waiting for or in prevalidation */
+static const size_t MAX_PEER_TX_PREVALIDATION = 100;
+
+/** Number of threads prevalidating transactions received from peers, before they are passed to AcceptToMemoryPool */
+extern int nTxPrevalidationThreads;
 
 class PeerLogicValidation : public CValidationInterface, public NetEventsInterface {
 private:
@@ -58,6 +67,8 @@ struct CNodeStateStats {
 
 /** Get statistics from node state */
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
+/** Run an instance of the transaction prevalidation thread */
+void ThreadTxPrevalidation();
 /** Increase a node's misbehavior score. */
 void Misbehaving(NodeId nodeid, int howmuch);
 
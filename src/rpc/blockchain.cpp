@@ -6,10 +6,14 @@
 #include "rpc/blockchain.h"
 
 #include "amount.h"
+#include "blockcache.h"
+#include "blockreader.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "coins.h"
+#include "coinstats.h"
+#include "coinswriter.h"
 #include "consensus/validation.h"
 #include "validation.h"
 #include "core_io.h"
@@ -689,13 +693,19 @@ UniValue getblockheader(const JSONRPCRequest& request)
     return blockheaderToJSON(pblockindex);
 }
 
-static void ReadBlockCheckPruned(CBlock& block, const CBlockIndex* pblockindex)
+static void CheckBlockPruned(const CBlockIndex* pblockindex)
 {
     if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0) {
         throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
     }
+}
+
+static std::shared_ptr<const CBlock> ReadBlockCheckPruned(const CBlockIndex* pblockindex)
+{
+    CheckBlockPruned(pblockindex);
 
-    if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus())) {
+    std::shared_ptr<const CBlock> pblock;
+    if (!ReadBlockCached(pblock, pblockindex, Params())) {
         // Block not found on disk. This could be because we have the block
         // header in our index but don't have the block (for example if a
         // non-whitelisted node sends us an unrequested long chain of valid
@@ -703,6 +713,18 @@ static void ReadBlockCheckPruned(CBlock& block, const CBlockIndex* pblockindex)
         // block).
         throw JSONRPCError(RPC_MISC_ERROR, "Block not found on disk");
     }
+    return pblock;
+}
+
+static CRawBlock ReadRawBlockCheckPruned(const CBlockIndex* pblockindex, bool fWitness)
+{
+    CheckBlockPruned(pblockindex);
+
+    CRawBlock raw;
+    if (!ReadRawBlockCached(raw, pblockindex, fWitness, Params())) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Block not found on disk");
+    }
+    return raw;
 }
 
 UniValue getblock(const JSONRPCRequest& request)
@@ -771,19 +793,16 @@ UniValue getblock(const JSONRPCRequest& request)
     if (mapBlockIndex.count(hash) == 0)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
-    CBlock block;
     CBlockIndex* pblockindex = mapBlockIndex[hash];
-    ReadBlockCheckPruned(block, pblockindex);
 
     if (verbosity <= 0)
     {
-        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-        ssBlock << block;
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
+        const CRawBlock raw = ReadRawBlockCheckPruned(pblockindex, !(RPCSerializationFlags() & SERIALIZE_TRANSACTION_NO_WITNESS));
+        std::string strHex = HexStr(raw.begin(), raw.end());
         return strHex;
     }
 
-    return blockToJSON(block, pblockindex, verbosity >= 2);
+    return blockToJSON(*ReadBlockCheckPruned(pblockindex), pblockindex, verbosity >= 2);
 }
 
 struct CCoinsStats
@@ -796,11 +815,13 @@ struct CCoinsStats
     uint256 hashSerialized;
     uint64_t nDiskSize;
     CAmount nTotalAmount;
+    CCoinsRollingStats rolling;
 
     CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nBogoSize(0), nDiskSize(0), nTotalAmount(0) {}
 };
 
-static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+template <typename Stream>
+static void ApplyStats(CCoinsStats &stats, Stream& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
 {
     assert(!outputs.empty());
     ss << hash;
@@ -812,45 +833,82 @@ static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash,
         ss << VARINT(output.second.out.nValue);
         stats.nTransactionOutputs++;
         stats.nTotalAmount += output.second.out.nValue;
-        stats.nBogoSize += 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
-                           2 /* scriptPubKey len */ + output.second.out.scriptPubKey.size() /* scriptPubKey */;
+        stats.nBogoSize += CCoinsRollingStats::GetBogoSize(output.second);
+        stats.rolling.AddCoin(COutPoint(hash, output.first), output.second);
     }
     ss << VARINT(0);
 }
 
+//! Number of ranges GetUTXOStats splits the UTXO set into
+static const int UTXO_STATS_SHARDS = 1024;
+
+//! Statistics of one range of the UTXO set, and its part of the serialized hash
+struct CCoinsShardStats
+{
+    CCoinsStats stats;
+    std::vector<unsigned char> serialized;
+};
+
 //! Calculate statistics about the unspent transaction output set
-static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
+static bool GetUTXOStats(CCoinsViewDB *view, CCoinsStats &stats)
 {
-    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
-    assert(pcursor);
+    // The ranges are scanned in parallel, and their serializations are fed
+    // into the hash in key order, so the result is the same as for a single
+    // sequential scan. Outputs of one transaction never span two ranges.
+    std::vector<CCoinsShardStats> shards(UTXO_STATS_SHARDS);
+    auto map = [&shards](int n, CCoinsViewCursor& cursor) {
+        CCoinsShardStats& shard = shards[n];
+        CVectorWriter ss(SER_GETHASH, PROTOCOL_VERSION, shard.serialized, 0);
+        shard.stats.hashBlock = cursor.GetBestBlock();
+        uint256 prevkey;
+        std::map<uint32_t, Coin> outputs;
+        while (cursor.Valid()) {
+            COutPoint key;
+            Coin coin;
+            if (cursor.GetKey(key) && cursor.GetValue(coin)) {
+                if (!outputs.empty() && key.hash != prevkey) {
+                    ApplyStats(shard.stats, ss, prevkey, outputs);
+                    outputs.clear();
+                }
+                prevkey = key.hash;
+                outputs[key.n] = std::move(coin);
+            } else {
+                return error("%s: unable to read value", __func__);
+            }
+            cursor.Next();
+        }
+        if (!outputs.empty()) {
+            ApplyStats(shard.stats, ss, prevkey, outputs);
+        }
+        return true;
+    };
 
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = pcursor->GetBestBlock();
+    auto reduce = [&shards, &stats, &ss](int n) {
+        CCoinsShardStats& shard = shards[n];
+        if (n == 0) {
+            stats.hashBlock = shard.stats.hashBlock;
+            ss << stats.hashBlock;
+        }
+        ss.write((const char*)shard.serialized.data(), shard.serialized.size());
+        stats.nTransactions += shard.stats.nTransactions;
+        stats.nTransactionOutputs += shard.stats.nTransactionOutputs;
+        stats.nBogoSize += shard.stats.nBogoSize;
+        stats.nTotalAmount += shard.stats.nTotalAmount;
+        stats.rolling += shard.stats.rolling;
+        shard = CCoinsShardStats();
+    };
+
+    if (!view->ParallelScan(UTXO_STATS_SHARDS, GetNumCores(), map, reduce)) {
+        return false;
+    }
     {
         LOCK(cs_main);
-        stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
-    }
-    ss << stats.hashBlock;
-    uint256 prevkey;
-    std::map<uint32_t, Coin> outputs;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        COutPoint key;
-        Coin coin;
-        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
-            if (!outputs.empty() && key.hash != prevkey) {
-                ApplyStats(stats, ss, prevkey, outputs);
-                outputs.clear();
-            }
-            prevkey = key.hash;
-            outputs[key.n] = std::move(coin);
-        } else {
-            return error("%s: unable to read value", __func__);
+        BlockMap::const_iterator it = mapBlockIndex.find(stats.hashBlock);
+        if (stats.hashBlock.IsNull() || it == mapBlockIndex.end()) {
+            return false;
         }
-        pcursor->Next();
-    }
-    if (!outputs.empty()) {
-        ApplyStats(stats, ss, prevkey, outputs);
+        stats.nHeight = it->second->nHeight;
     }
     stats.hashSerialized = ss.GetHash();
     stats.nDiskSize = view->EstimateSize();
@@ -908,31 +966,66 @@ UniValue pruneblockchain(const JSONRPCRequest& request)
 
 UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 0)
+    if (request.fHelp || request.params.size() > 1)
         throw std::runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( rolling )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "Note this call may take some time, unless rolling is set.\n"
+            "The UTXO set is scanned by default, because \"transactions\" and \"hash_serialized_2\" can only be\n"
+            "computed by a scan, and existing callers compare them between nodes. With -rollingutxostats (the default),\n"
+            "rolling=true returns the other statistics in constant time.\n"
+            "\nArguments:\n"
+            "1. rolling    (boolean, optional, default=false) Only return the statistics that are kept up to date as blocks\n"
+            "              are connected, instead of scanning the UTXO set. If they are not available (e.g. for a chainstate\n"
+            "              created by an older version), the UTXO set is scanned anyway.\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
-            "  \"transactions\": n,      (numeric) The number of transactions\n"
+            "  \"transactions\": n,      (numeric) The number of transactions (only if the UTXO set was scanned)\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
             "  \"bogosize\": n,          (numeric) A meaningless metric for UTXO set size\n"
-            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash\n"
+            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash (only if the UTXO set was scanned)\n"
+            "  \"hash_rolling\": \"hash\", (string) The order-independent hash of the UTXO set\n"
             "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk\n"
-            "  \"total_amount\": x.xxx          (numeric) The total amount\n"
+            "  \"total_amount\": x.xxx,  (numeric) The total amount\n"
+            "  \"verified\": xx          (boolean) Whether the scan matched the maintained statistics (only if the UTXO set\n"
+            "                            was scanned, and the statistics were kept for the scanned block)\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("gettxoutsetinfo", "")
             + HelpExampleRpc("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "true")
         );
 
     UniValue ret(UniValue::VOBJ);
 
+    bool fRollingOnly = !request.params[0].isNull() && request.params[0].get_bool();
+    CCoinsRollingStats rolling;
+    uint256 hashRolling;
+    if (fRollingOnly && GetRollingCoinsStats(rolling, hashRolling)) {
+        int nHeight;
+        {
+            LOCK(cs_main);
+            nHeight = mapBlockIndex.find(hashRolling)->second->nHeight;
+        }
+        ret.push_back(Pair("height", (int64_t)nHeight));
+        ret.push_back(Pair("bestblock", hashRolling.GetHex()));
+        ret.push_back(Pair("txouts", rolling.nTransactionOutputs));
+        ret.push_back(Pair("bogosize", rolling.nBogoSize));
+        ret.push_back(Pair("hash_rolling", rolling.GetHash().GetHex()));
+        ret.push_back(Pair("disk_size", (uint64_t)pcoinsdbview->EstimateSize()));
+        ret.push_back(Pair("total_amount", ValueFromAmount(rolling.nTotalAmount)));
+        return ret;
+    }
+
     CCoinsStats stats;
-    FlushStateToDisk();
+    bool fRolling;
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+        fRolling = GetRollingCoinsStats(rolling, hashRolling);
+    }
     if (GetUTXOStats(pcoinsdbview, stats)) {
         ret.push_back(Pair("height", (int64_t)stats.nHeight));
         ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
@@ -940,11 +1033,23 @@ UniValue gettxoutsetinfo(const JSONRPCRequest& request)
         ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
         ret.push_back(Pair("bogosize", (int64_t)stats.nBogoSize));
         ret.push_back(Pair("hash_serialized_2", stats.hashSerialized.GetHex()));
+        ret.push_back(Pair("hash_rolling", stats.rolling.GetHash().GetHex()));
         ret.push_back(Pair("disk_size", stats.nDiskSize));
         ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
     } else {
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
     }
+    if (!fRolling) {
+        // Keep them up to date from here on.
+        SetRollingCoinsStats(stats.rolling, stats.hashBlock);
+    } else if (hashRolling == stats.hashBlock) {
+        // No block was connected during the scan, so the two can be compared.
+        bool fVerified = rolling == stats.rolling;
+        if (!fVerified) {
+            LogPrintf("%s: rolling UTXO set statistics do not match the UTXO set at %s\n", __func__, stats.hashBlock.ToString());
+        }
+        ret.push_back(Pair("verified", fVerified));
+    }
     return ret;
 }
 
@@ -1173,6 +1278,14 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
             "        }\n"
             "     }\n"
             "  }\n"
+            "  \"chainstate_writes\": {     (object) statistics about writing the chainstate to disk in the background\n"
+            "     \"count\": xx,             (numeric) number of completed writes\n"
+            "     \"coins\": xx,             (numeric) number of modified coins written\n"
+            "     \"pending\": xx,           (boolean) whether a write is in progress\n"
+            "     \"last_duration\": xx,     (numeric) duration of the last completed write in seconds\n"
+            "     \"total_duration\": xx,    (numeric) duration of all completed writes in seconds\n"
+            "     \"total_stall\": xx        (numeric) time spent waiting for a write to complete in seconds\n"
+            "  },\n"
             "  \"warnings\" : \"...\",         (string) any network and blockchain warnings.\n"
             "}\n"
             "\nExamples:\n"
@@ -1222,6 +1335,16 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
     obj.push_back(Pair("softforks",             softforks));
     obj.push_back(Pair("bip9_softforks", bip9_softforks));
 
+    CCoinsWriterStats writerstats = pcoinswriter->GetStats();
+    UniValue writes(UniValue::VOBJ);
+    writes.push_back(Pair("count",          writerstats.nWrites));
+    writes.push_back(Pair("coins",          writerstats.nCoinsWritten));
+    writes.push_back(Pair("pending",        writerstats.fPending));
+    writes.push_back(Pair("last_duration",  writerstats.nLastWriteMicros * 0.000001));
+    writes.push_back(Pair("total_duration", writerstats.nTotalWriteMicros * 0.000001));
+    writes.push_back(Pair("total_stall",    writerstats.nTotalStallMicros * 0.000001));
+    obj.push_back(Pair("chainstate_writes", writes));
+
     obj.push_back(Pair("warnings", GetWarnings("statusbar")));
     return obj;
 }
@@ -1379,6 +1502,171 @@ UniValue getmempoolinfo(const JSONRPCRequest& request)
     return mempoolInfoToJSON();
 }
 
+UniValue getblockcacheinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getblockcacheinfo\n"
+            "\nReturns details on the cache of recently served blocks.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"size\": xxxxx,               (numeric) Number of cached blocks\n"
+            "  \"usage\": xxxxx,              (numeric) Total memory usage for the cache\n"
+            "  \"maxusage\": xxxxx,           (numeric) Maximum memory usage for the cache\n"
+            "  \"hits\": xxxxx,               (numeric) Number of lookups that found the block in the requested form\n"
+            "  \"misses\": xxxxx,             (numeric) Number of lookups that did not\n"
+            "  \"hitratio\": x.xxx,           (numeric) hits / (hits + misses)\n"
+            "  \"forms\": {                   (json object) The same counters for each form of the block\n"
+            "    \"block\": {                 (json object) Deserialized blocks\n"
+            "      \"hits\": xxxxx,\n"
+            "      \"misses\": xxxxx,\n"
+            "      \"hitratio\": x.xxx\n"
+            "    },\n"
+            "    \"witness\": {...},          (json object) Blocks serialized with witness data\n"
+            "    \"nowitness\": {...}         (json object) Blocks serialized without witness data\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockcacheinfo", "")
+            + HelpExampleRpc("getblockcacheinfo", "")
+        );
+
+    const CBlockCache::Stats stats = blockCache.GetStats();
+    auto counters = [](UniValue& obj, uint64_t nHits, uint64_t nMisses) {
+        obj.push_back(Pair("hits", nHits));
+        obj.push_back(Pair("misses", nMisses));
+        obj.push_back(Pair("hitratio", nHits + nMisses ? (double)nHits / (nHits + nMisses) : 0.0));
+    };
+    static const char* const FORM_NAMES[CBlockCache::FORM_COUNT] = {"block", "witness", "nowitness"};
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("size", (uint64_t)stats.nEntries));
+    ret.push_back(Pair("usage", (uint64_t)stats.nUsage));
+    ret.push_back(Pair("maxusage", (uint64_t)stats.nMaxUsage));
+    uint64_t nHits = 0, nMisses = 0;
+    UniValue forms(UniValue::VOBJ);
+    for (int i = 0; i < CBlockCache::FORM_COUNT; i++) {
+        UniValue form(UniValue::VOBJ);
+        counters(form, stats.nHits[i], stats.nMisses[i]);
+        forms.push_back(Pair(FORM_NAMES[i], form));
+        nHits += stats.nHits[i];
+        nMisses += stats.nMisses[i];
+    }
+    counters(ret, nHits, nMisses);
+    ret.push_back(Pair("forms", forms));
+    return ret;
+}
+
+UniValue histogramToJSON(const CValidationStats::Histogram& histogram, uint64_t nCount)
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("total", histogram.nTotal));
+    ret.push_back(Pair("mean", nCount ? histogram.nTotal / (int64_t)nCount : 0));
+    ret.push_back(Pair("max", histogram.nMax));
+    UniValue buckets(UniValue::VARR);
+    for (int i = 0; i < CValidationStats::Histogram::BUCKETS; i++) {
+        if (!histogram.vBuckets[i])
+            continue;
+        UniValue bucket(UniValue::VOBJ);
+        bucket.push_back(Pair("upto", i ? (int64_t)1 << i : 0));
+        bucket.push_back(Pair("count", histogram.vBuckets[i]));
+        buckets.push_back(bucket);
+    }
+    ret.push_back(Pair("histogram", buckets));
+    return ret;
+}
+
+UniValue getvalidationstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 1)
+        throw std::runtime_error(
+            "getvalidationstats ( nblocks )\n"
+            "\nReturns the time spent in each phase of connecting blocks to the active chain, in microseconds.\n"
+            "Blocks connected together during initial block download share the time spent waiting for the\n"
+            "script checks, flushing and writing the chainstate evenly.\n"
+            "\nArguments:\n"
+            "1. nblocks    (numeric, optional, default=10) Number of most recently connected blocks to list (at most " + std::to_string(VALIDATION_STATS_BLOCKS) + ")\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"blocks\": xxxxx,              (numeric) Number of blocks connected since startup\n"
+            "  \"phases\": {                   (json object) Statistics of each phase over all those blocks\n"
+            "    \"read\": {                   (json object) Reading the block from disk\n"
+            "      \"total\": xxxxx,           (numeric) Total time spent\n"
+            "      \"mean\": xxxxx,            (numeric) Mean time per block\n"
+            "      \"max\": xxxxx,             (numeric) Longest time for one block\n"
+            "      \"histogram\": [            (json array) The non-empty buckets, shortest first\n"
+            "        {\n"
+            "          \"upto\": xxxxx,        (numeric) Upper bound of the bucket, exclusive except for 0\n"
+            "          \"count\": xxxxx        (numeric) Number of blocks in the bucket\n"
+            "        }, ...\n"
+            "      ]\n"
+            "    },\n"
+            "    \"check\": {...},             (json object) Context-free checks of the block\n"
+            "    \"forks\": {...},             (json object) Checks of soft fork rules\n"
+            "    \"connect\": {...},           (json object) Applying the transactions to the UTXO set\n"
+            "    \"verify\": {...},            (json object) Waiting for the script check threads\n"
+            "    \"index\": {...},             (json object) Writing undo data and the transaction index\n"
+            "    \"flush\": {...},             (json object) Flushing the block's changes into the coins cache\n"
+            "    \"chainstate\": {...},        (json object) Writing the chainstate to disk, if needed\n"
+            "    \"postconnect\": {...},       (json object) Updating the mempool and the tip\n"
+            "    \"total\": {...}              (json object) All of the above\n"
+            "  },\n"
+            "  \"recent\": [                   (json array) The most recently connected blocks, oldest first\n"
+            "    {\n"
+            "      \"hash\": \"hash\",           (string) The block hash\n"
+            "      \"height\": xxxxx,          (numeric) The block height\n"
+            "      \"tx\": xxxxx,              (numeric) Number of transactions\n"
+            "      \"inputs\": xxxxx,          (numeric) Number of inputs, excluding the coinbase\n"
+            "      \"time\": xxxxx,            (numeric) When the block was connected, in seconds since epoch\n"
+            "      \"pipelined\": true|false,  (boolean) Whether it was connected together with other blocks\n"
+            "      \"phases\": {               (json object) The time spent in each phase\n"
+            "        \"read\": xxxxx,\n"
+            "        ...\n"
+            "      }\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getvalidationstats", "")
+            + HelpExampleCli("getvalidationstats", "100")
+            + HelpExampleRpc("getvalidationstats", "100")
+        );
+
+    int nRecent = 10;
+    if (!request.params[0].isNull()) {
+        nRecent = request.params[0].get_int();
+        if (nRecent < 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative number of blocks");
+    }
+
+    const CValidationStats::Stats stats = validationStats.GetStats(nRecent);
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("blocks", stats.nBlocks));
+    UniValue phases(UniValue::VOBJ);
+    for (int i = 0; i < CValidationStats::PHASE_COUNT; i++) {
+        phases.push_back(Pair(CValidationStats::PHASE_NAMES[i], histogramToJSON(stats.phases[i], stats.nBlocks)));
+    }
+    ret.push_back(Pair("phases", phases));
+    UniValue recent(UniValue::VARR);
+    for (const CValidationStats::BlockRecord& record : stats.vRecent) {
+        UniValue block(UniValue::VOBJ);
+        block.push_back(Pair("hash", record.hash.GetHex()));
+        block.push_back(Pair("height", record.nHeight));
+        block.push_back(Pair("tx", (uint64_t)record.nTx));
+        block.push_back(Pair("inputs", (uint64_t)record.nInputs));
+        block.push_back(Pair("time", record.nTime));
+        block.push_back(Pair("pipelined", record.fPipelined));
+        UniValue micros(UniValue::VOBJ);
+        for (int i = 0; i < CValidationStats::PHASE_COUNT; i++) {
+            micros.push_back(Pair(CValidationStats::PHASE_NAMES[i], record.nMicros[i]));
+        }
+        block.push_back(Pair("phases", micros));
+        recent.push_back(block);
+    }
+    ret.push_back(Pair("recent", recent));
+    return ret;
+}
+
 UniValue preciousblock(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 1)
@@ -1623,8 +1911,8 @@ static void UpdateBlockStats(const CBlockIndex* pindex, std::set<std::string>& s
     int64_t maxtxsize = 0;
     std::vector<int64_t> txsize_array;
 
-    CBlock block;
-    ReadBlockCheckPruned(block, pindex);
+    std::shared_ptr<const CBlock> pblock = ReadBlockCheckPruned(pindex);
+    const CBlock& block = *pblock;
 
     for (const auto& tx : block.vtx) {
         outputs += tx->vout.size();
@@ -1893,6 +2181,51 @@ UniValue savemempool(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+UniValue dumptxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1) {
+        throw std::runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrites a snapshot of the UTXO set to a file, which a new node can load with -loadtxoutset.\n"
+            "\nArguments:\n"
+            "1. \"path\"    (string, required) The file to write, relative to the data directory if not absolute\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"path\": \"path\",         (string) The absolute path of the file\n"
+            "  \"base_hash\": \"hash\",    (string) The block the snapshot is for\n"
+            "  \"base_height\": n,        (numeric) The height of that block\n"
+            "  \"txouts\": n,             (numeric) The number of coins written\n"
+            "  \"hash_rolling\": \"hash\", (string) The hash of the UTXO set, to pass as -loadtxoutsethash\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("dumptxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("dumptxoutset", "\"utxo.dat\"")
+        );
+    }
+
+    fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    if (fs::exists(path)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+    }
+
+    uint256 hashBlock;
+    CCoinsRollingStats stats;
+    if (!DumpUTXOSnapshot(path, hashBlock, stats)) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to write the UTXO set snapshot");
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("path", path.string()));
+    ret.push_back(Pair("base_hash", hashBlock.GetHex()));
+    {
+        LOCK(cs_main);
+        ret.push_back(Pair("base_height", mapBlockIndex.at(hashBlock)->nHeight));
+    }
+    ret.push_back(Pair("txouts", stats.nTransactionOutputs));
+    ret.push_back(Pair("hash_rolling", stats.GetHash().GetHex()));
+    return ret;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
   //  --------------------- ------------------------  -----------------------  ----------
@@ -1904,6 +2237,8 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getblock",               &getblock,               {"blockhash","verbosity|verbose"} },
     { "blockchain",         "getblockhash",           &getblockhash,           {"height"} },
     { "blockchain",         "getblockheader",         &getblockheader,         {"blockhash","verbose"} },
+    { "blockchain",         "getblockcacheinfo",      &getblockcacheinfo,      {} },
+    { "blockchain",         "getvalidationstats",     &getvalidationstats,     {"nblocks"} },
     { "blockchain",         "getchaintips",           &getchaintips,           {} },
     { "blockchain",         "getdifficulty",          &getdifficulty,          {} },
     { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    {"txid","verbose"} },
@@ -1912,7 +2247,8 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
     { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
+    { "blockchain",         "dumptxoutset",           &dumptxoutset,           {"path"} },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {"rolling"} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
     { "blockchain",         "savemempool",            &savemempool,            {} },
     { "blockchain",         "verifychain",            &verifychain,            {"checklevel","nblocks"} },
@@ -5,6 +5,8 @@
 #ifndef BITCOIN_RPC_BLOCKCHAIN_H
 #define BITCOIN_RPC_BLOCKCHAIN_H
 
+#include "validationstats.h"
+
 class CBlock;
 class CBlockIndex;
 class UniValue;
@@ -33,5 +35,8 @@ UniValue mempoolToJSON(bool fVerbose = false);
 /** Block header to JSON */
 UniValue blockheaderToJSON(const CBlockIndex* blockindex);
 
+/** Histogram of nCount durations to JSON */
+UniValue histogramToJSON(const CValidationStats::Histogram& histogram, uint64_t nCount);
+
 #endif
 
@@ -261,9 +261,63 @@ UniValue prioritisetransaction(const JSONRPCRequest& request)
     }
 
     mempool.PrioritiseTransaction(hash, nAmount);
+    if (g_blocktemplates)
+        g_blocktemplates->MarkSuboptimal();
     return true;
 }
 
+UniValue getblocktemplatestats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getblocktemplatestats\n"
+            "\nReturns statistics of the block template kept up to date with the mempool for getblocktemplate.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"tx\": xxxxx,                  (numeric) Number of transactions in the template, excluding the coinbase\n"
+            "  \"weight\": xxxxx,              (numeric) Weight of those transactions\n"
+            "  \"assembled\": xxxxx,           (numeric) Number of templates assembled from scratch\n"
+            "  \"updated\": xxxxx,             (numeric) Number of templates handed out after updating the last one\n"
+            "  \"txadded\": xxxxx,             (numeric) Number of transactions appended to the template\n"
+            "  \"txremoved\": xxxxx,           (numeric) Number of transactions removed from the template\n"
+            "  \"latency\": {                  (json object) Time taken to hand out a template, in microseconds\n"
+            "    \"assembled\": {              (json object) For templates assembled from scratch\n"
+            "      \"total\": xxxxx,           (numeric) Total time spent\n"
+            "      \"mean\": xxxxx,            (numeric) Mean time per template\n"
+            "      \"max\": xxxxx,             (numeric) Longest time for one template\n"
+            "      \"histogram\": [            (json array) The non-empty buckets, shortest first\n"
+            "        {\n"
+            "          \"upto\": xxxxx,        (numeric) Upper bound of the bucket, exclusive except for 0\n"
+            "          \"count\": xxxxx        (numeric) Number of templates in the bucket\n"
+            "        }, ...\n"
+            "      ]\n"
+            "    },\n"
+            "    \"updated\": {...}            (json object) For templates handed out after updating the last one\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblocktemplatestats", "")
+            + HelpExampleRpc("getblocktemplatestats", "")
+        );
+
+    if (!g_blocktemplates)
+        throw JSONRPCError(RPC_MISC_ERROR, "Block templates are not kept up to date");
+
+    const CBlockTemplateEngine::Stats stats = g_blocktemplates->GetStats();
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("tx", stats.nTx));
+    ret.push_back(Pair("weight", stats.nWeight));
+    ret.push_back(Pair("assembled", stats.nAssembled));
+    ret.push_back(Pair("updated", stats.nUpdated));
+    ret.push_back(Pair("txadded", stats.nTxAdded));
+    ret.push_back(Pair("txremoved", stats.nTxRemoved));
+    UniValue latency(UniValue::VOBJ);
+    latency.push_back(Pair("assembled", histogramToJSON(stats.assembleMicros, stats.nAssembled)));
+    latency.push_back(Pair("updated", histogramToJSON(stats.updateMicros, stats.nUpdated)));
+    ret.push_back(Pair("latency", latency));
+    return ret;
+}
+
 
 // NOTE: Assumes a conclusive result; if result is inconclusive, it must be handled by caller
 static UniValue BIP22ValidationResult(const CValidationState& state)
@@ -510,8 +564,10 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
     // Cache whether the last invocation was with segwit support, to avoid returning
     // a segwit-block to a non-segwit caller.
     static bool fLastTemplateSupportsSegwit = true;
+    // Without an up to date template, a new one is only assembled every
+    // five seconds, as this takes long with a large mempool.
     if (pindexPrev != chainActive.Tip() ||
-        (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5) ||
+        (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && (g_blocktemplates || GetTime() - nStart > 5)) ||
         fLastTemplateSupportsSegwit != fSupportsSegwit)
     {
         // Clear pindexPrev so future calls make a new block, despite any failures from here on
@@ -525,7 +581,11 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
 
         // Create new block
         CScript scriptDummy = CScript() << OP_TRUE;
-        pblocktemplate = BlockAssembler(Params()).CreateNewBlock(scriptDummy, fSupportsSegwit);
+        if (g_blocktemplates) {
+            pblocktemplate = g_blocktemplates->GetTemplate(scriptDummy, fSupportsSegwit);
+        } else {
+            pblocktemplate = BlockAssembler(Params()).CreateNewBlock(scriptDummy, fSupportsSegwit);
+        }
         if (!pblocktemplate)
             throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
 
@@ -983,6 +1043,7 @@ static const CRPCCommand commands[] =
     { "mining",             "getmininginfo",          &getmininginfo,          {} },
     { "mining",             "prioritisetransaction",  &prioritisetransaction,  {"txid","dummy","fee_delta"} },
     { "mining",             "getblocktemplate",       &getblocktemplate,       {"template_request"} },
+    { "mining",             "getblocktemplatestats",  &getblocktemplatestats,  {} },
     { "mining",             "submitblock",            &submitblock,            {"hexdata","dummy"} },
 
 
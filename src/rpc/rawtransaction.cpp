@@ -967,6 +967,129 @@ UniValue sendrawtransaction(const JSONRPCRequest& request)
     return hashTx.GetHex();
 }
 
+UniValue sendrawtransactions(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "sendrawtransactions [\"hexstring\",...] ( allowhighfees )\n"
+            "\nSubmits raw transactions (serialized, hex-encoded) to local node and network, together.\n"
+            "Transactions may spend the outputs of those before them, but not of those after them.\n"
+            "A transaction that is rejected doesn't stop the others from being submitted.\n"
+            "\nArguments:\n"
+            "1. \"txs\"          (string, required) A json array of hex strings of raw transactions, parents before children\n"
+            "    [\n"
+            "      \"hexstring\"   (string) The hex string of a raw transaction\n"
+            "      ,...\n"
+            "    ]\n"
+            "2. allowhighfees    (boolean, optional, default=false) Allow high fees\n"
+            "\nResult:\n"
+            "[                   (json array of objects) One for each transaction, in the same order\n"
+            "  {\n"
+            "    \"txid\" : \"hex\",     (string) The transaction hash in hex\n"
+            "    \"accepted\" : true|false, (boolean) If the transaction is in the mempool and was sent to the network\n"
+            "    \"error\" : \"text\"     (string) Why the transaction was not accepted, if it was not\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("sendrawtransactions", "\"[\\\"signedparenthex\\\",\\\"signedchildhex\\\"]\"") +
+            "\nAs a json rpc call\n"
+            + HelpExampleRpc("sendrawtransactions", "[\"signedparenthex\",\"signedchildhex\"]")
+        );
+
+    ObserveSafeMode();
+    RPCTypeCheck(request.params, {UniValue::VARR, UniValue::VBOOL});
+
+    const UniValue& txs = request.params[0].get_array();
+    std::vector<CTransactionRef> vtx;
+    std::map<uint256, size_t> mapIndex;
+    for (unsigned int idx = 0; idx < txs.size(); idx++) {
+        CMutableTransaction mtx;
+        if (!DecodeHexTx(mtx, txs[idx].get_str()))
+            throw JSONRPCError(RPC_DESERIALIZATION_ERROR, strprintf("TX decode failed for tx %d", idx));
+        vtx.push_back(MakeTransactionRef(std::move(mtx)));
+        if (!mapIndex.emplace(vtx.back()->GetHash(), idx).second)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, std::string("Invalid parameter, duplicated transaction: ") + vtx.back()->GetHash().GetHex());
+    }
+    for (unsigned int idx = 0; idx < vtx.size(); idx++) {
+        for (const CTxIn& txin : vtx[idx]->vin) {
+            auto it = mapIndex.find(txin.prevout.hash);
+            if (it != mapIndex.end() && it->second >= idx)
+                throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Invalid parameter, tx %d spends tx %d, which must come before it", idx, it->second));
+        }
+    }
+
+    CAmount nMaxRawTxFee = maxTxFee;
+    if (!request.params[1].isNull() && request.params[1].get_bool())
+        nMaxRawTxFee = 0;
+
+    // Only submit those we don't have yet; those in the mempool are sent to
+    // the network again.
+    std::vector<std::string> vError(vtx.size());
+    std::vector<bool> vAccepted(vtx.size(), false);
+    std::vector<CTransactionRef> package;
+    std::vector<size_t> vPackageIndex;
+    {
+        LOCK(cs_main);
+        CCoinsViewCache &view = *pcoinsTip;
+        for (size_t idx = 0; idx < vtx.size(); idx++) {
+            const uint256& hashTx = vtx[idx]->GetHash();
+            bool fHaveChain = false;
+            for (size_t o = 0; !fHaveChain && o < vtx[idx]->vout.size(); o++) {
+                const Coin& existingCoin = view.AccessCoin(COutPoint(hashTx, o));
+                fHaveChain = !existingCoin.IsSpent();
+            }
+            if (fHaveChain) {
+                vError[idx] = "transaction already in block chain";
+            } else if (mempool.exists(hashTx)) {
+                vAccepted[idx] = true;
+            } else {
+                package.push_back(vtx[idx]);
+                vPackageIndex.push_back(idx);
+            }
+        }
+    }
+
+    // push to local node and sync with wallets
+    std::vector<PackageTxResult> results;
+    AcceptPackageToMemoryPool(mempool, package, results, nullptr /* plTxnReplaced */, false /* bypass_limits */, nMaxRawTxFee);
+    for (size_t i = 0; i < package.size(); i++) {
+        const PackageTxResult& result = results[i];
+        size_t idx = vPackageIndex[i];
+        if (result.fAccepted) {
+            vAccepted[idx] = true;
+        } else if (result.state.IsInvalid()) {
+            vError[idx] = strprintf("%i: %s", result.state.GetRejectCode(), result.state.GetRejectReason());
+        } else if (result.fMissingInputs) {
+            vError[idx] = "Missing inputs";
+        } else {
+            vError[idx] = result.state.GetRejectReason();
+        }
+    }
+
+    if(!g_connman)
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+
+    UniValue ret(UniValue::VARR);
+    for (size_t idx = 0; idx < vtx.size(); idx++) {
+        const uint256& hashTx = vtx[idx]->GetHash();
+        if (vAccepted[idx]) {
+            CInv inv(MSG_TX, hashTx);
+            g_connman->ForEachNode([&inv](CNode* pnode)
+            {
+                pnode->PushInventory(inv);
+            });
+        }
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("txid", hashTx.GetHex()));
+        entry.push_back(Pair("accepted", (bool)vAccepted[idx]));
+        if (!vAccepted[idx])
+            entry.push_back(Pair("error", vError[idx]));
+        ret.push_back(entry);
+    }
+    return ret;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
   //  --------------------- ------------------------  -----------------------  ----------
@@ -975,6 +1098,7 @@ static const CRPCCommand commands[] =
     { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   {"hexstring"} },
     { "rawtransactions",    "decodescript",           &decodescript,           {"hexstring"} },
     { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     {"hexstring","allowhighfees"} },
+    { "rawtransactions",    "sendrawtransactions",    &sendrawtransactions,    {"txs","allowhighfees"} },
     { "rawtransactions",    "combinerawtransaction",  &combinerawtransaction,  {"txs"} },
     { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     {"hexstring","prevtxs","privkeys","sighashtype"} }, /* uses wallet if enabled */
 
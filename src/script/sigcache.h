@@ -53,4 +53,13 @@ public:
 
 void InitSignatureCache();
 
+/** Get the nonce and the entries of the signature cache, to save them. */
+void GetSignatureCacheEntries(uint256& nonce, std::vector<uint256>& entries);
+
+/**
+ * Use the nonce of entries saved earlier, and insert them into the signature
+ * cache. To be called before the cache is used.
+ */
+void LoadSignatureCacheEntries(const uint256& nonce, const std::vector<uint256>& entries);
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
@@ -0,0 +1,248 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+#define BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+/**
+ * A memory resource for many small allocations of similar size, such as the
+ * nodes of a node-based container.
+ *
+ * Memory is carved out of large chunks, which are only released when the
+ * resource is destroyed. Freed blocks are kept in a free list per size class
+ * (in units of ELEM_ALIGN_BYTES) and handed out again for the next allocation
+ * of that size. This avoids the per-allocation overhead and the fragmentation
+ * of the general purpose allocator, and keeps the nodes of a container close
+ * together in memory.
+ *
+ * Allocations larger than MAX_BLOCK_SIZE_BYTES, or with a stricter alignment
+ * than ELEM_ALIGN_BYTES, are passed on to ::operator new.
+ *
+ * Chunk sizes start small and double up to the maximum chunk size, so that a
+ * resource used for only a handful of allocations stays cheap.
+ */
+template <std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+class PoolResource
+{
+    static_assert(ALIGN_BYTES > 0 && (ALIGN_BYTES & (ALIGN_BYTES - 1)) == 0, "ALIGN_BYTES must be a power of two");
+
+    /** In-place free list node, stored in the freed block itself. */
+    struct ListNode {
+        ListNode* m_next;
+    };
+
+public:
+    /** Alignment (and granularity) of all pooled blocks. */
+    static constexpr std::size_t ELEM_ALIGN_BYTES = ALIGN_BYTES > alignof(ListNode) ? ALIGN_BYTES : alignof(ListNode);
+    static_assert(ELEM_ALIGN_BYTES <= alignof(std::max_align_t), "chunks from ::operator new must be sufficiently aligned");
+
+    /** Size of the first chunk. */
+    static constexpr std::size_t MIN_CHUNK_SIZE_BYTES = 4096;
+    /** Chunk size used once the resource has grown. */
+    static constexpr std::size_t DEFAULT_MAX_CHUNK_SIZE_BYTES = 256 * 1024;
+
+private:
+    /** Number of ELEM_ALIGN_BYTES units needed to hold bytes. */
+    static constexpr std::size_t NumElemAlignBytes(std::size_t bytes)
+    {
+        return (bytes + ELEM_ALIGN_BYTES - 1) / ELEM_ALIGN_BYTES + (bytes == 0);
+    }
+
+    /** Whether an allocation of the given size and alignment is served from the pool. */
+    static constexpr bool IsFreeListUsable(std::size_t bytes, std::size_t alignment)
+    {
+        return alignment <= ELEM_ALIGN_BYTES && bytes <= MAX_BLOCK_SIZE_BYTES;
+    }
+
+    const std::size_t m_max_chunk_size_bytes;
+    std::size_t m_next_chunk_size_bytes;
+    std::size_t m_allocated_bytes;
+    std::size_t m_free_list_bytes;
+
+    /** All chunks allocated so far. */
+    std::vector<char*> m_allocated_chunks;
+
+    /** Free lists, indexed by the number of ELEM_ALIGN_BYTES units of a block. */
+    std::array<ListNode*, NumElemAlignBytes(MAX_BLOCK_SIZE_BYTES) + 1> m_free_lists;
+
+    /** Unused remainder of the current chunk. */
+    char* m_available_memory_it;
+    char* m_available_memory_end;
+
+    void PushFree(void* p, std::size_t num_alignments)
+    {
+        ListNode* node = new (p) ListNode;
+        node->m_next = m_free_lists[num_alignments];
+        m_free_lists[num_alignments] = node;
+        m_free_list_bytes += num_alignments * ELEM_ALIGN_BYTES;
+    }
+
+    void AllocateChunk()
+    {
+        // Keep the remainder of the current chunk usable, through the free
+        // list of its size. It is always a multiple of ELEM_ALIGN_BYTES and
+        // smaller than the block that did not fit.
+        const std::size_t remaining = m_available_memory_end - m_available_memory_it;
+        if (remaining > 0) {
+            PushFree(m_available_memory_it, remaining / ELEM_ALIGN_BYTES);
+        }
+
+        const std::size_t chunk_size = m_next_chunk_size_bytes;
+        char* chunk = static_cast<char*>(::operator new(chunk_size));
+        m_allocated_chunks.push_back(chunk);
+        m_allocated_bytes += chunk_size;
+        m_available_memory_it = chunk;
+        m_available_memory_end = chunk + chunk_size;
+        if (m_next_chunk_size_bytes < m_max_chunk_size_bytes) {
+            m_next_chunk_size_bytes = std::min(m_next_chunk_size_bytes * 2, m_max_chunk_size_bytes);
+        }
+    }
+
+public:
+    explicit PoolResource(std::size_t max_chunk_size_bytes = DEFAULT_MAX_CHUNK_SIZE_BYTES)
+        : m_max_chunk_size_bytes((max_chunk_size_bytes > MIN_CHUNK_SIZE_BYTES ? max_chunk_size_bytes : MIN_CHUNK_SIZE_BYTES) / ELEM_ALIGN_BYTES * ELEM_ALIGN_BYTES),
+          m_next_chunk_size_bytes(MIN_CHUNK_SIZE_BYTES / ELEM_ALIGN_BYTES * ELEM_ALIGN_BYTES),
+          m_allocated_bytes(0),
+          m_free_list_bytes(0),
+          m_available_memory_it(nullptr),
+          m_available_memory_end(nullptr)
+    {
+        static_assert(MIN_CHUNK_SIZE_BYTES >= MAX_BLOCK_SIZE_BYTES, "a chunk must be able to hold the largest pooled block");
+        m_free_lists.fill(nullptr);
+    }
+
+    PoolResource(const PoolResource&) = delete;
+    PoolResource& operator=(const PoolResource&) = delete;
+
+    ~PoolResource()
+    {
+        for (char* chunk : m_allocated_chunks) {
+            ::operator delete(chunk);
+        }
+    }
+
+    void* Allocate(std::size_t bytes, std::size_t alignment)
+    {
+        if (!IsFreeListUsable(bytes, alignment)) {
+            return ::operator new(bytes);
+        }
+        const std::size_t num_alignments = NumElemAlignBytes(bytes);
+        ListNode* node = m_free_lists[num_alignments];
+        if (node != nullptr) {
+            m_free_lists[num_alignments] = node->m_next;
+            m_free_list_bytes -= num_alignments * ELEM_ALIGN_BYTES;
+            return node;
+        }
+        const std::size_t round_bytes = num_alignments * ELEM_ALIGN_BYTES;
+        if (round_bytes > static_cast<std::size_t>(m_available_memory_end - m_available_memory_it)) {
+            AllocateChunk();
+        }
+        void* p = m_available_memory_it;
+        m_available_memory_it += round_bytes;
+        return p;
+    }
+
+    void Deallocate(void* p, std::size_t bytes, std::size_t alignment) noexcept
+    {
+        if (!IsFreeListUsable(bytes, alignment)) {
+            ::operator delete(p);
+            return;
+        }
+        PushFree(p, NumElemAlignBytes(bytes));
+    }
+
+    /** Number of chunks allocated from the system. */
+    std::size_t NumAllocatedChunks() const { return m_allocated_chunks.size(); }
+
+    /** Total size of the chunks allocated from the system. */
+    std::size_t AllocatedBytes() const { return m_allocated_bytes; }
+
+    /** Part of the chunks that is free for reuse: freed blocks and the untouched end of the current chunk. */
+    std::size_t UnusedBytes() const { return m_free_list_bytes + (m_available_memory_end - m_available_memory_it); }
+};
+
+template <std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+constexpr std::size_t PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>::ELEM_ALIGN_BYTES;
+template <std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+constexpr std::size_t PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>::MIN_CHUNK_SIZE_BYTES;
+template <std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+constexpr std::size_t PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>::DEFAULT_MAX_CHUNK_SIZE_BYTES;
+
+/**
+ * Allocator that serves single-object allocations from a PoolResource, so
+ * that it can be used with node-based containers such as
+ * std::unordered_map. A default-constructed PoolAllocator has no resource and
+ * behaves like std::allocator.
+ */
+template <class T, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES = alignof(T)>
+class PoolAllocator
+{
+    template <class U, std::size_t M, std::size_t A>
+    friend class PoolAllocator;
+
+public:
+    typedef T value_type;
+    typedef PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> ResourceType;
+
+    // Replacing a container's contents also hands over its resource.
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    template <typename U>
+    struct rebind {
+        typedef PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> other;
+    };
+
+    PoolAllocator() noexcept : m_resource(nullptr) {}
+    explicit PoolAllocator(ResourceType* resource) noexcept : m_resource(resource) {}
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& other) noexcept : m_resource(other.m_resource) {}
+
+    T* allocate(std::size_t n)
+    {
+        if (m_resource) {
+            return static_cast<T*>(m_resource->Allocate(n * sizeof(T), alignof(T)));
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept
+    {
+        if (m_resource) {
+            m_resource->Deallocate(p, n * sizeof(T), alignof(T));
+        } else {
+            ::operator delete(p);
+        }
+    }
+
+    ResourceType* resource() const noexcept { return m_resource; }
+
+private:
+    ResourceType* m_resource;
+};
+
+template <class T1, class T2, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+bool operator==(const PoolAllocator<T1, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& a,
+                const PoolAllocator<T2, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& b) noexcept
+{
+    return a.resource() == b.resource();
+}
+
+template <class T1, class T2, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+bool operator!=(const PoolAllocator<T1, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& a,
+                const PoolAllocator<T2, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& b) noexcept
+{
+    return !(a == b);
+}
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_POOL_H
@@ -24,6 +24,7 @@
 extern bool AddOrphanTx(const CTransactionRef& tx, NodeId peer);
 extern void EraseOrphansFor(NodeId peer);
 extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans);
+extern void ProcessTransaction(CNode* pfrom, const CTransactionRef& ptx, CConnman* connman);
 struct COrphanTx {
     CTransactionRef tx;
     NodeId fromPeer;
@@ -213,3 +214,91 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
 }
 
 BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_FIXTURE_TEST_SUITE(DoS_orphan_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(DoS_orphan_rounds)
+{
+    CBasicKeyStore keystore;
+    keystore.AddKey(coinbaseKey);
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    // A parent with three outputs. The first is spent by a child, which is
+    // spent by a grandchild, and the others by transactions without a
+    // signature.
+    CMutableTransaction parent;
+    parent.vin.resize(1);
+    parent.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    parent.vout.resize(3);
+    for (CTxOut& out : parent.vout) {
+        out.nValue = (coinbaseTxns[0].vout[0].nValue - 10000) / 3;
+        out.scriptPubKey = scriptPubKey;
+    }
+    BOOST_REQUIRE(SignSignature(keystore, coinbaseTxns[0], parent, 0, SIGHASH_ALL));
+    CMutableTransaction child = SpendToKey(parent, coinbaseKey);
+    CMutableTransaction grandchild = SpendToKey(child, coinbaseKey);
+    std::vector<CMutableTransaction> vInvalid;
+    for (uint32_t n = 1; n < parent.vout.size(); n++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(parent.GetHash(), n);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = parent.vout[n].nValue - 10000;
+        tx.vout[0].scriptPubKey = scriptPubKey;
+        vInvalid.push_back(tx);
+    }
+
+    std::vector<std::unique_ptr<CNode>> nodes;
+    for (uint32_t i = 0; i < 3; i++) {
+        CAddress addr(ip(0xa0b0c010 + i), NODE_NONE);
+        nodes.emplace_back(new CNode(id++, NODE_NETWORK, 0, INVALID_SOCKET, addr, i, i, CAddress(), "", true));
+        nodes.back()->SetSendVersion(PROTOCOL_VERSION);
+        peerLogic->InitializeNode(nodes.back().get());
+        nodes.back()->nVersion = 1;
+        nodes.back()->fSuccessfullyConnected = true;
+    }
+
+    // The two levels of orphans come from the first two peers, and the
+    // invalid orphans from the third.
+    ProcessTransaction(nodes[0].get(), MakeTransactionRef(child), connman);
+    ProcessTransaction(nodes[1].get(), MakeTransactionRef(grandchild), connman);
+    for (const CMutableTransaction& tx : vInvalid) {
+        ProcessTransaction(nodes[2].get(), MakeTransactionRef(tx), connman);
+    }
+    {
+        LOCK(cs_main);
+        for (const CMutableTransaction& tx : {child, grandchild, vInvalid[0], vInvalid[1]}) {
+            BOOST_CHECK(mapOrphanTransactions.count(tx.GetHash()));
+        }
+    }
+
+    // The parent brings in the child and the invalid orphans in one round,
+    // and the grandchild in the next.
+    ProcessTransaction(nodes[0].get(), MakeTransactionRef(parent), connman);
+    {
+        LOCK(cs_main);
+        for (const CMutableTransaction& tx : {parent, child, grandchild}) {
+            BOOST_CHECK(mempool.exists(tx.GetHash()));
+        }
+        for (const CMutableTransaction& tx : {child, grandchild, vInvalid[0], vInvalid[1]}) {
+            BOOST_CHECK(!mapOrphanTransactions.count(tx.GetHash()));
+        }
+        BOOST_CHECK(!mempool.exists(vInvalid[0].GetHash()));
+        BOOST_CHECK(!mempool.exists(vInvalid[1].GetHash()));
+    }
+
+    // The peer that sent both invalid orphans is punished for one of them.
+    for (size_t i = 0; i < nodes.size(); i++) {
+        CNodeStateStats stats;
+        BOOST_REQUIRE(GetNodeStateStats(nodes[i]->GetId(), stats));
+        BOOST_CHECK_EQUAL(stats.nMisbehavior, i == 2 ? 100 : 0);
+    }
+
+    bool fUpdateConnectionTime = false;
+    for (const std::unique_ptr<CNode>& node : nodes) {
+        peerLogic->FinalizeNode(node->GetId(), fUpdateConnectionTime);
+    }
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
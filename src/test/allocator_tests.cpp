@@ -4,9 +4,13 @@
 
 #include "util.h"
 
+#include "support/allocators/pool.h"
 #include "support/allocators/secure.h"
 #include "test/test_bitcoin.h"
 
+#include <map>
+#include <set>
+
 #include <boost/test/unit_test.hpp>
 
 BOOST_FIXTURE_TEST_SUITE(allocator_tests, BasicTestingSetup)
@@ -231,4 +235,48 @@ BOOST_AUTO_TEST_CASE(lockedpool_tests_live)
     BOOST_CHECK(pool.stats().used == initial.used);
 }
 
+BOOST_AUTO_TEST_CASE(poolresource_tests)
+{
+    typedef PoolResource<64, 8> Resource;
+    Resource resource;
+    BOOST_CHECK(resource.NumAllocatedChunks() == 0);
+
+    // Blocks of the same size class are reused in LIFO order
+    void *a0 = resource.Allocate(24, 8);
+    void *a1 = resource.Allocate(20, 4);
+    BOOST_CHECK(a0 && a1 && a0 != a1);
+    BOOST_CHECK(resource.NumAllocatedChunks() == 1);
+    BOOST_CHECK(resource.AllocatedBytes() == Resource::MIN_CHUNK_SIZE_BYTES);
+    resource.Deallocate(a0, 24, 8);
+    BOOST_CHECK(resource.Allocate(17, 8) == a0);
+    resource.Deallocate(a1, 20, 4);
+    BOOST_CHECK(resource.Allocate(32, 8) != a1);
+
+    // Oversized or overaligned blocks bypass the pool
+    void *big = resource.Allocate(65, 8);
+    resource.Deallocate(big, 65, 8);
+    BOOST_CHECK(resource.NumAllocatedChunks() == 1);
+
+    // Chunks grow geometrically up to the maximum chunk size
+    std::set<void*> blocks;
+    for (int i = 0; i < 100000; ++i) {
+        void *p = resource.Allocate(64, 8);
+        BOOST_CHECK(blocks.insert(p).second);
+        *static_cast<uint64_t*>(p) = i;
+    }
+    BOOST_CHECK(resource.AllocatedBytes() >= 100000 * 64);
+    BOOST_CHECK(resource.AllocatedBytes() < 2 * 100000 * 64 + Resource::DEFAULT_MAX_CHUNK_SIZE_BYTES);
+    for (void *p : blocks) {
+        resource.Deallocate(p, 64, 8);
+    }
+
+    // A container using the allocator shares the resource across rebinds
+    std::map<int, int, std::less<int>, PoolAllocator<std::pair<const int, int>, 64, 8> > m{std::less<int>(), PoolAllocator<std::pair<const int, int>, 64, 8>(&resource)};
+    for (int i = 0; i < 1000; ++i) {
+        m[i] = i;
+    }
+    BOOST_CHECK(m.size() == 1000 && m[999] == 999);
+    BOOST_CHECK(m.get_allocator().resource() == &resource);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,136 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcache.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "primitives/block.h"
+#include "streams.h"
+#include "validation.h"
+#include "version.h"
+#include "test/test_bitcoin.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockcache_tests, BasicTestingSetup)
+
+static CRawBlock MakeRaw(size_t nSize)
+{
+    auto buffer = std::make_shared<std::vector<unsigned char>>(nSize, 0x42);
+    return CRawBlock(buffer, buffer->data(), buffer->size());
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_lru)
+{
+    CBlockCache cache(10000);
+    std::vector<uint256> hashes;
+    for (int i = 0; i < 5; ++i) hashes.push_back(InsecureRand256());
+
+    CRawBlock raw;
+    BOOST_CHECK(!cache.GetRawBlock(hashes[0], true, raw));
+    cache.AddRawBlock(hashes[0], true, MakeRaw(3500));
+    BOOST_CHECK(cache.GetRawBlock(hashes[0], true, raw));
+    BOOST_CHECK_EQUAL(raw.size(), 3500U);
+    // Each form is cached separately.
+    BOOST_CHECK(!cache.GetRawBlock(hashes[0], false, raw));
+    BOOST_CHECK(!cache.GetBlock(hashes[0]));
+    std::shared_ptr<const CBlock> block = std::make_shared<CBlock>();
+    cache.AddBlock(hashes[0], block);
+    BOOST_CHECK(cache.GetBlock(hashes[0]) == block);
+    // Lookups that are not counted leave the statistics alone.
+    BOOST_CHECK(cache.GetRawBlock(hashes[0], true, raw, false));
+    BOOST_CHECK(!cache.GetRawBlock(hashes[0], false, raw, false));
+    BOOST_CHECK(cache.GetBlock(hashes[0], false) == block);
+
+    CBlockCache::Stats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nEntries, 1U);
+    BOOST_CHECK(stats.nUsage > 3500 && stats.nUsage <= 10000);
+    BOOST_CHECK_EQUAL(stats.nHits[CBlockCache::WITNESS], 1U);
+    BOOST_CHECK_EQUAL(stats.nMisses[CBlockCache::WITNESS], 1U);
+    BOOST_CHECK_EQUAL(stats.nHits[CBlockCache::NO_WITNESS], 0U);
+    BOOST_CHECK_EQUAL(stats.nMisses[CBlockCache::NO_WITNESS], 1U);
+    BOOST_CHECK_EQUAL(stats.nHits[CBlockCache::BLOCK], 1U);
+    BOOST_CHECK_EQUAL(stats.nMisses[CBlockCache::BLOCK], 1U);
+
+    // Adding more than fits evicts the least recently used entries.
+    cache.AddRawBlock(hashes[1], true, MakeRaw(3500));
+    BOOST_CHECK(cache.GetRawBlock(hashes[0], true, raw));
+    cache.AddRawBlock(hashes[2], true, MakeRaw(3500));
+    BOOST_CHECK(cache.GetRawBlock(hashes[0], true, raw));
+    BOOST_CHECK(!cache.GetRawBlock(hashes[1], true, raw));
+    BOOST_CHECK(cache.GetRawBlock(hashes[2], true, raw));
+    BOOST_CHECK(cache.GetStats().nUsage <= 10000);
+
+    // A block larger than the limit is not kept.
+    cache.AddRawBlock(hashes[3], false, MakeRaw(20000));
+    BOOST_CHECK(!cache.GetRawBlock(hashes[3], false, raw));
+    BOOST_CHECK_EQUAL(cache.GetStats().nUsage, 0U);
+
+    // The cache copies the bytes instead of holding on to what they were read from.
+    auto buffer = std::make_shared<std::vector<unsigned char>>(100, 0x42);
+    std::weak_ptr<std::vector<unsigned char>> weakBuffer = buffer;
+    cache.AddRawBlock(hashes[3], true, CRawBlock(buffer, buffer->data(), buffer->size()));
+    buffer.reset();
+    BOOST_CHECK(weakBuffer.expired());
+    BOOST_CHECK(cache.GetRawBlock(hashes[3], true, raw));
+    BOOST_CHECK(std::vector<unsigned char>(raw.begin(), raw.end()) == std::vector<unsigned char>(100, 0x42));
+
+    cache.AddRawBlock(hashes[4], true, MakeRaw(3500));
+    cache.SetMaxUsage(0);
+    BOOST_CHECK_EQUAL(cache.GetStats().nEntries, 0U);
+    cache.AddRawBlock(hashes[4], true, MakeRaw(3500));
+    BOOST_CHECK(!cache.GetRawBlock(hashes[4], true, raw));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_FIXTURE_TEST_SUITE(blockcache_chain_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(blockcache_read)
+{
+    const CChainParams& chainparams = Params();
+    blockCache.Clear();
+    const CBlockCache::Stats before = blockCache.GetStats();
+    for (int nHeight : {0, 1, 50, 100}) {
+        const CBlockIndex* pindex = chainActive[nHeight];
+        CBlock block;
+        BOOST_CHECK(ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()));
+
+        for (bool fWitness : {true, false}) {
+            const int nVersion = PROTOCOL_VERSION | (fWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS);
+            CDataStream ss(SER_NETWORK, nVersion);
+            ss << block;
+            for (int i = 0; i < 2; ++i) {
+                CRawBlock raw;
+                BOOST_CHECK(ReadRawBlockCached(raw, pindex, fWitness, chainparams));
+                BOOST_CHECK(std::vector<unsigned char>(raw.begin(), raw.end()) == std::vector<unsigned char>(ss.begin(), ss.end()));
+            }
+        }
+
+        std::shared_ptr<const CBlock> pblock;
+        BOOST_CHECK(ReadBlockCached(pblock, pindex, chainparams));
+        BOOST_CHECK(pblock->GetHash() == pindex->GetBlockHash());
+        std::shared_ptr<const CBlock> pblock2;
+        BOOST_CHECK(ReadBlockCached(pblock2, pindex, chainparams));
+        BOOST_CHECK(pblock2 == pblock);
+    }
+
+    // Each read counts once, in the form requested. The serialized forms were
+    // read from disk or from another form once, and then from the cache. The
+    // deserialized blocks were already made for the form without witnesses.
+    CBlockCache::Stats stats = blockCache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nEntries, 4U);
+    BOOST_CHECK_EQUAL(stats.nHits[CBlockCache::WITNESS] - before.nHits[CBlockCache::WITNESS], 4U);
+    BOOST_CHECK_EQUAL(stats.nMisses[CBlockCache::WITNESS] - before.nMisses[CBlockCache::WITNESS], 4U);
+    BOOST_CHECK_EQUAL(stats.nHits[CBlockCache::NO_WITNESS] - before.nHits[CBlockCache::NO_WITNESS], 4U);
+    BOOST_CHECK_EQUAL(stats.nMisses[CBlockCache::NO_WITNESS] - before.nMisses[CBlockCache::NO_WITNESS], 4U);
+    BOOST_CHECK_EQUAL(stats.nHits[CBlockCache::BLOCK] - before.nHits[CBlockCache::BLOCK], 8U);
+    BOOST_CHECK_EQUAL(stats.nMisses[CBlockCache::BLOCK] - before.nMisses[CBlockCache::BLOCK], 0U);
+    blockCache.Clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
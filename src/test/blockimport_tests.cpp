@@ -0,0 +1,76 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockimport.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "primitives/block.h"
+#include "streams.h"
+#include "validation.h"
+#include "test/test_bitcoin.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockimport_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(blockimport_order)
+{
+    const CChainParams& chainparams = Params();
+    std::vector<unsigned char> data;
+    CVectorWriter writer(SER_DISK, CLIENT_VERSION, data, 0);
+    std::vector<std::pair<uint256, uint64_t>> expected;
+
+    auto writeBlock = [&](const CBlock& block) {
+        writer << FLATDATA(chainparams.MessageStart()) << (unsigned int)::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+        expected.emplace_back(block.GetHash(), data.size());
+        writer << block;
+    };
+
+    for (int nHeight = 1; nHeight <= 100; nHeight++) {
+        CBlock block;
+        BOOST_REQUIRE(ReadBlockFromDisk(block, chainActive[nHeight], chainparams.GetConsensus()));
+        if (nHeight % 10 == 0) {
+            // Garbage, including the first byte of the network magic.
+            writer << (unsigned char)0x17 << (unsigned char)chainparams.MessageStart()[0] << (unsigned char)0x42;
+        }
+        if (nHeight % 25 == 0) {
+            // A frame that does not deserialize and covers the next block,
+            // which is found by scanning again after the frame's magic.
+            std::vector<unsigned char> garbage(80, 0);
+            garbage.insert(garbage.end(), 9, 0xff);
+            writer << FLATDATA(chainparams.MessageStart())
+                   << (unsigned int)(garbage.size() + 8 + ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION));
+            writer.write((const char*)garbage.data(), garbage.size());
+        }
+        writeBlock(block);
+    }
+
+    fs::path path = GetDataDir() / "import.dat";
+    FILE* file = fsbridge::fopen(path, "wb");
+    BOOST_REQUIRE(file);
+    BOOST_REQUIRE_EQUAL(fwrite(data.data(), 1, data.size(), file), data.size());
+    fclose(file);
+
+    for (int nWorkers : {1, 3, 8}) {
+        CBlockFileImporter importer(fsbridge::fopen(path, "rb"), chainparams, nWorkers);
+        std::shared_ptr<CBlock> pblock;
+        uint64_t nPos;
+        size_t i = 0;
+        while (importer.Next(pblock, nPos)) {
+            BOOST_REQUIRE(i < expected.size());
+            BOOST_CHECK(pblock->GetHash() == expected[i].first);
+            BOOST_CHECK_EQUAL(nPos, expected[i].second);
+            BOOST_CHECK(pblock->fChecked);
+            i++;
+        }
+        BOOST_CHECK_EQUAL(i, expected.size());
+    }
+    fs::remove(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
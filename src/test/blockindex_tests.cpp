@@ -0,0 +1,98 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chain.h"
+#include "chainparams.h"
+#include "validation.h"
+#include "test/test_bitcoin.h"
+
+#include <map>
+#include <set>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockindex_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(blockindex_arena)
+{
+    CBlockIndexArena arena;
+    std::set<CBlockIndex*> entries;
+    CBlockIndex* pprev = nullptr;
+    for (int i = 0; i < 10000; i++) {
+        CBlockIndex* pindex = arena.New();
+        pindex->pprev = pprev;
+        pindex->nHeight = i;
+        BOOST_CHECK(entries.insert(pindex).second);
+        pprev = pindex;
+    }
+    BOOST_CHECK_EQUAL(arena.Size(), 10000U);
+    // Entries stay where they were allocated.
+    for (int i = 9999; pprev; i--, pprev = pprev->pprev) {
+        BOOST_CHECK_EQUAL(pprev->nHeight, i);
+    }
+
+    // Reserved entries are allocated next to each other.
+    arena.Reserve(5000);
+    CBlockIndex* pfirst = arena.New();
+    for (int i = 1; i < 5000; i++) {
+        BOOST_CHECK_EQUAL(arena.New(), pfirst + i);
+    }
+    BOOST_CHECK_EQUAL(arena.Size(), 15000U);
+
+    arena.Clear();
+    BOOST_CHECK_EQUAL(arena.Size(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_FIXTURE_TEST_SUITE(blockindex_chain_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(blockindex_reload)
+{
+    const CChainParams& chainparams = Params();
+    LOCK(cs_main);
+    FlushStateToDisk();
+
+    struct Entry {
+        int nHeight;
+        arith_uint256 nChainWork;
+        unsigned int nChainTx;
+        unsigned int nTimeMax;
+        uint32_t nStatus;
+        uint256 hashPrev;
+        uint256 hashSkip;
+    };
+    std::map<uint256, Entry> expected;
+    for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex) {
+        const CBlockIndex* pindex = item.second;
+        expected[item.first] = Entry{pindex->nHeight, pindex->nChainWork, pindex->nChainTx, pindex->nTimeMax, pindex->nStatus,
+            pindex->pprev ? pindex->pprev->GetBlockHash() : uint256(),
+            pindex->pskip ? pindex->pskip->GetBlockHash() : uint256()};
+    }
+    const uint256 hashTip = chainActive.Tip()->GetBlockHash();
+
+    UnloadBlockIndex();
+    BOOST_CHECK(mapBlockIndex.empty());
+    BOOST_REQUIRE(LoadBlockIndex(chainparams));
+    BOOST_REQUIRE(LoadChainTip(chainparams));
+
+    BOOST_CHECK_EQUAL(mapBlockIndex.size(), expected.size());
+    for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex) {
+        const CBlockIndex* pindex = item.second;
+        BOOST_REQUIRE(expected.count(item.first));
+        const Entry& entry = expected[item.first];
+        BOOST_CHECK(pindex->GetBlockHash() == item.first);
+        BOOST_CHECK_EQUAL(pindex->nHeight, entry.nHeight);
+        BOOST_CHECK(pindex->nChainWork == entry.nChainWork);
+        BOOST_CHECK_EQUAL(pindex->nChainTx, entry.nChainTx);
+        BOOST_CHECK_EQUAL(pindex->nTimeMax, entry.nTimeMax);
+        BOOST_CHECK_EQUAL(pindex->nStatus, entry.nStatus);
+        BOOST_CHECK(pindex->pprev ? pindex->pprev->GetBlockHash() == entry.hashPrev : entry.hashPrev.IsNull());
+        BOOST_CHECK(pindex->pskip ? pindex->pskip->GetBlockHash() == entry.hashSkip : entry.hashSkip.IsNull());
+    }
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == hashTip);
+    BOOST_CHECK(pindexBestHeader == chainActive.Tip());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
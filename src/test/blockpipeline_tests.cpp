@@ -0,0 +1,101 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chain.h"
+#include "chainparams.h"
+#include "consensus/merkle.h"
+#include "pow.h"
+#include "primitives/block.h"
+#include "validation.h"
+#include "validationstats.h"
+#include "test/test_bitcoin.h"
+
+#include <memory>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+// The test fixtures leave initial block download for good once any test has
+// built a recent chain, so pipelining is forced on as with -pipelineblocks.
+struct PipelineTestingSetup : public TestingSetup {
+    PipelineTestingSetup() : TestingSetup(CBaseChainParams::REGTEST) { fPipelineBlocks = true; }
+    ~PipelineTestingSetup() { fPipelineBlocks = DEFAULT_PIPELINE_BLOCKS; }
+};
+
+BOOST_FIXTURE_TEST_SUITE(blockpipeline_tests, PipelineTestingSetup)
+
+// A block with only a coinbase paying nValue.
+static std::shared_ptr<CBlock> MakeBlock(const CBlockHeader& prev, int nHeight, CAmount nValue)
+{
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << nHeight << OP_0;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    coinbase.vout[0].nValue = nValue;
+
+    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+    pblock->nVersion = 4;
+    pblock->hashPrevBlock = prev.GetHash();
+    pblock->nTime = prev.nTime + 600;
+    pblock->nBits = prev.nBits;
+    pblock->vtx.push_back(MakeTransactionRef(std::move(coinbase)));
+    pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
+    while (!CheckProofOfWork(pblock->GetHash(), pblock->nBits, Params().GetConsensus())) {
+        pblock->nNonce++;
+    }
+    return pblock;
+}
+
+BOOST_AUTO_TEST_CASE(pipelined_connect_invalid_block)
+{
+    const CChainParams& chainparams = Params();
+    const int nBlocks = 2 * MAX_PIPELINED_BLOCKS + 4;
+    // In the second run of blocks, so only that run falls back to connecting
+    // its blocks one at a time.
+    const int nInvalidHeight = MAX_PIPELINED_BLOCKS + 4;
+
+    std::vector<std::shared_ptr<CBlock>> blocks;
+    std::vector<CBlockHeader> headers;
+    CBlockHeader prev = chainparams.GenesisBlock().GetBlockHeader();
+    for (int nHeight = 1; nHeight <= nBlocks; nHeight++) {
+        CAmount nValue = GetBlockSubsidy(nHeight, chainparams.GetConsensus());
+        if (nHeight == nInvalidHeight) nValue++;
+        blocks.push_back(MakeBlock(prev, nHeight, nValue));
+        headers.push_back(blocks.back()->GetBlockHeader());
+        prev = headers.back();
+    }
+    CValidationState state;
+    BOOST_REQUIRE(ProcessNewBlockHeaders(headers, state, chainparams));
+
+    // Hand over the first block last, so that all of them are connected at once.
+    validationStats.Clear();
+    for (int i = nBlocks - 1; i >= 0; i--) {
+        bool fNewBlock = false;
+        BOOST_CHECK(ProcessNewBlock(chainparams, blocks[i], true, &fNewBlock));
+        BOOST_CHECK(fNewBlock);
+    }
+
+    LOCK(cs_main);
+    BOOST_CHECK_EQUAL(chainActive.Height(), nInvalidHeight - 1);
+    BOOST_CHECK(pcoinsTip->GetBestBlock() == chainActive.Tip()->GetBlockHash());
+    for (int nHeight = 1; nHeight <= nBlocks; nHeight++) {
+        const CBlockIndex* pindex = mapBlockIndex.at(headers[nHeight - 1].GetHash());
+        BOOST_CHECK_EQUAL(pindex->IsValid(BLOCK_VALID_SCRIPTS), nHeight < nInvalidHeight);
+        BOOST_CHECK_EQUAL((pindex->nStatus & BLOCK_FAILED_VALID) != 0, nHeight == nInvalidHeight);
+        BOOST_CHECK(pindex->nStatus & BLOCK_HAVE_DATA);
+    }
+
+    // The first run was connected together, the valid blocks of the second
+    // one by themselves.
+    CValidationStats::Stats stats = validationStats.GetStats(nBlocks);
+    BOOST_REQUIRE_EQUAL(stats.vRecent.size(), (size_t)nInvalidHeight - 1);
+    for (const CValidationStats::BlockRecord& record : stats.vRecent) {
+        BOOST_CHECK(record.hash == headers[record.nHeight - 1].GetHash());
+        BOOST_CHECK_EQUAL(record.fPipelined, record.nHeight <= (int)MAX_PIPELINED_BLOCKS);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,101 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockreader.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "streams.h"
+#include "validation.h"
+#include "version.h"
+#include "test/test_bitcoin.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockreader_tests, BasicTestingSetup)
+
+static void AppendToFile(const fs::path& path, const std::vector<unsigned char>& data)
+{
+    FILE* file = fsbridge::fopen(path, "ab");
+    BOOST_REQUIRE(file);
+    BOOST_REQUIRE_EQUAL(fwrite(data.data(), 1, data.size(), file), data.size());
+    fclose(file);
+}
+
+BOOST_AUTO_TEST_CASE(blockreader_mapper)
+{
+    fs::path dir = fs::temp_directory_path() / fs::unique_path();
+    fs::create_directories(dir);
+    fs::path path = dir / "blk00000.dat";
+    std::vector<unsigned char> data;
+    for (int i = 0; i < 5000; ++i) data.push_back(InsecureRandBits(8));
+    AppendToFile(path, data);
+
+    CBlockFileMapper mapper(2);
+    CRawBlock raw;
+    BOOST_CHECK(mapper.Read(path, 100, 1000, raw));
+    BOOST_CHECK(std::vector<unsigned char>(raw.begin(), raw.end()) == std::vector<unsigned char>(data.begin() + 100, data.begin() + 1100));
+    BOOST_CHECK(mapper.Read(path, 0, 5000, raw));
+    BOOST_CHECK(std::vector<unsigned char>(raw.begin(), raw.end()) == data);
+    BOOST_CHECK(!mapper.Read(path, 4000, 1001, raw));
+    BOOST_CHECK(!mapper.Read(dir / "blk00001.dat", 0, 1, raw));
+
+    // Reading past the end of the mapping maps the file again, once it has grown.
+    CRawBlock old;
+    BOOST_CHECK(mapper.Read(path, 4990, 10, old));
+    std::vector<unsigned char> more(3000, 0x42);
+    AppendToFile(path, more);
+    BOOST_CHECK(mapper.Read(path, 4500, 1000, raw));
+    BOOST_CHECK(std::vector<unsigned char>(raw.begin(), raw.begin() + 500) == std::vector<unsigned char>(data.begin() + 4500, data.end()));
+    BOOST_CHECK(std::vector<unsigned char>(raw.begin() + 500, raw.end()) == std::vector<unsigned char>(500, 0x42));
+    BOOST_CHECK(std::vector<unsigned char>(old.begin(), old.end()) == std::vector<unsigned char>(data.end() - 10, data.end()));
+
+    // Bytes that were read stay valid after the file is forgotten and removed.
+    mapper.Invalidate(path);
+    fs::remove(path);
+    BOOST_CHECK(std::vector<unsigned char>(raw.begin(), raw.begin() + 500) == std::vector<unsigned char>(data.begin() + 4500, data.end()));
+    BOOST_CHECK(!mapper.Read(path, 0, 1, raw));
+
+    // Only the most recently used files stay mapped.
+    for (int i = 0; i < 4; ++i) {
+        AppendToFile(dir / strprintf("blk%05u.dat", i + 1), data);
+        BOOST_CHECK(mapper.Read(dir / strprintf("blk%05u.dat", i + 1), 0, 1, raw));
+    }
+#ifndef WIN32
+    BOOST_CHECK_EQUAL(mapper.Size(), 2U);
+#endif
+    fs::remove_all(dir);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_FIXTURE_TEST_SUITE(blockreader_chain_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(blockreader_raw_block)
+{
+    const CChainParams& chainparams = Params();
+    for (int nHeight : {0, 1, 50, 100}) {
+        const CBlockIndex* pindex = chainActive[nHeight];
+        CBlock block;
+        BOOST_CHECK(ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()));
+        CRawBlock raw;
+        BOOST_CHECK(ReadRawBlockFromDisk(raw, pindex, chainparams.MessageStart()));
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << block;
+        BOOST_CHECK(std::vector<unsigned char>(raw.begin(), raw.end()) == std::vector<unsigned char>(ss.begin(), ss.end()));
+    }
+
+    // The magic preceding the block and the header hash are checked.
+    CRawBlock raw;
+    CMessageHeader::MessageStartChars wrongMagic = {0, 0, 0, 0};
+    BOOST_CHECK(!ReadRawBlockFromDisk(raw, chainActive.Tip(), wrongMagic));
+    CBlockIndex index(*chainActive.Tip()->pprev);
+    index.nFile = chainActive.Tip()->nFile;
+    index.nDataPos = chainActive.Tip()->nDataPos;
+    BOOST_CHECK(!ReadRawBlockFromDisk(raw, &index, chainparams.MessageStart()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,152 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "consensus/merkle.h"
+#include "consensus/validation.h"
+#include "pow.h"
+#include "primitives/block.h"
+#include "validation.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(checkblock_tests, TestingSetup)
+
+static CBlock MakeBlock(size_t nTx)
+{
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << OP_1 << OP_1;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 50 * COIN;
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    for (size_t i = 1; i < nTx; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = COIN;
+        tx.vout[0].scriptPubKey = CScript() << OP_CHECKSIG;
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+    return block;
+}
+
+static void SetTransaction(CBlock& block, size_t i, const CMutableTransaction& tx)
+{
+    block.vtx[i] = MakeTransactionRef(tx);
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+}
+
+// Check a block on the block check threads and on this thread alone, along
+// with the DoS score its peer gets for it.
+static void CheckBothWays(const CBlock& blockIn, bool fExpected, const std::string& strReason, int nDoSExpected = 100)
+{
+    for (int nThreads : {3, 0}) {
+        CBlock block(blockIn);
+        nScriptCheckThreads = nThreads;
+        CValidationState state;
+        BOOST_CHECK_EQUAL(CheckBlock(block, state, Params().GetConsensus(), false), fExpected);
+        BOOST_CHECK_EQUAL(state.GetRejectReason(), strReason);
+        int nDoS = 0;
+        BOOST_CHECK_EQUAL(state.IsInvalid(nDoS), !fExpected);
+        BOOST_CHECK_EQUAL(nDoS, fExpected ? 0 : nDoSExpected);
+    }
+    nScriptCheckThreads = 3;
+}
+
+BOOST_AUTO_TEST_CASE(checkblock_parallel)
+{
+    CBlock block = MakeBlock(200);
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    CheckBothWays(block, true, "");
+
+    // The first failure in block order is reported.
+    CMutableTransaction tx(*block.vtx[170]);
+    tx.vout[0].nValue = -1;
+    SetTransaction(block, 170, tx);
+    CheckBothWays(block, false, "bad-txns-vout-negative");
+
+    tx = CMutableTransaction(*block.vtx[40]);
+    tx.vin.clear();
+    SetTransaction(block, 40, tx);
+    CheckBothWays(block, false, "bad-txns-vin-empty", 10);
+
+    // Failures found before the transactions are checked come first.
+    block.vtx.push_back(block.vtx[0]);
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    CheckBothWays(block, false, "bad-cb-multiple");
+
+    // Sigops are counted over all transactions.
+    block = MakeBlock(200);
+    tx = CMutableTransaction(*block.vtx[100]);
+    tx.vout[0].scriptPubKey = CScript();
+    for (unsigned int i = 0; i < MAX_BLOCK_SIGOPS_COST / WITNESS_SCALE_FACTOR - 198 + 1; i++) {
+        tx.vout[0].scriptPubKey << OP_CHECKSIG;
+    }
+    SetTransaction(block, 100, tx);
+    CheckBothWays(block, false, "bad-blk-sigops");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+struct RegTestingSetup : public TestingSetup {
+    RegTestingSetup() : TestingSetup(CBaseChainParams::REGTEST) {}
+};
+
+BOOST_FIXTURE_TEST_SUITE(checkheaders_tests, RegTestingSetup)
+
+static std::vector<CBlockHeader> MakeHeaders(const CBlockIndex* pindexPrev, size_t nHeaders)
+{
+    std::vector<CBlockHeader> headers;
+    uint256 hashPrev = pindexPrev->GetBlockHash();
+    for (size_t i = 0; i < nHeaders; i++) {
+        CBlockHeader header;
+        header.nVersion = 4;
+        header.hashPrevBlock = hashPrev;
+        header.hashMerkleRoot = InsecureRand256();
+        header.nTime = pindexPrev->nTime + 1 + i;
+        header.nBits = pindexPrev->nBits;
+        while (!CheckProofOfWork(header.GetHash(), header.nBits, Params().GetConsensus())) {
+            header.nNonce++;
+        }
+        headers.push_back(header);
+        hashPrev = header.GetHash();
+    }
+    return headers;
+}
+
+BOOST_AUTO_TEST_CASE(processnewblockheaders_parallel)
+{
+    for (int nThreads : {3, 0}) {
+        nScriptCheckThreads = nThreads;
+        std::vector<CBlockHeader> headers;
+        {
+            LOCK(cs_main);
+            headers = MakeHeaders(chainActive.Tip(), 300);
+        }
+        CValidationState state;
+        const CBlockIndex* pindexLast = nullptr;
+        BOOST_CHECK(ProcessNewBlockHeaders(headers, state, Params(), &pindexLast));
+        BOOST_REQUIRE(pindexLast);
+        BOOST_CHECK(pindexLast->GetBlockHash() == headers.back().GetHash());
+        BOOST_CHECK_EQUAL(pindexLast->nHeight, 300);
+
+        // The headers before one without enough proof of work are accepted.
+        headers = MakeHeaders(pindexLast, 300);
+        while (CheckProofOfWork(headers[200].GetHash(), headers[200].nBits, Params().GetConsensus())) {
+            headers[200].nNonce++;
+        }
+        BOOST_CHECK(!ProcessNewBlockHeaders(headers, state, Params()));
+        BOOST_CHECK_EQUAL(state.GetRejectReason(), "high-hash");
+        LOCK(cs_main);
+        BOOST_CHECK(mapBlockIndex.count(headers[199].GetHash()));
+        BOOST_CHECK(!mapBlockIndex.count(headers[200].GetHash()));
+    }
+    nScriptCheckThreads = 3;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
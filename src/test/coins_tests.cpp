@@ -3,7 +3,9 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "coins.h"
+#include "coinstats.h"
 #include "script/standard.h"
+#include "txdb.h"
 #include "uint256.h"
 #include "undo.h"
 #include "utilstrencodings.h"
@@ -11,13 +13,15 @@
 #include "validation.h"
 #include "consensus/validation.h"
 
+#include <algorithm>
+#include <limits>
 #include <vector>
 #include <map>
 
 #include <boost/test/unit_test.hpp>
 
-int ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out);
-void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, CTxUndo &txundo, int nHeight);
+int ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out, CCoinsRollingStats* stats = nullptr);
+void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, CTxUndo &txundo, int nHeight, CCoinsRollingStats* stats = nullptr);
 
 namespace
 {
@@ -52,18 +56,17 @@ public:
 
     uint256 GetBestBlock() const override { return hashBestBlock_; }
 
-    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock) override
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, bool erase = true) override
     {
-        for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ) {
+        for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it = erase ? mapCoins.erase(it) : std::next(it)) {
             if (it->second.flags & CCoinsCacheEntry::DIRTY) {
                 // Same optimization used in CCoinsViewDB is to only write dirty entries.
-                map_[it->first] = it->second.coin;
+                map_[it->first] = it->second.coin.Expand();
                 if (it->second.coin.IsSpent() && InsecureRandRange(3) == 0) {
                     // Randomly delete empty entries on write.
                     map_.erase(it->first);
                 }
             }
-            mapCoins.erase(it++);
         }
         if (!hashBlock.IsNull())
             hashBestBlock_ = hashBlock;
@@ -276,11 +279,14 @@ UtxoData::iterator FindRandomFrom(const std::set<COutPoint> &utxoSet) {
 // random txs are created and UpdateCoins is used to update the cache stack
 // In particular it is tested that spending a duplicate coinbase tx
 // has the expected effect (the other duplicate is overwritten at all cache levels)
+// It also tests that the rolling UTXO set statistics track the changes.
 BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
 {
     bool spent_a_duplicate_coinbase = false;
     // A simple map to track what we expect the cache stack to represent.
     std::map<COutPoint, Coin> result;
+    // Statistics updated along with the cache stack.
+    CCoinsRollingStats stats;
 
     // The cache stack.
     CCoinsViewTest base; // A CCoinsViewTest at the bottom.
@@ -376,7 +382,7 @@ BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
 
             // Call UpdateCoins on the top cache
             CTxUndo undo;
-            UpdateCoins(tx, *(stack.back()), undo, height);
+            UpdateCoins(tx, *(stack.back()), undo, height, &stats);
 
             // Update the utxo set for future spends
             utxoset.insert(outpoint);
@@ -402,12 +408,14 @@ BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
             // Disconnect the tx from the current UTXO
             // See code in DisconnectBlock
             // remove outputs
-            stack.back()->SpendCoin(utxod->first);
+            Coin spent;
+            stack.back()->SpendCoin(utxod->first, &spent);
+            stats.RemoveCoin(utxod->first, spent);
             // restore inputs
             if (!tx.IsCoinBase()) {
                 const COutPoint &out = tx.vin[0].prevout;
                 Coin coin = undo.vprevout[0];
-                ApplyTxInUndo(std::move(coin), *(stack.back()), out);
+                ApplyTxInUndo(std::move(coin), *(stack.back()), out, &stats);
             }
             // Store as a candidate for reconnection
             disconnected_coins.insert(utxod->first);
@@ -420,12 +428,16 @@ BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
 
         // Once every 1000 iterations and at the end, verify the full cache.
         if (InsecureRandRange(1000) == 1 || i == NUM_SIMULATION_ITERATIONS - 1) {
+            CCoinsRollingStats expected;
             for (auto it = result.begin(); it != result.end(); it++) {
                 bool have = stack.back()->HaveCoin(it->first);
                 const Coin& coin = stack.back()->AccessCoin(it->first);
                 BOOST_CHECK(have == !coin.IsSpent());
                 BOOST_CHECK(coin == it->second);
+                if (!it->second.IsSpent()) expected.AddCoin(it->first, it->second);
             }
+            BOOST_CHECK(stats == expected);
+            BOOST_CHECK(stats.GetHash() == expected.GetHash());
         }
 
         // One every 10 iterations, remove a random entry from the cache
@@ -525,6 +537,77 @@ BOOST_AUTO_TEST_CASE(ccoins_serialization)
     }
 }
 
+BOOST_AUTO_TEST_CASE(ccoins_compact)
+{
+    auto InsecureRandBytes = [](size_t len) {
+        std::vector<unsigned char> ret(len);
+        for (unsigned char& byte : ret) byte = InsecureRandBits(8);
+        return ret;
+    };
+    std::vector<Coin> coins;
+    coins.emplace_back(CTxOut(1, GetScriptForDestination(CKeyID(uint160(InsecureRandBytes(20))))), 1, false);
+    coins.emplace_back(CTxOut(2, GetScriptForDestination(CScriptID(uint160(InsecureRandBytes(20))))), 2, true);
+    coins.emplace_back(CTxOut(MAX_MONEY, CScript() << OP_0 << InsecureRandBytes(20)), 3, false);
+    coins.emplace_back(CTxOut(4, CScript() << OP_0 << InsecureRandBytes(32)), 4, false);
+    coins.emplace_back(CTxOut(5, CScript() << InsecureRandBytes(33) << OP_CHECKSIG), 0x7fffffff, true);
+    coins.emplace_back(CTxOut(0, CScript()), 0, false);
+    coins.emplace_back();
+
+    for (const Coin& coin : coins) {
+        CompactCoin compact(coin);
+        BOOST_CHECK_EQUAL(compact.IsSpent(), coin.IsSpent());
+        Coin expanded = compact.Expand();
+        BOOST_CHECK(expanded.out == coin.out);
+        BOOST_CHECK_EQUAL(expanded.nHeight, coin.nHeight);
+        BOOST_CHECK_EQUAL(expanded.fCoinBase, coin.fCoinBase);
+        if (!coin.IsSpent()) {
+            BOOST_CHECK(SerializeHash(compact) == SerializeHash(coin));
+        }
+
+        // Only the scripts that are not reduced to a hash live on the heap.
+        bool inline_script = coin.IsSpent() || expanded.out.scriptPubKey.size() == 25 ||
+                             expanded.out.scriptPubKey.size() == 23 || expanded.out.scriptPubKey.size() == 22;
+        BOOST_CHECK_EQUAL(compact.DynamicMemoryUsage(), inline_script ? 0 : memusage::MallocUsage(coin.out.scriptPubKey.size()));
+        BOOST_CHECK(compact.DynamicMemoryUsage() <= coin.DynamicMemoryUsage());
+
+        CompactCoin copy(compact);
+        BOOST_CHECK_EQUAL(copy.DynamicMemoryUsage(), compact.DynamicMemoryUsage());
+        BOOST_CHECK(copy.Expand().out == coin.out);
+        CompactCoin moved(std::move(copy));
+        BOOST_CHECK(moved.Expand().out == coin.out);
+        BOOST_CHECK(copy.IsSpent());
+        compact.Clear();
+        BOOST_CHECK(compact.IsSpent());
+        BOOST_CHECK_EQUAL(compact.DynamicMemoryUsage(), 0U);
+    }
+    BOOST_CHECK(sizeof(CompactCoin) < sizeof(Coin));
+
+    // An amount that does not fit in 56 bits is kept whole instead.
+    Coin large(CTxOut(std::numeric_limits<CAmount>::max(), CScript() << OP_TRUE), 5, false);
+    CompactCoin compact(large);
+    BOOST_CHECK(compact.Expand().out == large.out);
+    BOOST_CHECK(SerializeHash(compact) == SerializeHash(large));
+    CompactCoin copy(compact);
+    BOOST_CHECK(copy.Expand().out == large.out);
+    CompactCoin moved(std::move(large));
+    BOOST_CHECK(moved.Expand().out == compact.Expand().out);
+    moved.Clear();
+    BOOST_CHECK(moved.IsSpent());
+    BOOST_CHECK_EQUAL(moved.DynamicMemoryUsage(), 0U);
+
+    // Accessing coins in a cache leaves their entries compact.
+    CCoinsView base;
+    CCoinsViewCache cache(&base);
+    for (size_t i = 0; i < coins.size(); i++) {
+        if (!coins[i].IsSpent()) cache.AddCoin(COutPoint(uint256(), i), Coin(coins[i]), false);
+    }
+    size_t usage = cache.DynamicMemoryUsage();
+    for (size_t i = 0; i < coins.size(); i++) {
+        BOOST_CHECK(cache.AccessCoin(COutPoint(uint256(), i)).out == coins[i].out);
+    }
+    BOOST_CHECK_EQUAL(cache.DynamicMemoryUsage(), usage);
+}
+
 const static COutPoint OUTPOINT;
 const static CAmount PRUNED = -1;
 const static CAmount ABSENT = -2;
@@ -559,9 +642,10 @@ size_t InsertCoinsMapEntry(CCoinsMap& map, CAmount value, char flags)
         return 0;
     }
     assert(flags != NO_ENTRY);
-    CCoinsCacheEntry entry;
+    Coin coin;
+    SetCoinsValue(value, coin);
+    CCoinsCacheEntry entry(std::move(coin));
     entry.flags = flags;
-    SetCoinsValue(value, entry.coin);
     auto inserted = map.emplace(OUTPOINT, std::move(entry));
     assert(inserted.second);
     return inserted.first->second.coin.DynamicMemoryUsage();
@@ -577,7 +661,7 @@ void GetCoinsMapEntry(const CCoinsMap& map, CAmount& value, char& flags)
         if (it->second.coin.IsSpent()) {
             value = PRUNED;
         } else {
-            value = it->second.coin.out.nValue;
+            value = it->second.coin.Expand().out.nValue;
         }
         flags = it->second.flags;
         assert(flags != NO_ENTRY);
@@ -855,4 +939,210 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+static Coin MakeTestCoin(CAmount value)
+{
+    Coin coin;
+    coin.out.nValue = value;
+    coin.nHeight = 1;
+    return coin;
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_sync)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 100; ++i) {
+        outpoints.emplace_back(InsecureRand256(), 0);
+        cache.AddCoin(outpoints.back(), MakeTestCoin(i + 1), false);
+    }
+    for (int i = 0; i < 10; ++i) {
+        cache.SpendCoin(outpoints[i]);
+    }
+    cache.SetBestBlock(InsecureRand256());
+
+    // Unspent coins are written, and stay cached as unmodified entries.
+    BOOST_CHECK(cache.Sync());
+    cache.SelfTest();
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 90U);
+    for (const auto& entry : cache.map()) {
+        BOOST_CHECK_EQUAL(entry.second.flags, 0);
+    }
+    for (int i = 0; i < 100; ++i) {
+        Coin coin;
+        BOOST_CHECK_EQUAL(base.GetCoin(outpoints[i], coin) && !coin.IsSpent(), i >= 10);
+    }
+
+    // A coin spent after syncing is removed from the base view and the cache on the next sync.
+    cache.SpendCoin(outpoints[10]);
+    BOOST_CHECK(cache.Sync());
+    cache.SelfTest();
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 89U);
+    Coin coin;
+    BOOST_CHECK(!base.GetCoin(outpoints[10], coin) || coin.IsSpent());
+    BOOST_CHECK(cache.HaveCoinInCache(outpoints[11]));
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_evict_clean)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+    cache.SetBestBlock(InsecureRand256());
+
+    // Three generations of coins, used in successive epochs of the cache
+    // (which advance whenever a child cache is written into it).
+    std::vector<COutPoint> generations[3];
+    for (int gen = 0; gen < 3; ++gen) {
+        for (int i = 0; i < 1000; ++i) {
+            generations[gen].emplace_back(InsecureRand256(), 0);
+            cache.AddCoin(generations[gen].back(), MakeTestCoin(1), false);
+        }
+        CCoinsViewCache child(&cache);
+        BOOST_CHECK(child.Flush());
+    }
+    BOOST_CHECK(cache.Sync());
+
+    // Use a tenth of the oldest coins again, and add an unwritten coin.
+    for (int i = 0; i < 100; ++i) {
+        cache.AccessCoin(generations[0][i]);
+    }
+    COutPoint modified(InsecureRand256(), 0);
+    cache.AddCoin(modified, MakeTestCoin(1), false);
+
+    BOOST_CHECK_EQUAL(cache.EvictClean(cache.DynamicMemoryUsage()), 0U);
+    size_t target = cache.DynamicMemoryUsage() / 2;
+    BOOST_CHECK_EQUAL(cache.EvictClean(target), 1900U);
+    cache.SelfTest();
+    BOOST_CHECK(cache.DynamicMemoryUsage() <= target);
+
+    for (int i = 0; i < 1000; ++i) {
+        BOOST_CHECK_EQUAL(cache.HaveCoinInCache(generations[0][i]), i < 100);
+        BOOST_CHECK(!cache.HaveCoinInCache(generations[1][i]));
+        BOOST_CHECK(cache.HaveCoinInCache(generations[2][i]));
+    }
+    BOOST_CHECK(cache.HaveCoinInCache(modified));
+
+    // Evicted coins are still available from the base view.
+    BOOST_CHECK(cache.HaveCoin(generations[1][0]));
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_flush_releases_memory)
+{
+    CCoinsView base;
+    CCoinsViewCacheTest root(&base);
+    CCoinsViewCacheTest cache(&root);
+    const size_t empty_usage = cache.DynamicMemoryUsage();
+
+    for (int i = 0; i < 10000; ++i) {
+        COutPoint outpoint(InsecureRand256(), InsecureRand32());
+        Coin coin;
+        coin.out.nValue = InsecureRand32();
+        coin.nHeight = 1;
+        cache.AddCoin(outpoint, std::move(coin), false);
+    }
+    cache.SelfTest();
+    BOOST_CHECK(cache.DynamicMemoryUsage() > empty_usage + 10000 * sizeof(CCoinsMap::value_type));
+
+    // Flushing hands the coins to the parent and gives the pool memory back.
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+    BOOST_CHECK_EQUAL(root.GetCacheSize(), 10000U);
+    BOOST_CHECK_EQUAL(cache.DynamicMemoryUsage(), empty_usage);
+    root.SelfTest();
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_pool_usage)
+{
+    CCoinsMapMemoryResource resource;
+    CCoinsMap map(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), CCoinsMapAllocator(&resource));
+    for (int i = 0; i < 3; ++i) {
+        map[COutPoint(InsecureRand256(), 0)];
+    }
+    // The few buckets are carved out of the single chunk along with the
+    // nodes, and are not counted again.
+    BOOST_CHECK(map.bucket_count() > 1);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), resource.AllocatedBytes() - resource.UnusedBytes() + memusage::MallocUsage(16) - 16 + memusage::MallocUsage(sizeof(void*)));
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_sharded_cursors)
+{
+    CCoinsViewDB db(1 << 20, true);
+    CCoinsViewCache cache(&db);
+    for (int i = 0; i < 1000; ++i) {
+        uint256 txid = InsecureRand256();
+        // Include txids at the ends of the key range.
+        if (i == 0) memset(txid.begin(), 0, 2);
+        if (i == 1) memset(txid.begin(), 0xff, 2);
+        for (uint32_t n = 0; n < 1 + InsecureRandRange(3); ++n) {
+            Coin coin;
+            coin.out.nValue = InsecureRand32();
+            coin.nHeight = 1;
+            cache.AddCoin(COutPoint(txid, n), std::move(coin), false);
+        }
+    }
+    uint256 hashBlock = InsecureRand256();
+    cache.SetBestBlock(hashBlock);
+    BOOST_CHECK(cache.Flush());
+
+    std::vector<COutPoint> expected;
+    std::unique_ptr<CCoinsViewCursor> cursor(db.Cursor());
+    for (; cursor->Valid(); cursor->Next()) {
+        COutPoint key;
+        BOOST_CHECK(cursor->GetKey(key));
+        expected.push_back(key);
+    }
+    BOOST_CHECK(expected.size() > 1000);
+
+    // The ranges together return the same coins in the same order.
+    for (int nShards : {1, 3, 256, 1000, MAX_COINS_SHARDS}) {
+        std::vector<COutPoint> outpoints;
+        std::vector<std::unique_ptr<CCoinsViewCursor>> cursors = db.ShardedCursors(nShards);
+        BOOST_CHECK(cursors.size() == (size_t)nShards);
+        for (auto& shard : cursors) {
+            BOOST_CHECK(shard->GetBestBlock() == hashBlock);
+            for (; shard->Valid(); shard->Next()) {
+                COutPoint key;
+                BOOST_CHECK(shard->GetKey(key));
+                outpoints.push_back(key);
+            }
+        }
+        BOOST_CHECK(outpoints == expected);
+    }
+
+    // The cursors see the database as of their creation.
+    std::vector<std::unique_ptr<CCoinsViewCursor>> cursors = db.ShardedCursors(4);
+    cache.SpendCoin(expected[0]);
+    cache.AddCoin(COutPoint(InsecureRand256(), 0), Coin(CTxOut(1, CScript()), 1, false), false);
+    cache.SetBestBlock(InsecureRand256());
+    BOOST_CHECK(cache.Flush());
+    size_t nCount = 0;
+    for (auto& shard : cursors) {
+        BOOST_CHECK(shard->GetBestBlock() == hashBlock);
+        for (; shard->Valid(); shard->Next()) nCount++;
+    }
+    BOOST_CHECK_EQUAL(nCount, expected.size());
+    expected.erase(expected.begin());
+
+    // A parallel scan reduces the ranges in order.
+    std::vector<std::vector<COutPoint>> shards(100);
+    std::vector<COutPoint> outpoints;
+    BOOST_CHECK(db.ParallelScan(100, 4, [&shards](int n, CCoinsViewCursor& shard) {
+        for (; shard.Valid(); shard.Next()) {
+            COutPoint key;
+            if (!shard.GetKey(key)) return false;
+            shards[n].push_back(key);
+        }
+        return true;
+    }, [&shards, &outpoints](int n) {
+        outpoints.insert(outpoints.end(), shards[n].begin(), shards[n].end());
+    }));
+    BOOST_CHECK_EQUAL(outpoints.size(), expected.size() + 1);
+    BOOST_CHECK(std::includes(outpoints.begin(), outpoints.end(), expected.begin(), expected.end()));
+
+    // A failing range makes the scan fail.
+    BOOST_CHECK(!db.ParallelScan(100, 4, [](int n, CCoinsViewCursor& shard) { return n != 42; }, [](int n) {}));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
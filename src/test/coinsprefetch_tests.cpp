@@ -0,0 +1,170 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinsprefetch.h"
+#include "primitives/block.h"
+#include "utiltime.h"
+
+#include "test/test_bitcoin.h"
+
+#include <map>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+namespace {
+
+//! Read-only base view, safe to use from the prefetch thread.
+class CCoinsViewMap : public CCoinsView
+{
+public:
+    std::map<COutPoint, Coin> coins;
+    size_t nWritten = 0;
+
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const override
+    {
+        auto it = coins.find(outpoint);
+        if (it == coins.end()) return false;
+        coin = it->second;
+        return true;
+    }
+
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, bool erase = true) override
+    {
+        for (const auto& entry : mapCoins) {
+            if (entry.second.flags & CCoinsCacheEntry::DIRTY) nWritten++;
+        }
+        if (erase) mapCoins.clear();
+        return true;
+    }
+};
+
+COutPoint RandomOutPoint()
+{
+    return COutPoint(InsecureRand256(), InsecureRandBits(2));
+}
+
+Coin MakeCoin()
+{
+    Coin coin;
+    coin.out.nValue = InsecureRandRange(1000) + 1;
+    coin.out.scriptPubKey.assign(InsecureRandBits(5), 0);
+    coin.nHeight = 1;
+    return coin;
+}
+
+CTransactionRef MakeTx(const std::vector<COutPoint>& prevouts)
+{
+    CMutableTransaction tx;
+    for (const COutPoint& prevout : prevouts) {
+        tx.vin.emplace_back(prevout);
+    }
+    tx.vout.resize(1);
+    return MakeTransactionRef(tx);
+}
+
+//! Wait until the prefetcher has read at least n coins (or given up on them).
+void WaitForPrefetch(CCoinsPrefetcher& prefetcher, uint64_t n)
+{
+    for (int i = 0; i < 1000; ++i) {
+        CCoinsPrefetchStats stats = prefetcher.GetStats();
+        if (stats.nPrefetched + stats.nDiscarded >= n) return;
+        MilliSleep(5);
+    }
+}
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(coinsprefetch_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(block_prevouts)
+{
+    COutPoint a = RandomOutPoint(), b = RandomOutPoint(), c = RandomOutPoint();
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.resize(1);
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    block.vtx.push_back(MakeTx({a, b}));
+    // Spends an output created earlier in the same block, which isn't prefetched.
+    block.vtx.push_back(MakeTx({COutPoint(block.vtx[1]->GetHash(), 0), c}));
+
+    std::vector<COutPoint> prevouts = CCoinsPrefetcher::GetBlockPrevouts(block);
+    BOOST_CHECK(prevouts == std::vector<COutPoint>({a, b, c}));
+}
+
+BOOST_AUTO_TEST_CASE(prefetch_into_cache)
+{
+    CCoinsViewMap base;
+    CCoinsViewCache cache(&base);
+    CCoinsPrefetcher prefetcher;
+
+    std::vector<COutPoint> prevouts;
+    for (int i = 0; i < 200; ++i) {
+        prevouts.push_back(RandomOutPoint());
+        base.coins[prevouts.back()] = MakeCoin();
+    }
+    // One input that is already cached, and one that doesn't exist.
+    cache.AccessCoin(prevouts[0]);
+    prevouts.push_back(RandomOutPoint());
+    CBlock block;
+    block.vtx.push_back(MakeTx(prevouts));
+
+    boost::thread_group threads;
+    threads.create_thread(boost::bind(&CCoinsPrefetcher::Thread, &prefetcher));
+
+    prefetcher.Enqueue(block, &base, cache);
+    WaitForPrefetch(prefetcher, 199);
+    BOOST_CHECK_EQUAL(prefetcher.GetStats().nPrefetched, 199U);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 1U);
+
+    size_t usage = cache.DynamicMemoryUsage();
+    prefetcher.Drain(cache);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 200U);
+    BOOST_CHECK(cache.DynamicMemoryUsage() > usage);
+    for (int i = 0; i < 200; ++i) {
+        BOOST_CHECK(cache.HaveCoinInCache(prevouts[i]));
+        BOOST_CHECK(cache.AccessCoin(prevouts[i]).out == base.coins[prevouts[i]].out);
+    }
+
+    prefetcher.CountHits(block, cache);
+    BOOST_CHECK_EQUAL(prefetcher.GetStats().nHits, 200U);
+    BOOST_CHECK_EQUAL(prefetcher.GetStats().nMisses, 1U);
+
+    // Prefetched entries are clean: flushing writes nothing to the base view.
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK_EQUAL(base.nWritten, 0U);
+
+    threads.interrupt_all();
+    threads.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(prefetch_invalidate)
+{
+    CCoinsViewMap base;
+    CCoinsViewCache cache(&base);
+    CCoinsPrefetcher prefetcher;
+
+    COutPoint outpoint = RandomOutPoint();
+    base.coins[outpoint] = MakeCoin();
+    CBlock block;
+    block.vtx.push_back(MakeTx({outpoint}));
+
+    boost::thread_group threads;
+    threads.create_thread(boost::bind(&CCoinsPrefetcher::Thread, &prefetcher));
+
+    prefetcher.Enqueue(block, &base, cache);
+    WaitForPrefetch(prefetcher, 1);
+
+    // The coin gets spent and the base view written before the coin is used.
+    prefetcher.Invalidate();
+    prefetcher.Drain(cache);
+    BOOST_CHECK(!cache.HaveCoinInCache(outpoint));
+    BOOST_CHECK_EQUAL(prefetcher.GetStats().nDiscarded, 1U);
+
+    threads.interrupt_all();
+    threads.join_all();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
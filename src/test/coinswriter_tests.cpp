@@ -0,0 +1,170 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinswriter.h"
+
+#include "test/test_bitcoin.h"
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+//! Base view whose writes can be held up until the test releases them.
+class CCoinsViewBlocking : public CCoinsView
+{
+public:
+    mutable std::mutex mutex;
+    std::condition_variable cond;
+    std::map<COutPoint, Coin> coins;
+    uint256 hashBestBlock;
+    bool fBlock = false;
+    bool fFail = false;
+    int nWrites = 0;
+
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const override
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = coins.find(outpoint);
+        if (it == coins.end()) return false;
+        coin = it->second;
+        return true;
+    }
+
+    uint256 GetBestBlock() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return hashBestBlock;
+    }
+
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, bool erase = true) override
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [this] { return !fBlock; });
+        if (fFail) return false;
+        for (const auto& entry : mapCoins) {
+            if (!(entry.second.flags & CCoinsCacheEntry::DIRTY)) continue;
+            if (entry.second.coin.IsSpent()) {
+                coins.erase(entry.first);
+            } else {
+                coins[entry.first] = entry.second.coin.Expand();
+            }
+        }
+        if (erase) mapCoins.clear();
+        hashBestBlock = hashBlock;
+        nWrites++;
+        return true;
+    }
+
+    void SetBlocked(bool fBlockIn)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            fBlock = fBlockIn;
+        }
+        cond.notify_all();
+    }
+};
+
+Coin MakeCoin()
+{
+    Coin coin;
+    coin.out.nValue = InsecureRandRange(1000) + 1;
+    coin.out.scriptPubKey.assign(InsecureRandBits(5), 0);
+    coin.nHeight = 1;
+    return coin;
+}
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(coinswriter_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(write_in_background)
+{
+    CCoinsViewBlocking base;
+    CCoinsViewAsyncWriter writer(&base);
+    CCoinsViewCache cache(&writer);
+
+    COutPoint spent(InsecureRand256(), 0), created(InsecureRand256(), 1);
+    Coin coin = MakeCoin();
+    base.coins[spent] = MakeCoin();
+    base.hashBestBlock = InsecureRand256();
+
+    cache.SpendCoin(spent);
+    cache.AddCoin(created, Coin(coin), false);
+    uint256 hashBlock = InsecureRand256();
+    cache.SetBestBlock(hashBlock);
+
+    // The write is held up in the base view, but Sync() returns regardless.
+    base.SetBlocked(true);
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK(writer.GetStats().fPending);
+    BOOST_CHECK(writer.DynamicMemoryUsage() > 0);
+
+    // The pending write is visible through the writer, and not yet in the base view.
+    Coin result;
+    BOOST_CHECK(!writer.GetCoin(spent, result));
+    BOOST_CHECK(writer.GetCoin(created, result));
+    BOOST_CHECK(result.out == coin.out);
+    BOOST_CHECK(writer.GetBestBlock() == hashBlock);
+    BOOST_CHECK(base.GetCoin(spent, result));
+    BOOST_CHECK(!base.GetCoin(created, result));
+
+    base.SetBlocked(false);
+    BOOST_CHECK(writer.Wait());
+    BOOST_CHECK(!writer.GetStats().fPending);
+    BOOST_CHECK_EQUAL(writer.DynamicMemoryUsage(), 0U);
+    BOOST_CHECK_EQUAL(writer.GetStats().nWrites, 1U);
+    BOOST_CHECK_EQUAL(writer.GetStats().nCoinsWritten, 2U);
+    BOOST_CHECK(!base.GetCoin(spent, result));
+    BOOST_CHECK(base.GetCoin(created, result));
+    BOOST_CHECK(result.out == coin.out);
+    BOOST_CHECK(base.GetBestBlock() == hashBlock);
+}
+
+BOOST_AUTO_TEST_CASE(write_waits_for_previous)
+{
+    CCoinsViewBlocking base;
+    CCoinsViewAsyncWriter writer(&base);
+    CCoinsViewCache cache(&writer);
+
+    for (int i = 0; i < 10; ++i) {
+        cache.AddCoin(COutPoint(InsecureRand256(), 0), MakeCoin(), false);
+        cache.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(cache.Sync());
+    }
+    BOOST_CHECK(writer.Wait());
+    BOOST_CHECK_EQUAL(base.nWrites, 10);
+    BOOST_CHECK_EQUAL(base.coins.size(), 10U);
+    BOOST_CHECK(base.GetBestBlock() == cache.GetBestBlock());
+}
+
+BOOST_AUTO_TEST_CASE(write_failure)
+{
+    CCoinsViewBlocking base;
+    CCoinsViewAsyncWriter writer(&base);
+    CCoinsViewCache cache(&writer);
+
+    COutPoint outpoint(InsecureRand256(), 0);
+    Coin coin = MakeCoin();
+    cache.AddCoin(outpoint, Coin(coin), false);
+    base.fFail = true;
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK(!writer.Wait());
+    BOOST_CHECK(writer.Failed());
+
+    // The coin that failed to be written can still be looked up.
+    Coin result;
+    BOOST_CHECK(writer.GetCoin(outpoint, result));
+    BOOST_CHECK(result.out == coin.out);
+
+    // Later writes are refused.
+    cache.AddCoin(COutPoint(InsecureRand256(), 0), MakeCoin(), false);
+    BOOST_CHECK(!cache.Sync());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
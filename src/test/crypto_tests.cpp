@@ -2,6 +2,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "crypto/adhash.h"
 #include "crypto/aes.h"
 #include "crypto/chacha20.h"
 #include "crypto/ripemd160.h"
@@ -10,7 +11,9 @@
 #include "crypto/sha512.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
+#include "hash.h"
 #include "random.h"
+#include "streams.h"
 #include "utilstrencodings.h"
 #include "test/test_bitcoin.h"
 
@@ -505,4 +508,88 @@ BOOST_AUTO_TEST_CASE(countbits_tests)
     }
 }
 
+BOOST_AUTO_TEST_CASE(sha256d64)
+{
+    for (int i = 0; i <= 32; ++i) {
+        unsigned char in[64 * 32];
+        unsigned char out1[32 * 32], out2[32 * 32];
+        for (int j = 0; j < 64 * i; ++j) {
+            in[j] = InsecureRandBits(8);
+        }
+        for (int j = 0; j < i; ++j) {
+            CHash256().Write(in + 64 * j, 64).Finalize(out1 + 32 * j);
+        }
+        SHA256D64(out2, in, i);
+        BOOST_CHECK(memcmp(out1, out2, 32 * i) == 0);
+        // Hashing in place gives the same result.
+        SHA256D64(in, in, i);
+        BOOST_CHECK(memcmp(out1, in, 32 * i) == 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(adhash_tests)
+{
+    std::vector<std::vector<unsigned char>> elements;
+    for (int i = 0; i < 16; ++i) {
+        elements.push_back(ParseHex(InsecureRand256().GetHex()));
+    }
+
+    // The empty set hashes to the digest of the zero state.
+    unsigned char hash1[AdHash4096::OUTPUT_SIZE], hash2[AdHash4096::OUTPUT_SIZE];
+    std::vector<unsigned char> zero(AdHash4096::BYTE_SIZE, 0);
+    AdHash4096 empty;
+    empty.Finalize(hash1);
+    CSHA256().Write(zero.data(), zero.size()).Finalize(hash2);
+    BOOST_CHECK(memcmp(hash1, hash2, sizeof(hash1)) == 0);
+
+    // Insertion order doesn't matter.
+    AdHash4096 forward, backward;
+    for (size_t i = 0; i < elements.size(); ++i) {
+        forward.Insert(elements[i].data(), elements[i].size());
+        backward.Insert(elements[elements.size() - 1 - i].data(), elements[i].size());
+    }
+    BOOST_CHECK(forward == backward);
+    forward.Finalize(hash1);
+    backward.Finalize(hash2);
+    BOOST_CHECK(memcmp(hash1, hash2, sizeof(hash1)) == 0);
+    BOOST_CHECK(forward != empty);
+
+    // Removing elements gives the hash of the remaining set, and combining
+    // the hashes of two halves gives the hash of the whole.
+    AdHash4096 half1, half2;
+    for (size_t i = 0; i < elements.size(); ++i) {
+        (i % 2 ? half1 : half2).Insert(elements[i].data(), elements[i].size());
+        if (i % 2 == 0) backward.Remove(elements[i].data(), elements[i].size());
+    }
+    BOOST_CHECK(backward == half1);
+    half1 += half2;
+    BOOST_CHECK(half1 == forward);
+    half1 -= half2;
+    half1 -= forward;
+    half1 += half2;
+    BOOST_CHECK(half1 == empty);
+
+    // Multiset semantics: an element inserted twice must be removed twice.
+    AdHash4096 twice;
+    twice.Insert(elements[0].data(), elements[0].size()).Insert(elements[0].data(), elements[0].size());
+    twice.Remove(elements[0].data(), elements[0].size());
+    BOOST_CHECK(twice != empty);
+    twice.Remove(elements[0].data(), elements[0].size());
+    BOOST_CHECK(twice == empty);
+
+    // Serialization round trip.
+    CDataStream ss(SER_DISK, 0);
+    ss << forward;
+    BOOST_CHECK(ss.size() == AdHash4096::BYTE_SIZE);
+    AdHash4096 copy;
+    ss >> copy;
+    BOOST_CHECK(copy == forward);
+
+    // Regression test vector.
+    AdHash4096 fixed;
+    fixed.Insert((const unsigned char*)"abc", 3).Insert((const unsigned char*)"", 0).Remove((const unsigned char*)"xyz", 3);
+    fixed.Finalize(hash1);
+    BOOST_CHECK_EQUAL(HexStr(hash1, hash1 + sizeof(hash1)), "14906923641de3441d08a2d68501cd8b8f8c6932b4ff149469dd33a278c4dbb2");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -286,7 +286,7 @@ BOOST_AUTO_TEST_CASE(MempoolIndexingTest)
 
     pool.removeRecursive(pool.mapTx.find(tx9.GetHash())->GetTx());
     pool.removeRecursive(pool.mapTx.find(tx8.GetHash())->GetTx());
-    /* Now check the sort on the mining score index.
+    /* Now check the sort on the mining score.
      * Final order should be:
      *
      * tx7 (2M)
@@ -314,7 +314,12 @@ BOOST_AUTO_TEST_CASE(MempoolIndexingTest)
         sortedOrder.push_back(tx3.GetHash().ToString());
         sortedOrder.push_back(tx6.GetHash().ToString());
     }
-    CheckSort<mining_score>(pool, sortedOrder);
+    std::vector<CTxMemPoolEntry> vMiningOrder(pool.mapTx.begin(), pool.mapTx.end());
+    std::sort(vMiningOrder.begin(), vMiningOrder.end(), CompareTxMemPoolEntryByScore());
+    BOOST_CHECK_EQUAL(vMiningOrder.size(), sortedOrder.size());
+    for (size_t i = 0; i < vMiningOrder.size(); i++) {
+        BOOST_CHECK_EQUAL(vMiningOrder[i].GetTx().GetHash().ToString(), sortedOrder[i]);
+    }
 }
 
 BOOST_AUTO_TEST_CASE(MempoolAncestorIndexingTest)
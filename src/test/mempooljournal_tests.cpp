@@ -0,0 +1,144 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "consensus/validation.h"
+#include "mempooljournal.h"
+#include "script/sign.h"
+#include "txmempool.h"
+#include "util.h"
+#include "validation.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(mempooljournal_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(journal_records)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    fs::path path = GetDataDir() / "test.journal";
+
+    CMutableTransaction tx1 = SpendToKey(coinbaseTxns[0], coinbaseKey, 10000);
+    CMutableTransaction tx2 = SpendToKey(coinbaseTxns[1], coinbaseKey, 10000);
+    CMutableTransaction tx3 = SpendToKey(coinbaseTxns[2], coinbaseKey, 10000);
+
+    {
+        CMempoolJournal journal(pool, path, 10);
+        LOCK(pool.cs);
+        pool.addUnchecked(tx1.GetHash(), entry.Time(1000).FromTx(tx1));
+        pool.addUnchecked(tx2.GetHash(), entry.FromTx(tx2));
+        pool.removeRecursive(tx1);
+        BOOST_CHECK(journal.GetSize() > 0);
+        // The records are buffered until the journal is flushed.
+        BOOST_CHECK_EQUAL(fs::file_size(path), 0U);
+        journal.Flush();
+        BOOST_CHECK_EQUAL(fs::file_size(path), journal.GetSize());
+    }
+
+    std::vector<CMempoolJournal::Record> records;
+    BOOST_REQUIRE(CMempoolJournal::Read(path, records));
+    BOOST_REQUIRE_EQUAL(records.size(), 3U);
+    BOOST_CHECK_EQUAL(records[0].nType, CMempoolJournal::ADDED);
+    BOOST_CHECK_EQUAL(records[0].nSeq, 11U);
+    BOOST_CHECK(records[0].tx->GetHash() == tx1.GetHash());
+    BOOST_CHECK_EQUAL(records[1].nSeq, 12U);
+    BOOST_CHECK(records[1].tx->GetHash() == tx2.GetHash());
+    BOOST_CHECK_EQUAL(records[2].nType, CMempoolJournal::REMOVED);
+    BOOST_CHECK_EQUAL(records[2].nSeq, 13U);
+    BOOST_CHECK(records[2].txid == tx1.GetHash());
+    BOOST_CHECK_EQUAL(records[2].nReason, (uint8_t)MemPoolRemovalReason::UNKNOWN);
+
+    // A record cut short by a crash ends the journal.
+    uint64_t nSize = fs::file_size(path);
+    fs::resize_file(path, nSize - 1);
+    records.clear();
+    BOOST_REQUIRE(CMempoolJournal::Read(path, records));
+    BOOST_CHECK_EQUAL(records.size(), 2U);
+    fs::resize_file(path, nSize);
+
+    // Compaction keeps only the records written during the dump.
+    {
+        CMempoolJournal journal(pool, path, 13);
+        uint64_t nSeq;
+        {
+            LOCK(pool.cs);
+            nSeq = journal.BeginCompaction();
+        }
+        BOOST_CHECK_EQUAL(nSeq, 13U);
+        {
+            LOCK(pool.cs);
+            pool.addUnchecked(tx3.GetHash(), entry.FromTx(tx3));
+        }
+        BOOST_CHECK(journal.EndCompaction(true));
+        LOCK(pool.cs);
+        pool.removeRecursive(tx2);
+    }
+    records.clear();
+    BOOST_REQUIRE(CMempoolJournal::Read(path, records));
+    BOOST_REQUIRE_EQUAL(records.size(), 2U);
+    BOOST_CHECK_EQUAL(records[0].nSeq, 14U);
+    BOOST_CHECK(records[0].tx->GetHash() == tx3.GetHash());
+    BOOST_CHECK_EQUAL(records[1].nSeq, 15U);
+    BOOST_CHECK(records[1].txid == tx2.GetHash());
+
+    // A failed dump leaves the journal as it was.
+    {
+        CMempoolJournal journal(pool, path, 15);
+        {
+            LOCK(pool.cs);
+            journal.BeginCompaction();
+            pool.removeRecursive(tx3);
+        }
+        BOOST_CHECK(journal.EndCompaction(false));
+    }
+    records.clear();
+    BOOST_REQUIRE(CMempoolJournal::Read(path, records));
+    BOOST_CHECK_EQUAL(records.size(), 3U);
+}
+
+BOOST_AUTO_TEST_CASE(journal_dump_and_load)
+{
+    // Mature the coinbases spent below.
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CreateAndProcessBlock({}, scriptPubKey);
+    CreateAndProcessBlock({}, scriptPubKey);
+
+    CMutableTransaction txParent = SpendToKey(coinbaseTxns[0], coinbaseKey, 10000);
+    CMutableTransaction txChild = SpendToKey(txParent, coinbaseKey, 10000);
+    CMutableTransaction txOther = SpendToKey(coinbaseTxns[1], coinbaseKey, 10000);
+    CMutableTransaction txEvicted = SpendToKey(coinbaseTxns[2], coinbaseKey, 10000);
+
+    BOOST_REQUIRE(ToMemPool(txParent));
+    BOOST_REQUIRE(StartMempoolJournal());
+
+    // Changes after the dump only reach the journal.
+    BOOST_REQUIRE(ToMemPool(txChild));
+    BOOST_REQUIRE(ToMemPool(txOther));
+    BOOST_REQUIRE(ToMemPool(txEvicted));
+    {
+        LOCK(mempool.cs);
+        mempool.removeRecursive(txEvicted);
+    }
+    StopMempoolJournal();
+
+    mempool.clear();
+    BOOST_REQUIRE(LoadMempool());
+    BOOST_CHECK_EQUAL(mempool.size(), 3U);
+    BOOST_CHECK(mempool.exists(txParent.GetHash()));
+    BOOST_CHECK(mempool.exists(txChild.GetHash()));
+    BOOST_CHECK(mempool.exists(txOther.GetHash()));
+    BOOST_CHECK(!mempool.exists(txEvicted.GetHash()));
+
+    // Without a journal a dump removes the stale one, and loads alone.
+    BOOST_REQUIRE(DumpMempool());
+    BOOST_CHECK(!fs::exists(GetDataDir() / "mempool.journal"));
+    mempool.clear();
+    BOOST_REQUIRE(LoadMempool());
+    BOOST_CHECK_EQUAL(mempool.size(), 3U);
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
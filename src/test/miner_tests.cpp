@@ -12,6 +12,7 @@
 #include "miner.h"
 #include "policy/policy.h"
 #include "pubkey.h"
+#include "script/sign.h"
 #include "script/standard.h"
 #include "txmempool.h"
 #include "uint256.h"
@@ -502,3 +503,72 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
 }
 
 BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_FIXTURE_TEST_SUITE(blocktemplate_tests, TestChain100Setup)
+
+static std::vector<uint256> TemplateTxids(const CBlockTemplate& blocktemplate)
+{
+    std::vector<uint256> txids;
+    for (size_t i = 1; i < blocktemplate.block.vtx.size(); i++) {
+        txids.push_back(blocktemplate.block.vtx[i]->GetHash());
+    }
+    return txids;
+}
+
+BOOST_AUTO_TEST_CASE(blocktemplate_engine)
+{
+    const CChainParams& chainparams = Params();
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CBlockTemplateEngine engine(chainparams);
+
+    std::unique_ptr<CBlockTemplate> pblocktemplate = engine.GetTemplate(scriptPubKey);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 1U);
+
+    // A chain of transactions is appended to the template as it enters the mempool.
+    CMutableTransaction txParent = SpendToKey(coinbaseTxns[0], coinbaseKey, 10000);
+    CMutableTransaction txChild = SpendToKey(txParent, coinbaseKey, 20000);
+    CMutableTransaction txGrandChild = SpendToKey(txChild, coinbaseKey, 30000);
+    BOOST_REQUIRE(ToMemPool(txParent));
+    pblocktemplate = engine.GetTemplate(scriptPubKey);
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 2U);
+    BOOST_CHECK_EQUAL(pblocktemplate->vTxFees[1], 10000);
+    BOOST_CHECK_EQUAL(pblocktemplate->vTxFees[0], -10000);
+    BOOST_REQUIRE(ToMemPool(txChild));
+    BOOST_REQUIRE(ToMemPool(txGrandChild));
+    pblocktemplate = engine.GetTemplate(scriptPubKey);
+    std::vector<uint256> txids{txParent.GetHash(), txChild.GetHash(), txGrandChild.GetHash()};
+    BOOST_CHECK(TemplateTxids(*pblocktemplate) == txids);
+    BOOST_CHECK(TemplateTxids(*BlockAssembler(chainparams).CreateNewBlock(scriptPubKey)) == txids);
+    BOOST_CHECK_EQUAL(pblocktemplate->vTxFees[0], -60000);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx[0]->GetValueOut(), GetBlockSubsidy(101, chainparams.GetConsensus()) + 60000);
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(TestBlockValidity(state, chainparams, pblocktemplate->block, chainActive.Tip(), false, false));
+    }
+
+    // Removing a transaction removes its descendants too.
+    mempool.removeRecursive(CTransaction(txChild));
+    pblocktemplate = engine.GetTemplate(scriptPubKey);
+    txids.resize(1);
+    BOOST_CHECK(TemplateTxids(*pblocktemplate) == txids);
+    BOOST_CHECK_EQUAL(pblocktemplate->vTxFees[0], -10000);
+
+    CBlockTemplateEngine::Stats stats = engine.GetStats();
+    BOOST_CHECK_EQUAL(stats.nAssembled, 1U);
+    BOOST_CHECK_EQUAL(stats.nUpdated, 3U);
+    BOOST_CHECK_EQUAL(stats.nTxAdded, 3U);
+    BOOST_CHECK_EQUAL(stats.nTxRemoved, 2U);
+    BOOST_CHECK_EQUAL(stats.nTx, 1U);
+
+    // A new tip assembles the template again.
+    CreateAndProcessBlock({txParent}, scriptPubKey);
+    pblocktemplate = engine.GetTemplate(scriptPubKey);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 1U);
+    BOOST_CHECK(pblocktemplate->block.hashPrevBlock == chainActive.Tip()->GetBlockHash());
+    stats = engine.GetStats();
+    BOOST_CHECK_EQUAL(stats.nAssembled, 2U);
+    BOOST_CHECK_EQUAL(stats.nTx, 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
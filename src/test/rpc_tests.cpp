@@ -8,9 +8,14 @@
 #include "base58.h"
 #include "core_io.h"
 #include "netbase.h"
+#include "txdb.h"
+#include "validation.h"
 
 #include "test/test_bitcoin.h"
 
+#include <atomic>
+#include <thread>
+
 #include <boost/algorithm/string.hpp>
 #include <boost/test/unit_test.hpp>
 
@@ -343,4 +348,45 @@ BOOST_AUTO_TEST_CASE(rpc_convert_values_generatetoaddress)
     BOOST_CHECK_EQUAL(result[2].get_int(), 9);
 }
 
+BOOST_AUTO_TEST_CASE(rpc_gettxoutsetinfo_during_write)
+{
+    uint256 hashBest;
+    {
+        LOCK(cs_main);
+        hashBest = chainActive.Tip()->GetBlockHash();
+    }
+
+    // Write every coin in a batch of its own, so that the chainstate spends
+    // most of the time in the middle of a write.
+    gArgs.ForceSetArg("-dbbatchsize", "1");
+    std::atomic<bool> fDone(false);
+    std::thread writer([&hashBest, &fDone] {
+        for (int i = 0; i < 20; i++) {
+            CCoinsMap map;
+            for (int j = 0; j < 100; j++) {
+                CCoinsCacheEntry& entry = map[COutPoint(InsecureRand256(), 0)];
+                entry.coin = Coin(CTxOut(COIN, CScript() << OP_TRUE), 1, false);
+                entry.flags = CCoinsCacheEntry::DIRTY;
+            }
+            pcoinsdbview->BatchWrite(map, hashBest);
+        }
+        fDone = true;
+    });
+
+    // Every scan sees the chainstate either before or after a write.
+    int nCalls = 0;
+    do {
+        UniValue result;
+        BOOST_CHECK_NO_THROW(result = CallRPC("gettxoutsetinfo"));
+        if (result.isObject()) {
+            BOOST_CHECK_EQUAL(find_value(result, "bestblock").get_str(), hashBest.GetHex());
+            BOOST_CHECK_EQUAL(find_value(result, "txouts").get_int64() % 100, 0);
+        }
+        nCalls++;
+    } while (!fDone);
+    writer.join();
+    gArgs.ForceSetArg("-dbbatchsize", std::to_string(nDefaultDbBatchSize));
+    BOOST_CHECK(nCalls > 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -5,6 +5,7 @@
 #include "test_bitcoin.h"
 
 #include "chainparams.h"
+#include "coinswriter.h"
 #include "consensus/consensus.h"
 #include "consensus/validation.h"
 #include "crypto/sha256.h"
@@ -21,6 +22,7 @@
 #include "streams.h"
 #include "rpc/server.h"
 #include "rpc/register.h"
+#include "script/interpreter.h"
 #include "script/sigcache.h"
 
 #include <memory>
@@ -71,7 +73,9 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
         mempool.setSanityCheck(1.0);
         pblocktree = new CBlockTreeDB(1 << 20, true);
         pcoinsdbview = new CCoinsViewDB(1 << 23, true);
-        pcoinsTip = new CCoinsViewCache(pcoinsdbview);
+        pcoinswriter = new CCoinsViewAsyncWriter(pcoinsdbview);
+        pcoinsTip = new CCoinsViewCache(pcoinswriter);
+        LoadRollingCoinsStats();
         if (!LoadGenesisBlock(chainparams)) {
             throw std::runtime_error("LoadGenesisBlock failed.");
         }
@@ -82,8 +86,10 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
             }
         }
         nScriptCheckThreads = 3;
-        for (int i=0; i < nScriptCheckThreads-1; i++)
+        for (int i=0; i < nScriptCheckThreads-1; i++) {
             threadGroup.create_thread(&ThreadScriptCheck);
+            threadGroup.create_thread(&ThreadBlockCheck);
+        }
         g_connman = std::unique_ptr<CConnman>(new CConnman(0x1337, 0x1337)); // Deterministic randomness for tests.
         connman = g_connman.get();
         peerLogic.reset(new PeerLogicValidation(connman));
@@ -99,8 +105,13 @@ TestingSetup::~TestingSetup()
         peerLogic.reset();
         UnloadBlockIndex();
         delete pcoinsTip;
+        pcoinsTip = nullptr;
+        delete pcoinswriter;
+        pcoinswriter = nullptr;
         delete pcoinsdbview;
+        pcoinsdbview = nullptr;
         delete pblocktree;
+        pblocktree = nullptr;
         fs::remove_all(pathTemp);
 }
 
@@ -145,6 +156,36 @@ TestChain100Setup::CreateAndProcessBlock(const std::vector<CMutableTransaction>&
     return result;
 }
 
+CMutableTransaction
+TestChain100Setup::SpendToKey(const CTransaction& txPrev, const CKey& key, CAmount nFee, bool fValidSig)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(txPrev.GetHash(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = txPrev.vout[0].nValue - nFee;
+    tx.vout[0].scriptPubKey = scriptPubKey;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    if (!key.Sign(hash, vchSig)) {
+        throw std::runtime_error("Signing the transaction failed.");
+    }
+    if (!fValidSig)
+        vchSig[vchSig.size() - 1] ^= 1;
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig << vchSig;
+    return tx;
+}
+
+bool TestChain100Setup::ToMemPool(const CMutableTransaction& tx)
+{
+    LOCK(cs_main);
+    CValidationState state;
+    return AcceptToMemoryPool(mempool, state, MakeTransactionRef(tx), nullptr /* pfMissingInputs */,
+                              nullptr /* plTxnReplaced */, true /* bypass_limits */, 0 /* nAbsurdFee */);
+}
+
 TestChain100Setup::~TestChain100Setup()
 {
 }
@@ -51,7 +51,6 @@ struct BasicTestingSetup {
 class CConnman;
 class PeerLogicValidation;
 struct TestingSetup: public BasicTestingSetup {
-    CCoinsViewDB *pcoinsdbview;
     fs::path pathTemp;
     boost::thread_group threadGroup;
     CConnman* connman;
@@ -78,6 +77,15 @@ struct TestChain100Setup : public TestingSetup {
     CBlock CreateAndProcessBlock(const std::vector<CMutableTransaction>& txns,
                                  const CScript& scriptPubKey);
 
+    // Create a transaction spending output 0 of txPrev to a P2PK output of
+    // key, paying nFee, and signed by key. If fValidSig is false, the
+    // signature is corrupted so that it does not verify.
+    CMutableTransaction SpendToKey(const CTransaction& txPrev, const CKey& key,
+                                   CAmount nFee = 10000, bool fValidSig = true);
+
+    // Try to add tx to the mempool, bypassing its size and fee limits.
+    bool ToMemPool(const CMutableTransaction& tx);
+
     ~TestChain100Setup();
 
     std::vector<CTransaction> coinbaseTxns; // For convenience, coinbase transactions
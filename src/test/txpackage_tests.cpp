@@ -0,0 +1,99 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "consensus/validation.h"
+#include "core_io.h"
+#include "rpc/server.h"
+#include "script/sign.h"
+#include "txmempool.h"
+#include "univalue.h"
+#include "validation.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+extern UniValue CallRPC(std::string args);
+
+BOOST_FIXTURE_TEST_SUITE(txpackage_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(package_accept)
+{
+    // Mature the second coinbase, which the invalid transactions spend.
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CreateAndProcessBlock({}, scriptPubKey);
+
+    CTransactionRef txParent = MakeTransactionRef(SpendToKey(coinbaseTxns[0], coinbaseKey));
+    CTransactionRef txChild = MakeTransactionRef(SpendToKey(*txParent, coinbaseKey));
+    CTransactionRef txGrandChild = MakeTransactionRef(SpendToKey(*txChild, coinbaseKey));
+    CTransactionRef txBadSig = MakeTransactionRef(SpendToKey(coinbaseTxns[1], coinbaseKey, 10000, false));
+    CTransactionRef txBadSigChild = MakeTransactionRef(SpendToKey(*txBadSig, coinbaseKey));
+
+    std::vector<PackageTxResult> results;
+    BOOST_CHECK(AcceptPackageToMemoryPool(mempool, {txParent, txChild, txGrandChild}, results, nullptr, false, 0));
+    BOOST_REQUIRE_EQUAL(results.size(), 3U);
+    for (const PackageTxResult& result : results) {
+        BOOST_CHECK(result.fAccepted);
+        BOOST_CHECK(result.state.IsValid());
+    }
+    BOOST_CHECK_EQUAL(mempool.size(), 3U);
+    mempool.clear();
+
+    // A child before its parent is missing inputs, but doesn't stop the parent.
+    BOOST_CHECK(!AcceptPackageToMemoryPool(mempool, {txChild, txParent}, results, nullptr, false, 0));
+    BOOST_REQUIRE_EQUAL(results.size(), 2U);
+    BOOST_CHECK(!results[0].fAccepted);
+    BOOST_CHECK(results[0].fMissingInputs);
+    BOOST_CHECK(results[1].fAccepted);
+    BOOST_CHECK(mempool.exists(txParent->GetHash()));
+    BOOST_CHECK(!mempool.exists(txChild->GetHash()));
+
+    // An invalid transaction leaves its children without inputs.
+    BOOST_CHECK(!AcceptPackageToMemoryPool(mempool, {txBadSig, txBadSigChild, txChild}, results, nullptr, false, 0));
+    BOOST_REQUIRE_EQUAL(results.size(), 3U);
+    BOOST_CHECK(!results[0].fAccepted);
+    BOOST_CHECK(results[0].state.IsInvalid());
+    BOOST_CHECK(results[0].state.GetRejectReason().find("script-verify-flag") != std::string::npos);
+    BOOST_CHECK(!results[1].fAccepted);
+    BOOST_CHECK(results[1].fMissingInputs);
+    BOOST_CHECK(results[2].fAccepted);
+    BOOST_CHECK_EQUAL(mempool.size(), 2U);
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_CASE(rpc_sendrawtransactions)
+{
+    // Mature the second coinbase, which the invalid transactions spend.
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CreateAndProcessBlock({}, scriptPubKey);
+
+    CTransactionRef txParent = MakeTransactionRef(SpendToKey(coinbaseTxns[0], coinbaseKey));
+    CTransactionRef txChild = MakeTransactionRef(SpendToKey(*txParent, coinbaseKey));
+    CTransactionRef txBadSig = MakeTransactionRef(SpendToKey(coinbaseTxns[1], coinbaseKey, 10000, false));
+    std::string strParent = EncodeHexTx(*txParent);
+    std::string strChild = EncodeHexTx(*txChild);
+    std::string strBadSig = EncodeHexTx(*txBadSig);
+
+    BOOST_CHECK_THROW(CallRPC("sendrawtransactions [\"" + strChild + "\",\"" + strParent + "\"]"), std::runtime_error);
+    BOOST_CHECK_THROW(CallRPC("sendrawtransactions [\"" + strParent + "\",\"" + strParent + "\"]"), std::runtime_error);
+    BOOST_CHECK_THROW(CallRPC("sendrawtransactions [\"00\"]"), std::runtime_error);
+    BOOST_CHECK_EQUAL(mempool.size(), 0U);
+
+    UniValue r = CallRPC("sendrawtransactions [\"" + strParent + "\",\"" + strBadSig + "\",\"" + strChild + "\"]");
+    BOOST_REQUIRE_EQUAL(r.size(), 3U);
+    BOOST_CHECK_EQUAL(find_value(r[0], "txid").get_str(), txParent->GetHash().GetHex());
+    BOOST_CHECK(find_value(r[0], "accepted").get_bool());
+    BOOST_CHECK(find_value(r[0], "error").isNull());
+    BOOST_CHECK(!find_value(r[1], "accepted").get_bool());
+    BOOST_CHECK(find_value(r[1], "error").get_str().find("script-verify-flag") != std::string::npos);
+    BOOST_CHECK(find_value(r[2], "accepted").get_bool());
+    BOOST_CHECK_EQUAL(mempool.size(), 2U);
+
+    // Transactions already in the mempool are accepted again.
+    r = CallRPC("sendrawtransactions [\"" + strChild + "\"]");
+    BOOST_CHECK(find_value(r[0], "accepted").get_bool());
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,142 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "consensus/validation.h"
+#include "policy/policy.h"
+#include "script/sign.h"
+#include "txmempool.h"
+#include "txprevalidation.h"
+#include "utiltime.h"
+#include "validation.h"
+
+#include "test/test_bitcoin.h"
+
+#include <atomic>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
+
+bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks);
+
+BOOST_FIXTURE_TEST_SUITE(txprevalidation_tests, BasicTestingSetup)
+
+static CTransactionRef MakeTx(uint32_t n)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout.n = n;
+    tx.vout.resize(1);
+    return MakeTransactionRef(tx);
+}
+
+BOOST_AUTO_TEST_CASE(queue_order)
+{
+    std::atomic<bool> fRelease(false);
+    std::atomic<int> nChecked(0);
+    CTxPrevalidationQueue queue([&](const CTransaction& tx) {
+        // Hold up the first transaction until released.
+        while (tx.vin[0].prevout.n == 0 && !fRelease) {
+            MilliSleep(1);
+        }
+        nChecked++;
+    });
+    std::atomic<int> nNotified(0);
+    queue.SetNotify([&] { nNotified++; });
+
+    std::vector<CTransactionRef> vtx;
+    for (uint32_t n = 0; n < 4; n++) {
+        vtx.push_back(MakeTx(n));
+    }
+    queue.Enqueue(1, vtx[0]);
+    queue.Enqueue(1, vtx[1]);
+    queue.Enqueue(2, vtx[2]);
+    queue.Enqueue(3, vtx[3]);
+    BOOST_CHECK_EQUAL(queue.Pending(1), 2U);
+    BOOST_CHECK_EQUAL(queue.Pending(2), 1U);
+    BOOST_CHECK(queue.TakeReady(1).empty());
+
+    // Nothing was taken for peer 3 yet, so its transaction is never checked.
+    queue.RemoveNode(3);
+    BOOST_CHECK_EQUAL(queue.Pending(3), 0U);
+
+    boost::thread_group threads;
+    for (int i = 0; i < 2; i++) {
+        threads.create_thread(boost::bind(&CTxPrevalidationQueue::Thread, &queue));
+    }
+
+    // Peer 1's second transaction is checked, but waits for its first.
+    while (nChecked < 2) {
+        MilliSleep(1);
+    }
+    BOOST_CHECK(queue.TakeReady(1).empty());
+    std::vector<CTransactionRef> vReady = queue.TakeReady(2);
+    BOOST_REQUIRE_EQUAL(vReady.size(), 1U);
+    BOOST_CHECK(vReady[0] == vtx[2]);
+    BOOST_CHECK_EQUAL(queue.Pending(2), 0U);
+
+    fRelease = true;
+    while (nChecked < 3) {
+        MilliSleep(1);
+    }
+    // The notification follows marking the job done.
+    while (nNotified < 3) {
+        MilliSleep(1);
+    }
+    vReady = queue.TakeReady(1);
+    BOOST_REQUIRE_EQUAL(vReady.size(), 2U);
+    BOOST_CHECK(vReady[0] == vtx[0]);
+    BOOST_CHECK(vReady[1] == vtx[1]);
+    BOOST_CHECK_EQUAL(queue.Pending(1), 0U);
+
+    threads.interrupt_all();
+    threads.join_all();
+    BOOST_CHECK_EQUAL(nChecked, 3);
+}
+
+static bool ScriptsCached(const CTransaction& tx)
+{
+    LOCK(cs_main);
+    CCoinsViewCache view(pcoinsTip);
+    CValidationState state;
+    PrecomputedTransactionData txdata(tx);
+    std::vector<CScriptCheck> vChecks;
+    // A cache hit returns before any check is queued.
+    BOOST_CHECK(CheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true, false, txdata, &vChecks));
+    return vChecks.empty();
+}
+
+BOOST_FIXTURE_TEST_CASE(prevalidate_transaction, TestChain100Setup)
+{
+    const CChainParams& chainparams = Params();
+
+    CMutableTransaction txValid = SpendToKey(coinbaseTxns[0], coinbaseKey);
+    CMutableTransaction txBadSig = SpendToKey(coinbaseTxns[0], coinbaseKey, 10000, false);
+    CMutableTransaction txOrphan = SpendToKey(txValid, coinbaseKey);
+
+    BOOST_CHECK(!ScriptsCached(txValid));
+    BOOST_CHECK(PrevalidateTransaction(txValid, chainparams));
+    BOOST_CHECK(ScriptsCached(txValid));
+
+    BOOST_CHECK(!PrevalidateTransaction(txBadSig, chainparams));
+    BOOST_CHECK(!PrevalidateTransaction(txOrphan, chainparams));
+
+    // The scripts of a transaction below the minimum relay fee are not run.
+    CMutableTransaction txNoFee = SpendToKey(coinbaseTxns[0], coinbaseKey, 0);
+    BOOST_CHECK(!PrevalidateTransaction(txNoFee, chainparams));
+    BOOST_CHECK(!ScriptsCached(txNoFee));
+
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(AcceptToMemoryPool(mempool, state, MakeTransactionRef(txValid), nullptr, nullptr, true, 0));
+    }
+    // Once in the mempool there is nothing left to prevalidate, but its
+    // outputs can be spent by the next one.
+    BOOST_CHECK(!PrevalidateTransaction(txValid, chainparams));
+    BOOST_CHECK(PrevalidateTransaction(txOrphan, chainparams));
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
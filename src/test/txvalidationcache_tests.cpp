@@ -11,6 +11,7 @@
 #include "random.h"
 #include "script/standard.h"
 #include "script/sign.h"
+#include "script/sigcache.h"
 #include "test/test_bitcoin.h"
 #include "utiltime.h"
 #include "core_io.h"
@@ -23,16 +24,6 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
 
 BOOST_AUTO_TEST_SUITE(tx_validationcache_tests)
 
-static bool
-ToMemPool(CMutableTransaction& tx)
-{
-    LOCK(cs_main);
-
-    CValidationState state;
-    return AcceptToMemoryPool(mempool, state, MakeTransactionRef(tx), nullptr /* pfMissingInputs */,
-                              nullptr /* plTxnReplaced */, true /* bypass_limits */, 0 /* nAbsurdFee */);
-}
-
 BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup)
 {
     // Make sure skipping validation of transctions that were
@@ -369,4 +360,51 @@ BOOST_FIXTURE_TEST_CASE(checkinputs_test, TestChain100Setup)
     }
 }
 
+BOOST_FIXTURE_TEST_CASE(script_caches_persist, TestChain100Setup)
+{
+    // Test that script executions cached before dumping the caches to disk
+    // are found again after starting over and loading them.
+    InitScriptExecutionCache();
+
+    CBasicKeyStore keystore;
+    keystore.AddKey(coinbaseKey);
+
+    CMutableTransaction spend_tx;
+    spend_tx.nVersion = 1;
+    spend_tx.vin.resize(1);
+    spend_tx.vin[0].prevout.hash = coinbaseTxns[0].GetHash();
+    spend_tx.vin[0].prevout.n = 0;
+    spend_tx.vout.resize(1);
+    spend_tx.vout[0].nValue = 11*CENT;
+    spend_tx.vout[0].scriptPubKey = GetScriptForDestination(coinbaseKey.GetPubKey().GetID());
+    BOOST_CHECK(SignSignature(keystore, coinbaseTxns[0], spend_tx, 0, SIGHASH_ALL));
+
+    LOCK(cs_main);
+
+    CValidationState state;
+    PrecomputedTransactionData txdata(spend_tx);
+    BOOST_CHECK(CheckInputs(spend_tx, state, pcoinsTip, true, SCRIPT_VERIFY_P2SH, true, true, txdata, nullptr));
+
+    BOOST_CHECK(DumpScriptCaches());
+
+    // Start over with caches of another size, where the entries are looked
+    // up at other places.
+    gArgs.ForceSetArg("-maxsigcachesize", "1");
+    InitSignatureCache();
+    InitScriptExecutionCache();
+    {
+        std::vector<CScriptCheck> scriptchecks;
+        BOOST_CHECK(CheckInputs(spend_tx, state, pcoinsTip, true, SCRIPT_VERIFY_P2SH, true, false, txdata, &scriptchecks));
+        BOOST_CHECK_EQUAL(scriptchecks.size(), 1);
+    }
+
+    BOOST_CHECK(LoadScriptCaches());
+    {
+        std::vector<CScriptCheck> scriptchecks;
+        BOOST_CHECK(CheckInputs(spend_tx, state, pcoinsTip, true, SCRIPT_VERIFY_P2SH, true, false, txdata, &scriptchecks));
+        BOOST_CHECK(scriptchecks.empty());
+    }
+    gArgs.ForceSetArg("-maxsigcachesize", std::to_string(DEFAULT_MAX_SIG_CACHE_SIZE));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,70 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "coinstats.h"
+#include "fs.h"
+#include "txdb.h"
+#include "validation.h"
+
+#include "test/test_bitcoin.h"
+
+#include <memory>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(utxosnapshot_tests, TestChain100Setup)
+
+// Load the snapshot at path into an empty chainstate, and check that it is
+// refused without writing any coins to it.
+static void CheckLoadRefused(const fs::path& path, const uint256& hashExpected)
+{
+    CCoinsViewDB* pcoinsdbviewOld = pcoinsdbview;
+    CBlockIndex* pindexTip = chainActive.Tip();
+    CCoinsViewDB empty(1 << 20, true, true);
+    pcoinsdbview = &empty;
+    bool fLoaded = LoadUTXOSnapshot(Params(), path, hashExpected);
+    pcoinsdbview = pcoinsdbviewOld;
+    {
+        LOCK(cs_main);
+        chainActive.SetTip(pindexTip);
+    }
+
+    BOOST_CHECK(!fLoaded);
+    BOOST_CHECK(empty.GetBestBlock().IsNull());
+    BOOST_CHECK(empty.GetHeadBlocks().empty());
+    std::unique_ptr<CCoinsViewCursor> cursor(empty.Cursor());
+    BOOST_CHECK(!cursor->Valid());
+}
+
+BOOST_AUTO_TEST_CASE(load_refused_leaves_chainstate_empty)
+{
+    fs::path path = GetDataDir() / "utxo.dat";
+    uint256 hashBlock;
+    CCoinsRollingStats stats;
+    BOOST_CHECK(DumpUTXOSnapshot(path, hashBlock, stats));
+    BOOST_CHECK(hashBlock == chainActive.Tip()->GetBlockHash());
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, 100);
+
+    // A snapshot of a different UTXO set than expected.
+    CheckLoadRefused(path, uint256S("01"));
+
+    // A snapshot cut off after its coins, which can only be detected at the end.
+    std::vector<unsigned char> data;
+    {
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        BOOST_REQUIRE(!file.IsNull());
+        data.resize(fs::file_size(path));
+        file.read((char*)data.data(), data.size());
+    }
+    fs::path pathTruncated = GetDataDir() / "utxo_truncated.dat";
+    {
+        CAutoFile file(fsbridge::fopen(pathTruncated, "wb"), SER_DISK, CLIENT_VERSION);
+        BOOST_REQUIRE(!file.IsNull());
+        file.write((const char*)data.data(), data.size() - 1);
+    }
+    CheckLoadRefused(pathTruncated, stats.GetHash());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,91 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "validationstats.h"
+
+#include "chain.h"
+#include "validation.h"
+#include "test/test_bitcoin.h"
+
+#include <limits>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(validationstats_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(validationstats_histogram)
+{
+    CValidationStats::Histogram histogram;
+    for (int64_t nMicros : {0, 1, 2, 3, 4, 1000, 1023, 1024, -5}) {
+        histogram.Add(nMicros);
+    }
+    histogram.Add(std::numeric_limits<int64_t>::max());
+    BOOST_CHECK_EQUAL(histogram.vBuckets[0], 2U);  // 0 and -5
+    BOOST_CHECK_EQUAL(histogram.vBuckets[1], 1U);  // 1
+    BOOST_CHECK_EQUAL(histogram.vBuckets[2], 2U);  // 2, 3
+    BOOST_CHECK_EQUAL(histogram.vBuckets[3], 1U);  // 4
+    BOOST_CHECK_EQUAL(histogram.vBuckets[10], 2U); // 1000, 1023
+    BOOST_CHECK_EQUAL(histogram.vBuckets[11], 1U); // 1024
+    BOOST_CHECK_EQUAL(histogram.vBuckets[CValidationStats::Histogram::BUCKETS - 1], 1U);
+    BOOST_CHECK_EQUAL(histogram.nMax, std::numeric_limits<int64_t>::max());
+}
+
+BOOST_AUTO_TEST_CASE(validationstats_recent)
+{
+    CValidationStats stats(5);
+    for (int i = 0; i < 8; i++) {
+        CValidationStats::BlockRecord record;
+        record.nHeight = i;
+        record.nMicros[CValidationStats::VERIFY] = i;
+        record.nMicros[CValidationStats::TOTAL] = 10 * i;
+        stats.AddBlock(record);
+    }
+    CValidationStats::Stats result = stats.GetStats(3);
+    BOOST_CHECK_EQUAL(result.nBlocks, 8U);
+    BOOST_CHECK_EQUAL(result.phases[CValidationStats::VERIFY].nTotal, 28);
+    BOOST_CHECK_EQUAL(result.phases[CValidationStats::TOTAL].nMax, 70);
+    BOOST_REQUIRE_EQUAL(result.vRecent.size(), 3U);
+    BOOST_CHECK_EQUAL(result.vRecent.front().nHeight, 5);
+    BOOST_CHECK_EQUAL(result.vRecent.back().nHeight, 7);
+
+    // Only the last five blocks are kept.
+    result = stats.GetStats(100);
+    BOOST_REQUIRE_EQUAL(result.vRecent.size(), 5U);
+    BOOST_CHECK_EQUAL(result.vRecent.front().nHeight, 3);
+
+    stats.Clear();
+    result = stats.GetStats(100);
+    BOOST_CHECK_EQUAL(result.nBlocks, 0U);
+    BOOST_CHECK_EQUAL(result.phases[CValidationStats::TOTAL].nTotal, 0);
+    BOOST_CHECK(result.vRecent.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_FIXTURE_TEST_SUITE(validationstats_chain_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(validationstats_connect)
+{
+    validationStats.Clear();
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CBlock block = CreateAndProcessBlock({}, scriptPubKey);
+
+    CValidationStats::Stats stats = validationStats.GetStats(10);
+    BOOST_CHECK_EQUAL(stats.nBlocks, 1U);
+    BOOST_REQUIRE_EQUAL(stats.vRecent.size(), 1U);
+    const CValidationStats::BlockRecord& record = stats.vRecent[0];
+    BOOST_CHECK(record.hash == block.GetHash());
+    BOOST_CHECK_EQUAL(record.nHeight, 101);
+    BOOST_CHECK_EQUAL(record.nTx, 1U);
+    BOOST_CHECK_EQUAL(record.nInputs, 0U);
+    BOOST_CHECK(!record.fPipelined);
+    int64_t nSum = 0;
+    for (int i = 0; i < CValidationStats::TOTAL; i++) {
+        BOOST_CHECK(record.nMicros[i] >= 0);
+        nSum += record.nMicros[i];
+    }
+    BOOST_CHECK(record.nMicros[CValidationStats::TOTAL] >= nSum);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -6,6 +6,7 @@
 #include "txdb.h"
 
 #include "chainparams.h"
+#include "coinstats.h"
 #include "hash.h"
 #include "random.h"
 #include "pow.h"
@@ -14,7 +15,13 @@
 #include "ui_interface.h"
 #include "init.h"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <iterator>
+#include <mutex>
 #include <stdint.h>
+#include <thread>
 
 #include <boost/thread.hpp>
 
@@ -29,6 +36,7 @@ static const char DB_HEAD_BLOCKS = 'H';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_ROLLING_STATS = 'S';
 
 namespace {
 
@@ -81,7 +89,8 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
     return vhashHeadBlocks;
 }
 
-bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase) {
+    std::lock_guard<std::mutex> lock(cs_write);
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
@@ -106,7 +115,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     batch.Erase(DB_BEST_BLOCK);
     batch.Write(DB_HEAD_BLOCKS, std::vector<uint256>{hashBlock, old_tip});
 
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it = erase ? mapCoins.erase(it) : std::next(it)) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
             CoinEntry entry(&it->first);
             if (it->second.coin.IsSpent())
@@ -116,8 +125,6 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
         if (batch.SizeEstimate() > batch_size) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
             db.WriteBatch(batch);
@@ -142,11 +149,51 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     return ret;
 }
 
+bool CCoinsViewDB::WriteSnapshotCoins(const std::vector<std::pair<COutPoint, Coin>> &coins, const uint256 &hashBlock) {
+    std::lock_guard<std::mutex> lock(cs_write);
+    CDBBatch batch(db);
+    size_t batch_size = (size_t)gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize);
+    assert(!hashBlock.IsNull());
+
+    batch.Erase(DB_BEST_BLOCK);
+    batch.Write(DB_HEAD_BLOCKS, std::vector<uint256>{hashBlock, uint256()});
+    for (const auto& coin : coins) {
+        batch.Write(CoinEntry(&coin.first), coin.second);
+        if (batch.SizeEstimate() > batch_size) {
+            if (!db.WriteBatch(batch)) return false;
+            batch.Clear();
+        }
+    }
+    return db.WriteBatch(batch);
+}
+
 size_t CCoinsViewDB::EstimateSize() const
 {
     return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
 }
 
+bool CCoinsViewDB::WriteRollingStats(const uint256 &hashBlock, const CCoinsRollingStats &stats) {
+    return db.Write(std::make_pair(DB_ROLLING_STATS, hashBlock), stats);
+}
+
+bool CCoinsViewDB::ReadRollingStats(const uint256 &hashBlock, CCoinsRollingStats &stats) const {
+    return db.Read(std::make_pair(DB_ROLLING_STATS, hashBlock), stats);
+}
+
+bool CCoinsViewDB::PruneRollingStats(const std::vector<uint256> &keep) {
+    CDBBatch batch(db);
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(std::make_pair(DB_ROLLING_STATS, uint256()));
+    std::pair<char, uint256> key;
+    while (pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_ROLLING_STATS) {
+        if (std::find(keep.begin(), keep.end(), key.second) == keep.end()) {
+            batch.Erase(key);
+        }
+        pcursor->Next();
+    }
+    return db.WriteBatch(batch);
+}
+
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
 }
 
@@ -178,16 +225,112 @@ CCoinsViewCursor *CCoinsViewDB::Cursor() const
        that restriction.  */
     i->pcursor->Seek(DB_COIN);
     // Cache key of first record
-    if (i->pcursor->Valid()) {
-        CoinEntry entry(&i->keyTmp.second);
-        i->pcursor->GetKey(entry);
-        i->keyTmp.first = entry.key;
-    } else {
-        i->keyTmp.first = 0; // Make sure Valid() and GetKey() return false
-    }
+    i->ReadKey();
     return i;
 }
 
+std::vector<std::unique_ptr<CCoinsViewCursor>> CCoinsViewDB::ShardedCursors(int nShards) const
+{
+    assert(nShards >= 1 && nShards <= MAX_COINS_SHARDS);
+    std::shared_ptr<const leveldb::Snapshot> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(cs_write);
+        snapshot = db.GetSnapshot();
+    }
+    uint256 hashBestChain;
+    if (!db.Read(DB_BEST_BLOCK, hashBestChain, snapshot.get())) {
+        hashBestChain.SetNull();
+    }
+
+    std::vector<std::unique_ptr<CCoinsViewCursor>> cursors;
+    for (int n = 0; n < nShards; ++n) {
+        // Split the range of the first two bytes of the txid evenly.
+        uint32_t nBegin = ((uint64_t)n << 16) / nShards;
+        uint32_t nEnd = ((uint64_t)(n + 1) << 16) / nShards;
+        CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper&>(db).NewIterator(snapshot.get()), hashBestChain, snapshot, nEnd);
+        COutPoint begin;
+        begin.hash.begin()[0] = nBegin >> 8;
+        begin.hash.begin()[1] = nBegin & 0xff;
+        i->pcursor->Seek(CoinEntry(&begin));
+        i->ReadKey();
+        cursors.emplace_back(i);
+    }
+    return cursors;
+}
+
+bool CCoinsViewDB::ParallelScan(int nShards, int nThreads, const std::function<bool(int, CCoinsViewCursor&)>& map, const std::function<void(int)>& reduce) const
+{
+    return ParallelScan(ShardedCursors(nShards), nThreads, map, reduce);
+}
+
+bool CCoinsViewDB::ParallelScan(std::vector<std::unique_ptr<CCoinsViewCursor>> cursors, int nThreads, const std::function<bool(int, CCoinsViewCursor&)>& map, const std::function<void(int)>& reduce)
+{
+    const int nShards = cursors.size();
+    nThreads = std::max(1, std::min(nThreads, nShards));
+    const int nWindow = 2 * nThreads;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    int nNextMap = 0; // next range to be picked up by a thread
+    int nReduced = 0; // number of ranges reduced so far
+    std::vector<bool> vDone(nShards, false);
+    bool fFailed = false;
+    bool fAbort = false;
+
+    auto worker = [&]() {
+        while (true) {
+            int n;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [&] { return fAbort || nNextMap >= nShards || nNextMap < nReduced + nWindow; });
+                if (fAbort || nNextMap >= nShards) return;
+                n = nNextMap++;
+            }
+            bool fOk;
+            try {
+                fOk = map(n, *cursors[n]);
+            } catch (const std::exception& e) {
+                LogPrintf("%s: %s\n", __func__, e.what());
+                fOk = false;
+            }
+            cursors[n].reset();
+            std::lock_guard<std::mutex> lock(mutex);
+            vDone[n] = true;
+            if (!fOk) fFailed = fAbort = true;
+            cond.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nThreads; ++i) {
+        threads.emplace_back(worker);
+    }
+    try {
+        for (int n = 0; n < nShards; ++n) {
+            boost::this_thread::interruption_point();
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [&] { return fAbort || vDone[n]; });
+                if (fAbort) break;
+            }
+            reduce(n);
+            std::lock_guard<std::mutex> lock(mutex);
+            nReduced = n + 1;
+            cond.notify_all();
+        }
+    } catch (...) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            fAbort = true;
+            cond.notify_all();
+        }
+        for (std::thread& thread : threads) thread.join();
+        throw;
+    }
+    for (std::thread& thread : threads) thread.join();
+    return !fFailed;
+}
+
 bool CCoinsViewDBCursor::GetKey(COutPoint &key) const
 {
     // Return cached key
@@ -216,9 +359,16 @@ bool CCoinsViewDBCursor::Valid() const
 void CCoinsViewDBCursor::Next()
 {
     pcursor->Next();
+    ReadKey();
+}
+
+void CCoinsViewDBCursor::ReadKey()
+{
     CoinEntry entry(&keyTmp.second);
     if (!pcursor->Valid() || !pcursor->GetKey(entry)) {
         keyTmp.first = 0; // Invalidate cached key after last record so that Valid() and GetKey() return false
+    } else if (entry.key == DB_COIN && ((uint32_t)keyTmp.second.hash.begin()[0] << 8 | keyTmp.second.hash.begin()[1]) >= nEndPrefix) {
+        keyTmp.first = 0; // Past the end of the range
     } else {
         keyTmp.first = entry.key;
     }
@@ -259,46 +409,64 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
+bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, int nThreads, std::vector<std::pair<uint256, CDiskBlockIndex>>& vEntries)
 {
-    std::unique_ptr<CDBIterator> pcursor(NewIterator());
-
-    pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, uint256()));
-
-    // Load mapBlockIndex
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight        = diskindex.nHeight;
-                pindexNew->nFile          = diskindex.nFile;
-                pindexNew->nDataPos       = diskindex.nDataPos;
-                pindexNew->nUndoPos       = diskindex.nUndoPos;
-                pindexNew->nVersion       = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime          = diskindex.nTime;
-                pindexNew->nBits          = diskindex.nBits;
-                pindexNew->nNonce         = diskindex.nNonce;
-                pindexNew->nStatus        = diskindex.nStatus;
-                pindexNew->nTx            = diskindex.nTx;
-
-                if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits, consensusParams))
-                    return error("%s: CheckProofOfWork failed: %s", __func__, pindexNew->ToString());
-
+    std::shared_ptr<const leveldb::Snapshot> snapshot = GetSnapshot();
+    std::vector<std::vector<std::pair<uint256, CDiskBlockIndex>>> vShards(BLOCK_INDEX_SHARDS);
+    std::atomic<int> nNextShard(0);
+    std::atomic<bool> fFailed(false);
+
+    auto worker = [&]() {
+        int n;
+        while (!fFailed && (n = nNextShard++) < BLOCK_INDEX_SHARDS) {
+            // Split the range of the first two bytes of the block hash evenly.
+            uint32_t nBegin = ((uint64_t)n << 16) / BLOCK_INDEX_SHARDS;
+            uint32_t nEnd = ((uint64_t)(n + 1) << 16) / BLOCK_INDEX_SHARDS;
+            uint256 begin;
+            begin.begin()[0] = nBegin >> 8;
+            begin.begin()[1] = nBegin & 0xff;
+
+            std::unique_ptr<CDBIterator> pcursor(NewIterator(snapshot.get()));
+            pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, begin));
+            while (!fFailed && pcursor->Valid()) {
+                std::pair<char, uint256> key;
+                if (!pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX) break;
+                if ((uint32_t)((key.second.begin()[0] << 8) | key.second.begin()[1]) >= nEnd) break;
+                CDiskBlockIndex diskindex;
+                if (!pcursor->GetValue(diskindex)) {
+                    error("%s: failed to read value", __func__);
+                    fFailed = true;
+                    break;
+                }
+                uint256 hash = diskindex.GetBlockHash();
+                if (!CheckProofOfWork(hash, diskindex.nBits, consensusParams)) {
+                    diskindex.phashBlock = &hash;
+                    error("%s: CheckProofOfWork failed: %s", __func__, diskindex.ToString());
+                    fFailed = true;
+                    break;
+                }
+                vShards[n].emplace_back(hash, std::move(diskindex));
                 pcursor->Next();
-            } else {
-                return error("%s: failed to read value", __func__);
             }
-        } else {
-            break;
         }
-    }
+    };
 
+    std::vector<std::thread> threads;
+    for (int i = 1; i < std::min(nThreads, BLOCK_INDEX_SHARDS); ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& thread : threads) thread.join();
+    if (fFailed) return false;
+
+    size_t nEntries = 0;
+    for (const auto& shard : vShards) nEntries += shard.size();
+    vEntries.clear();
+    vEntries.reserve(nEntries);
+    for (auto& shard : vShards) {
+        std::move(shard.begin(), shard.end(), std::back_inserter(vEntries));
+        std::vector<std::pair<uint256, CDiskBlockIndex>>().swap(shard);
+    }
     return true;
 }
 
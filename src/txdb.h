@@ -10,12 +10,16 @@
 #include "dbwrapper.h"
 #include "chain.h"
 
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <utility>
 #include <vector>
 
 class CBlockIndex;
+class CCoinsRollingStats;
 class CCoinsViewDBCursor;
 class uint256;
 
@@ -37,6 +41,10 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! Maximum number of ranges CCoinsViewDB::ShardedCursors() can split the coins into
+static const int MAX_COINS_SHARDS = 1 << 16;
+//! Number of ranges CBlockTreeDB::LoadBlockIndexGuts() splits the block index into
+static const int BLOCK_INDEX_SHARDS = 64;
 
 struct CDiskTxPos : public CDiskBlockPos
 {
@@ -68,6 +76,9 @@ class CCoinsViewDB final : public CCoinsView
 {
 protected:
     CDBWrapper db;
+    //! Held by writes that span several database batches, so that
+    //! ShardedCursors() never takes its snapshot in the middle of one
+    mutable std::mutex cs_write;
 public:
     explicit CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
@@ -75,12 +86,49 @@ public:
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase = true) override;
     CCoinsViewCursor *Cursor() const override;
 
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
     size_t EstimateSize() const override;
+
+    /**
+     * Cursors over nShards disjoint ranges of the coins (split by txid), which
+     * together return all coins in the same order as Cursor(). All cursors
+     * read from one snapshot of the database, taken between writes, and can
+     * be used concurrently.
+     * nShards must be between 1 and MAX_COINS_SHARDS.
+     */
+    std::vector<std::unique_ptr<CCoinsViewCursor>> ShardedCursors(int nShards) const;
+
+    /**
+     * Scan all coins on nThreads threads, split into nShards ranges as by
+     * ShardedCursors(). map(i, cursor) is called for range i on one of the
+     * threads. reduce(i) is called on the calling thread for each range in
+     * order, once map(i) has returned, so combining per-range results in
+     * reduce gives the same result as a single sequential scan. Maps run at
+     * most 2 * nThreads ranges ahead of the reductions, which bounds the
+     * memory held by results that are waiting to be reduced. Returns false if
+     * a map returned false or failed to read the database.
+     */
+    bool ParallelScan(int nShards, int nThreads, const std::function<bool(int, CCoinsViewCursor&)>& map, const std::function<void(int)>& reduce) const;
+    //! As above, over cursors obtained from ShardedCursors() earlier.
+    static bool ParallelScan(std::vector<std::unique_ptr<CCoinsViewCursor>> cursors, int nThreads, const std::function<bool(int, CCoinsViewCursor&)>& map, const std::function<void(int)>& reduce);
+
+    /**
+     * Write coins loaded from a snapshot of the UTXO set at hashBlock, which
+     * must be sorted. Until a final BatchWrite for hashBlock, the database is
+     * marked as being in the middle of a write from an empty chainstate to
+     * hashBlock, which cannot be replayed.
+     */
+    bool WriteSnapshotCoins(const std::vector<std::pair<COutPoint, Coin>> &coins, const uint256 &hashBlock);
+
+    //! Store the rolling statistics of the UTXO set as of block hashBlock.
+    bool WriteRollingStats(const uint256 &hashBlock, const CCoinsRollingStats &stats);
+    bool ReadRollingStats(const uint256 &hashBlock, CCoinsRollingStats &stats) const;
+    //! Erase the stored rolling statistics of all blocks not in keep.
+    bool PruneRollingStats(const std::vector<uint256> &keep);
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
@@ -97,10 +145,17 @@ public:
     void Next() override;
 
 private:
-    CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn):
-        CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn) {}
+    CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn, std::shared_ptr<const leveldb::Snapshot> snapshotIn = nullptr, uint32_t nEndPrefixIn = 1 << 16):
+        CCoinsViewCursor(hashBlockIn), snapshot(std::move(snapshotIn)), pcursor(pcursorIn), nEndPrefix(nEndPrefixIn) {}
+    //! Must outlive pcursor, if it was created from it.
+    std::shared_ptr<const leveldb::Snapshot> snapshot;
     std::unique_ptr<CDBIterator> pcursor;
     std::pair<char, COutPoint> keyTmp;
+    //! The cursor ends before the first txid whose first two bytes are at least this.
+    uint32_t nEndPrefix;
+
+    //! Cache the key at the current position, or invalidate it at the end of the range.
+    void ReadKey();
 
     friend class CCoinsViewDB;
 };
@@ -123,7 +178,12 @@ public:
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &vect);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
-    bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+    /**
+     * Read all block index entries and check their proof of work, along with
+     * their hashes. The entries are decoded on nThreads threads, each reading
+     * a range of hashes from one snapshot, and come out in no particular order.
+     */
+    bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, int nThreads, std::vector<std::pair<uint256, CDiskBlockIndex>>& vEntries);
 };
 
 #endif // BITCOIN_TXDB_H
@@ -0,0 +1,89 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txprevalidation.h"
+
+#include <algorithm>
+
+#include <boost/thread/thread.hpp>
+
+void CTxPrevalidationQueue::SetNotify(NotifyFn notifyIn)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    notify = notifyIn;
+}
+
+void CTxPrevalidationQueue::Thread()
+{
+    while (true) {
+        std::shared_ptr<Job> job;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (queue.empty()) {
+                condWorker.wait(lock); // interruption point
+            }
+            job = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        check(*job->tx);
+
+        NotifyFn notifyDone;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            job->fDone = true;
+            notifyDone = notify;
+        }
+        if (notifyDone)
+            notifyDone();
+    }
+}
+
+void CTxPrevalidationQueue::Enqueue(NodeId nodeid, const CTransactionRef& tx)
+{
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    job->nodeid = nodeid;
+    job->tx = tx;
+    job->fDone = false;
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    mapPeerJobs[nodeid].push_back(job);
+    queue.push_back(std::move(job));
+    condWorker.notify_one();
+}
+
+std::vector<CTransactionRef> CTxPrevalidationQueue::TakeReady(NodeId nodeid)
+{
+    std::vector<CTransactionRef> vReady;
+    boost::unique_lock<boost::mutex> lock(mutex);
+    auto it = mapPeerJobs.find(nodeid);
+    if (it == mapPeerJobs.end())
+        return vReady;
+    std::deque<std::shared_ptr<Job>>& jobs = it->second;
+    while (!jobs.empty() && jobs.front()->fDone) {
+        vReady.push_back(jobs.front()->tx);
+        jobs.pop_front();
+    }
+    if (jobs.empty())
+        mapPeerJobs.erase(it);
+    return vReady;
+}
+
+size_t CTxPrevalidationQueue::Pending(NodeId nodeid)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    auto it = mapPeerJobs.find(nodeid);
+    return it == mapPeerJobs.end() ? 0 : it->second.size();
+}
+
+void CTxPrevalidationQueue::RemoveNode(NodeId nodeid)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    mapPeerJobs.erase(nodeid);
+    // Jobs that no worker took yet are dropped. One being checked is finished,
+    // but nothing takes it anymore.
+    queue.erase(std::remove_if(queue.begin(), queue.end(), [nodeid](const std::shared_ptr<Job>& job) {
+        return job->nodeid == nodeid;
+    }), queue.end());
+}
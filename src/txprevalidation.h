@@ -0,0 +1,81 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXPREVALIDATION_H
+#define BITCOIN_TXPREVALIDATION_H
+
+#include "net.h"
+#include "primitives/transaction.h"
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+/**
+ * Runs the checks of transactions received from peers that do not need
+ * cs_main (see PrevalidateTransaction) on background threads, before they are
+ * passed to AcceptToMemoryPool by the message handler thread.
+ *
+ * Transactions are handed back to the message handler per peer and in the
+ * order they were received from it, so that a peer's transactions are
+ * accepted in the same order as without prevalidation. The result of the
+ * checks is not handed back: they only warm the caches AcceptToMemoryPool
+ * uses, and AcceptToMemoryPool makes every decision itself.
+ */
+class CTxPrevalidationQueue
+{
+public:
+    typedef std::function<void(const CTransaction&)> CheckFn;
+    typedef std::function<void()> NotifyFn;
+
+private:
+    struct Job {
+        NodeId nodeid;
+        CTransactionRef tx;
+        bool fDone;
+    };
+
+    //! Mutex to protect the inner state
+    boost::mutex mutex;
+
+    //! Worker threads block on this when out of work
+    boost::condition_variable condWorker;
+
+    //! Jobs waiting for a worker, in the order they were queued.
+    std::deque<std::shared_ptr<Job>> queue;
+
+    //! The jobs of each peer that were not taken yet, in the order they were received.
+    std::map<NodeId, std::deque<std::shared_ptr<Job>>> mapPeerJobs;
+
+    const CheckFn check;
+    NotifyFn notify;
+
+public:
+    explicit CTxPrevalidationQueue(CheckFn checkIn) : check(checkIn) {}
+
+    /** Set the function called, without the lock held, when a job is done. */
+    void SetNotify(NotifyFn notifyIn);
+
+    /** Worker thread loop. Returns when the thread is interrupted. */
+    void Thread();
+
+    /** Queue tx, received from peer nodeid, to be checked. */
+    void Enqueue(NodeId nodeid, const CTransactionRef& tx);
+
+    /** Take the transactions of peer nodeid that are checked and were received before any that are not. */
+    std::vector<CTransactionRef> TakeReady(NodeId nodeid);
+
+    /** Number of the transactions of peer nodeid that were not taken yet. */
+    size_t Pending(NodeId nodeid);
+
+    /** Forget the transactions of peer nodeid, which disconnected. */
+    void RemoveNode(NodeId nodeid);
+};
+
+#endif // BITCOIN_TXPREVALIDATION_H
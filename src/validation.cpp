@@ -6,10 +6,16 @@
 #include "validation.h"
 
 #include "arith_uint256.h"
+#include "blockcache.h"
+#include "blockimport.h"
+#include "blockreader.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
+#include "coinsprefetch.h"
+#include "coinstats.h"
+#include "coinswriter.h"
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/tx_verify.h"
@@ -18,6 +24,7 @@
 #include "fs.h"
 #include "hash.h"
 #include "init.h"
+#include "mempooljournal.h"
 #include "policy/fees.h"
 #include "policy/policy.h"
 #include "policy/rbf.h"
@@ -25,7 +32,6 @@
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "random.h"
-#include "reverse_iterator.h"
 #include "script/script.h"
 #include "script/sigcache.h"
 #include "script/standard.h"
@@ -39,10 +45,12 @@
 #include "utilmoneystr.h"
 #include "utilstrencodings.h"
 #include "validationinterface.h"
+#include "validationstats.h"
 #include "versionbits.h"
 #include "warnings.h"
 
 #include <atomic>
+#include <functional>
 #include <sstream>
 
 #include <boost/algorithm/string/replace.hpp>
@@ -63,11 +71,14 @@
 CCriticalSection cs_main;
 
 BlockMap mapBlockIndex;
+/** Owns the entries of mapBlockIndex. */
+static CBlockIndexArena blockIndexArena;
 CChain chainActive;
 CBlockIndex *pindexBestHeader = nullptr;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
+int nPrefetchThreads = 0;
 std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
 bool fTxIndex = false;
@@ -76,7 +87,9 @@ bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
+bool fPipelineBlocks = DEFAULT_PIPELINE_BLOCKS;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
+bool fRollingUTXOStats = DEFAULT_ROLLING_UTXO_STATS;
 size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
@@ -90,6 +103,8 @@ CAmount maxTxFee = DEFAULT_TRANSACTION_MAXFEE;
 
 CBlockPolicyEstimator feeEstimator;
 CTxMemPool mempool(&feeEstimator);
+CBlockCache blockCache(DEFAULT_BLOCK_CACHE_SIZE << 20);
+CValidationStats validationStats(VALIDATION_STATS_BLOCKS);
 
 static void CheckBlockIndex(const Consensus::Params& consensusParams);
 
@@ -182,9 +197,16 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 }
 
 CCoinsViewDB *pcoinsdbview = nullptr;
+CCoinsViewAsyncWriter *pcoinswriter = nullptr;
 CCoinsViewCache *pcoinsTip = nullptr;
 CBlockTreeDB *pblocktree = nullptr;
 
+/** Rolling statistics of the UTXO set as of pcoinsTip's best block, if known. */
+static CCoinsRollingStats rollingStatsTip;
+static bool fRollingStatsTip = false;
+/** Block of the rolling statistics stored with the last write of the chainstate. */
+static uint256 hashRollingStatsFlushed;
+
 enum FlushStateMode {
     FLUSH_STATE_NONE,
     FLUSH_STATE_IF_NEEDED,
@@ -409,6 +431,17 @@ void UpdateMempoolForReorg(DisconnectedBlockTransactions &disconnectpool, bool f
     LimitMempoolSize(mempool, gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
 }
 
+// The script flags that transactions are checked with before they are
+// accepted to the mempool.
+static unsigned int GetMempoolScriptVerifyFlags(const CChainParams& chainparams)
+{
+    unsigned int scriptVerifyFlags = STANDARD_SCRIPT_VERIFY_FLAGS;
+    if (!chainparams.RequireStandard()) {
+        scriptVerifyFlags = gArgs.GetArg("-promiscuousmempoolflags", scriptVerifyFlags);
+    }
+    return scriptVerifyFlags;
+}
+
 // Used to avoid mempool polluting consensus critical paths if CCoinsViewMempool
 // were somehow broken and returning the wrong scriptPubKeys
 static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &view, CTxMemPool& pool,
@@ -447,7 +480,8 @@ static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, CValidationSt
 
 static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool& pool, CValidationState& state, const CTransactionRef& ptx,
                               bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
-                              bool bypass_limits, const CAmount& nAbsurdFee, std::vector<COutPoint>& coins_to_uncache)
+                              bool bypass_limits, const CAmount& nAbsurdFee, std::vector<COutPoint>& coins_to_uncache,
+                              CCoinsViewMemPool& viewMemPool, PrecomputedTransactionData& txdata, bool fCheckScripts = true)
 {
     const CTransaction& tx = *ptx;
     const uint256 hash = tx.GetHash();
@@ -537,7 +571,6 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         LockPoints lp;
         {
         LOCK(pool.cs);
-        CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
         view.SetBackend(viewMemPool);
 
         // do all inputs exist?
@@ -790,15 +823,13 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
             }
         }
 
-        unsigned int scriptVerifyFlags = STANDARD_SCRIPT_VERIFY_FLAGS;
-        if (!chainparams.RequireStandard()) {
-            scriptVerifyFlags = gArgs.GetArg("-promiscuousmempoolflags", scriptVerifyFlags);
-        }
+        unsigned int scriptVerifyFlags = GetMempoolScriptVerifyFlags(chainparams);
 
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-        PrecomputedTransactionData txdata(tx);
-        if (!CheckInputs(tx, state, view, true, scriptVerifyFlags, true, false, txdata)) {
+        // Transactions reloaded from a mempool dump made at the current tip
+        // had their scripts checked with the same flags already.
+        if (fCheckScripts && !CheckInputs(tx, state, view, true, scriptVerifyFlags, true, false, txdata)) {
             // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
             // need to turn both off, and compare against just turning off CLEANSTACK
             // to see if the failure is specifically due to witness validation.
@@ -827,7 +858,7 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         // invalid blocks (using TestBlockValidity), however allowing such
         // transactions into the mempool can be exploited as a DoS attack.
         unsigned int currentBlockScriptVerifyFlags = GetBlockScriptFlags(chainActive.Tip(), Params().GetConsensus());
-        if (!CheckInputsFromMempoolAndCache(tx, state, view, pool, currentBlockScriptVerifyFlags, true, txdata))
+        if (fCheckScripts && !CheckInputsFromMempoolAndCache(tx, state, view, pool, currentBlockScriptVerifyFlags, true, txdata))
         {
             // If we're using promiscuousmempoolflags, we may hit this normally
             // Check if current block has some flags that scriptVerifyFlags
@@ -884,10 +915,12 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
 /** (try to) add transaction to memory pool with a specified acceptance time **/
 static bool AcceptToMemoryPoolWithTime(const CChainParams& chainparams, CTxMemPool& pool, CValidationState &state, const CTransactionRef &tx,
                         bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
-                        bool bypass_limits, const CAmount nAbsurdFee)
+                        bool bypass_limits, const CAmount nAbsurdFee, bool fCheckScripts = true)
 {
     std::vector<COutPoint> coins_to_uncache;
-    bool res = AcceptToMemoryPoolWorker(chainparams, pool, state, tx, pfMissingInputs, nAcceptTime, plTxnReplaced, bypass_limits, nAbsurdFee, coins_to_uncache);
+    CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
+    PrecomputedTransactionData txdata(*tx);
+    bool res = AcceptToMemoryPoolWorker(chainparams, pool, state, tx, pfMissingInputs, nAcceptTime, plTxnReplaced, bypass_limits, nAbsurdFee, coins_to_uncache, viewMemPool, txdata, fCheckScripts);
     if (!res) {
         for (const COutPoint& hashTx : coins_to_uncache)
             pcoinsTip->Uncache(hashTx);
@@ -906,6 +939,40 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
     return AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, pfMissingInputs, GetTime(), plTxnReplaced, bypass_limits, nAbsurdFee);
 }
 
+bool AcceptPackageToMemoryPool(CTxMemPool& pool, const std::vector<CTransactionRef>& package, std::vector<PackageTxResult>& results,
+                               std::list<CTransactionRef>* plTxnReplaced, bool bypass_limits, const CAmount nAbsurdFee)
+{
+    const CChainParams& chainparams = Params();
+    results.assign(package.size(), PackageTxResult());
+
+    // Hash the transactions for their signature checks before taking the lock.
+    std::vector<PrecomputedTransactionData> vTxData;
+    vTxData.reserve(package.size());
+    for (const CTransactionRef& tx : package) {
+        vTxData.emplace_back(*tx);
+    }
+
+    LOCK(cs_main);
+    CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
+    int64_t nAcceptTime = GetTime();
+    bool fAllAccepted = true;
+    for (size_t i = 0; i < package.size(); i++) {
+        PackageTxResult& result = results[i];
+        std::vector<COutPoint> coins_to_uncache;
+        result.fAccepted = AcceptToMemoryPoolWorker(chainparams, pool, result.state, package[i], &result.fMissingInputs, nAcceptTime,
+                                                    plTxnReplaced, bypass_limits, nAbsurdFee, coins_to_uncache, viewMemPool, vTxData[i]);
+        if (!result.fAccepted) {
+            fAllAccepted = false;
+            for (const COutPoint& outpoint : coins_to_uncache)
+                pcoinsTip->Uncache(outpoint);
+        }
+    }
+    // The coins cache only needs to be checked against its size limits once.
+    CValidationState stateDummy;
+    FlushStateToDisk(chainparams, stateDummy, FLUSH_STATE_PERIODIC);
+    return fAllAccepted;
+}
+
 /** Return transaction in txOut, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256 &hash, CTransactionRef &txOut, const Consensus::Params& consensusParams, uint256 &hashBlock, bool fAllowSlow)
 {
@@ -993,18 +1060,51 @@ static bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMes
     return true;
 }
 
+/** Mappings of the blk?????.dat files, shared by all readers of blocks. */
+static CBlockFileMapper blockFileMapper(MAX_MAPPED_BLOCK_FILES);
+
+bool ReadRawBlockFromDisk(CRawBlock& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
+{
+    // WriteBlockToDisk precedes each block with the network magic and its size.
+    const unsigned int nHeaderSize = CMessageHeader::MESSAGE_START_SIZE + sizeof(uint32_t);
+    if (pos.IsNull() || pos.nPos < nHeaderSize)
+        return error("%s: Invalid block position %s", __func__, pos.ToString());
+    fs::path path = GetBlockPosFilename(pos, "blk");
+    CRawBlock header;
+    if (!blockFileMapper.Read(path, pos.nPos - nHeaderSize, nHeaderSize, header))
+        return error("%s: Unable to read %s", __func__, pos.ToString());
+    if (memcmp(header.begin(), messageStart, CMessageHeader::MESSAGE_START_SIZE) != 0)
+        return error("%s: Block magic mismatch at %s", __func__, pos.ToString());
+    uint32_t nSize = ReadLE32(header.begin() + CMessageHeader::MESSAGE_START_SIZE);
+    if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+        return error("%s: Invalid block size %u at %s", __func__, nSize, pos.ToString());
+    if (!blockFileMapper.Read(path, pos.nPos, nSize, block))
+        return error("%s: Unable to read %u bytes at %s", __func__, nSize, pos.ToString());
+    return true;
+}
+
+bool ReadRawBlockFromDisk(CRawBlock& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart)
+{
+    if (!ReadRawBlockFromDisk(block, pindex->GetBlockPos(), messageStart))
+        return false;
+    if (Hash(block.begin(), block.begin() + 80) != pindex->GetBlockHash())
+        return error("%s: Block header doesn't match index for %s at %s", __func__,
+                pindex->ToString(), pindex->GetBlockPos().ToString());
+    return true;
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+    CRawBlock raw;
+    if (!ReadRawBlockFromDisk(raw, pos, Params().MessageStart()))
+        return error("ReadBlockFromDisk: Unable to read block at %s", pos.ToString());
 
     // Read block
     try {
-        filein >> block;
+        CMemoryReader reader(SER_DISK, CLIENT_VERSION, raw.begin(), raw.end());
+        reader >> block;
     }
     catch (const std::exception& e) {
         return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
@@ -1027,6 +1127,59 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return true;
 }
 
+/** ReadBlockCached, counting the cache lookup in its statistics if fCount. */
+static bool ReadBlockCached(std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex, const CChainParams& chainparams, bool fCount)
+{
+    const uint256 hash = pindex->GetBlockHash();
+    block = blockCache.GetBlock(hash, fCount);
+    if (block)
+        return true;
+
+    std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+    CRawBlock raw;
+    if (blockCache.GetRawBlock(hash, true, raw, false)) {
+        try {
+            CMemoryReader reader(SER_NETWORK, PROTOCOL_VERSION, raw.begin(), raw.end());
+            reader >> *pblockRead;
+        } catch (const std::exception& e) {
+            return error("%s: Deserialize error - %s for %s", __func__, e.what(), hash.ToString());
+        }
+    } else if (!ReadBlockFromDisk(*pblockRead, pindex, chainparams.GetConsensus())) {
+        return false;
+    }
+    block = pblockRead;
+    blockCache.AddBlock(hash, block);
+    return true;
+}
+
+bool ReadBlockCached(std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex, const CChainParams& chainparams)
+{
+    return ReadBlockCached(block, pindex, chainparams, true);
+}
+
+bool ReadRawBlockCached(CRawBlock& block, const CBlockIndex* pindex, bool fWitness, const CChainParams& chainparams)
+{
+    const uint256 hash = pindex->GetBlockHash();
+    if (blockCache.GetRawBlock(hash, fWitness, block))
+        return true;
+
+    if (fWitness) {
+        // Blocks are stored as they are serialized with witness data.
+        if (!ReadRawBlockFromDisk(block, pindex, chainparams.MessageStart()))
+            return false;
+    } else {
+        std::shared_ptr<const CBlock> pblock;
+        if (!ReadBlockCached(pblock, pindex, chainparams, false))
+            return false;
+        auto buffer = std::make_shared<std::vector<unsigned char>>();
+        buffer->reserve(::GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS));
+        CVectorWriter(SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS, *buffer, 0, *pblock);
+        block = CRawBlock(buffer, buffer->data(), buffer->size());
+    }
+    blockCache.AddRawBlock(hash, fWitness, block);
+    return true;
+}
+
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
 {
     int halvings = nHeight / consensusParams.nSubsidyHalvingInterval;
@@ -1183,7 +1336,7 @@ void static InvalidBlockFound(CBlockIndex *pindex, const CValidationState &state
     }
 }
 
-void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, CTxUndo &txundo, int nHeight)
+void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, CTxUndo &txundo, int nHeight, CCoinsRollingStats* stats = nullptr)
 {
     // mark inputs spent
     if (!tx.IsCoinBase()) {
@@ -1192,6 +1345,20 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, CTxUndo &txund
             txundo.vprevout.emplace_back();
             bool is_spent = inputs.SpendCoin(txin.prevout, &txundo.vprevout.back());
             assert(is_spent);
+            if (stats) stats->RemoveCoin(txin.prevout, txundo.vprevout.back());
+        }
+    }
+    if (stats) {
+        const uint256& txid = tx.GetHash();
+        for (size_t i = 0; i < tx.vout.size(); ++i) {
+            if (tx.vout[i].scriptPubKey.IsUnspendable()) continue;
+            COutPoint out(txid, i);
+            if (tx.IsCoinBase()) {
+                // Pre-BIP30 duplicate coinbases overwrite the outputs of the earlier one.
+                const Coin& coin = inputs.AccessCoin(out);
+                if (!coin.IsSpent()) stats->RemoveCoin(out, coin);
+            }
+            stats->AddCoin(out, Coin(tx.vout[i], nHeight, tx.IsCoinBase()));
         }
     }
     // add outputs
@@ -1244,6 +1411,17 @@ void InitScriptExecutionCache() {
  *
  * Non-static (and re-declared) in src/test/txvalidationcache_tests.cpp
  */
+/** The script execution cache entry for tx having passed its script checks with flags */
+static uint256 GetScriptExecutionCacheEntry(const CTransaction& tx, unsigned int flags)
+{
+    uint256 hashCacheEntry;
+    // We only use the first 19 bytes of nonce to avoid a second SHA
+    // round - giving us 19 + 32 + 4 = 55 bytes (+ 8 + 1 = 64)
+    static_assert(55 - sizeof(flags) - 32 >= 128/8, "Want at least 128 bits of nonce for script execution cache");
+    CSHA256().Write(scriptExecutionCacheNonce.begin(), 55 - sizeof(flags) - 32).Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
+    return hashCacheEntry;
+}
+
 bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks)
 {
     if (!tx.IsCoinBase())
@@ -1266,11 +1444,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
             // correct (ie that the transaction hash which is in tx's prevouts
             // properly commits to the scriptPubKey in the inputs view of that
             // transaction).
-            uint256 hashCacheEntry;
-            // We only use the first 19 bytes of nonce to avoid a second SHA
-            // round - giving us 19 + 32 + 4 = 55 bytes (+ 8 + 1 = 64)
-            static_assert(55 - sizeof(flags) - 32 >= 128/8, "Want at least 128 bits of nonce for script execution cache");
-            CSHA256().Write(scriptExecutionCacheNonce.begin(), 55 - sizeof(flags) - 32).Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
+            uint256 hashCacheEntry = GetScriptExecutionCacheEntry(tx, flags);
             AssertLockHeld(cs_main); //TODO: Remove this requirement by making CuckooCache not require external locks
             if (scriptExecutionCache.contains(hashCacheEntry, !cacheFullScriptStore)) {
                 return true;
@@ -1327,6 +1501,95 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
     return true;
 }
 
+bool PrevalidateTransaction(const CTransaction& tx, const CChainParams& chainparams)
+{
+    CValidationState state;
+    if (!CheckTransaction(tx, state) || tx.IsCoinBase())
+        return false;
+
+    // Copy the coins tx spends, and what its script flags depend on, holding
+    // the locks for just that.
+    CCoinsView viewDummy;
+    CCoinsViewCache view(&viewDummy);
+    bool witnessEnabled;
+    unsigned int currentBlockScriptVerifyFlags;
+    int nSpendHeight;
+    CAmount nFeeDelta = 0;
+    CFeeRate mempoolMinFeeRate;
+    {
+        LOCK2(cs_main, mempool.cs);
+        if (mempool.exists(tx.GetHash()))
+            return false;
+        witnessEnabled = IsWitnessEnabled(chainActive.Tip(), chainparams.GetConsensus());
+        currentBlockScriptVerifyFlags = GetBlockScriptFlags(chainActive.Tip(), chainparams.GetConsensus());
+        nSpendHeight = chainActive.Height() + 1;
+        mempool.ApplyDelta(tx.GetHash(), nFeeDelta);
+        mempoolMinFeeRate = mempool.GetMinFee(gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000);
+        CCoinsViewMemPool viewMemPool(pcoinsTip, mempool);
+        std::vector<COutPoint> coins_to_uncache;
+        bool fMissingInputs = false;
+        for (const CTxIn& txin : tx.vin) {
+            if (!pcoinsTip->HaveCoinInCache(txin.prevout))
+                coins_to_uncache.push_back(txin.prevout);
+            Coin coin;
+            if (!viewMemPool.GetCoin(txin.prevout, coin)) {
+                fMissingInputs = true;
+                break;
+            }
+            view.AddCoin(txin.prevout, std::move(coin), true);
+        }
+        // Leave it to AcceptToMemoryPool to decide which coins stay cached.
+        for (const COutPoint& outpoint : coins_to_uncache)
+            pcoinsTip->Uncache(outpoint);
+        if (fMissingInputs)
+            return false;
+    }
+
+    // The same input, standardness and fee checks as AcceptToMemoryPool,
+    // which would reject tx before checking its scripts.
+    std::string reason;
+    if (!gArgs.GetBoolArg("-prematurewitness", false) && tx.HasWitness() && !witnessEnabled)
+        return false;
+    if (fRequireStandard && !IsStandardTx(tx, reason, witnessEnabled))
+        return false;
+    CAmount nFees = 0;
+    if (!Consensus::CheckTxInputs(tx, state, view, nSpendHeight, nFees))
+        return false;
+    if (fRequireStandard && !AreInputsStandard(tx, view))
+        return false;
+    if (tx.HasWitness() && fRequireStandard && !IsWitnessStandard(tx, view))
+        return false;
+    int64_t nSigOpsCost = GetTransactionSigOpCost(tx, view, STANDARD_SCRIPT_VERIFY_FLAGS);
+    if (nSigOpsCost > MAX_STANDARD_TX_SIGOPS_COST)
+        return false;
+    unsigned int nSize = GetVirtualTransactionSize(tx, nSigOpsCost);
+    if (nFees + nFeeDelta < std::max(mempoolMinFeeRate.GetFee(nSize), ::minRelayTxFee.GetFee(nSize)))
+        return false;
+
+    unsigned int scriptVerifyFlags = GetMempoolScriptVerifyFlags(chainparams);
+
+    // Run the scripts with both sets of flags AcceptToMemoryPool checks them
+    // with. The signatures are only verified once, and then found in the
+    // signature cache.
+    PrecomputedTransactionData txdata(tx);
+    std::vector<uint256> vCacheEntries;
+    for (unsigned int flags : {scriptVerifyFlags, currentBlockScriptVerifyFlags}) {
+        if (!vCacheEntries.empty() && flags == scriptVerifyFlags)
+            break;
+        for (unsigned int i = 0; i < tx.vin.size(); i++) {
+            CScriptCheck check(view.AccessCoin(tx.vin[i].prevout).out, tx, i, flags, true, &txdata);
+            if (!check())
+                return false;
+        }
+        vCacheEntries.push_back(GetScriptExecutionCacheEntry(tx, flags));
+    }
+
+    LOCK(cs_main);
+    for (const uint256& entry : vCacheEntries)
+        scriptExecutionCache.insert(entry);
+    return true;
+}
+
 namespace {
 
 bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
@@ -1414,13 +1677,17 @@ enum DisconnectResult
  * @param undo The Coin to be restored.
  * @param view The coins view to which to apply the changes.
  * @param out The out point that corresponds to the tx input.
+ * @param stats If not null, updated with the change to the UTXO set statistics.
  * @return A DisconnectResult as an int
  */
-int ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out)
+int ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out, CCoinsRollingStats* stats = nullptr)
 {
     bool fClean = true;
 
-    if (view.HaveCoin(out)) fClean = false; // overwriting transaction output
+    if (view.HaveCoin(out)) {
+        fClean = false; // overwriting transaction output
+        if (stats) stats->RemoveCoin(out, view.AccessCoin(out));
+    }
 
     if (undo.nHeight == 0) {
         // Missing undo metadata (height and coinbase). Older versions included this
@@ -1438,14 +1705,16 @@ int ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out)
     // sure that the coin did not already exist in the cache. As we have queried for that above
     // using HaveCoin, we don't need to guess. When fClean is false, a coin already existed and
     // it is an overwrite.
+    if (stats) stats->AddCoin(out, undo);
     view.AddCoin(out, std::move(undo), !fClean);
 
     return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
 }
 
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
+ *  If stats is not null, the change to the UTXO set statistics is added to it.
  *  When FAILED is returned, view is left in an indeterminate state. */
-static DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view)
+static DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view, CCoinsRollingStats* stats = nullptr)
 {
     bool fClean = true;
 
@@ -1481,6 +1750,7 @@ static DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex*
                 if (!is_spent || tx.vout[o] != coin.out || pindex->nHeight != coin.nHeight || is_coinbase != coin.fCoinBase) {
                     fClean = false; // transaction output mismatch
                 }
+                if (is_spent && stats) stats->RemoveCoin(out, coin);
             }
         }
 
@@ -1493,7 +1763,7 @@ static DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex*
             }
             for (unsigned int j = tx.vin.size(); j-- > 0;) {
                 const COutPoint &out = tx.vin[j].prevout;
-                int res = ApplyTxInUndo(std::move(txundo.vprevout[j]), view, out);
+                int res = ApplyTxInUndo(std::move(txundo.vprevout[j]), view, out, stats);
                 if (res == DISCONNECT_FAILED) return DISCONNECT_FAILED;
                 fClean = fClean && res != DISCONNECT_UNCLEAN;
             }
@@ -1515,8 +1785,10 @@ void static FlushBlockFile(bool fFinalize = false)
 
     FILE *fileOld = OpenBlockFile(posOld);
     if (fileOld) {
-        if (fFinalize)
+        if (fFinalize) {
             TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nSize);
+            blockFileMapper.Invalidate(GetBlockPosFilename(posOld, "blk"));
+        }
         FileCommit(fileOld);
         fclose(fileOld);
     }
@@ -1539,6 +1811,93 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+/** Number of transactions whose context-free checks make up one check on blockcheckqueue */
+static const size_t BLOCK_TX_CHECK_BATCH = 16;
+
+/** The outcome of the context-free checks of a range of a block's transactions */
+struct CBlockTxCheckResult
+{
+    bool fOk = true;
+    //! The index of the transaction that failed, if any
+    size_t nFailed = 0;
+    CValidationState state;
+    unsigned int nSigOps = 0;
+};
+
+static void CheckBlockTransactions(const CBlock& block, size_t nBegin, size_t nEnd, CBlockTxCheckResult& result)
+{
+    for (size_t i = nBegin; i < nEnd; i++) {
+        if (!CheckTransaction(*block.vtx[i], result.state, false)) {
+            result.fOk = false;
+            result.nFailed = i;
+            return;
+        }
+        result.nSigOps += GetLegacySigOpCount(*block.vtx[i]);
+    }
+}
+
+/** Number of headers whose hash and proof of work make up one check on blockcheckqueue */
+static const size_t HEADER_CHECK_BATCH = 64;
+
+/** A header's hash and whether its proof of work is valid, found without holding cs_main */
+struct CCheckedHeader
+{
+    uint256 hash;
+    bool fValidPoW = false;
+};
+
+static void CheckHeaders(const std::vector<CBlockHeader>& headers, size_t nBegin, size_t nEnd, std::vector<CCheckedHeader>& vChecked, const Consensus::Params& consensusParams)
+{
+    for (size_t i = nBegin; i < nEnd; i++) {
+        vChecked[i].hash = headers[i].GetHash();
+        vChecked[i].fValidPoW = CheckProofOfWork(vChecked[i].hash, headers[i].nBits, consensusParams);
+    }
+}
+
+/**
+ * Closure representing context-free checks of a range of a block's
+ * transactions or of a batch of headers. It always succeeds, and leaves the
+ * outcome where the caller that queued it looks for it, so that the caller
+ * reports the failure a serial check would have found first, whichever
+ * thread found it.
+ */
+class CContextFreeCheck
+{
+private:
+    std::function<void()> func;
+
+public:
+    CContextFreeCheck() {}
+    explicit CContextFreeCheck(std::function<void()> funcIn) : func(std::move(funcIn)) {}
+
+    bool operator()() {
+        func();
+        return true;
+    }
+
+    void swap(CContextFreeCheck& check) {
+        func.swap(check.func);
+    }
+};
+
+static CCheckQueue<CContextFreeCheck> blockcheckqueue(128);
+
+void ThreadBlockCheck() {
+    RenameThread("bitcoin-blkcheck");
+    blockcheckqueue.Thread();
+}
+
+static CCoinsPrefetcher coinsprefetcher;
+
+void ThreadCoinsPrefetch() {
+    RenameThread("bitcoin-prefetch");
+    coinsprefetcher.Thread();
+}
+
+CCoinsPrefetchStats GetCoinsPrefetchStats() {
+    return coinsprefetcher.GetStats();
+}
+
 // Protected by cs_main
 VersionBitsCache versionbitscache;
 
@@ -1628,11 +1987,62 @@ static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 static int64_t nBlocksTotal = 0;
 
-/** Apply the effects of this block (with given index) on the UTXO set represented by coins.
- *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
- *  can fail if those validity checks fail (among other reasons). */
-static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex,
-                  CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck = false)
+/**
+ * What connecting a block keeps between applying its transactions to the UTXO
+ * set and writing its undo data, which waits for the block's script checks.
+ * The queued script checks refer to txdata.
+ */
+struct PendingBlockConnection
+{
+    bool fGenesis = false;
+    int64_t nTimeStart = 0;
+    int nInputs = 0;
+    std::vector<PrecomputedTransactionData> txdata;
+    CBlockUndo blockundo;
+    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
+    CValidationStats::BlockRecord record;
+};
+
+/** Whether the scripts of the block at pindex must be verified, which they
+ *  need not be for old enough ancestors of the assumed valid block. */
+static bool ShouldCheckScripts(const CBlockIndex* pindex, const CChainParams& chainparams)
+{
+    AssertLockHeld(cs_main);
+    if (!hashAssumeValid.IsNull()) {
+        // We've been configured with the hash of a block which has been externally verified to have a valid history.
+        // A suitable default value is included with the software and updated from time to time.  Because validity
+        //  relative to a piece of software is an objective fact these defaults can be easily reviewed.
+        // This setting doesn't force the selection of any particular chain but makes validating some faster by
+        //  effectively caching the result of part of the verification.
+        BlockMap::const_iterator  it = mapBlockIndex.find(hashAssumeValid);
+        if (it != mapBlockIndex.end()) {
+            if (it->second->GetAncestor(pindex->nHeight) == pindex &&
+                pindexBestHeader->GetAncestor(pindex->nHeight) == pindex &&
+                pindexBestHeader->nChainWork >= nMinimumChainWork) {
+                // This block is a member of the assumed verified chain and an ancestor of the best header.
+                // The equivalent time check discourages hash power from extorting the network via DOS attack
+                //  into accepting an invalid block through telling users they must manually set assumevalid.
+                //  Requiring a software change or burying the invalid block, regardless of the setting, makes
+                //  it hard to hide the implication of the demand.  This also avoids having release candidates
+                //  that are hardly doing any signature verification at all in testing without having to
+                //  artificially set the default assumed verified block further back.
+                // The test against nMinimumChainWork prevents the skipping when denied access to any chain at
+                //  least as good as the expected chain.
+                return (GetBlockProofEquivalentTime(*pindexBestHeader, *pindex, *pindexBestHeader, chainparams.GetConsensus()) <= 60 * 60 * 24 * 7 * 2);
+            }
+        }
+    }
+    return true;
+}
+
+/** Apply the transactions of this block (with given index) to the UTXO set
+ *  represented by coins, doing the validity checks that depend on it. The
+ *  script checks are added to pcontrol, or run right away if it is null, and
+ *  the block must not be used before they pass. If stats is not null, the
+ *  change to the UTXO set statistics is added to it. */
+static bool ConnectBlockTransactions(const CBlock& block, CValidationState& state, CBlockIndex* pindex,
+                  CCoinsViewCache& view, const CChainParams& chainparams, CCheckQueueControl<CScriptCheck>* pcontrol,
+                  PendingBlockConnection& pending, bool fJustCheck, CCoinsRollingStats* stats)
 {
     AssertLockHeld(cs_main);
     assert(pindex);
@@ -1654,38 +2064,16 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     if (block.GetHash() == chainparams.GetConsensus().hashGenesisBlock) {
         if (!fJustCheck)
             view.SetBestBlock(pindex->GetBlockHash());
+        pending.fGenesis = true;
         return true;
     }
 
     nBlocksTotal++;
 
-    bool fScriptChecks = true;
-    if (!hashAssumeValid.IsNull()) {
-        // We've been configured with the hash of a block which has been externally verified to have a valid history.
-        // A suitable default value is included with the software and updated from time to time.  Because validity
-        //  relative to a piece of software is an objective fact these defaults can be easily reviewed.
-        // This setting doesn't force the selection of any particular chain but makes validating some faster by
-        //  effectively caching the result of part of the verification.
-        BlockMap::const_iterator  it = mapBlockIndex.find(hashAssumeValid);
-        if (it != mapBlockIndex.end()) {
-            if (it->second->GetAncestor(pindex->nHeight) == pindex &&
-                pindexBestHeader->GetAncestor(pindex->nHeight) == pindex &&
-                pindexBestHeader->nChainWork >= nMinimumChainWork) {
-                // This block is a member of the assumed verified chain and an ancestor of the best header.
-                // The equivalent time check discourages hash power from extorting the network via DOS attack
-                //  into accepting an invalid block through telling users they must manually set assumevalid.
-                //  Requiring a software change or burying the invalid block, regardless of the setting, makes
-                //  it hard to hide the implication of the demand.  This also avoids having release candidates
-                //  that are hardly doing any signature verification at all in testing without having to
-                //  artificially set the default assumed verified block further back.
-                // The test against nMinimumChainWork prevents the skipping when denied access to any chain at
-                //  least as good as the expected chain.
-                fScriptChecks = (GetBlockProofEquivalentTime(*pindexBestHeader, *pindex, *pindexBestHeader, chainparams.GetConsensus()) <= 60 * 60 * 24 * 7 * 2);
-            }
-        }
-    }
+    bool fScriptChecks = ShouldCheckScripts(pindex, chainparams);
 
     int64_t nTime1 = GetTimeMicros(); nTimeCheck += nTime1 - nTimeStart;
+    pending.record.nMicros[CValidationStats::CHECK] = nTime1 - nTimeStart;
     LogPrint(BCLog::BENCH, "    - Sanity checks: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime1 - nTimeStart), nTimeCheck * MICRO, nTimeCheck * MILLI / nBlocksTotal);
 
     // Do not allow blocks that contain transactions which 'overwrite' older transactions,
@@ -1736,21 +2124,21 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     unsigned int flags = GetBlockScriptFlags(pindex, chainparams.GetConsensus());
 
     int64_t nTime2 = GetTimeMicros(); nTimeForks += nTime2 - nTime1;
+    pending.record.nMicros[CValidationStats::FORKS] = nTime2 - nTime1;
     LogPrint(BCLog::BENCH, "    - Fork checks: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime2 - nTime1), nTimeForks * MICRO, nTimeForks * MILLI / nBlocksTotal);
 
-    CBlockUndo blockundo;
-
-    CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : nullptr);
+    pending.nTimeStart = nTime2;
+    CBlockUndo& blockundo = pending.blockundo;
 
     std::vector<int> prevheights;
     CAmount nFees = 0;
     int nInputs = 0;
     int64_t nSigOpsCost = 0;
     CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
-    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
+    std::vector<std::pair<uint256, CDiskTxPos> >& vPos = pending.vPos;
     vPos.reserve(block.vtx.size());
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
-    std::vector<PrecomputedTransactionData> txdata;
+    std::vector<PrecomputedTransactionData>& txdata = pending.txdata;
     txdata.reserve(block.vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
@@ -1798,22 +2186,27 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
         {
             std::vector<CScriptCheck> vChecks;
             bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
-            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, fCacheResults, txdata[i], nScriptCheckThreads ? &vChecks : nullptr))
+            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, fCacheResults, txdata[i], pcontrol ? &vChecks : nullptr))
                 return error("ConnectBlock(): CheckInputs on %s failed with %s",
                     tx.GetHash().ToString(), FormatStateMessage(state));
-            control.Add(vChecks);
+            if (pcontrol)
+                pcontrol->Add(vChecks);
         }
 
         CTxUndo undoDummy;
         if (i > 0) {
             blockundo.vtxundo.push_back(CTxUndo());
         }
-        UpdateCoins(tx, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
+        UpdateCoins(tx, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight, stats);
 
         vPos.push_back(std::make_pair(tx.GetHash(), pos));
         pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
     }
+    pending.nInputs = nInputs;
     int64_t nTime3 = GetTimeMicros(); nTimeConnect += nTime3 - nTime2;
+    pending.record.nMicros[CValidationStats::CONNECT] = nTime3 - nTime2;
+    pending.record.nTx = block.vtx.size();
+    pending.record.nInputs = std::max(nInputs - 1, 0);
     LogPrint(BCLog::BENCH, "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs (%.2fms/blk)]\n", (unsigned)block.vtx.size(), MILLI * (nTime3 - nTime2), MILLI * (nTime3 - nTime2) / block.vtx.size(), nInputs <= 1 ? 0 : MILLI * (nTime3 - nTime2) / (nInputs-1), nTimeConnect * MICRO, nTimeConnect * MILLI / nBlocksTotal);
 
     CAmount blockReward = nFees + GetBlockSubsidy(pindex->nHeight, chainparams.GetConsensus());
@@ -1823,14 +2216,22 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
                                block.vtx[0]->GetValueOut(), blockReward),
                                REJECT_INVALID, "bad-cb-amount");
 
-    if (!control.Wait())
-        return state.DoS(100, error("%s: CheckQueue failed", __func__), REJECT_INVALID, "block-validation-failed");
-    int64_t nTime4 = GetTimeMicros(); nTimeVerify += nTime4 - nTime2;
-    LogPrint(BCLog::BENCH, "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs (%.2fms/blk)]\n", nInputs - 1, MILLI * (nTime4 - nTime2), nInputs <= 1 ? 0 : MILLI * (nTime4 - nTime2) / (nInputs-1), nTimeVerify * MICRO, nTimeVerify * MILLI / nBlocksTotal);
+    return true;
+}
 
-    if (fJustCheck)
+/** Write the undo data and transaction index entries of a block connected
+ *  by ConnectBlockTransactions, once its script checks passed, and make it
+ *  the best block of view. */
+static bool WriteBlockConnection(CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view,
+                  const CChainParams& chainparams, PendingBlockConnection& pending)
+{
+    AssertLockHeld(cs_main);
+    if (pending.fGenesis)
         return true;
 
+    int64_t nTime4 = GetTimeMicros();
+    const CBlockUndo& blockundo = pending.blockundo;
+
     // Write undo information to disk
     if (pindex->GetUndoPos().IsNull() || !pindex->IsValid(BLOCK_VALID_SCRIPTS))
     {
@@ -1851,7 +2252,7 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     }
 
     if (fTxIndex)
-        if (!pblocktree->WriteTxIndex(vPos))
+        if (!pblocktree->WriteTxIndex(pending.vPos))
             return AbortNode(state, "Failed to write transaction index");
 
     assert(pindex->phashBlock);
@@ -1859,6 +2260,7 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     view.SetBestBlock(pindex->GetBlockHash());
 
     int64_t nTime5 = GetTimeMicros(); nTimeIndex += nTime5 - nTime4;
+    pending.record.nMicros[CValidationStats::INDEX] = nTime5 - nTime4;
     LogPrint(BCLog::BENCH, "    - Index writing: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime5 - nTime4), nTimeIndex * MICRO, nTimeIndex * MILLI / nBlocksTotal);
 
     int64_t nTime6 = GetTimeMicros(); nTimeCallbacks += nTime6 - nTime5;
@@ -1867,11 +2269,48 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     return true;
 }
 
+/** Apply the effects of this block (with given index) on the UTXO set represented by coins.
+ *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
+ *  can fail if those validity checks fail (among other reasons). If stats is
+ *  not null, the change to the UTXO set statistics is added to it. If precord
+ *  is not null, the time spent in each phase is set in it. */
+static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex,
+                  CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck = false, CCoinsRollingStats* stats = nullptr,
+                  CValidationStats::BlockRecord* precord = nullptr)
+{
+    PendingBlockConnection pending;
+    const bool fParallel = nScriptCheckThreads && ShouldCheckScripts(pindex, chainparams);
+    CCheckQueueControl<CScriptCheck> control(fParallel ? &scriptcheckqueue : nullptr);
+    if (!ConnectBlockTransactions(block, state, pindex, view, chainparams, fParallel ? &control : nullptr, pending, fJustCheck, stats))
+        return false;
+    if (pending.fGenesis)
+        return true;
+
+    int64_t nTimeWait = GetTimeMicros();
+    if (!control.Wait())
+        return state.DoS(100, error("%s: CheckQueue failed", __func__), REJECT_INVALID, "block-validation-failed");
+    int64_t nTime4 = GetTimeMicros(); nTimeVerify += nTime4 - pending.nTimeStart;
+    pending.record.nMicros[CValidationStats::VERIFY] = nTime4 - nTimeWait;
+    const int nInputs = pending.nInputs;
+    LogPrint(BCLog::BENCH, "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs (%.2fms/blk)]\n", nInputs - 1, MILLI * (nTime4 - pending.nTimeStart), nInputs <= 1 ? 0 : MILLI * (nTime4 - pending.nTimeStart) / (nInputs-1), nTimeVerify * MICRO, nTimeVerify * MILLI / nBlocksTotal);
+
+    if (fJustCheck)
+        return true;
+
+    if (!WriteBlockConnection(state, pindex, view, chainparams, pending))
+        return false;
+    if (precord)
+        *precord = pending.record;
+    return true;
+}
+
 /**
  * Update the on-disk chain state.
  * The caches and indexes are flushed depending on the mode we're called with
  * if they're too large, if it's been a while since the last write,
  * or always and in all cases if we're in prune mode and are deleting files.
+ * Writing the coins cache keeps its contents; when it is too large, the least
+ * recently used unmodified coins are evicted instead.
  */
 bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &state, FlushStateMode mode, int nManualPruneHeight) {
     int64_t nMempoolUsage = mempool.DynamicMemoryUsage();
@@ -1913,18 +2352,29 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             nLastSetChain = nNow;
         }
         int64_t nMempoolSizeMax = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
-        int64_t cacheSize = pcoinsTip->DynamicMemoryUsage();
+        // A write still in progress holds a copy of the coins it writes.
+        int64_t nWriterUsage = pcoinswriter ? pcoinswriter->DynamicMemoryUsage() : 0;
+        int64_t cacheSize = pcoinsTip->DynamicMemoryUsage() + nWriterUsage;
         int64_t nTotalSpace = nCoinCacheUsage + std::max<int64_t>(nMempoolSizeMax - nMempoolUsage, 0);
         // The cache is large and we're within 10% and 10 MiB of the limit, but we have time now (not in the middle of a block processing).
         bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize > std::max((9 * nTotalSpace) / 10, nTotalSpace - MAX_BLOCK_COINSDB_USAGE * 1024 * 1024);
-        // The cache is over the limit, we have to write now.
+        // The cache is over the limit, we have to make room now.
         bool fCacheCritical = mode == FLUSH_STATE_IF_NEEDED && cacheSize > nTotalSpace;
+        // Make room by evicting the least recently used unmodified coins
+        // first. That needs no writes, and keeps the rest of the cache warm.
+        int64_t nEvictTarget = (8 * nTotalSpace) / 10;
+        if (fCacheLarge || fCacheCritical) {
+            pcoinsTip->EvictClean(std::max<int64_t>(nEvictTarget - nWriterUsage, 0));
+            cacheSize = pcoinsTip->DynamicMemoryUsage() + nWriterUsage;
+        }
+        // Modified coins take up too much of the cache; they need to be written before they can be evicted.
+        bool fCacheFull = (fCacheLarge || fCacheCritical) && cacheSize > nEvictTarget;
         // It's been a while since we wrote the block index to disk. Do this frequently, so we don't need to redownload after a crash.
         bool fPeriodicWrite = mode == FLUSH_STATE_PERIODIC && nNow > nLastWrite + (int64_t)DATABASE_WRITE_INTERVAL * 1000000;
         // It's been very long since we flushed the cache. Do this infrequently, to optimize cache usage.
         bool fPeriodicFlush = mode == FLUSH_STATE_PERIODIC && nNow > nLastFlush + (int64_t)DATABASE_FLUSH_INTERVAL * 1000000;
         // Combine all conditions that result in a full cache flush.
-        fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush || fFlushForPrune;
+        fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fCacheFull || fPeriodicFlush || fFlushForPrune;
         // Write blocks and block index to disk.
         if (fDoFullFlush || fPeriodicWrite) {
             // Depend on nMinDiskSpace to ensure we can write block index
@@ -1964,12 +2414,42 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             // overwrite one. Still, use a conservative safety factor of 2.
             if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
                 return state.Error("out of disk space");
-            // Flush the chainstate (which may refer to block index entries).
-            if (!pcoinsTip->Flush())
+            // Store the rolling UTXO set statistics before the write that
+            // makes their block the best one, so they survive a crash.
+            uint256 hashStats = pcoinsTip->GetBestBlock();
+            if (fRollingStatsTip && !pcoinsdbview->WriteRollingStats(hashStats, rollingStatsTip))
+                return AbortNode(state, "Failed to write to coin database");
+            // Hand the modified coins (which may refer to block index entries)
+            // to the background writer, keeping the cache contents. This only
+            // waits if the previous write is still in progress.
+            bool fSynced = pcoinsTip->Sync();
+            // Coins read by the prefetch threads may predate this write.
+            coinsprefetcher.Invalidate();
+            if (!fSynced)
+                return AbortNode(state, "Failed to write to coin database");
+            // The previous write has completed, so the database is at either
+            // its block or this one. Statistics for other blocks are unused.
+            if (fRollingStatsTip) {
+                if (!pcoinsdbview->PruneRollingStats({hashRollingStatsFlushed, hashStats}))
+                    return AbortNode(state, "Failed to write to coin database");
+                hashRollingStatsFlushed = hashStats;
+            }
+            // Callers asking for a flush, and pruning (which must not remove
+            // blocks that a replay after a crash could need), wait for the
+            // write to hit the disk.
+            if ((mode == FLUSH_STATE_ALWAYS || fFlushForPrune) && pcoinswriter && !pcoinswriter->Wait())
                 return AbortNode(state, "Failed to write to coin database");
+            // Everything cached is unmodified now, and can be evicted.
+            if (fCacheFull) {
+                nWriterUsage = pcoinswriter ? pcoinswriter->DynamicMemoryUsage() : 0;
+                pcoinsTip->EvictClean(std::max<int64_t>(nEvictTarget - nWriterUsage, 0));
+            }
             nLastFlush = nNow;
         }
     }
+    if (pcoinswriter && pcoinswriter->Failed()) {
+        return AbortNode(state, "Failed to write to coin database");
+    }
     if (fDoFullFlush || ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000)) {
         // Update best block in wallet (so we can detect restored wallets).
         GetMainSignals().SetBestChain(chainActive.GetLocator());
@@ -2081,11 +2561,13 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
     int64_t nStart = GetTimeMicros();
     {
         CCoinsViewCache view(pcoinsTip);
+        CCoinsRollingStats statsDelta;
         assert(view.GetBestBlock() == pindexDelete->GetBlockHash());
-        if (DisconnectBlock(block, pindexDelete, view) != DISCONNECT_OK)
+        if (DisconnectBlock(block, pindexDelete, view, fRollingStatsTip ? &statsDelta : nullptr) != DISCONNECT_OK)
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         bool flushed = view.Flush();
         assert(flushed);
+        rollingStatsTip += statsDelta;
     }
     LogPrint(BCLog::BENCH, "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * MILLI);
     // Write the chain state to disk, if necessary.
@@ -2208,10 +2690,18 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     // Apply the block atomically to the chain state.
     int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
+    CValidationStats::BlockRecord record;
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * MILLI, nTimeReadFromDisk * MICRO);
+    if (nPrefetchThreads) {
+        coinsprefetcher.Drain(*pcoinsTip);
+        coinsprefetcher.CountHits(blockConnecting, *pcoinsTip);
+        CCoinsPrefetchStats prefetchStats = coinsprefetcher.GetStats();
+        LogPrint(BCLog::BENCH, "  - Prefetch: %u coins, %u hits, %u misses\n", prefetchStats.nPrefetched, prefetchStats.nHits, prefetchStats.nMisses);
+    }
     {
         CCoinsViewCache view(pcoinsTip);
-        bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams);
+        CCoinsRollingStats statsDelta;
+        bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams, false, fRollingStatsTip ? &statsDelta : nullptr, &record);
         GetMainSignals().BlockChecked(blockConnecting, state);
         if (!rv) {
             if (state.IsInvalid())
@@ -2222,6 +2712,7 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
         LogPrint(BCLog::BENCH, "  - Connect total: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime3 - nTime2) * MILLI, nTimeConnectTotal * MICRO, nTimeConnectTotal * MILLI / nBlocksTotal);
         bool flushed = view.Flush();
         assert(flushed);
+        rollingStatsTip += statsDelta;
     }
     int64_t nTime4 = GetTimeMicros(); nTimeFlush += nTime4 - nTime3;
     LogPrint(BCLog::BENCH, "  - Flush: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime4 - nTime3) * MILLI, nTimeFlush * MICRO, nTimeFlush * MILLI / nBlocksTotal);
@@ -2240,23 +2731,147 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     LogPrint(BCLog::BENCH, "  - Connect postprocess: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime6 - nTime5) * MILLI, nTimePostConnect * MICRO, nTimePostConnect * MILLI / nBlocksTotal);
     LogPrint(BCLog::BENCH, "- Connect block: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime6 - nTime1) * MILLI, nTimeTotal * MICRO, nTimeTotal * MILLI / nBlocksTotal);
 
+    record.hash = pindexNew->GetBlockHash();
+    record.nHeight = pindexNew->nHeight;
+    record.nTime = GetTime();
+    record.nMicros[CValidationStats::READ] = nTime2 - nTime1;
+    record.nMicros[CValidationStats::FLUSH] = nTime4 - nTime3;
+    record.nMicros[CValidationStats::CHAINSTATE] = nTime5 - nTime4;
+    record.nMicros[CValidationStats::POSTCONNECT] = nTime6 - nTime5;
+    record.nMicros[CValidationStats::TOTAL] = nTime6 - nTime1;
+    validationStats.AddBlock(record);
+
     connectTrace.BlockConnected(pindexNew, std::move(pthisBlock));
     return true;
 }
 
 /**
- * Return the tip of the chain with the most work in it, that isn't
- * known to be invalid (it's however far from certain to be valid).
+ * Connect a run of blocks extending chainActive, in order, like ConnectTip
+ * would one by one. pblock is either nullptr or a pointer to a CBlock
+ * corresponding to the last block of the run.
+ *
+ * All blocks are applied to one coins view, and the script checks of each
+ * block are queued as soon as its transactions are applied, without waiting
+ * for them. Reading, checking and applying the next block thereby overlaps
+ * with the script checks of the blocks before it, which are waited for once,
+ * at the end.
+ *
+ * Nothing is changed unless all blocks are valid. Otherwise fConnected is
+ * false, and the blocks should be connected with ConnectTip, which finds
+ * out which block is invalid. Returns false on a system error.
  */
-static CBlockIndex* FindMostWorkChain() {
-    do {
-        CBlockIndex *pindexNew = nullptr;
+static bool ConnectTipsPipelined(CValidationState& state, const CChainParams& chainparams, const std::vector<CBlockIndex*>& vpindexNew, const std::shared_ptr<const CBlock>& pblock, ConnectTrace& connectTrace, DisconnectedBlockTransactions &disconnectpool, bool& fConnected)
+{
+    AssertLockHeld(cs_main);
+    assert(!vpindexNew.empty() && vpindexNew.front()->pprev == chainActive.Tip());
+    fConnected = false;
+    int64_t nTime1 = GetTimeMicros();
 
-        // Find the best candidate header.
-        {
-            std::set<CBlockIndex*, CBlockIndexWorkComparator>::reverse_iterator it = setBlockIndexCandidates.rbegin();
-            if (it == setBlockIndexCandidates.rend())
-                return nullptr;
+    std::vector<std::shared_ptr<const CBlock>> vBlocks;
+    std::vector<std::unique_ptr<PendingBlockConnection>> vPending;
+    CCoinsViewCache view(pcoinsTip);
+    CCoinsRollingStats statsDelta;
+    int64_t nTimeWait = 0;
+    {
+        // Declared after what the queued checks refer to, so that it waits
+        // for them before those are destroyed.
+        CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+        for (CBlockIndex* pindex : vpindexNew) {
+            int64_t nTimeRead = GetTimeMicros();
+            if (pblock && pindex == vpindexNew.back()) {
+                vBlocks.push_back(pblock);
+            } else {
+                std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
+                if (!ReadBlockFromDisk(*pblockNew, pindex, chainparams.GetConsensus()))
+                    return true;
+                vBlocks.push_back(std::move(pblockNew));
+            }
+            vPending.emplace_back(new PendingBlockConnection());
+            vPending.back()->record.nMicros[CValidationStats::READ] = GetTimeMicros() - nTimeRead;
+            if (nPrefetchThreads) {
+                coinsprefetcher.Drain(*pcoinsTip);
+                coinsprefetcher.CountHits(*vBlocks.back(), *pcoinsTip);
+            }
+            CValidationState stateBlock;
+            if (!ConnectBlockTransactions(*vBlocks.back(), stateBlock, pindex, view, chainparams, &control, *vPending.back(), false, fRollingStatsTip ? &statsDelta : nullptr))
+                return true;
+            view.SetBestBlock(pindex->GetBlockHash());
+        }
+        nTimeWait = GetTimeMicros();
+        if (!control.Wait())
+            return true;
+    }
+    int64_t nTime2 = GetTimeMicros(); nTimeConnectTotal += nTime2 - nTime1;
+    nTimeWait = nTime2 - nTimeWait;
+    LogPrint(BCLog::BENCH, "  - Connect %u blocks: %.2fms [%.2fs (%.2fms/blk)]\n", (unsigned)vpindexNew.size(), (nTime2 - nTime1) * MILLI, nTimeConnectTotal * MICRO, nTimeConnectTotal * MILLI / nBlocksTotal);
+
+    for (size_t i = 0; i < vpindexNew.size(); i++) {
+        if (!WriteBlockConnection(state, vpindexNew[i], view, chainparams, *vPending[i]))
+            return false;
+        GetMainSignals().BlockChecked(*vBlocks[i], state);
+    }
+    std::vector<CValidationStats::BlockRecord> vRecords;
+    for (const auto& pending : vPending) {
+        vRecords.push_back(pending->record);
+    }
+    vPending.clear();
+    int64_t nTimeFlushStart = GetTimeMicros();
+    bool flushed = view.Flush();
+    assert(flushed);
+    rollingStatsTip += statsDelta;
+    int64_t nTime3 = GetTimeMicros(); nTimeFlush += nTime3 - nTimeFlushStart;
+    LogPrint(BCLog::BENCH, "  - Flush: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime3 - nTimeFlushStart) * MILLI, nTimeFlush * MICRO, nTimeFlush * MILLI / nBlocksTotal);
+    // Write the chain state to disk, if necessary.
+    if (!FlushStateToDisk(chainparams, state, FLUSH_STATE_IF_NEEDED))
+        return false;
+    int64_t nTime4 = GetTimeMicros(); nTimeChainState += nTime4 - nTime3;
+    LogPrint(BCLog::BENCH, "  - Writing chainstate: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime4 - nTime3) * MILLI, nTimeChainState * MICRO, nTimeChainState * MILLI / nBlocksTotal);
+    for (size_t i = 0; i < vpindexNew.size(); i++) {
+        int64_t nTimePost = GetTimeMicros();
+        // Remove conflicting transactions from the mempool.
+        mempool.removeForBlock(vBlocks[i]->vtx, vpindexNew[i]->nHeight);
+        disconnectpool.removeForBlock(vBlocks[i]->vtx);
+        // Update chainActive & related variables.
+        UpdateTip(vpindexNew[i], chainparams);
+        connectTrace.BlockConnected(vpindexNew[i], std::move(vBlocks[i]));
+        vRecords[i].nMicros[CValidationStats::POSTCONNECT] = GetTimeMicros() - nTimePost;
+    }
+    fConnected = true;
+
+    int64_t nTime5 = GetTimeMicros(); nTimePostConnect += nTime5 - nTime4; nTimeTotal += nTime5 - nTime1;
+    LogPrint(BCLog::BENCH, "  - Connect postprocess: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime5 - nTime4) * MILLI, nTimePostConnect * MICRO, nTimePostConnect * MILLI / nBlocksTotal);
+    LogPrint(BCLog::BENCH, "- Connect %u blocks: %.2fms [%.2fs (%.2fms/blk)]\n", (unsigned)vpindexNew.size(), (nTime5 - nTime1) * MILLI, nTimeTotal * MICRO, nTimeTotal * MILLI / nBlocksTotal);
+
+    // The phases the blocks went through together are split evenly.
+    const int64_t nBlocks = vpindexNew.size();
+    for (size_t i = 0; i < vpindexNew.size(); i++) {
+        CValidationStats::BlockRecord& record = vRecords[i];
+        record.hash = vpindexNew[i]->GetBlockHash();
+        record.nHeight = vpindexNew[i]->nHeight;
+        record.nTime = GetTime();
+        record.fPipelined = true;
+        record.nMicros[CValidationStats::VERIFY] = nTimeWait / nBlocks;
+        record.nMicros[CValidationStats::FLUSH] = (nTime3 - nTimeFlushStart) / nBlocks;
+        record.nMicros[CValidationStats::CHAINSTATE] = (nTime4 - nTime3) / nBlocks;
+        record.nMicros[CValidationStats::TOTAL] = (nTime5 - nTime1) / nBlocks;
+        validationStats.AddBlock(record);
+    }
+    return true;
+}
+
+/**
+ * Return the tip of the chain with the most work in it, that isn't
+ * known to be invalid (it's however far from certain to be valid).
+ */
+static CBlockIndex* FindMostWorkChain() {
+    do {
+        CBlockIndex *pindexNew = nullptr;
+
+        // Find the best candidate header.
+        {
+            std::set<CBlockIndex*, CBlockIndexWorkComparator>::reverse_iterator it = setBlockIndexCandidates.rbegin();
+            if (it == setBlockIndexCandidates.rend())
+                return nullptr;
             pindexNew = *it;
         }
 
@@ -2354,8 +2969,31 @@ static bool ActivateBestChainStep(CValidationState& state, const CChainParams& c
         }
         nHeight = nTargetHeight;
 
-        // Connect new blocks.
-        for (CBlockIndex *pindexConnect : reverse_iterate(vpindexToConnect)) {
+        // Connect new blocks. During initial block download, runs of blocks
+        // are connected together, unless that failed for this run before.
+        bool fPipeline = nScriptCheckThreads && (IsInitialBlockDownload() || fPipelineBlocks);
+        for (auto it = vpindexToConnect.rbegin(); it != vpindexToConnect.rend(); ++it) {
+            CBlockIndex *pindexConnect = *it;
+            size_t nRun = std::min<size_t>(vpindexToConnect.rend() - it, MAX_PIPELINED_BLOCKS);
+            if (fPipeline && nRun > 1) {
+                std::vector<CBlockIndex*> vpindexRun(it, it + nRun);
+                bool fConnected;
+                if (!ConnectTipsPipelined(state, chainparams, vpindexRun, vpindexRun.back() == pindexMostWork ? pblock : std::shared_ptr<const CBlock>(), connectTrace, disconnectpool, fConnected)) {
+                    UpdateMempoolForReorg(disconnectpool, false);
+                    return false;
+                }
+                if (fConnected) {
+                    PruneBlockIndexCandidates();
+                    it += nRun - 1;
+                    if (!pindexOldTip || chainActive.Tip()->nChainWork > pindexOldTip->nChainWork) {
+                        // We're in a better position than we were. Return temporarily to release the lock.
+                        fContinue = false;
+                        break;
+                    }
+                    continue;
+                }
+                fPipeline = false;
+            }
             if (!ConnectTip(state, chainparams, pindexConnect, pindexConnect == pindexMostWork ? pblock : std::shared_ptr<const CBlock>(), connectTrace, disconnectpool)) {
                 if (state.IsInvalid()) {
                     // The block violates a consensus rule.
@@ -2603,16 +3241,16 @@ bool ResetBlockFailureFlags(CBlockIndex *pindex) {
     return true;
 }
 
-static CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
+static CBlockIndex* AddToBlockIndex(const CBlockHeader& block, const uint256* phash = nullptr)
 {
     // Check for duplicate
-    uint256 hash = block.GetHash();
+    uint256 hash = phash ? *phash : block.GetHash();
     BlockMap::iterator it = mapBlockIndex.find(hash);
     if (it != mapBlockIndex.end())
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
+    CBlockIndex* pindexNew = blockIndexArena.New(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
@@ -2774,10 +3412,10 @@ static bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos,
     return true;
 }
 
-static bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true)
+static bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true, const CCheckedHeader* pchecked = nullptr)
 {
     // Check proof of work matches claimed amount
-    if (fCheckPOW && !CheckProofOfWork(block.GetHash(), block.nBits, consensusParams))
+    if (fCheckPOW && !(pchecked ? pchecked->fValidPoW : CheckProofOfWork(block.GetHash(), block.nBits, consensusParams)))
         return state.DoS(50, false, REJECT_INVALID, "high-hash", false, "proof of work failed");
 
     return true;
@@ -2795,6 +3433,24 @@ bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::P
     if (!CheckBlockHeader(block, state, consensusParams, fCheckPOW))
         return false;
 
+    // Check the transactions of large blocks on the block check threads,
+    // while the rest is checked here. Another thread may be using them, for
+    // example to check blocks being imported, in which case this thread
+    // checks all transactions itself.
+    std::vector<CBlockTxCheckResult> vResults;
+    CCheckQueueControl<CContextFreeCheck> control(nScriptCheckThreads && block.vtx.size() > BLOCK_TX_CHECK_BATCH ? &blockcheckqueue : nullptr, boost::try_to_lock);
+    if (control.HasQueue()) {
+        vResults.resize((block.vtx.size() + BLOCK_TX_CHECK_BATCH - 1) / BLOCK_TX_CHECK_BATCH);
+        std::vector<CContextFreeCheck> vChecks;
+        vChecks.reserve(vResults.size());
+        for (size_t i = 0; i < vResults.size(); i++) {
+            const size_t nBegin = i * BLOCK_TX_CHECK_BATCH, nEnd = std::min(nBegin + BLOCK_TX_CHECK_BATCH, block.vtx.size());
+            CBlockTxCheckResult& result = vResults[i];
+            vChecks.emplace_back([&block, nBegin, nEnd, &result] { CheckBlockTransactions(block, nBegin, nEnd, result); });
+        }
+        control.Add(vChecks);
+    }
+
     // Check the merkle root.
     if (fCheckMerkleRoot) {
         bool mutated;
@@ -2827,15 +3483,22 @@ bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::P
             return state.DoS(100, false, REJECT_INVALID, "bad-cb-multiple", false, "more than one coinbase");
 
     // Check transactions
-    for (const auto& tx : block.vtx)
-        if (!CheckTransaction(*tx, state, false))
-            return state.Invalid(false, state.GetRejectCode(), state.GetRejectReason(),
-                                 strprintf("Transaction check failed (tx hash %s) %s", tx->GetHash().ToString(), state.GetDebugMessage()));
-
+    if (control.HasQueue()) {
+        control.Wait();
+    } else {
+        vResults.resize(1);
+        CheckBlockTransactions(block, 0, block.vtx.size(), vResults[0]);
+    }
     unsigned int nSigOps = 0;
-    for (const auto& tx : block.vtx)
-    {
-        nSigOps += GetLegacySigOpCount(*tx);
+    for (const CBlockTxCheckResult& result : vResults) {
+        if (!result.fOk) {
+            const CTransaction& tx = *block.vtx[result.nFailed];
+            int nDoS = 0;
+            result.state.IsInvalid(nDoS);
+            return state.DoS(nDoS, false, result.state.GetRejectCode(), result.state.GetRejectReason(), result.state.CorruptionPossible(),
+                             strprintf("Transaction check failed (tx hash %s) %s", tx.GetHash().ToString(), result.state.GetDebugMessage()));
+        }
+        nSigOps += result.nSigOps;
     }
     if (nSigOps * WITNESS_SCALE_FACTOR > MAX_BLOCK_SIGOPS_COST)
         return state.DoS(100, false, REJECT_INVALID, "bad-blk-sigops", false, "out-of-bounds SigOpCount");
@@ -3031,11 +3694,11 @@ static bool ContextualCheckBlock(const CBlock& block, CValidationState& state, c
     return true;
 }
 
-static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, const CCheckedHeader* pchecked = nullptr)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
-    uint256 hash = block.GetHash();
+    uint256 hash = pchecked ? pchecked->hash : block.GetHash();
     BlockMap::iterator miSelf = mapBlockIndex.find(hash);
     CBlockIndex *pindex = nullptr;
     if (hash != chainparams.GetConsensus().hashGenesisBlock) {
@@ -3050,7 +3713,7 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
             return true;
         }
 
-        if (!CheckBlockHeader(block, state, chainparams.GetConsensus()))
+        if (!CheckBlockHeader(block, state, chainparams.GetConsensus(), true, pchecked))
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
 
         // Get prev block index
@@ -3065,7 +3728,7 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
             return error("%s: Consensus::ContextualCheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
     }
     if (pindex == nullptr)
-        pindex = AddToBlockIndex(block);
+        pindex = AddToBlockIndex(block, &hash);
 
     if (ppindex)
         *ppindex = pindex;
@@ -3078,11 +3741,30 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
 // Exposed wrapper for AcceptBlockHeader
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex)
 {
+    // Hash the headers and check their proof of work before taking cs_main,
+    // on the block check threads if there are many of them.
+    std::vector<CCheckedHeader> vChecked(headers.size());
+    {
+        CCheckQueueControl<CContextFreeCheck> control(nScriptCheckThreads && headers.size() > HEADER_CHECK_BATCH ? &blockcheckqueue : nullptr, boost::try_to_lock);
+        if (control.HasQueue()) {
+            std::vector<CContextFreeCheck> vChecks;
+            for (size_t nBegin = 0; nBegin < headers.size(); nBegin += HEADER_CHECK_BATCH) {
+                const size_t nEnd = std::min(nBegin + HEADER_CHECK_BATCH, headers.size());
+                vChecks.emplace_back([&headers, nBegin, nEnd, &vChecked, &chainparams] { CheckHeaders(headers, nBegin, nEnd, vChecked, chainparams.GetConsensus()); });
+            }
+            control.Add(vChecks);
+            control.Wait();
+        } else {
+            CheckHeaders(headers, 0, headers.size(), vChecked, chainparams.GetConsensus());
+        }
+    }
+
     {
         LOCK(cs_main);
-        for (const CBlockHeader& header : headers) {
+        for (size_t i = 0; i < headers.size(); i++) {
+            const CBlockHeader& header = headers[i];
             CBlockIndex *pindex = nullptr; // Use a temp pindex instead of ppindex to avoid a const_cast
-            if (!AcceptBlockHeader(header, state, chainparams, &pindex)) {
+            if (!AcceptBlockHeader(header, state, chainparams, &pindex, &vChecked[i])) {
                 return false;
             }
             if (ppindex) {
@@ -3168,6 +3850,10 @@ static bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidation
         return AbortNode(state, std::string("System error: ") + e.what());
     }
 
+    // Start reading the block's inputs if it is likely to be connected soon.
+    if (nPrefetchThreads && pcoinswriter && fHasMoreWork && nHeight <= chainActive.Height() + PREFETCH_BLOCKS_AHEAD)
+        coinsprefetcher.Enqueue(block, pcoinswriter, *pcoinsTip);
+
     if (fCheckForPruning)
         FlushStateToDisk(chainparams, state, FLUSH_STATE_NONE); // we just allocated more disk space for block files
 
@@ -3284,6 +3970,7 @@ void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
 {
     for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         CDiskBlockPos pos(*it, 0);
+        blockFileMapper.Invalidate(GetBlockPosFilename(pos, "blk"));
         fs::remove(GetBlockPosFilename(pos, "blk"));
         fs::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -3441,7 +4128,7 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
+    CBlockIndex* pindexNew = blockIndexArena.New();
     mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
 
@@ -3450,23 +4137,72 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
 
 bool static LoadBlockIndexDB(const CChainParams& chainparams)
 {
-    if (!pblocktree->LoadBlockIndexGuts(chainparams.GetConsensus(), InsertBlockIndex))
+    std::vector<std::pair<uint256, CDiskBlockIndex>> vEntries;
+    if (!pblocktree->LoadBlockIndexGuts(chainparams.GetConsensus(), GetNumCores(), vEntries))
         return false;
 
     boost::this_thread::interruption_point();
 
-    // Calculate nChainWork
-    std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
-    vSortedByHeight.reserve(mapBlockIndex.size());
-    for (const std::pair<uint256, CBlockIndex*>& item : mapBlockIndex)
-    {
-        CBlockIndex* pindex = item.second;
-        vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
+    // Order the entries by height with a counting sort, and allocate them in
+    // that order, so the pass below walks through memory sequentially and
+    // parents mostly sit close to their children.
+    int nMaxHeight = 0;
+    for (const std::pair<uint256, CDiskBlockIndex>& entry : vEntries) {
+        nMaxHeight = std::max(nMaxHeight, entry.second.nHeight);
+    }
+    std::vector<size_t> vHeightPos(nMaxHeight + 2, 0);
+    for (const std::pair<uint256, CDiskBlockIndex>& entry : vEntries) {
+        vHeightPos[entry.second.nHeight + 1]++;
+    }
+    for (int nHeight = 0; nHeight <= nMaxHeight; nHeight++) {
+        vHeightPos[nHeight + 1] += vHeightPos[nHeight];
+    }
+    std::vector<size_t> vOrder(vEntries.size());
+    for (size_t i = 0; i < vEntries.size(); i++) {
+        vOrder[vHeightPos[vEntries[i].second.nHeight]++] = i;
+    }
+
+    mapBlockIndex.reserve(mapBlockIndex.size() + vEntries.size());
+    blockIndexArena.Reserve(vEntries.size());
+    std::vector<CBlockIndex*> vSortedByHeight;
+    vSortedByHeight.reserve(vEntries.size());
+    for (size_t i : vOrder) {
+        const CDiskBlockIndex& diskindex = vEntries[i].second;
+        CBlockIndex* pindexNew = InsertBlockIndex(vEntries[i].first);
+        pindexNew->nHeight        = diskindex.nHeight;
+        pindexNew->nFile          = diskindex.nFile;
+        pindexNew->nDataPos       = diskindex.nDataPos;
+        pindexNew->nUndoPos       = diskindex.nUndoPos;
+        pindexNew->nVersion       = diskindex.nVersion;
+        pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+        pindexNew->nTime          = diskindex.nTime;
+        pindexNew->nBits          = diskindex.nBits;
+        pindexNew->nNonce         = diskindex.nNonce;
+        pindexNew->nStatus        = diskindex.nStatus;
+        pindexNew->nTx            = diskindex.nTx;
+        vSortedByHeight.push_back(pindexNew);
+    }
+
+    // Link the entries to their parents, now that all of them exist. A parent
+    // missing from the database gets an empty entry at height 0, like before.
+    std::vector<CBlockIndex*> vMissingParents;
+    for (size_t i = 0; i < vOrder.size(); i++) {
+        const uint256& hashPrev = vEntries[vOrder[i]].second.hashPrev;
+        if (hashPrev.IsNull()) continue;
+        BlockMap::iterator mi = mapBlockIndex.find(hashPrev);
+        if (mi != mapBlockIndex.end()) {
+            vSortedByHeight[i]->pprev = mi->second;
+        } else {
+            vSortedByHeight[i]->pprev = InsertBlockIndex(hashPrev);
+            vMissingParents.push_back(vSortedByHeight[i]->pprev);
+        }
     }
-    sort(vSortedByHeight.begin(), vSortedByHeight.end());
-    for (const std::pair<int, CBlockIndex*>& item : vSortedByHeight)
+    vSortedByHeight.insert(vSortedByHeight.begin(), vMissingParents.begin(), vMissingParents.end());
+    std::vector<std::pair<uint256, CDiskBlockIndex>>().swap(vEntries);
+
+    // Calculate nChainWork
+    for (CBlockIndex* pindex : vSortedByHeight)
     {
-        CBlockIndex* pindex = item.second;
         pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
         pindex->nTimeMax = (pindex->pprev ? std::max(pindex->pprev->nTimeMax, pindex->nTime) : pindex->nTime);
         // We can link the chain of blocks for which we've received transactions at some point.
@@ -3545,6 +4281,42 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
     return true;
 }
 
+void LoadRollingCoinsStats()
+{
+    LOCK(cs_main);
+    hashRollingStatsFlushed = pcoinsTip->GetBestBlock();
+    if (!fRollingUTXOStats) {
+        fRollingStatsTip = false;
+        return;
+    }
+    if (hashRollingStatsFlushed.IsNull()) {
+        // An empty chainstate, which is built up from the genesis block.
+        rollingStatsTip = CCoinsRollingStats();
+        fRollingStatsTip = true;
+    } else {
+        fRollingStatsTip = pcoinsdbview->ReadRollingStats(hashRollingStatsFlushed, rollingStatsTip);
+    }
+    LogPrintf("%s: rolling UTXO set statistics %s\n", __func__, fRollingStatsTip ? "loaded" : "not available");
+}
+
+bool GetRollingCoinsStats(CCoinsRollingStats& stats, uint256& hashBlock)
+{
+    LOCK(cs_main);
+    if (!fRollingStatsTip) return false;
+    stats = rollingStatsTip;
+    hashBlock = pcoinsTip->GetBestBlock();
+    return true;
+}
+
+bool SetRollingCoinsStats(const CCoinsRollingStats& stats, const uint256& hashBlock)
+{
+    LOCK(cs_main);
+    if (!fRollingUTXOStats || fRollingStatsTip || pcoinsTip->GetBestBlock() != hashBlock) return false;
+    rollingStatsTip = stats;
+    fRollingStatsTip = true;
+    return true;
+}
+
 bool LoadChainTip(const CChainParams& chainparams)
 {
     if (chainActive.Tip() && chainActive.Tip()->GetBlockHash() == pcoinsTip->GetBestBlock()) return true;
@@ -3879,10 +4651,8 @@ void UnloadBlockIndex()
         warningcache[b].clear();
     }
 
-    for (BlockMap::value_type& entry : mapBlockIndex) {
-        delete entry.second;
-    }
     mapBlockIndex.clear();
+    blockIndexArena.Clear();
     fHavePruned = false;
 }
 
@@ -3950,43 +4720,18 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
 
     int nLoaded = 0;
     try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
+        // This takes over fileIn and closes it when done. Blocks are read,
+        // deserialized and checked on other threads, and come out in file order.
+        CBlockFileImporter importer(fileIn, chainparams, nScriptCheckThreads);
+        std::shared_ptr<CBlock> pblock;
+        uint64_t nBlockPos;
+        while (importer.Next(pblock, nBlockPos)) {
             boost::this_thread::interruption_point();
 
-            blkdat.SetPos(nRewind);
-            nRewind++; // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
-                blkdat.FindByte(chainparams.MessageStart()[0]);
-                nRewind = blkdat.GetPos()+1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
-            }
             try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
                 if (dbp)
                     dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
                 CBlock& block = *pblock;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
 
                 // detect out of order blocks, and store them for later
                 uint256 hash = block.GetHash();
@@ -4273,7 +5018,18 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
     return VersionBitsStateSinceHeight(chainActive.Tip(), params, pos, versionbitscache);
 }
 
-static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+static const uint64_t MEMPOOL_DUMP_VERSION = 2;
+
+static CCriticalSection cs_mempooljournal;
+static std::unique_ptr<CMempoolJournal> pmempooljournal;
+/** The number of the last journal record loaded, and the size of the last dump */
+static uint64_t nMempoolJournalSeq = 0;
+static uint64_t nMempoolDumpSize = 0;
+
+static fs::path GetMempoolJournalPath()
+{
+    return GetDataDir() / "mempool.journal";
+}
 
 bool LoadMempool(void)
 {
@@ -4286,59 +5042,149 @@ bool LoadMempool(void)
         return false;
     }
 
-    int64_t count = 0;
-    int64_t skipped = 0;
-    int64_t failed = 0;
-    int64_t nNow = GetTime();
+    struct Entry {
+        CTransactionRef tx;
+        int64_t nTime;
+        CAmount nFeeDelta;
+        bool fFromDump;
+    };
+    std::vector<Entry> entries;
+    std::map<uint256, CAmount> mapDeltas;
+    uint64_t nSeq = 0;
+    uint256 hashBestBlock;
+    uint32_t nScriptFlags = 0;
 
     try {
         uint64_t version;
         file >> version;
-        if (version != MEMPOOL_DUMP_VERSION) {
+        if (version != 1 && version != MEMPOOL_DUMP_VERSION) {
             return false;
         }
+        if (version >= 2) {
+            file >> nSeq;
+            file >> hashBestBlock;
+            file >> nScriptFlags;
+        }
         uint64_t num;
         file >> num;
         while (num--) {
-            CTransactionRef tx;
-            int64_t nTime;
+            Entry entry;
             int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
+            file >> entry.tx;
+            file >> entry.nTime;
             file >> nFeeDelta;
+            entry.nFeeDelta = nFeeDelta;
+            entry.fFromDump = true;
+            entries.push_back(std::move(entry));
+        }
+        file >> mapDeltas;
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
 
-            CAmount amountdelta = nFeeDelta;
-            if (amountdelta) {
-                mempool.PrioritiseTransaction(tx->GetHash(), amountdelta);
+    // Replay the changes journaled after the dump.
+    std::vector<CMempoolJournal::Record> records;
+    int64_t journaled = 0;
+    if (CMempoolJournal::Read(GetMempoolJournalPath(), records)) {
+        std::map<uint256, size_t> mapIndex;
+        for (size_t i = 0; i < entries.size(); i++) {
+            mapIndex[entries[i].tx->GetHash()] = i;
+        }
+        for (CMempoolJournal::Record& record : records) {
+            if (record.nSeq <= nSeq)
+                continue;
+            if (record.nType == CMempoolJournal::ADDED) {
+                mapIndex[record.tx->GetHash()] = entries.size();
+                entries.push_back(Entry{std::move(record.tx), record.nTime, 0, false});
+            } else {
+                auto it = mapIndex.find(record.txid);
+                if (it != mapIndex.end()) {
+                    entries[it->second].tx.reset();
+                    mapIndex.erase(it);
+                }
             }
+            nSeq = record.nSeq;
+            ++journaled;
+        }
+    }
+    nMempoolJournalSeq = std::max(nMempoolJournalSeq, nSeq);
+
+    // The transactions of a dump made at the current tip spend the same
+    // coins as when their scripts were checked.
+    bool fSameTip;
+    {
+        LOCK(cs_main);
+        fSameTip = !hashBestBlock.IsNull() && chainActive.Tip() && chainActive.Tip()->GetBlockHash() == hashBestBlock && nScriptFlags == GetMempoolScriptVerifyFlags(Params());
+    }
+
+    int64_t count = 0;
+    int64_t unchecked = 0;
+    int64_t skipped = 0;
+    int64_t failed = 0;
+    int64_t nNow = GetTime();
+
+    // Transactions readded by the journal before their parents are retried
+    // as long as some make it in.
+    std::vector<const Entry*> vRetry;
+    for (const Entry& entry : entries) {
+        if (!entry.tx)
+            continue;
+        if (entry.nFeeDelta) {
+            mempool.PrioritiseTransaction(entry.tx->GetHash(), entry.nFeeDelta);
+        }
+        CValidationState state;
+        if (entry.nTime + nExpiryTimeout > nNow) {
+            bool fMissingInputs = false;
+            bool fCheckScripts = !(fSameTip && entry.fFromDump);
+            LOCK(cs_main);
+            AcceptToMemoryPoolWithTime(chainparams, mempool, state, entry.tx, &fMissingInputs, entry.nTime,
+                                       nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */, fCheckScripts);
+            if (fMissingInputs) {
+                vRetry.push_back(&entry);
+            } else if (state.IsValid()) {
+                ++count;
+                if (!fCheckScripts)
+                    ++unchecked;
+            } else {
+                ++failed;
+            }
+        } else {
+            ++skipped;
+        }
+        if (ShutdownRequested())
+            return false;
+    }
+    while (!vRetry.empty()) {
+        std::vector<const Entry*> vMissing;
+        for (const Entry* pentry : vRetry) {
             CValidationState state;
-            if (nTime + nExpiryTimeout > nNow) {
-                LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(chainparams, mempool, state, tx, nullptr /* pfMissingInputs */, nTime,
-                                           nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */);
-                if (state.IsValid()) {
-                    ++count;
-                } else {
-                    ++failed;
-                }
+            bool fMissingInputs = false;
+            LOCK(cs_main);
+            AcceptToMemoryPoolWithTime(chainparams, mempool, state, pentry->tx, &fMissingInputs, pentry->nTime,
+                                       nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */);
+            if (fMissingInputs) {
+                vMissing.push_back(pentry);
+            } else if (state.IsValid()) {
+                ++count;
             } else {
-                ++skipped;
+                ++failed;
             }
             if (ShutdownRequested())
                 return false;
         }
-        std::map<uint256, CAmount> mapDeltas;
-        file >> mapDeltas;
-
-        for (const auto& i : mapDeltas) {
-            mempool.PrioritiseTransaction(i.first, i.second);
+        if (vMissing.size() == vRetry.size()) {
+            failed += vMissing.size();
+            break;
         }
-    } catch (const std::exception& e) {
-        LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
-        return false;
+        vRetry.swap(vMissing);
+    }
+
+    for (const auto& i : mapDeltas) {
+        mempool.PrioritiseTransaction(i.first, i.second);
     }
 
-    LogPrintf("Imported mempool transactions from disk: %i successes, %i failed, %i expired\n", count, failed, skipped);
+    LogPrintf("Imported mempool transactions from disk: %i successes (%i without script checks), %i failed, %i expired, %i journal records\n", count, unchecked, failed, skipped, journaled);
     return true;
 }
 
@@ -4346,15 +5192,22 @@ bool DumpMempool(void)
 {
     int64_t start = GetTimeMicros();
 
+    LOCK(cs_mempooljournal);
     std::map<uint256, CAmount> mapDeltas;
     std::vector<TxMempoolInfo> vinfo;
+    uint64_t nSeq = 0;
+    uint256 hashBestBlock;
 
     {
-        LOCK(mempool.cs);
+        LOCK2(cs_main, mempool.cs);
         for (const auto &i : mempool.mapDeltas) {
             mapDeltas[i.first] = i.second;
         }
         vinfo = mempool.infoAll();
+        if (chainActive.Tip())
+            hashBestBlock = chainActive.Tip()->GetBlockHash();
+        if (pmempooljournal)
+            nSeq = pmempooljournal->BeginCompaction();
     }
 
     int64_t mid = GetTimeMicros();
@@ -4362,6 +5215,8 @@ bool DumpMempool(void)
     try {
         FILE* filestr = fsbridge::fopen(GetDataDir() / "mempool.dat.new", "wb");
         if (!filestr) {
+            if (pmempooljournal)
+                pmempooljournal->EndCompaction(false);
             return false;
         }
 
@@ -4369,6 +5224,9 @@ bool DumpMempool(void)
 
         uint64_t version = MEMPOOL_DUMP_VERSION;
         file << version;
+        file << nSeq;
+        file << hashBestBlock;
+        file << (uint32_t)GetMempoolScriptVerifyFlags(Params());
 
         file << (uint64_t)vinfo.size();
         for (const auto& i : vinfo) {
@@ -4380,17 +5238,441 @@ bool DumpMempool(void)
 
         file << mapDeltas;
         FileCommit(file.Get());
+        nMempoolDumpSize = ftell(file.Get());
         file.fclose();
         RenameOver(GetDataDir() / "mempool.dat.new", GetDataDir() / "mempool.dat");
+        if (pmempooljournal) {
+            pmempooljournal->EndCompaction(true);
+        } else {
+            // Without a journal the records of an earlier one are stale.
+            fs::remove(GetMempoolJournalPath());
+        }
         int64_t last = GetTimeMicros();
         LogPrintf("Dumped mempool: %gs to copy, %gs to dump\n", (mid-start)*MICRO, (last-mid)*MICRO);
     } catch (const std::exception& e) {
         LogPrintf("Failed to dump mempool: %s. Continuing anyway.\n", e.what());
+        if (pmempooljournal)
+            pmempooljournal->EndCompaction(false);
+        return false;
+    }
+    return true;
+}
+
+bool StartMempoolJournal(void)
+{
+    LOCK(cs_mempooljournal);
+    // Records continue the numbering of the journal that was loaded, which
+    // dumping the mempool then replaces.
+    pmempooljournal.reset(new CMempoolJournal(mempool, GetMempoolJournalPath(), nMempoolJournalSeq));
+    return DumpMempool();
+}
+
+void StopMempoolJournal(void)
+{
+    LOCK(cs_mempooljournal);
+    pmempooljournal.reset();
+}
+
+void CompactMempoolJournal(void)
+{
+    LOCK(cs_mempooljournal);
+    if (!pmempooljournal)
+        return;
+    pmempooljournal->Flush();
+    if (pmempooljournal->GetSize() < std::max(MEMPOOL_JOURNAL_MIN_COMPACT_SIZE, nMempoolDumpSize))
+        return;
+    DumpMempool();
+}
+
+static const uint64_t SCRIPT_CACHES_DUMP_VERSION = 1;
+
+static void WriteCacheEntries(CAutoFile& file, const uint256& nonce, const std::vector<uint256>& entries)
+{
+    file << nonce;
+    file << (uint64_t)entries.size();
+    for (const uint256& entry : entries) {
+        file << entry;
+    }
+}
+
+static void ReadCacheEntries(CAutoFile& file, uint256& nonce, std::vector<uint256>& entries)
+{
+    file >> nonce;
+    uint64_t num;
+    file >> num;
+    while (num--) {
+        uint256 entry;
+        file >> entry;
+        entries.push_back(entry);
+    }
+}
+
+bool LoadScriptCaches(void)
+{
+    FILE* filestr = fsbridge::fopen(GetDataDir() / "sigcache.dat", "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open signature cache file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    uint256 sigNonce, scriptNonce;
+    std::vector<uint256> vSigEntries, vScriptEntries;
+    try {
+        uint64_t version;
+        file >> version;
+        if (version != SCRIPT_CACHES_DUMP_VERSION) {
+            return false;
+        }
+        ReadCacheEntries(file, sigNonce, vSigEntries);
+        ReadCacheEntries(file, scriptNonce, vScriptEntries);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize signature cache data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    // The entries are hashes that include the nonce, so they only mean
+    // anything with the nonce they were computed with.
+    LoadSignatureCacheEntries(sigNonce, vSigEntries);
+    {
+        LOCK(cs_main);
+        scriptExecutionCacheNonce = scriptNonce;
+        for (const uint256& entry : vScriptEntries) {
+            scriptExecutionCache.insert(entry);
+        }
+    }
+
+    LogPrintf("Imported cache entries from disk: %u signatures, %u script executions\n", vSigEntries.size(), vScriptEntries.size());
+    return true;
+}
+
+bool DumpScriptCaches(void)
+{
+    int64_t start = GetTimeMicros();
+
+    uint256 sigNonce, scriptNonce;
+    std::vector<uint256> vSigEntries, vScriptEntries;
+    GetSignatureCacheEntries(sigNonce, vSigEntries);
+    {
+        LOCK(cs_main);
+        scriptNonce = scriptExecutionCacheNonce;
+        scriptExecutionCache.for_each([&vScriptEntries](const uint256& entry) { vScriptEntries.push_back(entry); });
+    }
+
+    int64_t mid = GetTimeMicros();
+
+    try {
+        FILE* filestr = fsbridge::fopen(GetDataDir() / "sigcache.dat.new", "wb");
+        if (!filestr) {
+            return false;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+
+        uint64_t version = SCRIPT_CACHES_DUMP_VERSION;
+        file << version;
+
+        WriteCacheEntries(file, sigNonce, vSigEntries);
+        WriteCacheEntries(file, scriptNonce, vScriptEntries);
+
+        FileCommit(file.Get());
+        file.fclose();
+        RenameOver(GetDataDir() / "sigcache.dat.new", GetDataDir() / "sigcache.dat");
+        int64_t last = GetTimeMicros();
+        LogPrintf("Dumped signature cache: %gs to copy, %gs to dump\n", (mid-start)*MICRO, (last-mid)*MICRO);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump signature cache: %s. Continuing anyway.\n", e.what());
         return false;
     }
     return true;
 }
 
+static const uint64_t UTXO_SNAPSHOT_VERSION = 1;
+//! Number of chunks (ranges of txids) the coins of a UTXO set snapshot are split into
+static const int UTXO_SNAPSHOT_CHUNKS = 1024;
+
+/*
+ * A UTXO set snapshot consists of:
+ * - the version and the network's message start bytes
+ * - the hash of the block it is for, and the headers of the blocks after the
+ *   genesis block up to it, each followed by its number of transactions
+ * - the coins, in UTXO_SNAPSHOT_CHUNKS chunks. Each chunk is a serialized byte
+ *   vector of transactions (txid, number of coins, and for each coin its
+ *   output index and the Coin itself), followed by its double-SHA256.
+ * - the CCoinsRollingStats of all coins
+ */
+
+template<typename Stream>
+static void WriteSnapshotTx(Stream& s, const uint256& txid, const std::vector<std::pair<uint32_t, Coin>>& outputs)
+{
+    s << txid;
+    WriteCompactSize(s, outputs.size());
+    for (const auto& output : outputs) {
+        s << VARINT(output.first) << output.second;
+    }
+}
+
+bool DumpUTXOSnapshot(const fs::path& path, uint256& hashBlock, CCoinsRollingStats& stats)
+{
+    int64_t nStart = GetTimeMillis();
+
+    std::vector<std::unique_ptr<CCoinsViewCursor>> cursors;
+    std::vector<std::pair<CBlockHeader, unsigned int>> vHeaders;
+    {
+        LOCK(cs_main);
+        // Take the snapshot of the database before another write can start.
+        FlushStateToDisk();
+        cursors = pcoinsdbview->ShardedCursors(UTXO_SNAPSHOT_CHUNKS);
+        hashBlock = cursors[0]->GetBestBlock();
+        BlockMap::const_iterator it = mapBlockIndex.find(hashBlock);
+        if (it == mapBlockIndex.end()) {
+            return error("%s: chainstate is not at a known block", __func__);
+        }
+        for (const CBlockIndex* pindex = it->second; pindex->pprev; pindex = pindex->pprev) {
+            vHeaders.emplace_back(pindex->GetBlockHeader(), pindex->nTx);
+        }
+    }
+    std::reverse(vHeaders.begin(), vHeaders.end());
+
+    fs::path pathTmp = path.string() + ".incomplete";
+    try {
+        FILE* filestr = fsbridge::fopen(pathTmp, "wb");
+        if (!filestr) {
+            return error("%s: unable to open %s", __func__, pathTmp.string());
+        }
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+
+        file << UTXO_SNAPSHOT_VERSION;
+        file << FLATDATA(Params().MessageStart());
+        file << hashBlock;
+        WriteCompactSize(file, vHeaders.size());
+        for (const auto& header : vHeaders) {
+            file << header.first << VARINT(header.second);
+        }
+        file << (uint32_t)UTXO_SNAPSHOT_CHUNKS;
+
+        std::vector<std::vector<unsigned char>> vChunks(UTXO_SNAPSHOT_CHUNKS);
+        std::vector<CCoinsRollingStats> vChunkStats(UTXO_SNAPSHOT_CHUNKS);
+        auto map = [&vChunks, &vChunkStats](int n, CCoinsViewCursor& cursor) {
+            CVectorWriter ss(SER_DISK, CLIENT_VERSION, vChunks[n], 0);
+            uint256 txid;
+            std::vector<std::pair<uint32_t, Coin>> outputs;
+            for (; cursor.Valid(); cursor.Next()) {
+                COutPoint key;
+                Coin coin;
+                if (!cursor.GetKey(key) || !cursor.GetValue(coin)) {
+                    return error("%s: unable to read value", __func__);
+                }
+                if (!outputs.empty() && key.hash != txid) {
+                    WriteSnapshotTx(ss, txid, outputs);
+                    outputs.clear();
+                }
+                txid = key.hash;
+                vChunkStats[n].AddCoin(key, coin);
+                outputs.emplace_back(key.n, std::move(coin));
+            }
+            if (!outputs.empty()) {
+                WriteSnapshotTx(ss, txid, outputs);
+            }
+            return true;
+        };
+        stats = CCoinsRollingStats();
+        auto reduce = [&file, &vChunks, &vChunkStats, &stats](int n) {
+            file << vChunks[n];
+            file << Hash(vChunks[n].begin(), vChunks[n].end());
+            stats += vChunkStats[n];
+            std::vector<unsigned char>().swap(vChunks[n]);
+        };
+        if (!CCoinsViewDB::ParallelScan(std::move(cursors), GetNumCores(), map, reduce)) {
+            return false;
+        }
+        file << stats;
+
+        // If the snapshot is of the current tip, compare it against what was
+        // accumulated as blocks were connected.
+        CCoinsRollingStats rolling;
+        uint256 hashRolling;
+        if (GetRollingCoinsStats(rolling, hashRolling) && hashRolling == hashBlock && rolling != stats) {
+            return error("%s: the UTXO set does not match its rolling statistics", __func__);
+        }
+
+        FileCommit(file.Get());
+        file.fclose();
+        RenameOver(pathTmp, path);
+    } catch (const std::exception& e) {
+        return error("%s: %s", __func__, e.what());
+    }
+    LogPrintf("Dumped UTXO set snapshot at %s: %u coins, %dms\n", hashBlock.ToString(), stats.nTransactionOutputs, GetTimeMillis() - nStart);
+    return true;
+}
+
+bool LoadUTXOSnapshot(const CChainParams& chainparams, const fs::path& path, const uint256& hashExpected)
+{
+    int64_t nStart = GetTimeMillis();
+
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        return error("%s: unable to open %s", __func__, path.string());
+    }
+
+    try {
+        uint64_t version;
+        file >> version;
+        if (version != UTXO_SNAPSHOT_VERSION) {
+            return error("%s: unsupported snapshot version %u", __func__, version);
+        }
+        CMessageHeader::MessageStartChars messageStart;
+        file >> FLATDATA(messageStart);
+        if (memcmp(messageStart, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE) != 0) {
+            return error("%s: snapshot is for a different network", __func__);
+        }
+
+        // The headers are validated as if they came from a peer, against an
+        // active chain of just the genesis block.
+        {
+            LOCK(cs_main);
+            chainActive.SetTip(mapBlockIndex.at(chainparams.GetConsensus().hashGenesisBlock));
+        }
+        uint256 hashBlock;
+        file >> hashBlock;
+        uint64_t nHeaders = ReadCompactSize(file);
+        std::vector<unsigned int> vTx;
+        std::vector<CBlockHeader> headers;
+        for (uint64_t i = 0; i < nHeaders; ++i) {
+            CBlockHeader header;
+            unsigned int nTx;
+            file >> header >> VARINT(nTx);
+            if (nTx == 0) {
+                return error("%s: invalid transaction count for block %s", __func__, header.GetHash().ToString());
+            }
+            headers.push_back(header);
+            vTx.push_back(nTx);
+            if (headers.size() == MAX_HEADERS_RESULTS || i + 1 == nHeaders) {
+                CValidationState state;
+                if (!ProcessNewBlockHeaders(headers, state, chainparams)) {
+                    return error("%s: invalid header: %s", __func__, FormatStateMessage(state));
+                }
+                headers.clear();
+                if (ShutdownRequested()) return false;
+            }
+        }
+        CBlockIndex* pindexBase;
+        {
+            LOCK(cs_main);
+            BlockMap::iterator it = mapBlockIndex.find(hashBlock);
+            if (it == mapBlockIndex.end() || it->second->nHeight != (int)nHeaders) {
+                return error("%s: headers do not lead to the snapshot's block %s", __func__, hashBlock.ToString());
+            }
+            pindexBase = it->second;
+        }
+
+        // The coins are only written once the whole snapshot is known to hash
+        // to hashExpected, so that a corrupt or unexpected one leaves the
+        // chainstate empty: the chunks are read twice, first to hash them,
+        // then to write them. The coins are sorted, so each chunk is written
+        // as a sorted batch.
+        long nChunksPos = ftell(file.Get());
+        if (nChunksPos < 0) {
+            return error("%s: unable to read the position in the snapshot", __func__);
+        }
+        CCoinsRollingStats stats;
+        std::vector<unsigned char> chunk;
+        std::vector<std::pair<COutPoint, Coin>> coins;
+        for (int nPass = 0; nPass < 2; ++nPass) {
+            const bool fWrite = nPass == 1;
+            if (fseek(file.Get(), nChunksPos, SEEK_SET) != 0) {
+                return error("%s: unable to seek in the snapshot", __func__);
+            }
+            uint32_t nChunks;
+            file >> nChunks;
+            CCoinsRollingStats statsRead;
+            for (uint32_t i = 0; i < nChunks; ++i) {
+                uint256 hashChunk;
+                file >> chunk >> hashChunk;
+                if (Hash(chunk.begin(), chunk.end()) != hashChunk) {
+                    return error("%s: chunk %u is corrupted", __func__, i);
+                }
+                CDataStream ss(chunk, SER_DISK, CLIENT_VERSION);
+                coins.clear();
+                while (!ss.empty()) {
+                    uint256 txid;
+                    ss >> txid;
+                    uint64_t nOutputs = ReadCompactSize(ss);
+                    for (uint64_t j = 0; j < nOutputs; ++j) {
+                        uint32_t n;
+                        Coin coin;
+                        ss >> VARINT(n) >> coin;
+                        COutPoint outpoint(txid, n);
+                        statsRead.AddCoin(outpoint, coin);
+                        if (fWrite) {
+                            coins.emplace_back(outpoint, std::move(coin));
+                        }
+                    }
+                }
+                if (fWrite) {
+                    if (!pcoinsdbview->WriteSnapshotCoins(coins, hashBlock)) {
+                        return error("%s: failed to write to coin database", __func__);
+                    }
+                } else if (ShutdownRequested()) {
+                    return false;
+                }
+            }
+            if (fWrite) {
+                if (statsRead != stats) {
+                    return error("%s: snapshot changed while it was loaded", __func__);
+                }
+            } else {
+                CCoinsRollingStats statsFile;
+                file >> statsFile;
+                if (statsRead != statsFile) {
+                    return error("%s: snapshot is corrupted", __func__);
+                }
+                if (statsRead.GetHash() != hashExpected) {
+                    return error("%s: hash of the UTXO set %s does not match the expected %s", __func__, statsRead.GetHash().ToString(), hashExpected.ToString());
+                }
+                stats = statsRead;
+            }
+        }
+
+        // The blocks up to the snapshot's are now considered fully validated,
+        // but have no data, like pruned ones.
+        {
+            LOCK2(cs_main, cs_LastBlockFile);
+            std::vector<CBlockIndex*> vIndex(nHeaders);
+            for (CBlockIndex* pindex = pindexBase; pindex->pprev; pindex = pindex->pprev) {
+                vIndex[pindex->nHeight - 1] = pindex;
+            }
+            std::vector<const CBlockIndex*> vBlocks;
+            for (CBlockIndex* pindex : vIndex) {
+                pindex->nTx = vTx[pindex->nHeight - 1];
+                pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
+                pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
+                if (IsWitnessEnabled(pindex->pprev, chainparams.GetConsensus())) {
+                    pindex->nStatus |= BLOCK_OPT_WITNESS;
+                }
+                vBlocks.push_back(pindex);
+            }
+            setBlockIndexCandidates.insert(pindexBase);
+            if (!pblocktree->WriteBatchSync(std::vector<std::pair<int, const CBlockFileInfo*>>(), nLastBlockFile, vBlocks) ||
+                !pblocktree->WriteFlag("prunedblockfiles", true)) {
+                return error("%s: failed to write to block index database", __func__);
+            }
+            fHavePruned = true;
+        }
+
+        // Mark the chainstate as consistent with the snapshot's block.
+        CCoinsMap mapEmpty;
+        if ((fRollingUTXOStats && !pcoinsdbview->WriteRollingStats(hashBlock, stats)) ||
+            !pcoinsdbview->BatchWrite(mapEmpty, hashBlock)) {
+            return error("%s: failed to write to coin database", __func__);
+        }
+        LogPrintf("Loaded UTXO set snapshot at %s (height %d): %u coins, %dms\n", hashBlock.ToString(), pindexBase->nHeight, stats.nTransactionOutputs, GetTimeMillis() - nStart);
+    } catch (const std::exception& e) {
+        return error("%s: failed to read snapshot: %s", __func__, e.what());
+    }
+    return true;
+}
+
 //! Guess how far we are in the verification process at the given block index
 double GuessVerificationProgress(const ChainTxData& data, CBlockIndex *pindex) {
     if (pindex == nullptr)
@@ -4415,9 +5697,7 @@ public:
     CMainCleanup() {}
     ~CMainCleanup() {
         // block headers
-        BlockMap::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
         mapBlockIndex.clear();
+        blockIndexArena.Clear();
     }
 } instance_of_cmaincleanup;
@@ -12,6 +12,7 @@
 
 #include "amount.h"
 #include "coins.h"
+#include "consensus/validation.h"
 #include "fs.h"
 #include "protocol.h" // For CMessageHeader::MessageStartChars
 #include "policy/feerate.h"
@@ -33,13 +34,18 @@
 class CBlockIndex;
 class CBlockTreeDB;
 class CChainParams;
+class CCoinsRollingStats;
+class CCoinsViewAsyncWriter;
 class CCoinsViewDB;
 class CInv;
 class CConnman;
+class CRawBlock;
 class CScriptCheck;
+class CBlockCache;
+class CValidationStats;
 class CBlockPolicyEstimator;
 class CTxMemPool;
-class CValidationState;
+struct CCoinsPrefetchStats;
 struct ChainTxData;
 
 struct PrecomputedTransactionData;
@@ -73,13 +79,27 @@ static const unsigned int MAX_DISCONNECTED_TX_POOL_SIZE = 20000;
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 /** The pre-allocation chunk size for blk?????.dat files (since 0.8) */
 static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
+/** The maximum number of block files kept mapped in memory for reading blocks */
+static const size_t MAX_MAPPED_BLOCK_FILES = sizeof(void*) >= 8 ? 64 : 4;
+/** -blockcachesize default (MiB of recently served blocks kept in memory) */
+static const int64_t DEFAULT_BLOCK_CACHE_SIZE = 64;
+/** Maximum number of blocks connected together, overlapping their validation, during initial block download */
+static const unsigned int MAX_PIPELINED_BLOCKS = 8;
+/** Number of most recently connected blocks whose validation statistics are kept */
+static const size_t VALIDATION_STATS_BLOCKS = 1000;
 /** The pre-allocation chunk size for rev?????.dat files (since 0.8) */
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 
 /** Maximum number of script-checking threads allowed */
-static const int MAX_SCRIPTCHECK_THREADS = 16;
+static const int MAX_SCRIPTCHECK_THREADS = 64;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Maximum number of coins prefetch threads allowed */
+static const int MAX_PREFETCH_THREADS = 16;
+/** -prefetchthreads default (number of threads reading block inputs ahead of validation, 0 = disabled) */
+static const int DEFAULT_PREFETCH_THREADS = 4;
+/** Only prefetch the inputs of blocks at most this far ahead of the tip. */
+static const int PREFETCH_BLOCKS_AHEAD = 32;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -130,9 +150,21 @@ static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;
+/** Default for -rollingutxostats */
+static const bool DEFAULT_ROLLING_UTXO_STATS = true;
+/** Default for -pipelineblocks */
+static const bool DEFAULT_PIPELINE_BLOCKS = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Default for -mempooljournal */
+static const bool DEFAULT_MEMPOOL_JOURNAL = true;
+/** How often to write out the buffered mempool journal records and check whether the journal should be compacted, in seconds */
+static const int64_t MEMPOOL_JOURNAL_COMPACT_INTERVAL = 60;
+/** Journals smaller than this, or than the last mempool dump, are not compacted, in bytes */
+static const uint64_t MEMPOOL_JOURNAL_MIN_COMPACT_SIZE = 1 << 20;
+/** Default for -persistsigcache */
+static const bool DEFAULT_PERSIST_SIGCACHE = true;
 /** Default for -mempoolreplacement */
 static const bool DEFAULT_ENABLE_REPLACEMENT = true;
 /** Default for using fee filter */
@@ -158,6 +190,8 @@ extern CScript COINBASE_FLAGS;
 extern CCriticalSection cs_main;
 extern CBlockPolicyEstimator feeEstimator;
 extern CTxMemPool mempool;
+extern CBlockCache blockCache;
+extern CValidationStats validationStats;
 typedef std::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
 extern BlockMap mapBlockIndex;
 extern uint64_t nLastBlockTx;
@@ -168,10 +202,14 @@ extern CConditionVariable cvBlockChange;
 extern std::atomic_bool fImporting;
 extern std::atomic_bool fReindex;
 extern int nScriptCheckThreads;
+extern int nPrefetchThreads;
 extern bool fTxIndex;
+extern bool fRollingUTXOStats;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
+/** Whether runs of blocks are connected together after initial block download too, for testing */
+extern bool fPipelineBlocks;
 extern bool fCheckpointsEnabled;
 extern size_t nCoinCacheUsage;
 /** A fee rate smaller than this is considered zero fee (for relaying, mining and transaction creation) */
@@ -265,10 +303,28 @@ bool LoadGenesisBlock(const CChainParams& chainparams);
 bool LoadBlockIndex(const CChainParams& chainparams);
 /** Update the chain tip based on database information. */
 bool LoadChainTip(const CChainParams& chainparams);
+
+/** Load the rolling UTXO set statistics for pcoinsTip's best block. */
+void LoadRollingCoinsStats();
+
+/** Get the rolling UTXO set statistics and the block they are for. Returns false if they are not known. */
+bool GetRollingCoinsStats(CCoinsRollingStats& stats, uint256& hashBlock);
+
+/**
+ * Set the rolling UTXO set statistics from a full scan of the UTXO set as of
+ * hashBlock, if they are not known yet and hashBlock is still the best block.
+ */
+bool SetRollingCoinsStats(const CCoinsRollingStats& stats, const uint256& hashBlock);
 /** Unload database information */
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the thread checking the transactions of new blocks */
+void ThreadBlockCheck();
+/** Run an instance of the coins prefetch thread */
+void ThreadCoinsPrefetch();
+/** Statistics of the coins prefetch threads */
+CCoinsPrefetchStats GetCoinsPrefetchStats();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
@@ -308,6 +364,37 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
                         bool* pfMissingInputs, std::list<CTransactionRef>* plTxnReplaced,
                         bool bypass_limits, const CAmount nAbsurdFee);
 
+/** The outcome of AcceptPackageToMemoryPool for one transaction of the package */
+struct PackageTxResult
+{
+    bool fAccepted = false;
+    bool fMissingInputs = false;
+    CValidationState state;
+};
+
+/**
+ * (try to) add the transactions of package to memory pool, in order, so that
+ * each can spend the outputs of those before it. This takes cs_main once for
+ * the whole package, and shares the mempool view and the coins cache upkeep
+ * between its transactions. A transaction that isn't accepted doesn't stop
+ * the ones after it, though those that spend its outputs are missing inputs.
+ * Fills results with the outcome for each transaction, and returns whether
+ * all were accepted.
+ */
+bool AcceptPackageToMemoryPool(CTxMemPool& pool, const std::vector<CTransactionRef>& package, std::vector<PackageTxResult>& results,
+                               std::list<CTransactionRef>* plTxnReplaced, bool bypass_limits, const CAmount nAbsurdFee);
+
+/**
+ * Run the context-free and script checks of AcceptToMemoryPool on tx without
+ * holding cs_main, so that when tx is then passed to AcceptToMemoryPool its
+ * signatures and scripts are found in the caches. Holds cs_main only to copy
+ * the coins tx spends. Transactions that AcceptToMemoryPool would reject on
+ * their inputs, standardness or fee are refused before their scripts are run.
+ * Returns whether the checks passed; either way it is still
+ * AcceptToMemoryPool that decides whether tx is accepted.
+ */
+bool PrevalidateTransaction(const CTransaction& tx, const CChainParams& chainparams);
+
 /** Convert CValidationState to a human-readable message for logging */
 std::string FormatStateMessage(const CValidationState &state);
 
@@ -395,6 +482,13 @@ void InitScriptExecutionCache();
 /** Functions for disk access for blocks */
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/** Read the serialized form of a block, without copying or deserializing it. Only the header is checked. */
+bool ReadRawBlockFromDisk(CRawBlock& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
+bool ReadRawBlockFromDisk(CRawBlock& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart);
+/** Read a block through blockCache, adding it to the cache if it was not there yet. */
+bool ReadBlockCached(std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex, const CChainParams& chainparams);
+/** Read the serialization of a block, with or without witness data, through blockCache. */
+bool ReadRawBlockCached(CRawBlock& block, const CBlockIndex* pindex, bool fWitness, const CChainParams& chainparams);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -445,6 +539,9 @@ extern CChain chainActive;
 /** Global variable that points to the coins database (protected by cs_main) */
 extern CCoinsViewDB *pcoinsdbview;
 
+/** Global variable that points to the view writing to pcoinsdbview in the background (protected by cs_main) */
+extern CCoinsViewAsyncWriter *pcoinswriter;
+
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache *pcoinsTip;
 
@@ -479,7 +576,36 @@ CBlockFileInfo* GetBlockFileInfo(size_t n);
 /** Dump the mempool to disk. */
 bool DumpMempool();
 
-/** Load the mempool from disk. */
+/** Load the mempool from disk, replaying the journal of changes since it was dumped. */
 bool LoadMempool();
 
+/** Start journaling mempool changes, after the mempool was loaded. Dumps the mempool. */
+bool StartMempoolJournal();
+
+/** Stop journaling mempool changes. */
+void StopMempoolJournal();
+
+/** Write out the buffered journal records, and dump the mempool, which rewrites the journal, if the journal grew larger than the last dump. */
+void CompactMempoolJournal();
+
+/** Dump the signature and script execution caches to disk. */
+bool DumpScriptCaches();
+
+/** Load the signature and script execution caches from disk. To be called before they are used. */
+bool LoadScriptCaches();
+
+/**
+ * Write a snapshot of the UTXO set at the best block of the chainstate to path.
+ * Sets hashBlock to that block and stats to the statistics of the coins written.
+ */
+bool DumpUTXOSnapshot(const fs::path& path, uint256& hashBlock, CCoinsRollingStats& stats);
+
+/**
+ * Load a snapshot written by DumpUTXOSnapshot into the empty chainstate, and
+ * the headers it contains into the block index. The coins are only accepted if
+ * their rolling hash (as reported by gettxoutsetinfo) is hashExpected. Blocks
+ * up to the snapshot's have no data afterwards, as if they had been pruned.
+ */
+bool LoadUTXOSnapshot(const CChainParams& chainparams, const fs::path& path, const uint256& hashExpected);
+
 #endif // BITCOIN_VALIDATION_H
@@ -0,0 +1,59 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "validationstats.h"
+
+#include <algorithm>
+
+const char* const CValidationStats::PHASE_NAMES[CValidationStats::PHASE_COUNT] = {
+    "read", "check", "forks", "connect", "verify", "index", "flush", "chainstate", "postconnect", "total"
+};
+
+void CValidationStats::Histogram::Add(int64_t nMicros)
+{
+    nMicros = std::max<int64_t>(nMicros, 0);
+    nTotal += nMicros;
+    nMax = std::max(nMax, nMicros);
+    int nBucket = 0;
+    while (nMicros > 0 && nBucket < BUCKETS - 1) {
+        nMicros >>= 1;
+        nBucket++;
+    }
+    vBuckets[nBucket]++;
+}
+
+CValidationStats::CValidationStats(size_t nMaxRecentIn) : nMaxRecent(nMaxRecentIn), nBlocks(0)
+{
+}
+
+void CValidationStats::AddBlock(const BlockRecord& record)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    nBlocks++;
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        phases[i].Add(record.nMicros[i]);
+    }
+    recent.push_back(record);
+    while (recent.size() > nMaxRecent) {
+        recent.pop_front();
+    }
+}
+
+CValidationStats::Stats CValidationStats::GetStats(size_t nRecent)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    Stats stats;
+    stats.nBlocks = nBlocks;
+    std::copy(phases, phases + PHASE_COUNT, stats.phases);
+    stats.vRecent.assign(recent.end() - std::min(nRecent, recent.size()), recent.end());
+    return stats;
+}
+
+void CValidationStats::Clear()
+{
+    std::lock_guard<std::mutex> lock(cs);
+    nBlocks = 0;
+    std::fill(phases, phases + PHASE_COUNT, Histogram());
+    recent.clear();
+}
@@ -0,0 +1,97 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_VALIDATIONSTATS_H
+#define BITCOIN_VALIDATIONSTATS_H
+
+#include "uint256.h"
+
+#include <deque>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Statistics of the time spent connecting blocks to the active chain, per
+ * phase: a histogram of each phase over all blocks connected since startup,
+ * and a record of the phases of each of the most recently connected blocks.
+ *
+ * When blocks are connected together during initial block download, the
+ * phases they share (waiting for the script checks, flushing and writing
+ * the chainstate) are split evenly between them.
+ */
+class CValidationStats
+{
+public:
+    enum Phase {
+        READ,        //!< Reading the block from disk
+        CHECK,       //!< Context-free checks of the block
+        FORKS,       //!< Checks of soft fork rules
+        CONNECT,     //!< Applying the transactions to the UTXO set
+        VERIFY,      //!< Waiting for the script check threads
+        INDEX,       //!< Writing undo data and the transaction index
+        FLUSH,       //!< Flushing the block's changes into the coins cache
+        CHAINSTATE,  //!< Writing the chainstate to disk, if needed
+        POSTCONNECT, //!< Updating the mempool and the tip
+        TOTAL,       //!< All of the above
+        PHASE_COUNT
+    };
+
+    static const char* const PHASE_NAMES[PHASE_COUNT];
+
+    /**
+     * Histogram of durations in microseconds. Bucket 0 counts durations of
+     * 0, and bucket i > 0 those from 2^(i-1) up to 2^i, where the last
+     * bucket also counts everything longer.
+     */
+    struct Histogram
+    {
+        static const int BUCKETS = 32;
+
+        int64_t nTotal = 0;
+        int64_t nMax = 0;
+        uint64_t vBuckets[BUCKETS] = {};
+
+        void Add(int64_t nMicros);
+    };
+
+    /** The time spent in each phase connecting one block, in microseconds */
+    struct BlockRecord
+    {
+        uint256 hash;
+        int nHeight = 0;
+        unsigned int nTx = 0;
+        unsigned int nInputs = 0;
+        //! When the block was connected
+        int64_t nTime = 0;
+        //! Whether it was connected together with other blocks
+        bool fPipelined = false;
+        int64_t nMicros[PHASE_COUNT] = {};
+    };
+
+    struct Stats
+    {
+        uint64_t nBlocks;
+        Histogram phases[PHASE_COUNT];
+        //! Oldest first
+        std::vector<BlockRecord> vRecent;
+    };
+
+private:
+    std::mutex cs;
+    const size_t nMaxRecent;
+    uint64_t nBlocks;
+    Histogram phases[PHASE_COUNT];
+    std::deque<BlockRecord> recent;
+
+public:
+    explicit CValidationStats(size_t nMaxRecentIn);
+
+    void AddBlock(const BlockRecord& record);
+    /** Get the statistics, with at most nRecent of the most recent blocks. */
+    Stats GetStats(size_t nRecent);
+    void Clear();
+};
+
+#endif // BITCOIN_VALIDATIONSTATS_H
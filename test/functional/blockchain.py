@@ -55,6 +55,7 @@ class BlockchainTest(BitcoinTestFramework):
             'bip9_softforks',
             'blocks',
             'chain',
+            'chainstate_writes',
             'chainwork',
             'difficulty',
             'headers',
@@ -142,6 +143,16 @@ class BlockchainTest(BitcoinTestFramework):
         assert size < 64000
         assert_equal(len(res['bestblock']), 64)
         assert_equal(len(res['hash_serialized_2']), 64)
+        assert_equal(len(res['hash_rolling']), 64)
+        assert_equal(res['verified'], True)
+
+        self.log.info("Test that gettxoutsetinfo(rolling=True) returns the same statistics without a scan")
+        res_rolling = node.gettxoutsetinfo(True)
+        assert 'transactions' not in res_rolling
+        assert 'hash_serialized_2' not in res_rolling
+        assert 'verified' not in res_rolling
+        for key in ['total_amount', 'height', 'txouts', 'bogosize', 'bestblock', 'hash_rolling']:
+            assert_equal(res_rolling[key], res[key])
 
         self.log.info("Test that gettxoutsetinfo() works for blockchain with just the genesis block")
         b1hash = node.getblockhash(1)
@@ -155,6 +166,8 @@ class BlockchainTest(BitcoinTestFramework):
         assert_equal(res2['bogosize'], 0),
         assert_equal(res2['bestblock'], node.getblockhash(0))
         assert_equal(len(res2['hash_serialized_2']), 64)
+        assert_equal(res2['verified'], True)
+        assert_equal(node.gettxoutsetinfo(True)['hash_rolling'], res2['hash_rolling'])
 
         self.log.info("Test that gettxoutsetinfo() returns the same result after invalidate/reconsider block")
         node.reconsiderblock(b1hash)
@@ -167,6 +180,8 @@ class BlockchainTest(BitcoinTestFramework):
         assert_equal(res['bogosize'], res3['bogosize'])
         assert_equal(res['bestblock'], res3['bestblock'])
         assert_equal(res['hash_serialized_2'], res3['hash_serialized_2'])
+        assert_equal(res['hash_rolling'], res3['hash_rolling'])
+        assert_equal(res3['verified'], True)
 
     def _test_getblockheader(self):
         node = self.nodes[0]
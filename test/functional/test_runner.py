@@ -123,6 +123,7 @@ BASE_SCRIPTS= [
     'uptime.py',
     'resendwallettransactions.py',
     'getblockstats.py',
+    'utxo_snapshot.py',
     'minchainwork.py',
     'p2p-fingerprint.py',
 ]
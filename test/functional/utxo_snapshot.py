@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+# Copyright (c) 2017 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test dumptxoutset and -loadtxoutset.
+
+- Node 0 mines a chain and writes a snapshot of its UTXO set.
+- Node 1 fails to start with a snapshot without -prune, or with the wrong hash.
+- Node 2 starts from the snapshot, and syncs the blocks after it from node 0.
+"""
+import os
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+    connect_nodes,
+    sync_blocks,
+)
+
+ADDRESS = "mjTkW3DjgyZck4KbiRusZsqTgaYTxdSz6z"
+
+class UTXOSnapshotTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 3
+
+    def setup_network(self):
+        self.setup_nodes()
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.generatetoaddress(200, ADDRESS)
+
+        self.log.info("Write a snapshot")
+        path = os.path.join(node.datadir, "regtest", "utxo.dat")
+        dump = node.dumptxoutset("utxo.dat")
+        assert_equal(dump['path'], path)
+        assert_equal(dump['base_hash'], node.getbestblockhash())
+        assert_equal(dump['base_height'], 200)
+        info = node.gettxoutsetinfo()
+        assert_equal(dump['txouts'], info['txouts'])
+        assert_equal(dump['hash_rolling'], info['hash_rolling'])
+        assert_raises_rpc_error(-8, "already exists", node.dumptxoutset, "utxo.dat")
+
+        self.log.info("Refuse to load a snapshot without pruning, or with the wrong hash")
+        self.stop_node(1)
+        self.assert_start_raises_init_error(1, ["-loadtxoutset=" + path, "-loadtxoutsethash=" + dump['hash_rolling']],
+                                            "-loadtxoutset requires -prune")
+        self.assert_start_raises_init_error(1, ["-prune=1", "-loadtxoutset=" + path, "-loadtxoutsethash=" + "00" * 32],
+                                            "Unable to load the UTXO set snapshot")
+
+        self.log.info("Load the snapshot")
+        args = ["-prune=1", "-loadtxoutset=" + path, "-loadtxoutsethash=" + dump['hash_rolling']]
+        self.restart_node(2, args)
+        snapshot_node = self.nodes[2]
+        assert_equal(snapshot_node.getbestblockhash(), dump['base_hash'])
+        assert_equal(snapshot_node.getblockchaininfo()['pruned'], True)
+        assert_raises_rpc_error(-1, "Block not available", snapshot_node.getblock, snapshot_node.getblockhash(100))
+        info = snapshot_node.gettxoutsetinfo()
+        assert_equal(info['verified'], True)
+        assert_equal(info['hash_rolling'], dump['hash_rolling'])
+        assert_equal(info['hash_serialized_2'], node.gettxoutsetinfo()['hash_serialized_2'])
+
+        self.log.info("Sync the blocks after the snapshot")
+        connect_nodes(snapshot_node, 0)
+        node.generatetoaddress(10, ADDRESS)
+        sync_blocks([node, snapshot_node])
+        assert_equal(snapshot_node.gettxoutsetinfo(True)['hash_rolling'], node.gettxoutsetinfo(True)['hash_rolling'])
+
+        self.log.info("Restart from the loaded chainstate, with the snapshot ignored")
+        self.restart_node(2, args)
+        assert_equal(snapshot_node.getblockcount(), 210)
+        assert_equal(snapshot_node.gettxoutsetinfo()['verified'], True)
+
+if __name__ == '__main__':
+    UTXOSnapshotTest().main()